@@ -2,8 +2,8 @@
 """
 analyze_entropy.py — Coherence analysis of multi-device MED RNG entropy data.
 
-Reads timestamped hex entropy files produced by record_entropy.py and generates
-a 4-panel figure:
+Reads the per-second summaries (.epochs) record_entropy.py's bin format writes,
+or else its timestamped hex entropy files, and generates a 4-panel figure:
   1. Random walks (overlay, all devices)
   2. Cross-correlation matrix (heatmap)
   3. GCP1 Network Variance cumulative deviation
@@ -75,6 +75,36 @@ def load_all_devices(data_dir):
     return devices
 
 
+# Row of a .epochs file, after its 16-byte header ("MFEPOCH\0", epoch length
+# in ms, reserved). Times are UTC nanoseconds; epoch is the start time divided
+# by the epoch length. Epochs without bits have no row.
+EPOCH_HEADER_BYTES = 16
+EPOCH_DTYPE = np.dtype([("epoch", "<i8"), ("bit_count", "<u8"), ("bit_sum", "<u8"),
+                        ("first_utc_ns", "<i8"), ("last_utc_ns", "<i8")])
+
+
+def load_epoch_summaries(data_dir):
+    """Load all 1-second .epochs files. Returns dict: serial -> row array."""
+    summaries = {}
+    for fpath in sorted(glob.glob(os.path.join(data_dir, "*.epochs"))):
+        serial = os.path.splitext(os.path.basename(fpath))[0]
+        with open(fpath, "rb") as f:
+            header = f.read(EPOCH_HEADER_BYTES)
+        if len(header) < EPOCH_HEADER_BYTES or header[:8] != b"MFEPOCH\0":
+            continue
+        epoch_ms = int.from_bytes(header[8:12], "little")
+        if epoch_ms != 1000:
+            print(f"  {serial}: skipped, {epoch_ms} ms epochs")
+            continue
+        rows = np.fromfile(fpath, dtype=EPOCH_DTYPE, offset=EPOCH_HEADER_BYTES)
+        if len(rows):
+            summaries[serial] = rows
+            first, last = (datetime.fromtimestamp(int(e), timezone.utc) for e in rows["epoch"][[0, -1]])
+            print(f"  {serial}: {len(rows)} epochs, "
+                  f"{first.strftime('%H:%M:%S')} - {last.strftime('%H:%M:%S')}")
+    return summaries
+
+
 # ──────────────────────────────────────────────────────────────────────────────
 # Time-aligned epoch matrix
 # ──────────────────────────────────────────────────────────────────────────────
@@ -125,6 +155,30 @@ def build_epoch_matrix(devices):
     return np.array(epoch_times), z_matrix, serials
 
 
+def build_epoch_matrix_from_summaries(summaries):
+    """
+    Same as build_epoch_matrix, from per-second summaries instead of the bits.
+    """
+    serials = sorted(summaries.keys())
+    N = len(serials)
+
+    first_epoch = min(int(summaries[s]["epoch"][0]) for s in serials)
+    last_epoch = max(int(summaries[s]["epoch"][-1]) for s in serials)
+    total_seconds = last_epoch - first_epoch + 1
+    t_start = datetime.fromtimestamp(first_epoch, timezone.utc)
+    epoch_times = [t_start + timedelta(seconds=s) for s in range(total_seconds)]
+
+    z_matrix = np.full((total_seconds, N), np.nan)
+    for col, serial in enumerate(serials):
+        rows = summaries[serial]
+        rows = rows[rows["bit_count"] > 0]
+        n = rows["bit_count"].astype(np.float64)
+        s = rows["bit_sum"].astype(np.float64)
+        z_matrix[rows["epoch"] - first_epoch, col] = (s - n / 2) / np.sqrt(n / 4)
+
+    return np.array(epoch_times), z_matrix, serials
+
+
 # ──────────────────────────────────────────────────────────────────────────────
 # Panel 1: Random walks
 # ──────────────────────────────────────────────────────────────────────────────
@@ -135,10 +189,10 @@ COLORS = ["#1f77b4", "#ff7f0e", "#2ca02c", "#d62728", "#9467bd",
 NZDT = timezone(timedelta(hours=13))
 
 
-def plot_random_walks(ax, devices, serials):
-    """Overlay random walk for each device, x-axis = real timestamps."""
-    for i, serial in enumerate(serials):
-        timestamps, byte_chunks = devices[serial]
+def device_walks(devices):
+    """Walk of each device from its bits. Returns dict: serial -> (times, positions)."""
+    walks = {}
+    for serial, (timestamps, byte_chunks) in devices.items():
         # Build walk: accumulate bits as +1/-1
         walk_segments_x = []
         walk_segments_y = []
@@ -151,7 +205,24 @@ def plot_random_walks(ax, devices, serials):
             # Use the timestamp for the whole chunk (sub-second resolution not needed)
             walk_segments_x.append(ts)
             walk_segments_y.append(pos)
+        walks[serial] = (walk_segments_x, walk_segments_y)
+    return walks
+
 
+def summary_walks(summaries):
+    """Walk of each device from its per-second summaries, a point per second."""
+    walks = {}
+    for serial, rows in summaries.items():
+        steps = 2 * rows["bit_sum"].astype(np.int64) - rows["bit_count"].astype(np.int64)
+        times = [datetime.fromtimestamp(ns / 1e9, timezone.utc) for ns in rows["last_utc_ns"]]
+        walks[serial] = (times, np.cumsum(steps))
+    return walks
+
+
+def plot_random_walks(ax, walks, serials):
+    """Overlay random walk for each device, x-axis = real timestamps."""
+    for i, serial in enumerate(serials):
+        walk_segments_x, walk_segments_y = walks[serial]
         ax.plot(walk_segments_x, walk_segments_y,
                 color=COLORS[i % len(COLORS)], linewidth=0.6,
                 label=serial, alpha=0.85)
@@ -374,14 +445,20 @@ def main():
     data_dir = sys.argv[1] if len(sys.argv) >= 2 else "./entropy_data"
 
     print("Loading data...")
-    devices = load_all_devices(data_dir)
-    if not devices:
-        print("No .hex files found in", data_dir)
-        sys.exit(1)
-
-    serials = sorted(devices.keys())
-    print(f"\n{len(serials)} devices loaded. Building epoch matrix...")
-    epoch_times, z_matrix, serials = build_epoch_matrix(devices)
+    summaries = load_epoch_summaries(data_dir)
+    if summaries:
+        print(f"\n{len(summaries)} devices' summaries loaded. Building epoch matrix...")
+        epoch_times, z_matrix, serials = build_epoch_matrix_from_summaries(summaries)
+        walks = summary_walks(summaries)
+    else:
+        devices = load_all_devices(data_dir)
+        if not devices:
+            print("No .epochs or .hex files found in", data_dir)
+            sys.exit(1)
+
+        print(f"\n{len(devices)} devices loaded. Building epoch matrix...")
+        epoch_times, z_matrix, serials = build_epoch_matrix(devices)
+        walks = device_walks(devices)
     T, N = z_matrix.shape
     print(f"Epoch matrix: {T} seconds x {N} devices\n")
 
@@ -405,7 +482,7 @@ def main():
 
     # Panel 1: Random walks (top, full width)
     ax1 = fig.add_subplot(gs[0, :])
-    plot_random_walks(ax1, devices, serials)
+    plot_random_walks(ax1, walks, serials)
 
     # Panel 2: Correlation matrix (middle left)
     ax2 = fig.add_subplot(gs[1, 0])
@@ -24,6 +24,9 @@ ENTROPY_BUFFER_LEN_USER_INIT_MODE = 2048
 
 MAX_X_AXIS = 300000
 
+# Points each device's walk is decimated to by the library (when it can), whatever the device's bit rate
+WALK_VIEW_POINTS = 2000
+
 GRAPH_LINE_COLORS = ('b-','g-','r-','c-','m-','y-','k-','w-') # implicit max of 8 devices max TODO: need support for more??
 
 # FIFO queue for random bits read in from devices
@@ -46,6 +49,16 @@ thread_messages = {}
 maxs = {}
 mins = {}
 
+# When each device's last grab/reset was requested (UTC nanoseconds), for capturing from the moment of the key press
+grab_times = {}
+
+# Milliseconds of history the library keeps while capturing in user-initiated mode
+CAPTURE_HISTORY_MS = 5000
+
+# Buffers for each device's decimated walk (lowest and highest position of each point)
+walk_mins = {}
+walk_maxs = {}
+
 def load_library():
     # Load the MeterFeeter library
     global METER_FEEDER_LIB
@@ -64,6 +77,26 @@ def load_library():
     # METER_FEEDER_LIB.MF_GetListGenerators.argtypes = [POINTER(c_char_p)]
     METER_FEEDER_LIB.MF_GetBytes.argtypes = c_int, POINTER(c_ubyte), c_char_p, c_char_p,
 
+    # With trial capture the device streams continuously in user-initiated mode and grabs start at the key press
+    global USE_CAPTURE
+    USE_CAPTURE = hasattr(METER_FEEDER_LIB, 'MF_CaptureTrial')
+    if USE_CAPTURE:
+        METER_FEEDER_LIB.MF_StartCapture.argtypes = c_char_p, c_int, c_char_p,
+        METER_FEEDER_LIB.MF_StartCapture.restype = c_bool
+        METER_FEEDER_LIB.MF_StopCapture.argtypes = c_char_p,
+        METER_FEEDER_LIB.MF_CaptureTrial.argtypes = c_char_p, c_int64, c_int, c_int, POINTER(c_ubyte), POINTER(c_int64), POINTER(c_int), c_char_p,
+        METER_FEEDER_LIB.MF_CaptureTrial.restype = c_int
+
+    # With the walk view the library keeps each device's walk and hands over a fixed number of points to draw
+    global USE_WALK_VIEW
+    USE_WALK_VIEW = hasattr(METER_FEEDER_LIB, 'MF_GetWalkView')
+    if USE_WALK_VIEW:
+        METER_FEEDER_LIB.MF_SetWalkView.argtypes = c_char_p, c_int, c_int64, c_char_p,
+        METER_FEEDER_LIB.MF_SetWalkView.restype = c_bool
+        METER_FEEDER_LIB.MF_GetWalkView.argtypes = c_char_p, c_int, POINTER(c_int64), POINTER(c_int64), POINTER(c_int64), POINTER(c_int64), POINTER(c_int64), POINTER(c_int64), c_char_p,
+        METER_FEEDER_LIB.MF_GetWalkView.restype = c_int
+        METER_FEEDER_LIB.MF_ResetWalkView.argtypes = c_char_p,
+
     # Make driver initialize all the connected devices
     global med_error_reason
     med_error_reason = create_string_buffer(256)
@@ -89,6 +122,10 @@ def get_devices():
         thread_messages[kvs[0]] = 1 # continuous mode
         mins[kvs[0]] = 0
         maxs[kvs[0]] = 0
+        if USE_WALK_VIEW:
+            walk_mins[kvs[0]] = (c_int64 * WALK_VIEW_POINTS)()
+            walk_maxs[kvs[0]] = (c_int64 * WALK_VIEW_POINTS)()
+            METER_FEEDER_LIB.MF_SetWalkView(kvs[0].encode("utf-8"), WALK_VIEW_POINTS, MAX_X_AXIS, med_error_reason)
         print("\t" + str(kvs[0]) + "->" + kvs[1])
 
 def clear_stuff(serialNumber, walker):
@@ -97,6 +134,8 @@ def clear_stuff(serialNumber, walker):
     walker.clear()
     mins[serialNumber] = 0
     maxs[serialNumber] = 0
+    if USE_WALK_VIEW:
+        METER_FEEDER_LIB.MF_ResetWalkView(serialNumber.encode("utf-8"))
 
 def bin_array(num): # source: https://stackoverflow.com/a/47521145/1103264
     """Convert a positive integer num into an 8-bit bit vector"""
@@ -124,7 +163,8 @@ def run_trials(serialNumber):
         control_message = thread_messages[serialNumber]
         if (mode == 3 and control_message == 3): # in user-initiated mode but no grab command so don't do any entropy reading/processing
             time.sleep(.001)
-            fq[serialNumber].put_nowait(walker) # so graph frame updater doesn't get it's IO blocked waiting for something to go into the queue, even if it's nothing
+            if not USE_WALK_VIEW: # the graph frame updater doesn't read the queue when drawing the walk view, so don't grow it
+                fq[serialNumber].put_nowait(walker) # so graph frame updater doesn't get it's IO blocked waiting for something to go into the queue, even if it's nothing
             continue
             # continue # loop again
         elif (mode == 3 and control_message == 4): # in user-initiated mode with grab command
@@ -135,7 +175,10 @@ def run_trials(serialNumber):
             thread_messages[serialNumber] = 3
             walker.clear()
             counter = 0
-            fq[serialNumber].put_nowait(walker)
+            if USE_WALK_VIEW:
+                METER_FEEDER_LIB.MF_ResetWalkView(serialNumber.encode("utf-8"))
+            else:
+                fq[serialNumber].put_nowait(walker)
             print(serialNumber + " doing user-initiated mode reset")
             # ... continue below and do 1 grab (entropy reading/processing)
         elif (mode != 3 and control_message == 4): # toggle into user-initiated mode
@@ -144,8 +187,12 @@ def run_trials(serialNumber):
             buffer_length = ENTROPY_BUFFER_LEN_USER_INIT_MODE
             clear_stuff(serialNumber, walker)
             counter = 0
+            if USE_CAPTURE:
+                METER_FEEDER_LIB.MF_StartCapture(serialNumber.encode("utf-8"), CAPTURE_HISTORY_MS, med_error_reason)
             print(serialNumber + " toggled to user-initiated mode")
         elif (control_message == 2): # continuous mode reset
+            if mode == 3 and USE_CAPTURE:
+                METER_FEEDER_LIB.MF_StopCapture(serialNumber.encode("utf-8"))
             mode = thread_messages[serialNumber] = 1 # continuous mode toggle
             ubuffer = ubuffer_cont_mode
             buffer_length = ENTROPY_BUFFER_LEN_CONT_MODE
@@ -158,7 +205,17 @@ def run_trials(serialNumber):
             walker.clear()
 
         tic = time.perf_counter()
-        METER_FEEDER_LIB.MF_GetBytes(buffer_length, ubuffer, serialNumber.encode("utf-8"), med_error_reason)
+        if mode == 3 and USE_CAPTURE:
+            # Bits from the moment the grab was requested, already streaming so no start-up delay
+            first_bit_ns, trigger_offset = c_int64(), c_int()
+            METER_FEEDER_LIB.MF_CaptureTrial(serialNumber.encode("utf-8"), grab_times.get(serialNumber, 0), 0, buffer_length * 8,
+                                             ubuffer, byref(first_bit_ns), byref(trigger_offset), med_error_reason)
+        else:
+            METER_FEEDER_LIB.MF_GetBytes(buffer_length, ubuffer, serialNumber.encode("utf-8"), med_error_reason)
+        if USE_WALK_VIEW:
+            # The library has already walked the bits
+            print(f"{(time.perf_counter() - tic)*1000:0.0f}ms")
+            continue
         for i in range(buffer_length):
             # print(ubuffer[i])
             bits = bin_array(ubuffer[i])
@@ -199,12 +256,16 @@ def cont_mode_reset_callback(event):
 
 def user_init_mode_grab_callback(event):
     # Message each device's message thread to grab/toggle its user-initiated mode
+    now = time.time_ns()
     for key in devices.keys():
+        grab_times[key] = now
         thread_messages[key] = 4
 
 def user_init_mode_resset_callback(event):
     # Message each device's message thread to reset its user-initiated mode
+    now = time.time_ns()
     for key in devices.keys():
+        grab_times[key] = now
         thread_messages[key] = 5
 
 def update(frame):
@@ -224,6 +285,22 @@ def update(frame):
     # Graph entropy in the FIFO queue(s)
     ci = 0 # color index
     for key, value in devices.items():
+        if USE_WALK_VIEW:
+            position, low, high, steps_per_point = c_int64(), c_int64(), c_int64(), c_int64()
+            n = METER_FEEDER_LIB.MF_GetWalkView(key.encode("utf-8"), WALK_VIEW_POINTS, walk_mins[key], walk_maxs[key], byref(position),
+                                                byref(low), byref(high), byref(steps_per_point), med_error_reason)
+            if n <= 0:
+                continue
+            # Each point's lowest then highest position, drawn as one line so spikes keep their height
+            xs = np.repeat(np.arange(n) * steps_per_point.value, 2)
+            ys = np.empty(2 * n, dtype=np.int64)
+            ys[0::2] = np.ctypeslib.as_array(walk_mins[key])[:n]
+            ys[1::2] = np.ctypeslib.as_array(walk_maxs[key])[:n]
+            ax.plot(xs, ys, GRAPH_LINE_COLORS[ci], label=key + " " + value + " [" + str(low.value) + "," + str(high.value) + "," + str(position.value) +"]")
+            ci += 1
+            ax.legend(loc=2)
+            continue
+
         # Plot from the queue
         ys = fq[key].get_nowait()
         if (len(ys)) == 0:
@@ -3,12 +3,20 @@
 record_entropy.py — Continuously record hex entropy from every connected
 MED USB RNG device into per-device files.
 
-Usage:  python3 record_entropy.py [output_dir] [bytes_per_read]
+Usage:  python3 record_entropy.py [output_dir] [bytes_per_read] [format]
 
   output_dir      Directory for output files (default: ./entropy_data)
   bytes_per_read  Bytes to read per iteration (default: 1024, max: 1048576)
+  format          hex (default) or bin
 
 Output files:  <output_dir>/<serial>.hex
+               Each line is "[<UTC time of the first bit>] [<read time>] <hex>".
+               With bin, the library writes <output_dir>/<serial>.bin (the raw bytes)
+               and <output_dir>/<serial>.walk (a walk pyramid for zooming through
+               the session, which also times the bytes), plus per-second
+               summaries analyze_entropy.py reads instead of the bits:
+               <output_dir>/<serial>.epochs (bit sum, bit count, first and last
+               bit times) and <output_dir>/<serial>.hist (byte histograms).
 Stop with:     Ctrl+C
 """
 
@@ -19,8 +27,8 @@ import signal
 import threading
 from datetime import datetime, timezone
 from ctypes import (
-    cdll, c_int, c_char_p, c_ubyte, create_string_buffer,
-    addressof, POINTER,
+    cdll, c_bool, c_int, c_int64, c_double, c_char_p, c_ubyte, create_string_buffer,
+    addressof, byref, POINTER,
 )
 
 SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
@@ -28,6 +36,7 @@ LIB_PATH = os.path.join(SCRIPT_DIR, "builds", "linux", "libmeterfeeder.so")
 
 OUTPUT_DIR = sys.argv[1] if len(sys.argv) >= 2 else "./entropy_data"
 CHUNK = int(sys.argv[2]) if len(sys.argv) >= 3 else 1024
+FORMAT = sys.argv[3] if len(sys.argv) >= 4 else "hex"
 
 stop_event = threading.Event()
 
@@ -42,6 +51,17 @@ def load_library():
     lib.MF_GetNumberGenerators.restype = c_int
     lib.MF_GetListGenerators.argtypes = (POINTER(c_char_p),)
     lib.MF_GetBytes.argtypes = (c_int, POINTER(c_ubyte), c_char_p, c_char_p)
+    if hasattr(lib, "MF_GetBytesTimestamped"):
+        lib.MF_GetBytesTimestamped.argtypes = (
+            c_int, POINTER(c_ubyte), c_char_p,
+            POINTER(c_int64), POINTER(c_int64), POINTER(c_double), c_char_p,
+        )
+        lib.MF_GetBytesTimestamped.restype = None
+    if hasattr(lib, "MF_StartRecording"):
+        lib.MF_StartRecording.argtypes = (c_char_p, c_char_p, c_char_p)
+        lib.MF_StartRecording.restype = c_bool
+        lib.MF_StopRecording.argtypes = (c_char_p, c_char_p)
+        lib.MF_StopRecording.restype = c_bool
     return lib
 
 
@@ -74,18 +94,29 @@ def record_device(lib, serial, chunk, outpath):
     err = create_string_buffer(256)
     reads = 0
     total_bytes = 0
+    timestamped = hasattr(lib, "MF_GetBytesTimestamped")
+    first_utc_ns, first_mono_ns, bit_period_ns = c_int64(), c_int64(), c_double()
 
     with open(outpath, "a") as f:
         while not stop_event.is_set():
             err.value = b""
             t_start = time.perf_counter()
-            lib.MF_GetBytes(chunk, buf, serial.encode(), err)
+            if timestamped:
+                # Stamped by the library when the read completed, taken back to the first bit
+                lib.MF_GetBytesTimestamped(chunk, buf, serial.encode(),
+                                           byref(first_utc_ns), byref(first_mono_ns), byref(bit_period_ns), err)
+            else:
+                lib.MF_GetBytes(chunk, buf, serial.encode(), err)
             t_elapsed_ms = (time.perf_counter() - t_start) * 1000
             if err.value:
                 print(f"  [{serial}] Error: {err.value.decode()}")
                 time.sleep(0.5)
                 continue
-            timestamp = datetime.now(timezone.utc).strftime("%Y-%m-%dT%H:%M:%S.%fZ")
+            if timestamped:
+                first_bit = datetime.fromtimestamp(first_utc_ns.value / 1e9, timezone.utc)
+            else:
+                first_bit = datetime.now(timezone.utc)
+            timestamp = first_bit.strftime("%Y-%m-%dT%H:%M:%S.%fZ")
             hex_line = bytes(buf).hex()
             f.write(f"[{timestamp}] [{t_elapsed_ms:.1f}ms] {hex_line}\n")
             f.flush()
@@ -95,9 +126,35 @@ def record_device(lib, serial, chunk, outpath):
     print(f"  [{serial}] Stopped after {reads} reads ({total_bytes:,} bytes)")
 
 
+def record_device_binary(lib, serial, chunk, basepath):
+    """Thread target: continuously read entropy, which the library records with its walk pyramid."""
+    buf = (c_ubyte * chunk)()
+    err = create_string_buffer(256)
+    if not lib.MF_StartRecording(serial.encode(), basepath.encode(), err):
+        print(f"  [{serial}] Error: {err.value.decode()}")
+        return
+    reads = 0
+    while not stop_event.is_set():
+        err.value = b""
+        lib.MF_GetBytes(chunk, buf, serial.encode(), err)
+        if err.value:
+            print(f"  [{serial}] Error: {err.value.decode()}")
+            time.sleep(0.5)
+            continue
+        reads += 1
+    lib.MF_StopRecording(serial.encode(), err)
+    print(f"  [{serial}] Stopped after {reads} reads ({reads * chunk:,} bytes)")
+
+
 def main():
     print("Loading library...")
     lib = load_library()
+    if FORMAT not in ("hex", "bin"):
+        print(f"Unknown format: {FORMAT}")
+        sys.exit(1)
+    if FORMAT == "bin" and not hasattr(lib, "MF_StartRecording"):
+        print("The library is too old to record in the bin format.")
+        sys.exit(1)
 
     print("Initializing driver...")
     initialize(lib)
@@ -117,10 +174,14 @@ def main():
 
     threads = []
     for serial, desc in devices.items():
-        outpath = os.path.join(OUTPUT_DIR, f"{serial}.hex")
-        print(f"  {serial} -> {outpath} ({CHUNK} bytes/read)")
+        if FORMAT == "bin":
+            outpath = os.path.join(OUTPUT_DIR, serial)
+            print(f"  {serial} -> {outpath}.bin ({CHUNK} bytes/read)")
+        else:
+            outpath = os.path.join(OUTPUT_DIR, f"{serial}.hex")
+            print(f"  {serial} -> {outpath} ({CHUNK} bytes/read)")
         t = threading.Thread(
-            target=record_device,
+            target=record_device_binary if FORMAT == "bin" else record_device,
             args=(lib, serial, CHUNK, outpath),
             name=f"reader-{serial}",
             daemon=True,
@@ -150,9 +211,10 @@ def main():
     # Print final file sizes
     print(f"\nOutput files in: {OUTPUT_DIR}")
     for serial in devices:
-        p = os.path.join(OUTPUT_DIR, f"{serial}.hex")
-        sz = os.path.getsize(p) if os.path.exists(p) else 0
-        print(f"  {serial}.hex: {sz:,} bytes")
+        for ext in ((".bin", ".walk", ".epochs", ".hist") if FORMAT == "bin" else (".hex",)):
+            p = os.path.join(OUTPUT_DIR, f"{serial}{ext}")
+            sz = os.path.getsize(p) if os.path.exists(p) else 0
+            print(f"  {serial}{ext}: {sz:,} bytes")
 
 
 if __name__ == "__main__":
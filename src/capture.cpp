@@ -0,0 +1,468 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#ifdef _WIN32
+// Before windows.h (pulled in by ftd2xx.h) so the old winsock.h isn't used
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#include "capture.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+namespace MeterFeeder {
+    static int64_t monotonicNowNs() {
+        return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static int64_t utcNowNs() {
+        return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+}
+
+MeterFeeder::TrialCapture::TrialCapture(const Generator& generator, size_t historyBytes)
+    : generator_(generator), running_(false), status_(MF_OK), written_(0), validFrom_(0), gaps_(0) {
+    TransportProfile profile = generator_.GetProfile();
+    bitRate_ = profile.nominalBitRate;
+
+    // Small enough reads that the bits after a trigger turn up soon after they're generated
+    double chunkBytes = bitRate_ / 8 * MF_CAPTURE_CHUNK_MS / 1000;
+    chunkBytes_ = chunkBytes < 1 ? 1 : (DWORD)chunkBytes;
+    if (chunkBytes_ > profile.readChunkBytes) {
+        chunkBytes_ = profile.readChunkBytes;
+    }
+
+    ring_.resize(historyBytes > chunkBytes_ * 4 ? historyBytes : chunkBytes_ * 4);
+}
+
+MeterFeeder::TrialCapture::~TrialCapture() {
+    Stop();
+}
+
+int MeterFeeder::TrialCapture::Start() {
+    int status;
+    try {
+        std::lock_guard<std::mutex> io(generator_.GetIoMutex());
+        status = generator_.StartStreaming();
+    } catch (const std::runtime_error&) {
+        status = MF_GENERATOR_CLOSED;
+    }
+    if (status != MF_OK) {
+        return status;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = true;
+    status_ = MF_OK;
+    thread_ = std::thread(&TrialCapture::run, this);
+    return MF_OK;
+}
+
+void MeterFeeder::TrialCapture::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_) {
+            status_ = MF_GENERATOR_CLOSED;
+        }
+        running_ = false;
+    }
+    arrived_.notify_all();
+    if (!thread_.joinable()) {
+        return;
+    }
+    thread_.join();
+
+    try {
+        std::lock_guard<std::mutex> io(generator_.GetIoMutex());
+        generator_.StopStreaming();
+    } catch (const std::runtime_error&) {
+        // Already closed
+    }
+}
+
+void MeterFeeder::TrialCapture::run() {
+    std::vector<unsigned char> chunk(chunkBytes_);
+    uint64_t purges = generator_.GetMetrics().purges;
+
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!running_) {
+                return;
+            }
+        }
+
+        int status = MF_OK;
+        bool gap = false;
+        ChunkTiming timing = ChunkTiming();
+        try {
+            std::lock_guard<std::mutex> io(generator_.GetIoMutex());
+
+            // Someone else restarted (or stopped) the stream since the last chunk
+            if (generator_.GetMetrics().purges != purges || !generator_.IsStreaming()) {
+                gap = true;
+                if (!generator_.IsStreaming()) {
+                    status = generator_.StartStreaming();
+                }
+            }
+            if (status == MF_OK) {
+                status = generator_.Read(chunkBytes_, &chunk[0]);
+                timing = generator_.GetLastChunkTiming();
+            }
+            purges = generator_.GetMetrics().purges;
+        } catch (const std::runtime_error&) {
+            status = MF_GENERATOR_CLOSED;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (gap || status == MF_RXD_BYTES_LENGTH_WRONG) {
+            // What comes next doesn't follow on from what's in the ring
+            validFrom_ = written_;
+            anchors_.clear();
+            gaps_++;
+        }
+        if (status == MF_RXD_BYTES_LENGTH_WRONG) {
+            continue;
+        }
+        if (status != MF_OK) {
+            status_ = status;
+            running_ = false;
+            arrived_.notify_all();
+            return;
+        }
+        append(&chunk[0], chunkBytes_, timing);
+    }
+}
+
+// Called with mutex_ held
+void MeterFeeder::TrialCapture::append(const unsigned char* data, size_t length, const ChunkTiming& timing) {
+    size_t capacity = ring_.size();
+    size_t offset = (size_t)(written_ % capacity);
+    size_t first = length < capacity - offset ? length : capacity - offset;
+    memcpy(&ring_[offset], data, first);
+    memcpy(&ring_[0], data + first, length - first);
+
+    written_ += length;
+    if (written_ - validFrom_ > capacity) {
+        validFrom_ = written_ - capacity;
+    }
+
+    Anchor anchor = { written_ * 8, timing.lastBitMonotonicNs, timing.lastBitUtcNs };
+    anchors_.push_back(anchor);
+    while (anchors_.size() > 1 && anchors_.front().bitEnd <= validFrom_ * 8) {
+        anchors_.pop_front();
+    }
+
+    arrived_.notify_all();
+}
+
+// Find the first bit generated at or after a time, interpolating from the nearest later chunk.
+// Called with mutex_ held.
+bool MeterFeeder::TrialCapture::locate(int64_t monotonicNs, uint64_t* bitIndex) {
+    if (anchors_.empty() || bitRate_ <= 0) {
+        return false;
+    }
+
+    const Anchor* anchor = &anchors_.back();
+    for (size_t i = anchors_.size(); i-- > 0;) {
+        if (anchors_[i].lastBitMonotonicNs < monotonicNs) {
+            break;
+        }
+        anchor = &anchors_[i];
+    }
+
+    double periodNs = 1e9 / bitRate_;
+    double index = (double)anchor->bitEnd - 1 - std::floor((anchor->lastBitMonotonicNs - monotonicNs) / periodNs);
+    if (index < 0) {
+        return false;
+    }
+    *bitIndex = (uint64_t)index;
+    return true;
+}
+
+// Called with mutex_ held
+void MeterFeeder::TrialCapture::copyBits(uint64_t firstBit, uint64_t numBits, std::vector<unsigned char>* bits) {
+    size_t capacity = ring_.size();
+    bits->assign((size_t)((numBits + 7) / 8), 0);
+
+    unsigned shift = (unsigned)(firstBit % 8);
+    uint64_t firstByte = firstBit / 8;
+    uint64_t lastByte = (firstBit + numBits - 1) / 8;
+    for (size_t i = 0; i < bits->size(); i++) {
+        uint64_t byteIndex = firstByte + i;
+        unsigned value = (unsigned)ring_[(size_t)(byteIndex % capacity)] << shift;
+        if (shift > 0 && byteIndex + 1 <= lastByte) {
+            value |= ring_[(size_t)((byteIndex + 1) % capacity)] >> (8 - shift);
+        }
+        (*bits)[i] = (unsigned char)value;
+    }
+
+    // Clear the bits past the end of the window
+    if (numBits % 8 != 0) {
+        bits->back() &= (unsigned char)(0xff << (8 - numBits % 8));
+    }
+}
+
+int MeterFeeder::TrialCapture::Trigger(int64_t triggerMonotonicNs, uint64_t preBits, uint64_t postBits, TrialWindow* window) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    double periodNs = bitRate_ > 0 ? 1e9 / bitRate_ : 0;
+
+    // Allow for the bits after the trigger to be generated then make their way over USB
+    int64_t waitNs = (int64_t)(postBits * periodNs) + (int64_t)(MF_CAPTURE_CHUNK_MS + 1000) * 1000000;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point(
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(triggerMonotonicNs + waitNs)));
+
+    uint64_t gaps = gaps_;
+    uint64_t triggerBit = 0;
+    for (;;) {
+        if (gaps_ != gaps) {
+            return MF_CAPTURE_GAP;
+        }
+        if (!running_) {
+            return status_ != MF_OK ? status_ : MF_GENERATOR_CLOSED;
+        }
+
+        // Done once the trigger time is covered by a chunk and the bits after it are in
+        bool located = !anchors_.empty() && anchors_.back().lastBitMonotonicNs >= triggerMonotonicNs && locate(triggerMonotonicNs, &triggerBit);
+        if (located && written_ * 8 >= triggerBit + postBits) {
+            break;
+        }
+        if (arrived_.wait_until(lock, deadline) == std::cv_status::timeout) {
+            return MF_READ_TIMEOUT;
+        }
+    }
+
+    // The trigger's already fallen out of the history, or came before the last restart
+    uint64_t validFromBit = validFrom_ * 8;
+    if (triggerBit < validFromBit) {
+        return MF_CAPTURE_GAP;
+    }
+    uint64_t firstBit = triggerBit - validFromBit >= preBits ? triggerBit - preBits : validFromBit;
+
+    window->numBits = triggerBit + postBits - firstBit;
+    window->firstBitIndex = firstBit;
+    window->triggerBitOffset = triggerBit - firstBit;
+    copyBits(firstBit, window->numBits, &window->bits);
+
+    const Anchor* anchor = &anchors_.back();
+    for (size_t i = 0; i < anchors_.size(); i++) {
+        if (anchors_[i].bitEnd > triggerBit) {
+            anchor = &anchors_[i];
+            break;
+        }
+    }
+    window->bitPeriodNs = periodNs;
+    window->triggerMonotonicNs = triggerMonotonicNs;
+    window->triggerUtcNs = triggerMonotonicNs + (anchor->lastBitUtcNs - anchor->lastBitMonotonicNs);
+    window->firstBitUtcNs = anchor->lastBitUtcNs - (int64_t)((double)(anchor->bitEnd - 1 - firstBit) * periodNs);
+    return MF_OK;
+}
+
+int64_t MeterFeeder::TrialCapture::UtcToMonotonic(int64_t utcNs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (anchors_.empty()) {
+        return utcNs - (utcNowNs() - monotonicNowNs());
+    }
+    return utcNs - (anchors_.back().lastBitUtcNs - anchors_.back().lastBitMonotonicNs);
+}
+
+#ifdef _WIN32
+#define MF_INVALID_SOCKET ((intptr_t)INVALID_SOCKET)
+#define closeSocket(s) closesocket((SOCKET)(s))
+#else
+#define MF_INVALID_SOCKET ((intptr_t)-1)
+#define closeSocket(s) close((int)(s))
+#endif
+
+// Largest UDP payload, and room for a reply's header before its hex
+#define MF_TRIGGER_MAX_DATAGRAM 65507
+#define MF_TRIGGER_MAX_HEADER 256
+// Longest serial or tag echoed in a header, leaving the rest for its numbers
+#define MF_TRIGGER_MAX_FIELD 64
+
+MeterFeeder::TriggerServer::TriggerServer() : socket_(MF_INVALID_SOCKET), running_(false) {
+}
+
+MeterFeeder::TriggerServer::~TriggerServer() {
+    Stop();
+}
+
+bool MeterFeeder::TriggerServer::Start(int port, FindCapture findCapture, std::string* errorReason) {
+    Stop();
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        *errorReason = "Could not initialize Winsock";
+        return false;
+    }
+#endif
+
+    intptr_t s = (intptr_t)socket(AF_INET, SOCK_DGRAM, 0);
+    if (s == MF_INVALID_SOCKET) {
+        *errorReason = "Could not create the trigger socket";
+        return false;
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons((unsigned short)port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(s, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        char reason[64];
+        snprintf(reason, sizeof(reason), "Could not listen for triggers on port %d", port);
+        *errorReason = reason;
+        closeSocket(s);
+        return false;
+    }
+
+    // Wake up now and then to check for Stop()
+#ifdef _WIN32
+    DWORD timeout = 100;
+#else
+    struct timeval timeout = { 0, 100000 };
+#endif
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+
+    findCapture_ = findCapture;
+    socket_ = s;
+    running_ = true;
+    receiver_ = std::thread(&TriggerServer::receive, this);
+    responder_ = std::thread(&TriggerServer::respond, this);
+    return true;
+}
+
+void MeterFeeder::TriggerServer::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    pendingAvailable_.notify_all();
+    if (receiver_.joinable()) {
+        receiver_.join();
+    }
+    if (responder_.joinable()) {
+        responder_.join();
+    }
+    if (socket_ != MF_INVALID_SOCKET) {
+        closeSocket(socket_);
+        socket_ = MF_INVALID_SOCKET;
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+    pending_.clear();
+}
+
+void MeterFeeder::TriggerServer::receive() {
+    char buffer[512];
+    for (;;) {
+        struct sockaddr_in from;
+        socklen_t fromLength = sizeof(from);
+        int received = (int)recvfrom(socket_, buffer, sizeof(buffer), 0, (struct sockaddr*)&from, &fromLength);
+
+        // Take the trigger time before anything else
+        int64_t now = monotonicNowNs();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        if (received <= 0) {
+            continue;
+        }
+        Pending pending;
+        pending.triggerMonotonicNs = now;
+        pending.request.assign(buffer, received);
+        pending.address.assign((unsigned char*)&from, (unsigned char*)&from + fromLength);
+        pending_.push_back(pending);
+        pendingAvailable_.notify_one();
+    }
+}
+
+void MeterFeeder::TriggerServer::respond() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        pendingAvailable_.wait(lock, [this]() { return !running_ || !pending_.empty(); });
+        if (!running_) {
+            return;
+        }
+        Pending pending = pending_.front();
+        pending_.pop_front();
+
+        lock.unlock();
+        std::string reply = handle(pending);
+        int sent = (int)sendto(socket_, reply.data(), (int)reply.size(), 0, (struct sockaddr*)&pending.address[0], (socklen_t)pending.address.size());
+        if (sent != (int)reply.size()) {
+            // Let the client know rather than leave it waiting, with the request's tag
+            std::istringstream fields(reply);
+            std::string status, tag;
+            fields >> status >> tag;
+            std::string error = "ERR " + tag + " Couldn't send the reply";
+            sendto(socket_, error.data(), (int)error.size(), 0, (struct sockaddr*)&pending.address[0], (socklen_t)pending.address.size());
+        }
+        lock.lock();
+    }
+}
+
+std::string MeterFeeder::TriggerServer::handle(const Pending& pending) {
+    std::istringstream request(pending.request);
+    std::string command, serialNumber, tag;
+    long long preBits = -1, postBits = -1;
+    request >> command >> serialNumber >> preBits >> postBits >> tag;
+    if (tag.empty()) {
+        tag = "-";
+    }
+
+    if (command != "TRIGGER" || preBits < 0 || postBits < 0) {
+        return "ERR " + tag + " Expected TRIGGER <serial> <pre bits> <post bits> [tag]";
+    }
+    if (serialNumber.size() > MF_TRIGGER_MAX_FIELD || tag.size() > MF_TRIGGER_MAX_FIELD) {
+        return "ERR " + tag + " Serial or tag longer than " + std::to_string(MF_TRIGGER_MAX_FIELD) + " characters";
+    }
+    // Keep the hex reply, two characters a byte, within a UDP datagram
+    long long maxBits = (long long)(MF_TRIGGER_MAX_DATAGRAM - MF_TRIGGER_MAX_HEADER) / 2 * 8;
+    if (preBits > maxBits || postBits > maxBits - preBits) {
+        return "ERR " + tag + " Window too long for a datagram";
+    }
+    std::shared_ptr<TrialCapture> capture = findCapture_(serialNumber);
+    if (!capture) {
+        return "ERR " + tag + " No capture running on " + serialNumber;
+    }
+
+    TrialWindow window;
+    int status = capture->Trigger(pending.triggerMonotonicNs, (uint64_t)preBits, (uint64_t)postBits, &window);
+    if (status != MF_OK) {
+        char reason[64];
+        snprintf(reason, sizeof(reason), "Capture failed [%d]", status);
+        return "ERR " + tag + " " + reason;
+    }
+
+    char header[MF_TRIGGER_MAX_HEADER];
+    snprintf(header, sizeof(header), "OK %s %s %lld %lld %.3f %llu %llu ", tag.c_str(), serialNumber.c_str(),
+        (long long)window.triggerUtcNs, (long long)window.firstBitUtcNs, window.bitPeriodNs,
+        (unsigned long long)window.triggerBitOffset, (unsigned long long)window.numBits);
+    std::string reply = header;
+    static const char hexDigits[] = "0123456789abcdef";
+    for (size_t i = 0; i < window.bits.size(); i++) {
+        reply += hexDigits[window.bits[i] >> 4];
+        reply += hexDigits[window.bits[i] & 0xf];
+    }
+    return reply;
+}
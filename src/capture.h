@@ -0,0 +1,191 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "constants.h"
+#include "generator.h"
+
+namespace MeterFeeder {
+    /**
+     * Bits around a trial trigger, from T-pre to T+post.
+     */
+    struct TrialWindow {
+        // The bits packed most significant bit first, the first bit generated at about firstBitUtcNs
+        std::vector<unsigned char> bits;
+        uint64_t numBits;
+
+        // Index of the first bit since the capture started
+        uint64_t firstBitIndex;
+
+        // Index in the window of the first bit generated at or after the trigger
+        uint64_t triggerBitOffset;
+
+        // When the trigger happened (nanoseconds)
+        int64_t triggerMonotonicNs;
+        int64_t triggerUtcNs;
+
+        // When the first bit was generated (nanoseconds since the Unix epoch)
+        int64_t firstBitUtcNs;
+
+        // Nominal time between bits (nanoseconds)
+        double bitPeriodNs;
+    };
+
+    /**
+     * Streams a generator continuously into a history ring so trial windows can start before
+     * the trigger and no start-streaming latency is added after it.
+     * 
+     * The stream must be left alone while capturing: anything restarting it (e.g. GetBytes) leaves
+     * a gap, and windows overlapping the gap fail with MF_CAPTURE_GAP.
+     */
+    class TrialCapture {
+        public:
+            /**
+             * @param The generator to capture from.
+             * @param Bytes of history to keep.
+             */
+            TrialCapture(const Generator& generator, size_t historyBytes);
+            ~TrialCapture();
+            TrialCapture(const TrialCapture&) = delete;
+            TrialCapture& operator=(const TrialCapture&) = delete;
+
+            /**
+             * Start streaming into the history ring.
+             * 
+             * @return FT_STATUS or MF_STATUS on error starting the stream.
+             */
+            int Start();
+
+            /**
+             * Stop streaming. Anything waiting in Trigger() gets MF_GENERATOR_CLOSED.
+             */
+            void Stop();
+
+            /**
+             * Get the window around a trigger, waiting for the bits after it to arrive.
+             * 
+             * @param Time of the trigger on the host monotonic clock (nanoseconds, see ChunkTiming).
+             * @param Bits to return from before the trigger. Fewer are returned if the history doesn't go back that far.
+             * @param Bits to return from the trigger on.
+             * @param Where to store the window.
+             * 
+             * @return MF_OK, MF_READ_TIMEOUT if the bits after the trigger didn't arrive in time, MF_CAPTURE_GAP
+             *         if the stream was restarted inside the window, or the error that stopped the capture.
+             */
+            int Trigger(int64_t triggerMonotonicNs, uint64_t preBits, uint64_t postBits, TrialWindow* window);
+
+            /**
+             * Convert a UTC time to the host monotonic clock using the capture's latest timestamps.
+             * 
+             * @param UTC time (nanoseconds since the Unix epoch).
+             * 
+             * @return Monotonic time (nanoseconds).
+             */
+            int64_t UtcToMonotonic(int64_t utcNs);
+
+            /**
+             * Get the generator being captured.
+             */
+            Generator& GetGenerator() { return generator_; }
+
+        private:
+            // Bit position in the stream of a chunk's last bit, and when it was generated
+            struct Anchor {
+                uint64_t bitEnd;
+                int64_t lastBitMonotonicNs;
+                int64_t lastBitUtcNs;
+            };
+
+            void run();
+            void append(const unsigned char* data, size_t length, const ChunkTiming& timing);
+            bool locate(int64_t monotonicNs, uint64_t* bitIndex);
+            void copyBits(uint64_t firstBit, uint64_t numBits, std::vector<unsigned char>* bits);
+
+            Generator generator_;
+            std::vector<unsigned char> ring_;
+            DWORD chunkBytes_;
+            double bitRate_;
+
+            std::mutex mutex_;
+            std::condition_variable arrived_;
+            std::thread thread_;
+            bool running_;
+            int status_;
+
+            // Bytes written since the capture started, and the first one still valid (after the last gap or overwrite)
+            uint64_t written_;
+            uint64_t validFrom_;
+            uint64_t gaps_;
+            std::deque<Anchor> anchors_;
+    };
+
+    /**
+     * Takes trial triggers as UDP datagrams on the loopback interface, so a stimulus program
+     * (or a key handler) can trigger with a single sendto() and get the window back as the reply.
+     * 
+     * Request:  "TRIGGER <serial> <pre bits> <post bits> [tag]"
+     * Reply:    "OK <tag> <serial> <trigger UTC ns> <first bit UTC ns> <bit period ns> <trigger bit offset> <bits> <hex>"
+     *           or "ERR <tag> <reason>"
+     * 
+     * The trigger time is taken as the datagram is received.
+     */
+    class TriggerServer {
+        public:
+            typedef std::function<std::shared_ptr<TrialCapture>(const std::string& serialNumber)> FindCapture;
+
+            TriggerServer();
+            ~TriggerServer();
+            TriggerServer(const TriggerServer&) = delete;
+            TriggerServer& operator=(const TriggerServer&) = delete;
+
+            /**
+             * Start listening on 127.0.0.1.
+             * 
+             * @param UDP port.
+             * @param Looks up the capture for a serial number.
+             * @param Error reason if the socket could not be opened.
+             * 
+             * @return true on success, false otherwise.
+             */
+            bool Start(int port, FindCapture findCapture, std::string* errorReason);
+
+            /**
+             * Stop listening.
+             */
+            void Stop();
+
+        private:
+            struct Pending {
+                int64_t triggerMonotonicNs;
+                std::string request;
+                std::vector<unsigned char> address;
+            };
+
+            void receive();
+            void respond();
+            std::string handle(const Pending& pending);
+
+            FindCapture findCapture_;
+            intptr_t socket_;
+            std::mutex mutex_;
+            std::condition_variable pendingAvailable_;
+            std::deque<Pending> pending_;
+            bool running_;
+            std::thread receiver_;
+            std::thread responder_;
+    };
+}
@@ -0,0 +1,268 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "coherence.h"
+
+#include "constants.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define MF_COHERENCE_PI 3.14159265358979323846
+
+// Epochs per device held for a block: the margin before it, the block, and two margins after
+#define MF_COHERENCE_BUFFER_EPOCHS (MF_COHERENCE_BLOCK_EPOCHS + 3 * MF_COHERENCE_MARGIN_EPOCHS)
+
+// Points in each Hilbert transform: the block with a margin either side
+#define MF_COHERENCE_HILBERT_POINTS (MF_COHERENCE_BLOCK_EPOCHS + 2 * MF_COHERENCE_MARGIN_EPOCHS)
+
+MeterFeeder::BandPassFilter::BandPassFilter(unsigned order, double lowHz, double highHz, double sampleRateHz) {
+    typedef std::complex<double> Complex;
+    sampleRateHz_ = sampleRateHz;
+
+    // Edges prewarped for the bilinear transform, with scipy's normalization (fs = 2)
+    const double fs2 = 4;
+    double low = fs2 * tan(MF_COHERENCE_PI * lowHz / sampleRateHz);
+    double high = fs2 * tan(MF_COHERENCE_PI * highHz / sampleRateHz);
+    double bandwidth = high - low, center2 = low * high;
+
+    // Analog prototype poles, each becoming two band-pass poles, then mapped to the z-plane
+    std::vector<Complex> poles;
+    Complex gainDenominator = 1;
+    for (unsigned k = 0; k < order; k++) {
+        Complex prototype = -std::exp(Complex(0, MF_COHERENCE_PI * (2.0 * k - order + 1) / (2.0 * order)));
+        Complex scaled = prototype * bandwidth / 2.0;
+        Complex root = std::sqrt(scaled * scaled - center2);
+        Complex analog[2] = { scaled + root, scaled - root };
+        for (int i = 0; i < 2; i++) {
+            gainDenominator *= fs2 - analog[i];
+            poles.push_back((fs2 + analog[i]) / (fs2 - analog[i]));
+        }
+    }
+    double gain = pow(bandwidth, (double)order) * pow(fs2, (double)order) / gainDenominator.real();
+
+    // One of each conjugate pair per section, those nearest the unit circle last; every section
+    // gets one of the zeros at z = 1 (from s = 0) and one at z = -1 (from infinity)
+    std::vector<Complex> upper;
+    for (size_t i = 0; i < poles.size(); i++) {
+        if (poles[i].imag() > 0) {
+            upper.push_back(poles[i]);
+        }
+    }
+    std::sort(upper.begin(), upper.end(), [](const Complex& a, const Complex& b) { return std::abs(a) < std::abs(b); });
+    for (size_t i = 0; i < upper.size(); i++) {
+        Section section = { { 1, 0, -1 }, { 1, -2 * upper[i].real(), std::norm(upper[i]) } };
+        if (i == 0) {
+            section.b[0] *= gain;
+            section.b[2] *= gain;
+        }
+        sections_.push_back(section);
+    }
+    state_.assign(sections_.size() * 2, 0);
+}
+
+double MeterFeeder::BandPassFilter::Process(double x) {
+    for (size_t i = 0; i < sections_.size(); i++) {
+        const Section& s = sections_[i];
+        double* z = &state_[i * 2];
+        double y = s.b[0] * x + z[0];
+        z[0] = s.b[1] * x - s.a[1] * y + z[1];
+        z[1] = s.b[2] * x - s.a[2] * y;
+        x = y;
+    }
+    return x;
+}
+
+void MeterFeeder::BandPassFilter::Reset() {
+    std::fill(state_.begin(), state_.end(), 0);
+}
+
+std::complex<double> MeterFeeder::BandPassFilter::Response(double hz) const {
+    std::complex<double> z1 = std::exp(std::complex<double>(0, -2 * MF_COHERENCE_PI * hz / sampleRateHz_));
+    std::complex<double> z2 = z1 * z1, response = 1;
+    for (size_t i = 0; i < sections_.size(); i++) {
+        const Section& s = sections_[i];
+        response *= (s.b[0] + s.b[1] * z1 + s.b[2] * z2) / (s.a[0] + s.a[1] * z1 + s.a[2] * z2);
+    }
+    return response;
+}
+
+MeterFeeder::CoherenceAnalyzer::CoherenceAnalyzer(size_t numDevices, const CoherenceOptions& options)
+    : fft_(MF_COHERENCE_HILBERT_POINTS) {
+    numDevices_ = numDevices;
+    options_ = options;
+    for (size_t d = 0; d < numDevices; d++) {
+        filters_.push_back(BandPassFilter(options.order, options.lowHz, options.highHz, options.sampleRateHz));
+    }
+
+    // Raised cosine over the outer half of each margin
+    taper_.resize(MF_COHERENCE_MARGIN_EPOCHS / 2);
+    for (size_t i = 0; i < MF_COHERENCE_MARGIN_EPOCHS / 2; i++) {
+        taper_[i] = 0.5 - 0.5 * cos(MF_COHERENCE_PI * (i + 0.5) / (MF_COHERENCE_MARGIN_EPOCHS / 2));
+    }
+
+    // The margin before the first block is zeros
+    forward_.assign(numDevices * MF_COHERENCE_BUFFER_EPOCHS, 0);
+    buffered_ = MF_COHERENCE_MARGIN_EPOCHS;
+
+    size_t pairs = numDevices * (numDevices - 1) / 2;
+    phasorSums_.assign(pairs, 0);
+    productSums_.assign(pairs, 0);
+    amplitudeSums_.assign(numDevices, 0);
+    squareSums_.assign(numDevices, 0);
+}
+
+bool MeterFeeder::CoherenceAnalyzer::CheckOptions(size_t numDevices, const CoherenceOptions& options, std::string* errorReason) {
+    if (numDevices < 2) {
+        *errorReason = "Coherence needs at least 2 devices";
+    } else if (!(options.sampleRateHz > 0)) {
+        *errorReason = "Sample rate must be positive";
+    } else if (!(options.lowHz > 0 && options.lowHz < options.highHz && options.highHz < options.sampleRateHz / 2)) {
+        *errorReason = "Band must be within 0 and half the sample rate, low below high";
+    } else if (options.order < 1 || options.order > 16) {
+        *errorReason = "Filter order must be 1 to 16";
+    } else if (options.windowEpochs < 2) {
+        *errorReason = "Windows must be at least 2 epochs";
+    } else {
+        return true;
+    }
+    return false;
+}
+
+void MeterFeeder::CoherenceAnalyzer::AddEpoch(const double* zScores) {
+    if (finished_) {
+        return;
+    }
+    for (size_t d = 0; d < numDevices_; d++) {
+        double z = std::isnan(zScores[d]) ? 0 : zScores[d];
+        forward_[d * MF_COHERENCE_BUFFER_EPOCHS + buffered_] = filters_[d].Process(z);
+    }
+    buffered_++;
+    epochs_++;
+    if (buffered_ == MF_COHERENCE_BUFFER_EPOCHS) {
+        processBlock(MF_COHERENCE_BLOCK_EPOCHS);
+    }
+}
+
+void MeterFeeder::CoherenceAnalyzer::Finish() {
+    if (finished_) {
+        return;
+    }
+    finished_ = true;
+
+    // Past the end the input is zero, though the filters still ring
+    while (processed_ < epochs_) {
+        while (buffered_ < MF_COHERENCE_BUFFER_EPOCHS) {
+            for (size_t d = 0; d < numDevices_; d++) {
+                forward_[d * MF_COHERENCE_BUFFER_EPOCHS + buffered_] = filters_[d].Process(0);
+            }
+            buffered_++;
+        }
+        processBlock(std::min((size_t)MF_COHERENCE_BLOCK_EPOCHS, epochs_ - processed_));
+    }
+}
+
+std::vector<MeterFeeder::CoherenceWindow> MeterFeeder::CoherenceAnalyzer::TakeWindows() {
+    std::vector<CoherenceWindow> windows;
+    windows.swap(windows_);
+    return windows;
+}
+
+// Filter the buffer backwards from its end, for zero phase over the block and its margins, take the
+// analytic signal of that, and add the block's epochs to the windows
+void MeterFeeder::CoherenceAnalyzer::processBlock(size_t validEpochs) {
+    const size_t points = MF_COHERENCE_HILBERT_POINTS;
+    std::vector<std::complex<double>> analytic(numDevices_ * MF_COHERENCE_BLOCK_EPOCHS);
+    std::vector<double> zeroPhase(MF_COHERENCE_BUFFER_EPOCHS);
+    std::vector<std::complex<double>> spectrum(points);
+    for (size_t d = 0; d < numDevices_; d++) {
+        BandPassFilter backward = filters_[d];
+        backward.Reset();
+        const double* forward = &forward_[d * MF_COHERENCE_BUFFER_EPOCHS];
+        for (size_t i = MF_COHERENCE_BUFFER_EPOCHS; i-- > 0;) {
+            zeroPhase[i] = backward.Process(forward[i]);
+        }
+
+        // Hilbert transform: keep the positive frequencies, doubled. The margins are tapered to zero
+        // towards the ends, as cutting the signal off short would leak into the block
+        for (size_t i = 0; i < points; i++) {
+            size_t edge = std::min(i, points - 1 - i);
+            spectrum[i] = edge < MF_COHERENCE_MARGIN_EPOCHS / 2 ? zeroPhase[i] * taper_[edge] : zeroPhase[i];
+        }
+        fft_.Forward(&spectrum[0]);
+        for (size_t k = 1; k < points / 2; k++) {
+            spectrum[k] *= 2;
+        }
+        for (size_t k = points / 2 + 1; k < points; k++) {
+            spectrum[k] = 0;
+        }
+        fft_.Inverse(&spectrum[0]);
+        for (size_t i = 0; i < MF_COHERENCE_BLOCK_EPOCHS; i++) {
+            analytic[i * numDevices_ + d] = spectrum[MF_COHERENCE_MARGIN_EPOCHS + i];
+        }
+    }
+    for (size_t i = 0; i < validEpochs; i++) {
+        processed_++;
+        addAnalytic(&analytic[i * numDevices_]);
+    }
+
+    // The next block starts a block on, keeping its margin before and what's been read after
+    for (size_t d = 0; d < numDevices_; d++) {
+        double* forward = &forward_[d * MF_COHERENCE_BUFFER_EPOCHS];
+        std::copy(forward + MF_COHERENCE_BLOCK_EPOCHS, forward + MF_COHERENCE_BUFFER_EPOCHS, forward);
+    }
+    buffered_ -= MF_COHERENCE_BLOCK_EPOCHS;
+}
+
+// Add one epoch's analytic signals to the window sums, closing the window when it's full
+void MeterFeeder::CoherenceAnalyzer::addAnalytic(const std::complex<double>* analytic) {
+    std::vector<double> amplitudes(numDevices_);
+    std::vector<std::complex<double>> phasors(numDevices_);
+    for (size_t d = 0; d < numDevices_; d++) {
+        amplitudes[d] = std::abs(analytic[d]);
+        phasors[d] = amplitudes[d] > 0 ? analytic[d] / amplitudes[d] : 1;
+        amplitudeSums_[d] += amplitudes[d];
+        squareSums_[d] += amplitudes[d] * amplitudes[d];
+    }
+    size_t pair = 0;
+    for (size_t i = 0; i < numDevices_; i++) {
+        for (size_t j = i + 1; j < numDevices_; j++, pair++) {
+            phasorSums_[pair] += phasors[i] * std::conj(phasors[j]);
+            productSums_[pair] += amplitudes[i] * amplitudes[j];
+        }
+    }
+
+    if (++windowFill_ < options_.windowEpochs) {
+        return;
+    }
+    double n = (double)options_.windowEpochs;
+    CoherenceWindow window;
+    window.firstEpoch = processed_ - options_.windowEpochs;
+    window.phaseLocking = 0;
+    window.amplitudeCoherence = 0;
+    pair = 0;
+    for (size_t i = 0; i < numDevices_; i++) {
+        double meanI = amplitudeSums_[i] / n, varianceI = squareSums_[i] / n - meanI * meanI;
+        for (size_t j = i + 1; j < numDevices_; j++, pair++) {
+            window.phaseLocking += std::abs(phasorSums_[pair]) / n;
+
+            // Pairs with a flat envelope count as uncorrelated
+            double meanJ = amplitudeSums_[j] / n, varianceJ = squareSums_[j] / n - meanJ * meanJ;
+            if (varianceI > 1e-12 * meanI * meanI && varianceJ > 1e-12 * meanJ * meanJ) {
+                window.amplitudeCoherence += (productSums_[pair] / n - meanI * meanJ) / sqrt(varianceI * varianceJ);
+            }
+        }
+    }
+    window.phaseLocking /= (double)pair;
+    window.amplitudeCoherence /= (double)pair;
+    windows_.push_back(window);
+
+    windowFill_ = 0;
+    std::fill(phasorSums_.begin(), phasorSums_.end(), std::complex<double>(0));
+    std::fill(productSums_.begin(), productSums_.end(), 0);
+    std::fill(amplitudeSums_.begin(), amplitudeSums_.end(), 0);
+    std::fill(squareSums_.begin(), squareSums_.end(), 0);
+}
@@ -0,0 +1,168 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "fft.h"
+
+namespace MeterFeeder {
+    /**
+     * Butterworth band-pass filter as second order sections (direct form II transposed), designed the way
+     * scipy's butter(order, [low, high], btype="band", output="sos") does: bilinear transform of the analog
+     * prototype with prewarped edges. Filters a stream one sample at a time.
+     */
+    class BandPassFilter {
+        public:
+            struct Section {
+                double b[3];
+                double a[3];
+            };
+
+            /**
+             * @param Order of the prototype (the filter has twice as many poles).
+             * @param Lower and upper edges (Hz), 0 < low < high < sampleRate / 2.
+             * @param Sample rate (Hz).
+             */
+            BandPassFilter(unsigned order, double lowHz, double highHz, double sampleRateHz);
+
+            /**
+             * Filter the next sample.
+             */
+            double Process(double x);
+
+            /**
+             * Clear the state, as if no samples had been filtered.
+             */
+            void Reset();
+
+            /**
+             * Get the filter's response at a frequency.
+             * 
+             * @param Frequency (Hz).
+             */
+            std::complex<double> Response(double hz) const;
+
+            const std::vector<Section>& GetSections() const { return sections_; }
+
+        private:
+            double sampleRateHz_;
+            std::vector<Section> sections_;
+            std::vector<double> state_;
+    };
+
+    /**
+     * Parameters of a coherence analysis, defaulting to analyze_entropy.py's.
+     */
+    struct CoherenceOptions {
+        // Epochs per second
+        double sampleRateHz = 1;
+
+        // Band kept before taking phases and amplitudes (Hz), and the Butterworth prototype order
+        double lowHz = 0.01;
+        double highHz = 0.1;
+        unsigned order = 4;
+
+        // Epochs per coherence window
+        size_t windowEpochs = 60;
+    };
+
+    /**
+     * Coherence of the devices over one window.
+     */
+    struct CoherenceWindow {
+        // Index of the window's first epoch
+        size_t firstEpoch;
+
+        // Phase locking value: |mean of e^(i phase difference)| averaged over the pairs of devices
+        double phaseLocking;
+
+        // Pearson correlation of the amplitude envelopes averaged over the pairs of devices
+        double amplitudeCoherence;
+    };
+
+    /**
+     * GCP2-style phase and amplitude coherence of the devices' per-epoch Z-scores, as analyze_entropy.py
+     * and compare_entropy.py compute it, but incrementally: epochs go through the band-pass filter as
+     * they're added, and are filtered back the other way (zero phase, like sosfiltfilt) and turned into
+     * analytic signals a block at a time with margins either side. Memory stays at a few blocks per device
+     * however long the session, and windows come out a couple of blocks behind the epochs.
+     * 
+     * Away from the ends of the session the results match the whole-array computation; at the ends the
+     * data is taken as zero beyond them, rather than the odd extension sosfiltfilt pads with.
+     */
+    class CoherenceAnalyzer {
+        public:
+            /**
+             * @param Number of devices, at least 2.
+             * @param Analysis parameters, see CheckOptions().
+             */
+            CoherenceAnalyzer(size_t numDevices, const CoherenceOptions& options);
+
+            /**
+             * Check analysis parameters.
+             * 
+             * @param Number of devices.
+             * @param The parameters.
+             * @param Error reason upon bad parameters.
+             * 
+             * @return true if usable, otherwise false.
+             */
+            static bool CheckOptions(size_t numDevices, const CoherenceOptions& options, std::string* errorReason);
+
+            /**
+             * Add the next epoch.
+             * 
+             * @param Z-score of each device, NaN where it had no data (taken as 0).
+             */
+            void AddEpoch(const double* zScores);
+
+            /**
+             * Process the epochs still held back for lack of later ones. No more can be added after.
+             */
+            void Finish();
+
+            /**
+             * Get the windows completed since the last call, in order.
+             */
+            std::vector<CoherenceWindow> TakeWindows();
+
+            /**
+             * Get the number of epochs added.
+             */
+            size_t GetEpochCount() const { return epochs_; }
+
+        private:
+            void processBlock(size_t validEpochs);
+            void addAnalytic(const std::complex<double>* analytic);
+
+            size_t numDevices_;
+            CoherenceOptions options_;
+            std::vector<BandPassFilter> filters_;
+            Fft fft_;
+            std::vector<double> taper_; // Ramp over the outer half of the margins before the Hilbert transform
+
+            // Forward filtered epochs of each device from margin before the block start on, device after device
+            std::vector<double> forward_;
+            size_t buffered_;
+            size_t epochs_ = 0;
+            size_t processed_ = 0;
+            bool finished_ = false;
+
+            // Sums over the window being filled: phasor products and amplitude products per pair,
+            // amplitudes and their squares per device
+            std::vector<std::complex<double>> phasorSums_;
+            std::vector<double> productSums_;
+            std::vector<double> amplitudeSums_;
+            std::vector<double> squareSums_;
+            size_t windowFill_ = 0;
+            std::vector<CoherenceWindow> windows_;
+    };
+}
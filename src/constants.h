@@ -30,8 +30,78 @@ enum {
 enum {
     MF_OK,
     MF_RXD_BYTES_LENGTH_WRONG = 1000,
+    MF_READ_TIMEOUT,        // 1001: deadline passed before the read completed
+    MF_READ_CANCELLED,      // 1002: read cancelled before it completed
+    MF_GENERATOR_CLOSED,    // 1003: generator closed while the read was pending
+    MF_CAPTURE_GAP,         // 1004: stream restarted (or history overwritten) inside a trial window
+    MF_RESEED_FAILED,       // 1005: a DRBG couldn't get a fresh seed from its generator
+    MF_REPLAY_ENDED,        // 1006: a replayed recording has no more bytes
 };
 
+// Longest the read reactor sleeps between polls of the receive queues while reads are pending
+// (milliseconds). Bounds the delay from a missed FT_EVENT_RXCHAR notification.
+#define MF_REACTOR_POLL_MS 1
+
+// Longest stretch of data a trial capture reads at a time (milliseconds at the nominal rate).
+// Bounds how soon after T+post a trial window is returned.
+#define MF_CAPTURE_CHUNK_MS 10
+
+// Default bit reservoir refill (milliseconds of data at the nominal rate). Draws needing more read more.
+#define MF_RESERVOIR_REFILL_MS 10
+
+// Longest read a big reservoir refill is split into (milliseconds of data at the nominal rate),
+// kept well within FTDI_DEVICE_TX_TIMEOUT_MS
+#define MF_RESERVOIR_PIECE_MS 1000
+
+// Random bits beyond the bound's own that a bounded integer draws per try, making rejections rarer than 1 in 2^8
+// for bounds up to 2^24. Tries never draw more than 32 bits, so larger bounds reject up to half the time near 2^31
+#define MF_BOUNDED_EXTRA_BITS 8
+
+// Default budgets after which a DRBG reseeds from its generator (256MB, 10 seconds), and the rate it reports
+#define MF_DRBG_DEFAULT_RESEED_BYTES (256ULL << 20)
+#define MF_DRBG_DEFAULT_RESEED_MS 10000
+#define MF_DRBG_NOMINAL_BIT_RATE 8e9
+
+// Random bits for the coin of each alias method choice, so weights resolve to 1 in 2^32
+#define MF_ALIAS_COIN_BITS 32
+
+// Start of the tail of the normal (128 layer) and exponential (256 layer) ziggurats
+#define MF_ZIGGURAT_NORMAL_R 3.442619855899
+#define MF_ZIGGURAT_EXPONENTIAL_R 7.697117470131487
+
+// Fewest bits the SP 800-90B estimators are run on, enough for the compression estimator's dictionary
+// and the longest MultiMCW window to leave most of the samples for testing
+#define MF_MIN_ENTROPY_MIN_BITS (1 << 14)
+
+// Snapshots the bias monitor keeps per window, so each window slides a 1/60th of its length at a time
+#define MF_BIAS_WINDOW_BUCKETS 60
+
+// Most autocorrelation lags and most spectral peaks a spectral analysis reports
+#define MF_SPECTRAL_MAX_PEAKS 100
+
+// Coherence analysis block length and the margins either side of it (epochs): the backward filter pass
+// starts a margin past the block and the Hilbert transform covers a margin before and after it
+#define MF_COHERENCE_BLOCK_EPOCHS 2048
+#define MF_COHERENCE_MARGIN_EPOCHS 1024
+
+// Most points a random walk view may be decimated to
+#define MF_WALK_MAX_POINTS (1 << 16)
+
+// Bits per level 0 block of a walk pyramid (a multiple of 8), most levels it may have, and level 0 blocks
+// buffered between writes while recording
+#define MF_PYRAMID_BASE_BITS 4096
+#define MF_PYRAMID_MAX_LEVELS 48
+#define MF_PYRAMID_FLUSH_BLOCKS 256
+
+// Epoch length of the per-epoch summaries written alongside binary recordings (milliseconds)
+#define MF_RECORDING_EPOCH_MS 1000
+
+// Largest history a trial capture may keep (1GB)
+#define MF_CAPTURE_MAX_HISTORY_BYTES (1 << 30)
+
+// Default UDP port of the local trial trigger server
+#define MF_TRIGGER_DEFAULT_PORT 47474
+
 #define FTDI_DEVICE_HALF_OF_UNIFORM_LSB        1.7763568394002505e-15
 #define FTDI_DEVICE_2_PI                    6.283185307179586
 
@@ -0,0 +1,182 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "convert.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "recording.h"
+
+// Bytes of .hex text each thread decodes per batch
+#define MF_CONVERT_RANGE_BYTES (8 * 1024 * 1024)
+
+namespace MeterFeeder {
+    // The entries of a range of a .hex file: their bytes one after another, where each entry ends, and its time
+    struct DecodedRange {
+        std::vector<unsigned char> bytes;
+        std::vector<size_t> ends;
+        std::vector<int64_t> utcNs;
+        uint64_t skippedLines;
+    };
+
+    static void decodeRange(const char* text, size_t length, DecodedRange* range) {
+        range->bytes.clear();
+        range->ends.clear();
+        range->utcNs.clear();
+        range->skippedLines = 0;
+        range->bytes.reserve(length / 2);
+
+        const char* end = text + length;
+        for (const char* line = text; line < end; ) {
+            const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+            lineEnd = lineEnd != nullptr ? lineEnd + 1 : end;
+            int64_t utcNs = 0;
+            if (RecordingReader::ParseLine(line, lineEnd - line, &range->bytes, &utcNs)) {
+                range->ends.push_back(range->bytes.size());
+                range->utcNs.push_back(utcNs);
+            } else if (lineEnd - line > 2 || (*line != '\n' && *line != '\r')) {
+                range->skippedLines++;
+            }
+            line = lineEnd;
+        }
+    }
+}
+
+bool MeterFeeder::ConvertHexRecording(const std::string& hexPath, const std::string& basePath, double bitRate, unsigned threads,
+                                      ConversionStats* stats, std::string* errorReason) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ConversionStats counts = ConversionStats();
+    if (!(bitRate > 0)) {
+        *errorReason = "The bit rate must be positive";
+        return false;
+    }
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+    }
+
+    FILE* file = fopen(hexPath.c_str(), "rb");
+    if (file == nullptr) {
+        *errorReason = "Couldn't open " + hexPath;
+        return false;
+    }
+    RecordingWriter writer;
+    if (!writer.Open(basePath, errorReason)) {
+        fclose(file);
+        return false;
+    }
+
+    // Two batches, so one is written while the next is decoded
+    std::vector<char> text;
+    std::vector<DecodedRange> decoded[2] = { std::vector<DecodedRange>(threads), std::vector<DecodedRange>(threads) };
+    std::future<bool> writing;
+    std::string writeError;
+    double bitPeriodNs = 1e9 / bitRate;
+    int64_t followingUtcNs = 0;
+    auto write = [&](const std::vector<DecodedRange>& ranges) {
+        for (size_t r = 0; r < ranges.size(); r++) {
+            const DecodedRange& range = ranges[r];
+            size_t begin = 0;
+            for (size_t e = 0; e < range.ends.size(); e++) {
+                size_t length = range.ends[e] - begin;
+                int64_t utcNs = range.utcNs[e];
+                if (utcNs == 0) {
+                    utcNs = followingUtcNs;
+                    counts.untimedLines++;
+                }
+                if (length > 0 && !writer.Write(&range.bytes[begin], length, utcNs, bitPeriodNs, &writeError)) {
+                    return false;
+                }
+                followingUtcNs = utcNs + (int64_t)(length * 8 * bitPeriodNs);
+                begin = range.ends[e];
+            }
+            counts.lines += range.ends.size();
+            counts.skippedLines += range.skippedLines;
+            counts.bytes += range.bytes.size();
+        }
+        return true;
+    };
+
+    bool ok = true;
+    size_t carried = 0;
+    int batch = 0;
+    while (ok) {
+        // Read after the partial line left from the last batch, keeping this batch's for the next
+        size_t want = (size_t)MF_CONVERT_RANGE_BYTES * threads;
+        text.resize(carried + want);
+        size_t got = fread(&text[carried], 1, want, file);
+        if (got < want && ferror(file)) {
+            *errorReason = "Error reading " + hexPath;
+            ok = false;
+            break;
+        }
+        counts.hexBytes += got;
+        bool last = got < want;
+        size_t length = carried + got;
+        size_t usable = length;
+        if (!last) {
+            while (usable > 0 && text[usable - 1] != '\n') {
+                usable--;
+            }
+            if (usable == 0) {
+                // Not even a whole line yet
+                carried = length;
+                continue;
+            }
+        }
+
+        // Line-aligned ranges, a thread each
+        std::vector<size_t> bounds(threads + 1, usable);
+        bounds[0] = 0;
+        for (unsigned t = 1; t < threads; t++) {
+            size_t bound = std::max((size_t)((double)usable * t / threads), bounds[t - 1]);
+            const char* newline = bound < usable ? (const char*)memchr(text.data() + bound, '\n', usable - bound) : nullptr;
+            bounds[t] = newline != nullptr ? newline - text.data() + 1 : usable;
+        }
+        std::vector<DecodedRange>& ranges = decoded[batch];
+        std::vector<std::thread> decoders;
+        for (unsigned t = 0; t < threads; t++) {
+            decoders.push_back(std::thread(decodeRange, text.data() + bounds[t], bounds[t + 1] - bounds[t], &ranges[t]));
+        }
+        for (size_t t = 0; t < decoders.size(); t++) {
+            decoders[t].join();
+        }
+        memmove(text.data(), text.data() + usable, length - usable);
+        carried = length - usable;
+
+        // Finish writing the last batch before starting on this one
+        if (writing.valid() && !writing.get()) {
+            *errorReason = writeError;
+            ok = false;
+            break;
+        }
+        writing = std::async(std::launch::async, write, std::cref(ranges));
+        if (last) {
+            break;
+        }
+        batch ^= 1;
+    }
+    if (writing.valid() && !writing.get() && ok) {
+        *errorReason = writeError;
+        ok = false;
+    }
+    fclose(file);
+    std::string closeError;
+    if (!writer.Close(&closeError) && ok) {
+        *errorReason = closeError;
+        ok = false;
+    }
+
+    counts.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (stats != nullptr) {
+        *stats = counts;
+    }
+    return ok;
+}
@@ -0,0 +1,50 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace MeterFeeder {
+    /**
+     * What a conversion did.
+     */
+    struct ConversionStats {
+        // Bytes of the .hex file read
+        uint64_t hexBytes;
+
+        // Entries converted, and other or malformed lines skipped
+        uint64_t lines;
+        uint64_t skippedLines;
+
+        // Entries without a usable time, timed as following on from the entry before
+        uint64_t untimedLines;
+
+        // Bytes recorded
+        uint64_t bytes;
+
+        double seconds;
+    };
+
+    /**
+     * Convert a .hex recording (record_entropy.py's "[<UTC time of the first bit>] [<read time>] <hex>" lines)
+     * to a binary recording, as RecordingWriter writes them: <base>.bin with its .walk pyramid and .epochs
+     * summaries. The file is read a batch at a time, each batch split into line-aligned ranges decoded on
+     * their own threads, while the batch before is written out.
+     * 
+     * @param Path of the .hex file.
+     * @param Path of the binary recording without the extension. An existing recording is left alone.
+     * @param Bit rate of the generator (bits per second), to time the bits after each entry's first.
+     * @param Number of threads to decode on, 0 for one per core.
+     * @param Where to store what the conversion did (may be null).
+     * @param Error reason upon failure.
+     * 
+     * @return true on success, otherwise false.
+     */
+    bool ConvertHexRecording(const std::string& hexPath, const std::string& basePath, double bitRate, unsigned threads,
+                             ConversionStats* stats, std::string* errorReason);
+}
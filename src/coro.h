@@ -0,0 +1,505 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+// C++20 coroutine interface. Compiled in only when the compiler supports coroutines
+// (e.g. g++ -std=c++20), everything else in the library builds as C++11/17.
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L && __has_include(<coroutine>)
+#define MF_HAS_COROUTINES 1
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "driver.h"
+
+namespace MeterFeeder {
+    /**
+     * Minimal thread pool that resumes coroutines.
+     * A handful of threads can run any number of suspended tasks since a task only
+     * occupies a thread between its co_awaits.
+     */
+    class Executor {
+        public:
+            /**
+             * @param Number of worker threads.
+             */
+            explicit Executor(unsigned numThreads = 2) {
+                for (unsigned i = 0; i < numThreads; i++) {
+                    threads_.emplace_back([this]() { work(); });
+                }
+            }
+
+            ~Executor() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    stopping_ = true;
+                }
+                available_.notify_all();
+                for (size_t i = 0; i < threads_.size(); i++) {
+                    threads_[i].join();
+                }
+            }
+
+            /**
+             * Queue work to run on one of the worker threads.
+             */
+            void Post(std::function<void()> work) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    queue_.push_back(std::move(work));
+                }
+                available_.notify_one();
+            }
+
+            /**
+             * Awaitable moving the awaiting coroutine onto a worker thread: co_await executor.Schedule();
+             */
+            auto Schedule() {
+                struct ScheduleAwaitable {
+                    Executor* executor;
+                    bool await_ready() const noexcept { return false; }
+                    void await_suspend(std::coroutine_handle<> handle) { executor->Post([handle]() { handle.resume(); }); }
+                    void await_resume() const noexcept {}
+                };
+                return ScheduleAwaitable{ this };
+            }
+
+        private:
+            void work() {
+                for (;;) {
+                    std::function<void()> work;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        available_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+                        if (queue_.empty()) {
+                            return;
+                        }
+                        work = std::move(queue_.front());
+                        queue_.pop_front();
+                    }
+                    work();
+                }
+            }
+
+            std::mutex mutex_;
+            std::condition_variable available_;
+            std::deque<std::function<void()>> queue_;
+            std::vector<std::thread> threads_;
+            bool stopping_ = false;
+    };
+
+    /**
+     * Lazily started coroutine returning a T. Starts when awaited (or passed to SyncWait)
+     * and resumes its awaiter when done.
+     */
+    template <typename T>
+    class Task {
+        public:
+            struct promise_type {
+                T value{};
+                std::exception_ptr exception;
+                std::coroutine_handle<> continuation = std::noop_coroutine();
+
+                Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+                std::suspend_always initial_suspend() noexcept { return {}; }
+                auto final_suspend() noexcept {
+                    struct FinalAwaitable {
+                        bool await_ready() const noexcept { return false; }
+                        std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                            return handle.promise().continuation;
+                        }
+                        void await_resume() const noexcept {}
+                    };
+                    return FinalAwaitable{};
+                }
+                void return_value(T result) { value = std::move(result); }
+                void unhandled_exception() { exception = std::current_exception(); }
+            };
+
+            Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+            Task(const Task&) = delete;
+            ~Task() {
+                if (handle_) {
+                    handle_.destroy();
+                }
+            }
+
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+                handle_.promise().continuation = awaiter;
+                return handle_;
+            }
+            T await_resume() {
+                if (handle_.promise().exception) {
+                    std::rethrow_exception(handle_.promise().exception);
+                }
+                return std::move(handle_.promise().value);
+            }
+
+        private:
+            explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+            std::coroutine_handle<promise_type> handle_;
+    };
+
+    /**
+     * Coroutine yielding a sequence of values, each produced asynchronously.
+     * Consume with: while (co_await stream.Next()) { use(stream.Value()); }
+     */
+    template <typename T>
+    class AsyncGenerator {
+        public:
+            struct promise_type {
+                T* current = nullptr;
+                std::exception_ptr exception;
+                std::coroutine_handle<> consumer;
+
+                struct ResumeConsumer {
+                    bool await_ready() const noexcept { return false; }
+                    std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                        return handle.promise().consumer;
+                    }
+                    void await_resume() const noexcept {}
+                };
+
+                AsyncGenerator get_return_object() { return AsyncGenerator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+                std::suspend_always initial_suspend() noexcept { return {}; }
+                ResumeConsumer final_suspend() noexcept { current = nullptr; return {}; }
+                ResumeConsumer yield_value(T& value) noexcept { current = &value; return {}; }
+                void return_void() {}
+                void unhandled_exception() { exception = std::current_exception(); current = nullptr; }
+            };
+
+            AsyncGenerator(AsyncGenerator&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+            AsyncGenerator(const AsyncGenerator&) = delete;
+            ~AsyncGenerator() {
+                if (handle_) {
+                    handle_.destroy();
+                }
+            }
+
+            /**
+             * Awaitable resuming the generator until it yields the next value.
+             * Resumes to true if there is a value, false once the generator has finished.
+             */
+            auto Next() {
+                struct NextAwaitable {
+                    std::coroutine_handle<promise_type> producer;
+                    bool await_ready() const noexcept { return producer.done(); }
+                    std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer) noexcept {
+                        producer.promise().consumer = consumer;
+                        return producer;
+                    }
+                    bool await_resume() {
+                        if (producer.promise().exception) {
+                            std::rethrow_exception(producer.promise().exception);
+                        }
+                        return !producer.done() && producer.promise().current;
+                    }
+                };
+                return NextAwaitable{ handle_ };
+            }
+
+            /**
+             * Get the value yielded last.
+             */
+            T& Value() { return *handle_.promise().current; }
+
+        private:
+            explicit AsyncGenerator(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+            std::coroutine_handle<promise_type> handle_;
+    };
+
+    /**
+     * Result of an asynchronous read.
+     */
+    struct AsyncReadResult {
+        // MF_OK or the reason the read failed (see Reactor::Completion)
+        int status;
+
+        // Number of bytes stored
+        DWORD bytesRead;
+    };
+
+    /**
+     * A generator read through the driver's reactor from coroutines:
+     *
+     *     AsyncReadResult result = co_await generator.Read(span);
+     *
+     * The awaiting coroutine is suspended, not blocking a thread, until the data has arrived
+     * and is then resumed on the executor.
+     */
+    class AsyncGeneratorReader {
+        public:
+            /**
+             * @param The driver owning the generator.
+             * @param Handle of the generator.
+             * @param Executor to resume awaiting coroutines on.
+             * @param Time allowed for each read in milliseconds.
+             */
+            AsyncGeneratorReader(Driver* driver, FT_HANDLE handle, Executor* executor, DWORD timeoutMs = FTDI_DEVICE_TX_TIMEOUT_MS)
+                : driver_(driver), handle_(handle), executor_(executor), timeoutMs_(timeoutMs) {}
+
+            /**
+             * Awaitable filling the buffer with bytes of randomness.
+             * 
+             * @param Where to store the bytes. Must stay valid until the read finishes.
+             * @param true to purge and restart streaming first (fresh data like Driver::GetBytes),
+             *        false to continue the stream from the previous read.
+             */
+            auto Read(std::span<unsigned char> buffer, bool restart = true) {
+                struct ReadAwaitable {
+                    AsyncGeneratorReader* reader;
+                    std::span<unsigned char> buffer;
+                    bool restart;
+                    AsyncReadResult result{ MF_OK, 0 };
+
+                    bool await_ready() const noexcept { return false; }
+                    bool await_suspend(std::coroutine_handle<> handle) {
+                        std::string errorReason;
+                        Executor* executor = reader->executor_;
+                        uint64_t id = reader->driver_->SubmitRead(reader->handle_, (int)buffer.size(), buffer.data(), reader->timeoutMs_, restart,
+                            [this, executor, handle](uint64_t, int status, DWORD bytesRead) {
+                                result.status = status;
+                                result.bytesRead = bytesRead;
+                                executor->Post([handle]() { handle.resume(); });
+                            }, &errorReason);
+                        if (id == 0) {
+                            // Couldn't submit, carry on without suspending
+                            result.status = MF_GENERATOR_CLOSED;
+                            return false;
+                        }
+                        return true;
+                    }
+                    AsyncReadResult await_resume() const noexcept { return result; }
+                };
+                return ReadAwaitable{ this, buffer, restart };
+            }
+
+            /**
+             * Stream contiguous chunks of randomness. The next chunk is read ahead while the
+             * current one is being consumed, so the device's output is never left waiting.
+             * Finishes after the given number of chunks, or on the first failed read.
+             * The stream may be destroyed before it finishes: a read-ahead still queued is then
+             * cancelled, and one already under way waited for, so destroying it blocks briefly
+             * and mustn't be done from a reactor completion.
+             * 
+             * @param Chunk size in bytes.
+             * @param Number of chunks, 0 for no limit.
+             */
+            AsyncGenerator<std::span<unsigned char>> Chunks(size_t chunkSize, uint64_t numChunks = 0) {
+                std::vector<unsigned char> buffers[2] = { std::vector<unsigned char>(chunkSize), std::vector<unsigned char>(chunkSize) };
+                AsyncReadResult results[2];
+                std::atomic<int> pending[2] = { 0, 0 };
+                std::coroutine_handle<> waiting[2];
+                uint64_t ids[2] = { 0, 0 };
+                std::mutex mutex;
+                std::condition_variable finished;
+
+                // Destroyed before the buffers, including when the stream is abandoned mid-flight, so no
+                // read-ahead's completion writes into them or the frame once they're gone
+                struct ReadAheadGuard {
+                    Driver* driver;
+                    uint64_t* ids;
+                    std::atomic<int>* pending;
+                    std::coroutine_handle<>* waiting;
+                    std::mutex* mutex;
+                    std::condition_variable* finished;
+                    ~ReadAheadGuard() {
+                        {
+                            std::lock_guard<std::mutex> lock(*mutex);
+                            waiting[0] = nullptr;
+                            waiting[1] = nullptr;
+                        }
+                        for (int b = 0; b < 2; b++) {
+                            if (pending[b] != 0) {
+                                driver->CancelRead(ids[b]);
+                            }
+                        }
+                        std::unique_lock<std::mutex> lock(*mutex);
+                        finished->wait(lock, [this]() { return pending[0] == 0 && pending[1] == 0; });
+                    }
+                };
+                ReadAheadGuard guard{ driver_, ids, pending, waiting, &mutex, &finished };
+
+                // Read-ahead is plain reactor submission; the generator only suspends when the chunk it
+                // needs next hasn't arrived yet
+                auto submit = [&](int b, bool restart) {
+                    pending[b] = 1;
+                    std::string errorReason;
+                    uint64_t id = driver_->SubmitRead(handle_, (int)chunkSize, buffers[b].data(), timeoutMs_, restart,
+                        [&, b](uint64_t, int status, DWORD bytesRead) {
+                            std::coroutine_handle<> resume;
+                            {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                results[b].status = status;
+                                results[b].bytesRead = bytesRead;
+                                pending[b] = 0;
+                                resume = std::exchange(waiting[b], nullptr);
+                                finished.notify_all();
+                            }
+                            if (resume) {
+                                executor_->Post([resume]() { resume.resume(); });
+                            }
+                        }, &errorReason);
+                    if (id == 0) {
+                        results[b].status = MF_GENERATOR_CLOSED;
+                        results[b].bytesRead = 0;
+                        pending[b] = 0;
+                    }
+                    ids[b] = id;
+                };
+                struct ChunkAwaitable {
+                    int b;
+                    std::atomic<int>* pending;
+                    std::coroutine_handle<>* waiting;
+                    std::mutex* mutex;
+                    bool await_ready() const noexcept { return pending[b] == 0; }
+                    bool await_suspend(std::coroutine_handle<> handle) {
+                        std::lock_guard<std::mutex> lock(*mutex);
+                        if (pending[b] == 0) {
+                            return false;
+                        }
+                        waiting[b] = handle;
+                        return true;
+                    }
+                    void await_resume() const noexcept {}
+                };
+
+                submit(0, true);
+                for (uint64_t chunk = 0; numChunks == 0 || chunk < numChunks; chunk++) {
+                    int b = chunk % 2;
+                    if (numChunks == 0 || chunk + 1 < numChunks) {
+                        submit(1 - b, false);
+                    }
+                    co_await ChunkAwaitable{ b, pending, waiting, &mutex };
+                    if (results[b].status != MF_OK) {
+                        break;
+                    }
+                    std::span<unsigned char> chunkSpan(buffers[b].data(), results[b].bytesRead);
+                    co_yield chunkSpan;
+                }
+
+                // Don't leave a read-ahead writing into the buffers after they're gone
+                co_await ChunkAwaitable{ 0, pending, waiting, &mutex };
+                co_await ChunkAwaitable{ 1, pending, waiting, &mutex };
+            }
+
+        private:
+            Driver* driver_;
+            FT_HANDLE handle_;
+            Executor* executor_;
+            DWORD timeoutMs_;
+    };
+
+    /**
+     * Eagerly started coroutine nobody awaits, for kicking off tasks from ordinary code.
+     */
+    struct DetachedTask {
+        struct promise_type {
+            DetachedTask get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    template <typename T>
+    DetachedTask whenAllRun(Task<T>& task, T* result, std::exception_ptr* exception, std::atomic<size_t>* remaining,
+                            std::coroutine_handle<> continuation) {
+        try {
+            *result = co_await std::move(task);
+        } catch (...) {
+            *exception = std::current_exception();
+        }
+        if (--*remaining == 0) {
+            continuation.resume();
+        }
+    }
+
+    /**
+     * Run tasks concurrently and resume once all of them have finished.
+     * Each task starts on the awaiting thread and runs until its first suspension.
+     * 
+     * @return The tasks' results, in order. Rethrows an exception thrown by any of them.
+     */
+    template <typename T>
+    Task<std::vector<T>> WhenAll(std::vector<Task<T>> tasks) {
+        // Not a vector<T> since vector<bool> elements can't be pointed to
+        std::unique_ptr<T[]> results(new T[tasks.size()]());
+        std::vector<std::exception_ptr> exceptions(tasks.size());
+        std::atomic<size_t> remaining(tasks.size() + 1);
+
+        struct AllAwaitable {
+            std::vector<Task<T>>* tasks;
+            T* results;
+            std::vector<std::exception_ptr>* exceptions;
+            std::atomic<size_t>* remaining;
+
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> handle) {
+                for (size_t i = 0; i < tasks->size(); i++) {
+                    whenAllRun(tasks->at(i), &results[i], &exceptions->at(i), remaining, handle);
+                }
+                // Don't suspend if every task already finished
+                return --*remaining != 0;
+            }
+            void await_resume() const noexcept {}
+        };
+        co_await AllAwaitable{ &tasks, results.get(), &exceptions, &remaining };
+
+        for (size_t i = 0; i < exceptions.size(); i++) {
+            if (exceptions[i]) {
+                std::rethrow_exception(exceptions[i]);
+            }
+        }
+        co_return std::vector<T>(results.get(), results.get() + tasks.size());
+    }
+
+    /**
+     * Run a task to completion from ordinary (non-coroutine) code, blocking the calling thread.
+     */
+    template <typename T>
+    T SyncWait(Task<T> task) {
+        std::mutex mutex;
+        std::condition_variable done;
+        bool finished = false;
+        T value{};
+        std::exception_ptr exception;
+
+        auto run = [&]() -> DetachedTask {
+            try {
+                value = co_await std::move(task);
+            } catch (...) {
+                exception = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+            done.notify_all();
+        };
+        run();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&]() { return finished; });
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        return value;
+    }
+}
+
+#endif
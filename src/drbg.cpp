@@ -0,0 +1,586 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "drbg.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MF_DRBG_SSE2
+#include <emmintrin.h>
+#endif
+
+// AES-NI and AVX2 are picked at runtime, so they're compiled in for any x86 target
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define MF_DRBG_AESNI
+#define MF_DRBG_AVX2
+#include <immintrin.h>
+#include <wmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <stdlib.h>
+#define MF_AESNI_TARGET
+#define MF_AVX2_TARGET
+#define MF_BSWAP64(v) _byteswap_uint64(v)
+#else
+#define MF_AESNI_TARGET __attribute__((target("aes,sse2")))
+#define MF_AVX2_TARGET __attribute__((target("avx2")))
+#define MF_BSWAP64(v) __builtin_bswap64(v)
+#endif
+#endif
+
+// Device bytes per seed, two 256-bit keys' worth mixed in one after the other
+#define MF_DRBG_SEED_BYTES 64
+
+#define MF_ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define MF_CHACHA_QUARTERROUND(a, b, c, d) \
+    a += b; d ^= a; d = MF_ROTL32(d, 16);  \
+    c += d; b ^= c; b = MF_ROTL32(b, 12);  \
+    a += b; d ^= a; d = MF_ROTL32(d, 8);   \
+    c += d; b ^= c; b = MF_ROTL32(b, 7);
+
+namespace MeterFeeder {
+    // One 64 byte ChaCha20 block (D. J. Bernstein, "ChaCha, a variant of Salsa20", 2008)
+    static void chachaBlock(const uint32_t in[16], UCHAR out[64]) {
+        uint32_t x[16];
+        memcpy(x, in, sizeof(x));
+        for (int i = 0; i < 10; i++) {
+            MF_CHACHA_QUARTERROUND(x[0], x[4], x[8], x[12]);
+            MF_CHACHA_QUARTERROUND(x[1], x[5], x[9], x[13]);
+            MF_CHACHA_QUARTERROUND(x[2], x[6], x[10], x[14]);
+            MF_CHACHA_QUARTERROUND(x[3], x[7], x[11], x[15]);
+            MF_CHACHA_QUARTERROUND(x[0], x[5], x[10], x[15]);
+            MF_CHACHA_QUARTERROUND(x[1], x[6], x[11], x[12]);
+            MF_CHACHA_QUARTERROUND(x[2], x[7], x[8], x[13]);
+            MF_CHACHA_QUARTERROUND(x[3], x[4], x[9], x[14]);
+        }
+        for (int i = 0; i < 16; i++) {
+            uint32_t word = x[i] + in[i];
+            out[i * 4] = (UCHAR)word;
+            out[i * 4 + 1] = (UCHAR)(word >> 8);
+            out[i * 4 + 2] = (UCHAR)(word >> 16);
+            out[i * 4 + 3] = (UCHAR)(word >> 24);
+        }
+    }
+
+#ifdef MF_DRBG_SSE2
+#define MF_ROTL32X4(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+#define MF_CHACHA_QUARTERROUNDX4(a, b, c, d)                                               \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = MF_ROTL32X4(d, 16);              \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = MF_ROTL32X4(b, 12);              \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = MF_ROTL32X4(d, 8);               \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = MF_ROTL32X4(b, 7);
+
+    // Four consecutive ChaCha20 blocks at once, lane i of each register holding a word of block i
+    static void chachaBlocks4(const uint32_t in[16], UCHAR out[256]) {
+        uint64_t counter = in[12] | ((uint64_t)in[13] << 32);
+        __m128i counterLow = _mm_set_epi32((int)(uint32_t)(counter + 3), (int)(uint32_t)(counter + 2), (int)(uint32_t)(counter + 1),
+                                           (int)(uint32_t)counter);
+        __m128i counterHigh = _mm_set_epi32((int)(uint32_t)((counter + 3) >> 32), (int)(uint32_t)((counter + 2) >> 32),
+                                            (int)(uint32_t)((counter + 1) >> 32), (int)(uint32_t)(counter >> 32));
+        __m128i x[16];
+        for (int i = 0; i < 16; i++) {
+            x[i] = _mm_set1_epi32((int)in[i]);
+        }
+        x[12] = counterLow;
+        x[13] = counterHigh;
+
+        for (int i = 0; i < 10; i++) {
+            MF_CHACHA_QUARTERROUNDX4(x[0], x[4], x[8], x[12]);
+            MF_CHACHA_QUARTERROUNDX4(x[1], x[5], x[9], x[13]);
+            MF_CHACHA_QUARTERROUNDX4(x[2], x[6], x[10], x[14]);
+            MF_CHACHA_QUARTERROUNDX4(x[3], x[7], x[11], x[15]);
+            MF_CHACHA_QUARTERROUNDX4(x[0], x[5], x[10], x[15]);
+            MF_CHACHA_QUARTERROUNDX4(x[1], x[6], x[11], x[12]);
+            MF_CHACHA_QUARTERROUNDX4(x[2], x[7], x[8], x[13]);
+            MF_CHACHA_QUARTERROUNDX4(x[3], x[4], x[9], x[14]);
+        }
+
+        // Transpose each group of four words from lanes to blocks (x86 is little-endian, so no byte swaps)
+        for (int i = 0; i < 16; i++) {
+            x[i] = _mm_add_epi32(x[i], i == 12 ? counterLow : i == 13 ? counterHigh : _mm_set1_epi32((int)in[i]));
+        }
+        for (int g = 0; g < 16; g += 4) {
+            __m128i a = x[g], b = x[g + 1], c = x[g + 2], d = x[g + 3];
+            __m128i ab01 = _mm_unpacklo_epi32(a, b), cd01 = _mm_unpacklo_epi32(c, d);
+            __m128i ab23 = _mm_unpackhi_epi32(a, b), cd23 = _mm_unpackhi_epi32(c, d);
+            _mm_storeu_si128((__m128i*)(out + g * 4), _mm_unpacklo_epi64(ab01, cd01));
+            _mm_storeu_si128((__m128i*)(out + 64 + g * 4), _mm_unpackhi_epi64(ab01, cd01));
+            _mm_storeu_si128((__m128i*)(out + 128 + g * 4), _mm_unpacklo_epi64(ab23, cd23));
+            _mm_storeu_si128((__m128i*)(out + 192 + g * 4), _mm_unpackhi_epi64(ab23, cd23));
+        }
+    }
+#endif
+
+#ifdef MF_DRBG_AVX2
+    static bool cpuHasAvx2() {
+#ifdef _MSC_VER
+        // Also needs the OS to save the YMM registers
+        int registers[4];
+        __cpuid(registers, 1);
+        if ((registers[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6) {
+            return false;
+        }
+        __cpuidex(registers, 7, 0);
+        return (registers[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+
+#define MF_ROTL32X8(v, n) _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - (n)))
+#define MF_CHACHA_QUARTERROUNDX8(a, b, c, d)                                                                   \
+    a = _mm256_add_epi32(a, b); d = _mm256_xor_si256(d, a); d = _mm256_shuffle_epi8(d, rotate16);              \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = MF_ROTL32X8(b, 12);                            \
+    a = _mm256_add_epi32(a, b); d = _mm256_xor_si256(d, a); d = _mm256_shuffle_epi8(d, rotate8);               \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = MF_ROTL32X8(b, 7);
+
+    // Eight consecutive ChaCha20 blocks at once, like chachaBlocks4 but with the byte rotations as shuffles
+    MF_AVX2_TARGET static void chachaBlocks8(const uint32_t in[16], UCHAR out[512]) {
+        const __m256i rotate16 = _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+                                                 13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+        const __m256i rotate8 = _mm256_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3,
+                                                14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+        uint64_t counter = in[12] | ((uint64_t)in[13] << 32);
+        alignas(32) uint32_t low[8], high[8];
+        for (int i = 0; i < 8; i++) {
+            low[i] = (uint32_t)(counter + i);
+            high[i] = (uint32_t)((counter + i) >> 32);
+        }
+        __m256i counterLow = _mm256_load_si256((const __m256i*)low);
+        __m256i counterHigh = _mm256_load_si256((const __m256i*)high);
+        __m256i x[16];
+        for (int i = 0; i < 16; i++) {
+            x[i] = _mm256_set1_epi32((int)in[i]);
+        }
+        x[12] = counterLow;
+        x[13] = counterHigh;
+
+        for (int i = 0; i < 10; i++) {
+            MF_CHACHA_QUARTERROUNDX8(x[0], x[4], x[8], x[12]);
+            MF_CHACHA_QUARTERROUNDX8(x[1], x[5], x[9], x[13]);
+            MF_CHACHA_QUARTERROUNDX8(x[2], x[6], x[10], x[14]);
+            MF_CHACHA_QUARTERROUNDX8(x[3], x[7], x[11], x[15]);
+            MF_CHACHA_QUARTERROUNDX8(x[0], x[5], x[10], x[15]);
+            MF_CHACHA_QUARTERROUNDX8(x[1], x[6], x[11], x[12]);
+            MF_CHACHA_QUARTERROUNDX8(x[2], x[7], x[8], x[13]);
+            MF_CHACHA_QUARTERROUNDX8(x[3], x[4], x[9], x[14]);
+        }
+
+        for (int i = 0; i < 16; i++) {
+            x[i] = _mm256_add_epi32(x[i], i == 12 ? counterLow : i == 13 ? counterHigh : _mm256_set1_epi32((int)in[i]));
+        }
+        // The unpacks work within each 128-bit half, so the low halves give blocks 0-3 and the high halves 4-7
+        for (int g = 0; g < 16; g += 4) {
+            __m256i ab01 = _mm256_unpacklo_epi32(x[g], x[g + 1]), cd01 = _mm256_unpacklo_epi32(x[g + 2], x[g + 3]);
+            __m256i ab23 = _mm256_unpackhi_epi32(x[g], x[g + 1]), cd23 = _mm256_unpackhi_epi32(x[g + 2], x[g + 3]);
+            __m256i blocks[4] = { _mm256_unpacklo_epi64(ab01, cd01), _mm256_unpackhi_epi64(ab01, cd01),
+                                  _mm256_unpacklo_epi64(ab23, cd23), _mm256_unpackhi_epi64(ab23, cd23) };
+            for (int b = 0; b < 4; b++) {
+                _mm_storeu_si128((__m128i*)(out + b * 64 + g * 4), _mm256_castsi256_si128(blocks[b]));
+                _mm_storeu_si128((__m128i*)(out + (b + 4) * 64 + g * 4), _mm256_extracti128_si256(blocks[b], 1));
+            }
+        }
+    }
+#endif
+
+#ifdef MF_DRBG_AESNI
+    static bool cpuHasAesNi() {
+#ifdef _MSC_VER
+        int registers[4];
+        __cpuid(registers, 1);
+        return (registers[2] & (1 << 25)) != 0;
+#else
+        return __builtin_cpu_supports("aes");
+#endif
+    }
+
+#define MF_AES256_EXPAND_A(k1, k2, rcon, out)                                                    \
+    t = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(k2, rcon), 0xff);                            \
+    k1 = _mm_xor_si128(k1, _mm_slli_si128(k1, 4));                                               \
+    k1 = _mm_xor_si128(k1, _mm_slli_si128(k1, 4));                                               \
+    k1 = _mm_xor_si128(k1, _mm_slli_si128(k1, 4));                                               \
+    k1 = _mm_xor_si128(k1, t);                                                                   \
+    out = k1;
+#define MF_AES256_EXPAND_B(k1, k2, out)                                                          \
+    t = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(k1, 0), 0xaa);                               \
+    k2 = _mm_xor_si128(k2, _mm_slli_si128(k2, 4));                                               \
+    k2 = _mm_xor_si128(k2, _mm_slli_si128(k2, 4));                                               \
+    k2 = _mm_xor_si128(k2, _mm_slli_si128(k2, 4));                                               \
+    k2 = _mm_xor_si128(k2, t);                                                                   \
+    out = k2;
+
+    // AES-256 key schedule (FIPS 197), 15 round keys
+    MF_AESNI_TARGET static void aesExpandKey(const UCHAR key[32], UCHAR roundKeys[15 * 16]) {
+        __m128i* rk = (__m128i*)roundKeys;
+        __m128i k1 = _mm_loadu_si128((const __m128i*)key);
+        __m128i k2 = _mm_loadu_si128((const __m128i*)(key + 16));
+        __m128i t;
+        rk[0] = k1;
+        rk[1] = k2;
+        MF_AES256_EXPAND_A(k1, k2, 0x01, rk[2]); MF_AES256_EXPAND_B(k1, k2, rk[3]);
+        MF_AES256_EXPAND_A(k1, k2, 0x02, rk[4]); MF_AES256_EXPAND_B(k1, k2, rk[5]);
+        MF_AES256_EXPAND_A(k1, k2, 0x04, rk[6]); MF_AES256_EXPAND_B(k1, k2, rk[7]);
+        MF_AES256_EXPAND_A(k1, k2, 0x08, rk[8]); MF_AES256_EXPAND_B(k1, k2, rk[9]);
+        MF_AES256_EXPAND_A(k1, k2, 0x10, rk[10]); MF_AES256_EXPAND_B(k1, k2, rk[11]);
+        MF_AES256_EXPAND_A(k1, k2, 0x20, rk[12]); MF_AES256_EXPAND_B(k1, k2, rk[13]);
+        MF_AES256_EXPAND_A(k1, k2, 0x40, rk[14]);
+    }
+
+    static uint64_t loadBigEndian64(const UCHAR* bytes) {
+        uint64_t value = 0;
+        for (int i = 0; i < 8; i++) {
+            value = (value << 8) | bytes[i];
+        }
+        return value;
+    }
+
+    static void storeBigEndian64(uint64_t value, UCHAR* bytes) {
+        for (int i = 7; i >= 0; i--) {
+            bytes[i] = (UCHAR)value;
+            value >>= 8;
+        }
+    }
+
+    // The counter block offset blocks on from high:low, big-endian
+    MF_AESNI_TARGET static inline __m128i counterBlock(uint64_t high, uint64_t low, uint64_t offset) {
+        uint64_t blockLow = low + offset;
+        uint64_t blockHigh = high + (blockLow < low ? 1 : 0);
+        return _mm_set_epi64x((long long)MF_BSWAP64(blockLow), (long long)MF_BSWAP64(blockHigh));
+    }
+
+#define MF_AES_EACH8(op) op(0) op(1) op(2) op(3) op(4) op(5) op(6) op(7)
+#define MF_AES_START(b) __m128i x##b = _mm_xor_si128(counterBlock(high, low, b), key);
+#define MF_AES_ROUND(b) x##b = _mm_aesenc_si128(x##b, key);
+#define MF_AES_LAST(b) x##b = _mm_aesenclast_si128(x##b, key);
+#define MF_AES_STORE(b) _mm_storeu_si128((__m128i*)(dest + b * 16), x##b);
+
+    // Encrypt numBlocks successive counter blocks, eight at a time to keep the AES unit busy
+    MF_AESNI_TARGET static void aesCtrBlocks(const UCHAR roundKeys[15 * 16], UCHAR counter[16], UCHAR* out, size_t numBlocks) {
+        const __m128i* rk = (const __m128i*)roundKeys;
+        uint64_t high = loadBigEndian64(counter), low = loadBigEndian64(counter + 8);
+        UCHAR partial[8 * 16];
+        while (numBlocks > 0) {
+            size_t n = numBlocks < 8 ? numBlocks : 8;
+            __m128i key = rk[0];
+            MF_AES_EACH8(MF_AES_START)
+            for (int r = 1; r < 14; r++) {
+                key = rk[r];
+                MF_AES_EACH8(MF_AES_ROUND)
+            }
+            key = rk[14];
+            MF_AES_EACH8(MF_AES_LAST)
+
+            // Only the counters of the blocks kept are used up
+            UCHAR* dest = n == 8 ? out : partial;
+            MF_AES_EACH8(MF_AES_STORE)
+            if (n < 8) {
+                memcpy(out, partial, n * 16);
+            }
+            uint64_t previousLow = low;
+            low += n;
+            if (low < previousLow) {
+                high++;
+            }
+            out += n * 16;
+            numBlocks -= n;
+        }
+        storeBigEndian64(high, counter);
+        storeBigEndian64(low, counter + 8);
+    }
+#endif
+
+    // RFC 8439 section 2.3.2: key 00..1f, nonce 00:00:00:09:00:00:00:4a:00:00:00:00, block counter 1
+    static const UCHAR chachaKnownBlock[64] = {
+        0x10, 0xf1, 0xe7, 0xe4, 0xd1, 0x3b, 0x59, 0x15, 0x50, 0x0f, 0xdd, 0x1f, 0xa3, 0x20, 0x71, 0xc4,
+        0xc7, 0xd1, 0xf4, 0xc7, 0x33, 0xc0, 0x68, 0x03, 0x04, 0x22, 0xaa, 0x9a, 0xc3, 0xd4, 0x6c, 0x4e,
+        0xd2, 0x82, 0x64, 0x46, 0x07, 0x9f, 0xaa, 0x09, 0x14, 0xc2, 0xd7, 0x05, 0xd9, 0x8b, 0x02, 0xa2,
+        0xb5, 0x12, 0x9c, 0xd1, 0xde, 0x16, 0x4e, 0xb9, 0xcb, 0xd0, 0x83, 0xe8, 0xa2, 0x50, 0x3c, 0x4e,
+    };
+
+#ifdef MF_DRBG_AESNI
+    // SP 800-38A F.5.5 (CTR-AES256.Encrypt)
+    static const UCHAR aesKnownKey[32] = {
+        0x60, 0x3d, 0xeb, 0x10, 0x15, 0xca, 0x71, 0xbe, 0x2b, 0x73, 0xae, 0xf0, 0x85, 0x7d, 0x77, 0x81,
+        0x1f, 0x35, 0x2c, 0x07, 0x3b, 0x61, 0x08, 0xd7, 0x2d, 0x98, 0x10, 0xa3, 0x09, 0x14, 0xdf, 0xf4,
+    };
+    static const UCHAR aesKnownCounter[16] = {
+        0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff,
+    };
+    static const UCHAR aesKnownPlaintext[64] = {
+        0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+        0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+        0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+        0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10,
+    };
+    static const UCHAR aesKnownCiphertext[64] = {
+        0x60, 0x1e, 0xc3, 0x13, 0x77, 0x57, 0x89, 0xa5, 0xb7, 0xa7, 0xf5, 0x04, 0xbb, 0xf3, 0xd2, 0x28,
+        0xf4, 0x43, 0xe3, 0xca, 0x4d, 0x62, 0xb5, 0x9a, 0xca, 0x84, 0xe9, 0x90, 0xca, 0xca, 0xf5, 0xc5,
+        0x2b, 0x09, 0x30, 0xda, 0xa2, 0x3d, 0xe9, 0x4c, 0xe8, 0x70, 0x17, 0xba, 0x2d, 0x84, 0x98, 0x8d,
+        0xdf, 0xc9, 0xc5, 0x8d, 0xb6, 0x7a, 0xad, 0xa6, 0x13, 0xc2, 0xdd, 0x08, 0x45, 0x79, 0x41, 0xa6,
+    };
+#endif
+}
+
+MeterFeeder::DrbgSource::DrbgSource(DrbgAlgorithm algorithm, Seeder seeder, uint64_t reseedBytes, DWORD reseedMs) {
+    algorithm_ = algorithm;
+    seeder_ = seeder;
+    reseedBytes_ = reseedBytes;
+    reseedMs_ = reseedMs;
+#ifdef MF_DRBG_AVX2
+    useAvx2_ = cpuHasAvx2();
+#endif
+
+    UCHAR zeroKey[32] = {0};
+    rekey(zeroKey);
+    seededAt_ = std::chrono::steady_clock::now();
+}
+
+bool MeterFeeder::DrbgSource::IsSupported(DrbgAlgorithm algorithm) {
+    if (algorithm == DRBG_CHACHA20) {
+        return true;
+    }
+#ifdef MF_DRBG_AESNI
+    return algorithm == DRBG_AES_CTR && cpuHasAesNi();
+#else
+    return false;
+#endif
+}
+
+// Each multi-block path is run from the RFC's counter, whose first block it must reproduce, and from just
+// before the low counter word wraps; its other blocks must match the scalar code's at the same counters
+bool MeterFeeder::DrbgSource::SelfTest(std::string* checked, std::string* errorReason) {
+    uint32_t state[16] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };
+    for (int i = 0; i < 8; i++) {
+        state[4 + i] = (uint32_t)(i * 4) | ((uint32_t)(i * 4 + 1) << 8) | ((uint32_t)(i * 4 + 2) << 16) | ((uint32_t)(i * 4 + 3) << 24);
+    }
+    state[12] = 1;
+    state[13] = 0x09000000;
+    state[14] = 0x4a000000;
+    state[15] = 0;
+
+    UCHAR block[64];
+    chachaBlock(state, block);
+    if (memcmp(block, chachaKnownBlock, sizeof(block)) != 0) {
+        *errorReason = "ChaCha20 scalar block doesn't match RFC 8439";
+        return false;
+    }
+    *checked = "ChaCha20 scalar";
+
+    const uint32_t firstCounters[2] = { 1, 0xfffffffd };
+    for (int run = 0; run < 2; run++) {
+        state[12] = firstCounters[run];
+        state[13] = 0x09000000;
+        UCHAR expected[512];
+        uint32_t blockState[16];
+        memcpy(blockState, state, sizeof(blockState));
+        for (int b = 0; b < 8; b++) {
+            chachaBlock(blockState, expected + b * 64);
+            if (++blockState[12] == 0) {
+                blockState[13]++;
+            }
+        }
+        UCHAR out[512];
+#ifdef MF_DRBG_SSE2
+        chachaBlocks4(state, out);
+        if (memcmp(out, expected, 256) != 0 || (run == 0 && memcmp(out, chachaKnownBlock, 64) != 0)) {
+            *errorReason = "ChaCha20 SSE2 blocks don't match RFC 8439";
+            return false;
+        }
+#endif
+#ifdef MF_DRBG_AVX2
+        if (cpuHasAvx2()) {
+            chachaBlocks8(state, out);
+            if (memcmp(out, expected, 512) != 0 || (run == 0 && memcmp(out, chachaKnownBlock, 64) != 0)) {
+                *errorReason = "ChaCha20 AVX2 blocks don't match RFC 8439";
+                return false;
+            }
+        }
+#endif
+    }
+#ifdef MF_DRBG_SSE2
+    *checked += ", ChaCha20 SSE2";
+#endif
+#ifdef MF_DRBG_AVX2
+    if (cpuHasAvx2()) {
+        *checked += ", ChaCha20 AVX2";
+    }
+#endif
+
+#ifdef MF_DRBG_AESNI
+    // Four blocks go through the partial batch, eight through a full one
+    if (cpuHasAesNi()) {
+        alignas(16) UCHAR roundKeys[15 * 16];
+        aesExpandKey(aesKnownKey, roundKeys);
+        for (size_t numBlocks = 4; numBlocks <= 8; numBlocks += 4) {
+            UCHAR counter[16];
+            memcpy(counter, aesKnownCounter, sizeof(counter));
+            UCHAR out[8 * 16];
+            aesCtrBlocks(roundKeys, counter, out, numBlocks);
+            for (size_t i = 0; i < sizeof(aesKnownPlaintext); i++) {
+                out[i] ^= aesKnownPlaintext[i];
+            }
+            if (memcmp(out, aesKnownCiphertext, sizeof(aesKnownCiphertext)) != 0) {
+                *errorReason = "AES-256-CTR doesn't match SP 800-38A";
+                return false;
+            }
+        }
+        *checked += ", AES-256-CTR AES-NI";
+    }
+#endif
+    return true;
+}
+
+bool MeterFeeder::DrbgSource::Reseed(std::string* errorReason) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return reseed(errorReason);
+}
+
+uint64_t MeterFeeder::DrbgSource::GetBytesGenerated() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytesGenerated_;
+}
+
+uint64_t MeterFeeder::DrbgSource::GetReseedCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return reseedCount_;
+}
+
+int MeterFeeder::DrbgSource::StartStreaming() {
+    return MF_OK;
+}
+
+int MeterFeeder::DrbgSource::StopStreaming() {
+    return MF_OK;
+}
+
+// Any read can be met at once, so the reactor reads whole requests. Being on demand, this isn't taken as a backlog
+int MeterFeeder::DrbgSource::GetQueueStatus(DWORD* bytesAvailable) {
+    *bytesAvailable = MF_MAX_READ_LENGTH;
+    return MF_OK;
+}
+
+int MeterFeeder::DrbgSource::Read(DWORD length, UCHAR* dxData, DWORD* bytesRxd, DWORD /* timeoutMs: never waits */) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    *bytesRxd = 0;
+
+    bool bytesSpent = reseedBytes_ > 0 && bytesSinceSeed_ >= reseedBytes_;
+    bool timeSpent = reseedMs_ > 0 && std::chrono::steady_clock::now() - seededAt_ >= std::chrono::milliseconds(reseedMs_);
+    if (reseedCount_ == 0 || bytesSpent || timeSpent) {
+        lastError_.clear();
+        if (!reseed(&lastError_)) {
+            return MF_RESEED_FAILED;
+        }
+    }
+
+    generate(dxData, length);
+    *bytesRxd = length;
+    bytesGenerated_ += length;
+    bytesSinceSeed_ += length;
+
+    // Fast key erasure: nothing left in the state can reproduce what was just handed out
+    UCHAR nextKey[32];
+    generate(nextKey, sizeof(nextKey));
+    rekey(nextKey);
+    memset(nextKey, 0, sizeof(nextKey));
+    return MF_OK;
+}
+
+std::string MeterFeeder::DrbgSource::GetLastError() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lastError_;
+}
+
+// Mix a seed into the key: each half of it is XORed with fresh keystream to make the next key,
+// so the state keeps whatever entropy it had even if a seed turns out to be poor
+bool MeterFeeder::DrbgSource::reseed(std::string* errorReason) {
+    UCHAR seed[MF_DRBG_SEED_BYTES];
+    if (!seeder_(seed, sizeof(seed), errorReason)) {
+        return false;
+    }
+
+    for (size_t half = 0; half < sizeof(seed); half += 32) {
+        UCHAR key[32];
+        generate(key, sizeof(key));
+        for (int i = 0; i < 32; i++) {
+            key[i] ^= seed[half + i];
+        }
+        rekey(key);
+        memset(key, 0, sizeof(key));
+    }
+    memset(seed, 0, sizeof(seed));
+
+    reseedCount_++;
+    bytesSinceSeed_ = 0;
+    seededAt_ = std::chrono::steady_clock::now();
+    return true;
+}
+
+// Keystream from the current key and counter; a partly used last block is dropped
+void MeterFeeder::DrbgSource::generate(UCHAR* out, size_t length) {
+#ifdef MF_DRBG_AESNI
+    if (algorithm_ == DRBG_AES_CTR) {
+        size_t wholeBlocks = length / 16;
+        aesCtrBlocks(aesRoundKeys_, aesCounter_, out, wholeBlocks);
+        if (length % 16 != 0) {
+            UCHAR block[16];
+            aesCtrBlocks(aesRoundKeys_, aesCounter_, block, 1);
+            memcpy(out + wholeBlocks * 16, block, length % 16);
+        }
+        return;
+    }
+#endif
+
+    size_t done = 0;
+#ifdef MF_DRBG_AVX2
+    for (; useAvx2_ && length - done >= 512; done += 512) {
+        chachaBlocks8(chacha_, out + done);
+        uint64_t counter = (chacha_[12] | ((uint64_t)chacha_[13] << 32)) + 8;
+        chacha_[12] = (uint32_t)counter;
+        chacha_[13] = (uint32_t)(counter >> 32);
+    }
+#endif
+#ifdef MF_DRBG_SSE2
+    for (; length - done >= 256; done += 256) {
+        chachaBlocks4(chacha_, out + done);
+        uint64_t counter = (chacha_[12] | ((uint64_t)chacha_[13] << 32)) + 4;
+        chacha_[12] = (uint32_t)counter;
+        chacha_[13] = (uint32_t)(counter >> 32);
+    }
+#endif
+    while (done < length) {
+        UCHAR block[64];
+        chachaBlock(chacha_, block);
+        if (++chacha_[12] == 0) {
+            chacha_[13]++;
+        }
+        size_t n = length - done < 64 ? length - done : 64;
+        memcpy(out + done, block, n);
+        done += n;
+    }
+}
+
+void MeterFeeder::DrbgSource::rekey(const UCHAR* key) {
+#ifdef MF_DRBG_AESNI
+    if (algorithm_ == DRBG_AES_CTR) {
+        if (IsSupported(DRBG_AES_CTR)) {
+            aesExpandKey(key, aesRoundKeys_);
+        }
+        memset(aesCounter_, 0, sizeof(aesCounter_));
+        return;
+    }
+#endif
+
+    // "expand 32-byte k", the key, a 64-bit block counter and a zero nonce (every key is used for one stream)
+    chacha_[0] = 0x61707865;
+    chacha_[1] = 0x3320646e;
+    chacha_[2] = 0x79622d32;
+    chacha_[3] = 0x6b206574;
+    for (int i = 0; i < 8; i++) {
+        chacha_[4 + i] = key[i * 4] | ((uint32_t)key[i * 4 + 1] << 8) | ((uint32_t)key[i * 4 + 2] << 16) | ((uint32_t)key[i * 4 + 3] << 24);
+    }
+    chacha_[12] = chacha_[13] = chacha_[14] = chacha_[15] = 0;
+}
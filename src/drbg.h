@@ -0,0 +1,122 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "source.h"
+
+namespace MeterFeeder {
+    /**
+     * Ciphers a DrbgSource can expand its seed with.
+     */
+    enum DrbgAlgorithm {
+        DRBG_CHACHA20,  // ChaCha20, several blocks at a time with AVX2 or SSE2 where available
+        DRBG_AES_CTR,   // AES-256 in counter mode, needs AES-NI
+    };
+
+    /**
+     * Deterministic random bit generator seeded from a generator's entropy, for consumers that need
+     * far more bytes than the device produces. Output is keystream with fast key erasure: after every
+     * read the key is replaced with fresh keystream, so earlier output can't be recovered from the
+     * state. It reseeds from the device once a byte or time budget is spent.
+     * 
+     * Its bytes are always available and are never MMI-sensitive in themselves; the device's own
+     * stream is only read for seeds.
+     */
+    class DrbgSource : public VirtualSource {
+        public:
+            /**
+             * Fills a buffer with entropy from the seeding generator.
+             * Returns true on success, otherwise false with the error reason set.
+             */
+            typedef std::function<bool(UCHAR* seed, size_t length, std::string* errorReason)> Seeder;
+
+            /**
+             * @param The cipher.
+             * @param Where seeds come from.
+             * @param Output after which to reseed in bytes (0 for no byte budget).
+             * @param Time after which to reseed in milliseconds (0 for no time budget).
+             */
+            DrbgSource(DrbgAlgorithm algorithm, Seeder seeder, uint64_t reseedBytes, DWORD reseedMs);
+
+            /**
+             * Check if the CPU can run a cipher.
+             * 
+             * @param The cipher.
+             * 
+             * @return true if supported, otherwise false.
+             */
+            static bool IsSupported(DrbgAlgorithm algorithm);
+
+            /**
+             * Check each keystream path this CPU can run against known answers: RFC 8439's ChaCha20
+             * block for the scalar, SSE2 and AVX2 code, and SP 800-38A's CTR-AES256 vectors for AES-NI.
+             * 
+             * @param Where to list the paths checked.
+             * @param Error reason naming the path that gave the wrong keystream.
+             * 
+             * @return true if every path checked matched, otherwise false.
+             */
+            static bool SelfTest(std::string* checked, std::string* errorReason);
+
+            /**
+             * Seed from the device now, as done on creation and when a budget is spent.
+             * 
+             * @param Error reason upon failure to get the seed.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool Reseed(std::string* errorReason);
+
+            /**
+             * Get the number of bytes generated so far.
+             */
+            uint64_t GetBytesGenerated();
+
+            /**
+             * Get the number of times seeded so far, including the first.
+             */
+            uint64_t GetReseedCount();
+
+            int StartStreaming();
+            int StopStreaming();
+            int GetQueueStatus(DWORD* bytesAvailable);
+            int Read(DWORD length, UCHAR* dxData, DWORD* bytesRxd, DWORD timeoutMs);
+            bool IsOnDemand() const { return true; }
+            std::string GetLastError();
+
+        private:
+            bool reseed(std::string* errorReason);
+            void generate(UCHAR* out, size_t length);
+            void rekey(const UCHAR* key);
+
+            std::mutex mutex_;
+            DrbgAlgorithm algorithm_;
+            Seeder seeder_;
+            uint64_t reseedBytes_;
+            DWORD reseedMs_;
+            bool useAvx2_ = false;
+
+            // Why the last reseed from Read() failed
+            std::string lastError_;
+
+            // ChaCha20 input block, or the AES-256 round keys and big-endian counter block
+            uint32_t chacha_[16];
+            alignas(16) UCHAR aesRoundKeys_[15 * 16];
+            UCHAR aesCounter_[16];
+
+            uint64_t bytesGenerated_ = 0;
+            uint64_t bytesSinceSeed_ = 0;
+            uint64_t reseedCount_ = 0;
+            std::chrono::steady_clock::time_point seededAt_;
+    };
+}
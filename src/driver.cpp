@@ -7,6 +7,10 @@
 #include "driver.h"
 
 bool MeterFeeder::Driver::Initialize(string* errorReason) {
+    return Initialize(vector<string>(), errorReason);
+};
+
+bool MeterFeeder::Driver::Initialize(const vector<string>& filters, string* errorReason) {
     DWORD numDevices;
     FT_STATUS ftdiStatus = FT_CreateDeviceInfoList(&numDevices);
     if (ftdiStatus != FT_OK) {
@@ -25,65 +29,305 @@ bool MeterFeeder::Driver::Initialize(string* errorReason) {
         return false;
     }
 
-    _generators.clear();
+    stopAllCaptures();
+    stopAllRecordings();
+    _reactor.CancelAll();
+    {
+        lock_guard<mutex> lock(_generatorsMutex);
+        _generators.clear();
+    }
+    _initResults.clear();
 
-    // Open devices by serialNumber
+    // Pick out the devices to claim
+    vector<DWORD> selected;
     for (DWORD i = 0; i < numDevices; i++) {
         string serialNumber = devInfoList[i].SerialNumber;
-        serialNumber.resize(sizeof(devInfoList[i].SerialNumber));
-        FT_HANDLE ftHandle = devInfoList[i].ftHandle;
 
         if (serialNumber.find("QWR") != 0) {
             // Skip other but MED1K or MED100K and PQ128MU devices
             continue;
         }
+        if (!matchesFilter(serialNumber, filters)) {
+            // Left for another process to claim
+            continue;
+        }
+        selected.push_back(i);
+    }
+    if (selected.empty()) {
+        makeErrorStr(errorReason, "No generators matching the filter connected");
+        return false;
+    }
 
-        // Open the current device
-        ftdiStatus = FT_OpenEx(&devInfoList[i].SerialNumber, FT_OPEN_BY_SERIAL_NUMBER, &ftHandle);
-        if (ftdiStatus != FT_OK) {
-            makeErrorStr(errorReason, "Failed to connect to %s", &serialNumber);
-            return false;
+    // Open the devices concurrently, each one on its own thread
+    _initResults.resize(selected.size());
+    vector<FT_HANDLE> handles(selected.size(), nullptr);
+    vector<thread> openers;
+    for (size_t i = 0; i < selected.size(); i++) {
+        openers.push_back(thread([this, &devInfoList, &selected, &handles, i]() {
+            handles[i] = openGenerator(&devInfoList[selected[i]], &_initResults[i]);
+        }));
+    }
+    for (size_t i = 0; i < openers.size(); i++) {
+        openers[i].join();
+    }
+
+    // Add the successfully initialized devices to the list of generators the driver will control
+    for (size_t i = 0; i < selected.size(); i++) {
+        if (!_initResults[i].ok) {
+            continue;
         }
+        FT_DEVICE_LIST_INFO_NODE* devInfo = &devInfoList[selected[i]];
+        shared_ptr<Generator> generator = make_shared<Generator>(&devInfo->SerialNumber[0], &devInfo->Description[0], handles[i]);
+        lock_guard<mutex> lock(_generatorsMutex);
+        _generators.push_back(generator);
+    }
+
+    if (GetNumberGenerators() == 0) {
+        *errorReason = _initResults[0].errorReason;
+        return false;
+    }
+
+    return true;
+};
+
+bool MeterFeeder::Driver::InitializeSimulated(int count, const string& modelPrefix, string* errorReason) {
+    if (count < 1 || count > 999) {
+        makeErrorStr(errorReason, "Number of simulated generators must be between 1 and 999");
+        return false;
+    }
+    if (modelPrefix.find("QWR") != 0) {
+        makeErrorStr(errorReason, "Unknown model %s to simulate", modelPrefix.c_str());
+        return false;
+    }
+
+    stopAllCaptures();
+    stopAllRecordings();
+    _reactor.CancelAll();
+    {
+        lock_guard<mutex> lock(_generatorsMutex);
+        _generators.clear();
+    }
+    _initResults.clear();
 
-        // Configure FTDI transport parameters
-        ftdiStatus = FT_SetLatencyTimer(ftHandle, FTDI_DEVICE_LATENCY_MS);
-        if (ftdiStatus != FT_OK) {
-            makeErrorStr(errorReason, "Failed to set latency time for %s", &serialNumber);
+    for (int i = 0; i < count; i++) {
+        char serialNumber[32];
+        snprintf(serialNumber, sizeof(serialNumber), "SIM%s%03d", modelPrefix.substr(3).c_str(), i + 1);
+
+        TransportProfile profile = FindTransportProfile(string("QWR") + (serialNumber + 3), "");
+        string description = string("Simulated ") + profile.model;
+        shared_ptr<VirtualSource> source = make_shared<SimulatedSource>(profile.nominalBitRate, 0x4d4544ULL * (i + 1));
+        AddVirtualGenerator(serialNumber, description, source, profile, errorReason);
+        if (!errorReason->empty()) {
             return false;
         }
-        ftdiStatus = FT_SetUSBParameters(ftHandle, FTDI_DEVICE_PACKET_USB_SIZE_BYTES, FTDI_DEVICE_PACKET_USB_SIZE_BYTES);
-        if (ftdiStatus != FT_OK) {
-            makeErrorStr(errorReason, "Failed to set in/out packset size for %s", &serialNumber);
+
+        InitResult result = { serialNumber, description, true, "" };
+        _initResults.push_back(result);
+    }
+
+    return true;
+};
+
+bool MeterFeeder::Driver::InitializeReplay(const vector<string>& paths, double speed, string* errorReason) {
+    if (paths.empty()) {
+        makeErrorStr(errorReason, "No recordings to replay");
+        return false;
+    }
+    if (!(speed >= 0)) {
+        makeErrorStr(errorReason, "Replay speed must be 0 (full speed) or more");
+        return false;
+    }
+
+    stopAllCaptures();
+    stopAllRecordings();
+    _reactor.CancelAll();
+    {
+        lock_guard<mutex> lock(_generatorsMutex);
+        _generators.clear();
+    }
+    _initResults.clear();
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        // The serial number is the file name without its extension
+        size_t nameStart = paths[i].find_last_of("/\\");
+        string serialNumber = paths[i].substr(nameStart == string::npos ? 0 : nameStart + 1);
+        serialNumber = serialNumber.substr(0, serialNumber.rfind('.'));
+
+        shared_ptr<ReplaySource> source = make_shared<ReplaySource>(speed);
+        if (!source->Open(paths[i], errorReason)) {
             return false;
         }
-        ftdiStatus = FT_SetTimeouts(ftHandle, FTDI_DEVICE_TX_TIMEOUT_MS, FTDI_DEVICE_TX_TIMEOUT_MS);
-        if (ftdiStatus != FT_OK) {
-            makeErrorStr(errorReason, "Failed to set timeout time for %s", &serialNumber);
+
+        // Sped up, the bits come in that much faster
+        TransportProfile profile = FindTransportProfile(serialNumber, "");
+        if (speed > 0) {
+            profile.nominalBitRate *= speed;
+        }
+        string description = "Replay of " + paths[i];
+        AddVirtualGenerator(serialNumber, description, source, profile, errorReason);
+        if (!errorReason->empty()) {
             return false;
         }
 
-        // Device is successfully initialized. Add it to the list of generators the driver will control.
-        Generator generator = Generator(&devInfoList[i].SerialNumber[0], &devInfoList[i].Description[0], ftHandle);
-        _generators.push_back(generator);
+        InitResult result = { serialNumber, description, true, "" };
+        _initResults.push_back(result);
     }
 
     return true;
 };
 
+void MeterFeeder::Driver::AddVirtualGenerator(const string& serialNumber, const string& description, shared_ptr<VirtualSource> source,
+                                              const TransportProfile& profile, string* errorReason) {
+    // Checked and added under the one lock, so two generators of the same serial number can't both be added
+    lock_guard<mutex> lock(_generatorsMutex);
+    for (size_t i = 0; i < _generators.size(); i++) {
+        if (_generators[i]->GetSerialNumber() == serialNumber) {
+            makeErrorStr(errorReason, "A generator with the serial number %s already exists", serialNumber.c_str());
+            return;
+        }
+    }
+    _generators.push_back(make_shared<Generator>(serialNumber, description, source, profile));
+};
+
+string MeterFeeder::Driver::AddDrbgGenerator(FT_HANDLE handle, DrbgAlgorithm algorithm, uint64_t reseedBytes, DWORD reseedMs,
+                                             string* errorReason) {
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return "";
+    }
+    const char* cipher = algorithm == DRBG_AES_CTR ? "AESCTR" : "CHACHA20";
+    if (!DrbgSource::IsSupported(algorithm)) {
+        makeErrorStr(errorReason, "%s is not supported by this CPU", cipher);
+        return "";
+    }
+
+    // Seeds are read straight from the generator, looking it up each time in case it was reinitialized. Its stream
+    // is left running, and the seeds stay out of its walk view and recording as they're not handed out
+    string seedSerialNumber = generator->GetSerialNumber();
+    DrbgSource::Seeder seeder = [this, seedSerialNumber](UCHAR* seed, size_t length, string* seedErrorReason) {
+        shared_ptr<Generator> seedGenerator = FindGeneratorBySerial(seedSerialNumber);
+        if (!seedGenerator) {
+            makeErrorStr(seedErrorReason, "Could not find the generator %s to seed from", seedSerialNumber.c_str());
+            return false;
+        }
+        try {
+            lock_guard<mutex> io(seedGenerator->GetIoMutex());
+            if (!seedGenerator->IsStreaming()) {
+                FT_STATUS streamStatus = seedGenerator->StartStreaming();
+                if (streamStatus != FT_OK) {
+                    makeErrorStr(seedErrorReason, "Error instructing %s to start streaming entropy [%d]", seedSerialNumber.c_str(), streamStatus);
+                    return false;
+                }
+            }
+            FT_STATUS readStatus = seedGenerator->Read((DWORD)length, seed);
+            if (readStatus != FT_OK) {
+                makeErrorStr(seedErrorReason, "Error reading a seed from %s [%d]", seedSerialNumber.c_str(), readStatus);
+                return false;
+            }
+        } catch (const std::runtime_error&) {
+            makeErrorStr(seedErrorReason, "The generator %s to seed from is closed", seedSerialNumber.c_str());
+            return false;
+        }
+        return true;
+    };
+    shared_ptr<DrbgSource> source = make_shared<DrbgSource>(algorithm, seeder, reseedBytes, reseedMs);
+    if (!source->Reseed(errorReason)) {
+        return "";
+    }
+
+    string serialNumber = seedSerialNumber + "-" + cipher;
+    string description = string(algorithm == DRBG_AES_CTR ? "AES-256-CTR" : "ChaCha20") + " DRBG seeded by " + seedSerialNumber;
+    TransportProfile profile = { "", nullptr, "DRBG", MF_DRBG_NOMINAL_BIT_RATE, 0, 65536, MF_MAX_READ_LENGTH };
+    AddVirtualGenerator(serialNumber, description, source, profile, errorReason);
+    if (!errorReason->empty()) {
+        return "";
+    }
+
+    // Its seeds are what the parent's monitor counts; expanding them doesn't need watching, or slowing down
+    shared_ptr<Generator> drbg = FindGeneratorBySerial(serialNumber);
+    if (drbg) {
+        drbg->GetMetrics().bias.SetEnabled(false);
+    }
+    return serialNumber;
+};
+
+vector<MeterFeeder::InitResult>* MeterFeeder::Driver::GetInitResults() {
+    return &_initResults;
+};
+
+bool MeterFeeder::Driver::matchesFilter(const string& serialNumber, const vector<string>& filters) {
+    if (filters.empty()) {
+        return true;
+    }
+    for (size_t i = 0; i < filters.size(); i++) {
+        if (!filters[i].empty() && serialNumber.compare(0, filters[i].length(), filters[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+};
+
+FT_HANDLE MeterFeeder::Driver::openGenerator(FT_DEVICE_LIST_INFO_NODE* devInfo, InitResult* result) {
+    result->serialNumber = devInfo->SerialNumber;
+    result->description = devInfo->Description;
+    result->ok = false;
+    const char* serialNumber = result->serialNumber.c_str();
+    FT_HANDLE ftHandle = nullptr;
+    TransportProfile profile = FindTransportProfile(result->serialNumber, result->description);
+
+    // Open the current device
+    FT_STATUS ftdiStatus = FT_OpenEx(devInfo->SerialNumber, FT_OPEN_BY_SERIAL_NUMBER, &ftHandle);
+    if (ftdiStatus != FT_OK) {
+        makeErrorStr(&result->errorReason, "Failed to connect to %s [%d]", serialNumber, ftdiStatus);
+        return nullptr;
+    }
+
+    // Configure FTDI transport parameters for the model
+    ftdiStatus = FT_SetLatencyTimer(ftHandle, profile.latencyMs);
+    if (ftdiStatus != FT_OK) {
+        makeErrorStr(&result->errorReason, "Failed to set latency time for %s [%d]", serialNumber, ftdiStatus);
+        FT_Close(ftHandle);
+        return nullptr;
+    }
+    ftdiStatus = FT_SetUSBParameters(ftHandle, profile.usbTransferSize, FTDI_DEVICE_PACKET_USB_SIZE_BYTES);
+    if (ftdiStatus != FT_OK) {
+        makeErrorStr(&result->errorReason, "Failed to set in/out packset size for %s [%d]", serialNumber, ftdiStatus);
+        FT_Close(ftHandle);
+        return nullptr;
+    }
+    ftdiStatus = FT_SetTimeouts(ftHandle, FTDI_DEVICE_TX_TIMEOUT_MS, FTDI_DEVICE_TX_TIMEOUT_MS);
+    if (ftdiStatus != FT_OK) {
+        makeErrorStr(&result->errorReason, "Failed to set timeout time for %s [%d]", serialNumber, ftdiStatus);
+        FT_Close(ftHandle);
+        return nullptr;
+    }
+
+    result->ok = true;
+    return ftHandle;
+};
+
 void MeterFeeder::Driver::Shutdown() {
+    // Nothing may be reading from the generators while closing them
+    stopAllCaptures();
+    stopAllRecordings();
+    _reactor.CancelAll();
+
     // Shutdown all generators
+    lock_guard<mutex> lock(_generatorsMutex);
     for (size_t i = 0; i < _generators.size(); i++) {
-        _generators[i].Close();
+        _generators[i]->Close();
     }
 };
 
 void MeterFeeder::Driver::Clear(FT_HANDLE handle, string* errorReason) {
     // Find the specified generator
-    Generator *generator = FindGeneratorByHandle(handle);
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
     if (!generator) {
-        makeErrorStr(errorReason, "Could not find %s by the handle %x", generator->GetSerialNumber().c_str(), generator->GetHandle());
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
         return;
     }
+    std::lock_guard<std::mutex> io(generator->GetIoMutex());
 
     // Get the device to stop measuring randomness
     FT_STATUS streamStatus = generator->StopStreaming();
@@ -94,180 +338,1695 @@ void MeterFeeder::Driver::Clear(FT_HANDLE handle, string* errorReason) {
 };
 
 int MeterFeeder::Driver::GetNumberGenerators() {
+    lock_guard<mutex> lock(_generatorsMutex);
     return _generators.size();    
 };
 
-vector<MeterFeeder::Generator>* MeterFeeder::Driver::GetListGenerators() {
-    return &_generators;
+vector<MeterFeeder::Generator> MeterFeeder::Driver::GetListGenerators() {
+    // Copies share the generators' state, so the list can be used outside the lock
+    vector<Generator> generators;
+    lock_guard<mutex> lock(_generatorsMutex);
+    for (size_t i = 0; i < _generators.size(); i++) {
+        generators.push_back(*_generators[i]);
+    }
+    return generators;
 };
 
 void MeterFeeder::Driver::GetBytes(FT_HANDLE handle, int length, unsigned char* entropyBytes, string* errorReason) {
+    GetBytesTimestamped(handle, length, entropyBytes, nullptr, errorReason);
+};
+
+void MeterFeeder::Driver::GetBytesTimestamped(FT_HANDLE handle, int length, unsigned char* entropyBytes, ChunkTiming* timing, string* errorReason) {
     // Find the specified generator
-    Generator *generator = FindGeneratorByHandle(handle);
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
     if (!generator) {
-        makeErrorStr(errorReason, "Could not find %s by the handle %x", generator->GetSerialNumber().c_str(), generator->GetHandle());
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
         return;
     }
 
+    TraceSpan getBytes("GetBytes", generator->GetSerialNumber());
+
+    // Keep the reactor off the device for the whole purge, start and read
+    TraceSpan lockWait("lock", generator->GetSerialNumber());
+    std::lock_guard<std::mutex> io(generator->GetIoMutex());
+    lockWait.End(MF_OK, 0);
+
     // Get the device to start measuring randomness
     FT_STATUS streamStatus = generator->StartStreaming();
     if (streamStatus != FT_OK) {
         makeErrorStr(errorReason, "Error instructing %s to start streaming entropy [%d]", generator->GetSerialNumber().c_str(), streamStatus);
+        getBytes.End(streamStatus, 0);
         return;
     }
 
     // Read in the entropy
     FT_STATUS readStatus = generator->Read(length, entropyBytes);
+    if (readStatus == MF_REPLAY_ENDED) {
+        makeErrorStr(errorReason, "The recording %s replays has ended [%d]", generator->GetSerialNumber().c_str(), readStatus);
+        getBytes.End(readStatus, 0);
+        return;
+    }
     if (readStatus != FT_OK) {
-        makeErrorStr(errorReason, "Error reading in entropy from %s [%d]", generator->GetSerialNumber().c_str(), readStatus);
+        readErrorStr(errorReason, generator.get(), readStatus);
+        getBytes.End(readStatus, 0);
         return;
     }
+    ChunkTiming chunk = generator->GetLastChunkTiming();
+    if (timing) {
+        *timing = chunk;
+    }
+    handOut(handle, generator.get(), entropyBytes, length, chunk, errorReason);
+    getBytes.End(MF_OK, length);
 };
 
-MeterFeeder::Generator* MeterFeeder::Driver::FindGeneratorByHandle(FT_HANDLE handle) {
-    for (size_t i = 0; i < _generators.size(); i++) {
-        if (_generators[i].GetHandle() == handle) {
-            return &_generators[i];
+// Add bytes read for a consumer to the generator's walk view, and to its recording if it's being recorded.
+// The chunk's timing must end with the last of the bytes.
+void MeterFeeder::Driver::handOut(FT_HANDLE handle, Generator* generator, const UCHAR* bytes, DWORD length, ChunkTiming chunk,
+                                  string* errorReason) {
+    generator->GetWalkView().Add(bytes, (uint64_t)length * 8);
+    shared_ptr<RecordingWriter> recording;
+    {
+        lock_guard<mutex> lock(_recordingsMutex);
+        map<FT_HANDLE, shared_ptr<RecordingWriter>>::iterator it = _recordings.find(handle);
+        if (it != _recordings.end()) {
+            recording = it->second;
         }
     }
+    if (recording) {
+        chunk.length = length;
+        string recordError;
+        if (!recording->Write(bytes, length, GetBitTimeNs(chunk, 0, true), chunk.bitRate > 0 ? 1e9 / chunk.bitRate : 0, &recordError)) {
+            makeErrorStr(errorReason, "Error recording %s: %s", generator->GetSerialNumber().c_str(), recordError.c_str());
+        }
+    }
+};
 
-    return nullptr;
+uint64_t MeterFeeder::Driver::SubmitRead(FT_HANDLE handle, int length, unsigned char* entropyBytes, DWORD timeoutMs, bool restart,
+                                         Reactor::Completion completion, string* errorReason) {
+    return SubmitRead(handle, length, length, entropyBytes, timeoutMs, restart, completion, errorReason);
 };
 
-MeterFeeder::Generator* MeterFeeder::Driver::FindGeneratorBySerial(string serialNumber) {
-    for (size_t i = 0; i < _generators.size(); i++) {
-        if (_generators[i].GetSerialNumber() == serialNumber) {
-            return &_generators[i];
-        }
+uint64_t MeterFeeder::Driver::SubmitRead(FT_HANDLE handle, int minLength, int maxLength, unsigned char* entropyBytes, DWORD timeoutMs, bool restart,
+                                         Reactor::Completion completion, string* errorReason) {
+    // Find the specified generator
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return 0;
+    }
+    if (!entropyBytes || maxLength <= 0 || maxLength > MF_MAX_READ_LENGTH || minLength < 0 || minLength > maxLength) {
+        makeErrorStr(errorReason, "Invalid read of %d to %d bytes from %s", minLength, maxLength, generator->GetSerialNumber().c_str());
+        return 0;
     }
 
-    return nullptr;
+    // What arrives is handed out like GetBytes's, timed by the read's last piece. Completions carry no error
+    // string, so a failing recording only shows when it's stopped
+    Generator reading = *generator;
+    Reactor::Completion handedOut = [this, handle, reading, entropyBytes, completion](uint64_t id, int status, DWORD bytesRead) mutable {
+        if (bytesRead > 0) {
+            string recordError;
+            handOut(handle, &reading, entropyBytes, bytesRead, reading.GetLastChunkTiming(), &recordError);
+        }
+        if (completion) {
+            completion(id, status, bytesRead);
+        }
+    };
+    return _reactor.Submit(*generator, minLength, maxLength, entropyBytes, timeoutMs, restart, handedOut);
 };
 
-void MeterFeeder::Driver::makeErrorStr(string* errorReason, const char* format, ...) {
-    char buffer[MF_ERROR_STR_MAX_LEN];
-    va_list args;
-    va_start (args, format);
-    vsnprintf (buffer, MF_ERROR_STR_MAX_LEN-1, format, args);
-    *errorReason = buffer;
-    va_end (args);
-};
+int MeterFeeder::Driver::GetBytesWithDeadline(FT_HANDLE handle, int minLength, int maxLength, unsigned char* entropyBytes, DWORD timeoutMs, string* errorReason) {
+    std::mutex mutex;
+    std::condition_variable finished;
+    bool done = false;
+    int status = MF_OK;
+    DWORD bytesRead = 0;
 
-/**
- * Code below for interfacing with MeterFeeder as a library
- */
+    // The generator may be gone by the deadline, e.g. after a reinitialization, so name it up front
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return 0;
+    }
+    string serialNumber = generator->GetSerialNumber();
 
-#ifdef __APPLE__
-    #define DllExport __attribute__((visibility("default")))
-#elif defined __GNUC__
-    #define DllExport __attribute__((visibility("default")))
-#else
-     #define DllExport __declspec(dllexport)
-#endif
+    uint64_t id = SubmitRead(handle, minLength, maxLength, entropyBytes, timeoutMs, true,
+        [&](uint64_t, int readStatus, DWORD readBytes) {
+            std::lock_guard<std::mutex> lock(mutex);
+            status = readStatus;
+            bytesRead = readBytes;
+            done = true;
+            finished.notify_one();
+        }, errorReason);
+    if (id == 0) {
+        return 0;
+    }
 
-extern "C" {
-    /**
-     * Library functions exposed for consumption by Unity/C# or whomever
-     */
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&]() { return done; });
+    if (status == MF_READ_TIMEOUT) {
+        makeErrorStr(errorReason, "Only %lu of at least %d bytes arrived from %s by the deadline",
+            (unsigned long)bytesRead, minLength, serialNumber.c_str());
+    } else if (status != MF_OK) {
+        readErrorStr(errorReason, generator.get(), status);
+    }
+    return (int)bytesRead;
+};
 
-    using namespace MeterFeeder;
-    Driver driver = Driver();
+bool MeterFeeder::Driver::CancelRead(uint64_t id) {
+    return _reactor.Cancel(id);
+};
 
-    // Initialize the connected generators
-    DllExport int MF_Initialize(char* pErrorReason) {
-        string errorReason = "";
-        int res = driver.Initialize(&errorReason);
-        std::strcpy(pErrorReason, errorReason.c_str());
-        return res;
+void MeterFeeder::Driver::SetTransportProfile(FT_HANDLE handle, const TransportProfile& profile, string* errorReason) {
+    // Find the specified generator
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return;
     }
 
-    // Shutdown and de-initialize all the generators.
-    DllExport void MF_Shutdown() {
-        driver.Shutdown();
+    if (profile.usbTransferSize < FTDI_DEVICE_PACKET_USB_SIZE_BYTES || profile.usbTransferSize > 65536
+        || profile.usbTransferSize % FTDI_DEVICE_PACKET_USB_SIZE_BYTES != 0) {
+        makeErrorStr(errorReason, "USB transfer size %lu must be a multiple of 64 up to 65536", (unsigned long)profile.usbTransferSize);
+        return;
+    }
+    if (profile.readChunkBytes == 0 || profile.readChunkBytes > MF_MAX_READ_LENGTH) {
+        makeErrorStr(errorReason, "Read chunk size %lu out of range", (unsigned long)profile.readChunkBytes);
+        return;
     }
 
-    // Shutdown and re-initialize all the generators.
-    DllExport int MF_Reset(char* pErrorReason) {
-        MF_Shutdown();
-        return MF_Initialize(pErrorReason);
+    FT_STATUS status = generator->ApplyProfile(profile);
+    if (status != FT_OK) {
+        makeErrorStr(errorReason, "Error applying transport profile to %s [%d]", generator->GetSerialNumber().c_str(), status);
+        return;
     }
+};
 
-    // Stop streaming on the specified generator.
-    DllExport bool MF_Clear(char* generatorSerialNumber, char* pErrorReason) {
-        string errorReason = "";
-        Generator *generator = driver.FindGeneratorBySerial(generatorSerialNumber);
-        if (!generator) {
-            std::strcpy(pErrorReason, "Generator not found");
-            return false;
+void MeterFeeder::Driver::TuneTransport(FT_HANDLE handle, vector<TuneSample>* samples, string* errorReason) {
+    static const UCHAR latencies[] = { 1, 2, 4, 8, 16 };
+    static const DWORD transferSizes[] = { 64, 512, 4096, 16384, 65536 };
+    const int rounds = 3;
+
+    // Find the specified generator
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return;
+    }
+
+    TransportProfile original = generator->GetProfile();
+    vector<UCHAR> buffer(max((DWORD)FTDI_DEVICE_PACKET_USB_SIZE_BYTES, original.readChunkBytes));
+    samples->clear();
+
+    // Read straight from the generator, restarting the stream each time like GetBytes, so the benchmark's
+    // bytes stay out of the walk view and any recording
+    auto read = [&](DWORD length) {
+        FT_STATUS status = generator->StartStreaming();
+        if (status != FT_OK) {
+            makeErrorStr(errorReason, "Error instructing %s to start streaming entropy [%d]", generator->GetSerialNumber().c_str(), status);
+            return;
         }
-        driver.Clear(generator->GetHandle(), &errorReason);
-        std::strcpy(pErrorReason, errorReason.c_str());
-        if (*pErrorReason != '\0') {
-            return false;
+        status = generator->Read(length, &buffer[0]);
+        if (status != FT_OK) {
+            readErrorStr(errorReason, generator.get(), status);
+        }
+    };
+
+    // Hold the generator for the whole sweep so no other read lands between the timed ones
+    lock_guard<mutex> io(generator->GetIoMutex());
+
+    for (size_t l = 0; l < sizeof(latencies) / sizeof(latencies[0]); l++) {
+        for (size_t t = 0; t < sizeof(transferSizes) / sizeof(transferSizes[0]); t++) {
+            if (transferSizes[t] > 4 * original.readChunkBytes) {
+                // Bigger transfers than reads can't help
+                continue;
+            }
+
+            TransportProfile candidate = original;
+            candidate.latencyMs = latencies[l];
+            candidate.usbTransferSize = transferSizes[t];
+            SetTransportProfile(handle, candidate, errorReason);
+            if (!errorReason->empty()) {
+                generator->ApplyProfile(original);
+                return;
+            }
+
+            // Warm up the pipe with the new settings, then time packet sized and chunk sized reads
+            read(FTDI_DEVICE_PACKET_USB_SIZE_BYTES);
+            using namespace std::chrono;
+            auto start = steady_clock::now();
+            for (int r = 0; r < rounds && errorReason->empty(); r++) {
+                read(FTDI_DEVICE_PACKET_USB_SIZE_BYTES);
+            }
+            auto middle = steady_clock::now();
+            for (int r = 0; r < rounds && errorReason->empty(); r++) {
+                read(original.readChunkBytes);
+            }
+            auto end = steady_clock::now();
+            if (!errorReason->empty()) {
+                generator->ApplyProfile(original);
+                return;
+            }
+
+            TuneSample sample;
+            sample.latencyMs = candidate.latencyMs;
+            sample.usbTransferSize = candidate.usbTransferSize;
+            sample.packetReadMs = duration<double, std::milli>(middle - start).count() / rounds;
+            sample.throughput = (double)original.readChunkBytes * rounds / duration<double>(end - middle).count();
+            samples->push_back(sample);
         }
-        return true;
     }
 
-    // Get the number of connected and successfully initialized generators.
-    DllExport int MF_GetNumberGenerators() {
-        return driver.GetNumberGenerators();
+    // Every transfer size was too big for reads this small
+    if (samples->empty()) {
+        generator->ApplyProfile(original);
+        makeErrorStr(errorReason, "No transfer size to try with reads of %lu bytes from %s",
+                     (unsigned long)original.readChunkBytes, generator->GetSerialNumber().c_str());
+        return;
     }
 
-      // Get the list of connected and successfully initialized generators with serial number and device description.
-    // Array element format: <serial number>|<description>
-    DllExport int MF_GetListGeneratorsWithSize(char** pGenerators, int arraySize) {
-        vector<Generator>* generators = driver.GetListGenerators();
-        int numGenerators = driver.GetNumberGenerators();
-        
-        if (arraySize < numGenerators) {
-            return -1;  // Array too small
+    // Pick the highest throughput, preferring the lowest latency among near ties
+    const TuneSample* best = &samples->at(0);
+    for (size_t i = 1; i < samples->size(); i++) {
+        const TuneSample* sample = &samples->at(i);
+        if (sample->throughput > best->throughput * 1.05
+            || (sample->throughput > best->throughput * 0.95 && sample->packetReadMs < best->packetReadMs)) {
+            best = sample;
         }
-        
-        for (int i = 0; i < numGenerators; i++) {
-            Generator generator = generators->at(i);
-            string fullGenDesc = generator.GetSerialNumber() + "|" + generator.GetDescription();
-            std::strcpy(pGenerators[i], fullGenDesc.c_str());
+    }
+
+    TransportProfile tuned = original;
+    tuned.latencyMs = best->latencyMs;
+    tuned.usbTransferSize = best->usbTransferSize;
+    SetTransportProfile(handle, tuned, errorReason);
+};
+
+string MeterFeeder::Driver::GetMetrics(const string& serialNumber) {
+    // Copies share the generators' metrics, so they can be formatted outside the lock
+    vector<Generator> generators;
+    {
+        lock_guard<mutex> lock(_generatorsMutex);
+        for (size_t i = 0; i < _generators.size(); i++) {
+            if (serialNumber.empty() || _generators[i]->GetSerialNumber() == serialNumber) {
+                generators.push_back(*_generators[i]);
+            }
         }
-        return numGenerators;
     }
 
-    // Original function maintained for backward compatibility
-    DllExport void MF_GetListGenerators(char** pGenerators) {
-        MF_GetListGeneratorsWithSize(pGenerators, driver.GetNumberGenerators());
+    string text;
+    if (generators.empty()) {
+        return text;
+    }
+    vector<MetricsEntry> entries;
+    for (size_t i = 0; i < generators.size(); i++) {
+        entries.push_back(MetricsEntry(generators[i].GetSerialNumber(), &generators[i].GetMetrics()));
     }
+    FormatMetrics(&text, entries);
+    return text;
+};
 
-    // Get the list of connected and successfully initialized generators.
-    // Array element format: <serial number>
-    DllExport int MF_GetSerialListGeneratorsWithSize(char** pGenerators, int arraySize) {
-        vector<Generator>* generators = driver.GetListGenerators();
-        int numGenerators = driver.GetNumberGenerators();
-        
-        if (arraySize < numGenerators) {
-            return -1;  // Array too small
-        }
-        
-        for (int i = 0; i < numGenerators; i++) {
-            Generator generator = generators->at(i);
-            std::strcpy(pGenerators[i], generator.GetSerialNumber().c_str());
-        }
-        return numGenerators;
+void MeterFeeder::Driver::StartMetricsExporter(const string& path, DWORD intervalMs, string* errorReason) {
+    if (path.empty()) {
+        makeErrorStr(errorReason, "No metrics file path given");
+        return;
     }
+    _metricsExporter.Start(path, intervalMs, [this]() { return GetMetrics(""); }, errorReason);
+};
 
-    // Original function maintained for backward compatibility
-    DllExport void MF_GetSerialListGenerators(char** pGenerators) {
-        MF_GetSerialListGeneratorsWithSize(pGenerators, driver.GetNumberGenerators());
+void MeterFeeder::Driver::StopMetricsExporter() {
+    _metricsExporter.Stop();
+}
+
+void MeterFeeder::Driver::GetBiasStats(FT_HANDLE handle, vector<BiasWindowStats>* windows, string* errorReason) {
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return;
+    }
+    BiasMonitor& monitor = generator->GetMetrics().bias;
+    if (!monitor.IsEnabled()) {
+        makeErrorStr(errorReason, "Bias monitor is off for %s", generator->GetSerialNumber().c_str());
+        return;
     }
+    monitor.GetWindows(windows);
+};
 
-    // Get bytes of randomness.
-    DllExport void MF_GetBytes(int length, unsigned char* buffer, char* generatorSerialNumber, char* pErrorReason) {
-        string errorReason = "";
-        Generator *generator = driver.FindGeneratorBySerial(generatorSerialNumber);
-        if (!generator) {
-            std::strcpy(pErrorReason, "Generator not found");
-            return;
-        }
-        driver.GetBytes(generator->GetHandle(), length, buffer, &errorReason);
-        std::strcpy(pErrorReason, errorReason.c_str());
+void MeterFeeder::Driver::SetBiasMonitor(FT_HANDLE handle, bool enabled, string* errorReason) {
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return;
+    }
+    generator->GetMetrics().bias.SetEnabled(enabled);
+};
+
+void MeterFeeder::Driver::SetWalkView(FT_HANDLE handle, size_t numPoints, uint64_t spanSteps, string* errorReason) {
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return;
+    }
+    if (numPoints > MF_WALK_MAX_POINTS || (numPoints > 0 && spanSteps == 0)) {
+        makeErrorStr(errorReason, "Invalid walk view of %lu points over %llu steps", (unsigned long)numPoints, (unsigned long long)spanSteps);
+        return;
+    }
+    generator->GetWalkView().Configure(numPoints, spanSteps);
+};
+
+void MeterFeeder::Driver::GetWalkView(FT_HANDLE handle, vector<int64_t>* mins, vector<int64_t>* maxs, WalkSummary* summary, string* errorReason) {
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return;
+    }
+    WalkView& walk = generator->GetWalkView();
+    if (!walk.IsEnabled()) {
+        makeErrorStr(errorReason, "No walk view set on %s", generator->GetSerialNumber().c_str());
+        return;
+    }
+    walk.GetView(mins, maxs, summary);
+};
+
+void MeterFeeder::Driver::ResetWalkView(FT_HANDLE handle, string* errorReason) {
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return;
+    }
+    generator->GetWalkView().Reset();
+};
+
+void MeterFeeder::Driver::GetBits(FT_HANDLE handle, uint64_t numBits, unsigned char* bits, string* errorReason) {
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return;
+    }
+    if (!bits || numBits == 0 || numBits > (uint64_t)MF_MAX_READ_LENGTH * 8) {
+        makeErrorStr(errorReason, "Invalid draw of %llu bits from %s", (unsigned long long)numBits, generator->GetSerialNumber().c_str());
+        return;
+    }
+
+    BitReservoir& reservoir = generator->GetReservoir();
+    lock_guard<mutex> lock(reservoir.GetMutex());
+    if (!refillReservoir(generator.get(), numBits, errorReason)) {
+        return;
+    }
+    reservoir.Take(bits, numBits);
+};
+
+uint64_t MeterFeeder::Driver::GetBitsValue(FT_HANDLE handle, unsigned numBits, string* errorReason) {
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return 0;
+    }
+    if (numBits < 1 || numBits > 64) {
+        makeErrorStr(errorReason, "Invalid draw of %u bits from %s", numBits, generator->GetSerialNumber().c_str());
+        return 0;
+    }
+
+    BitReservoir& reservoir = generator->GetReservoir();
+    lock_guard<mutex> lock(reservoir.GetMutex());
+    if (!refillReservoir(generator.get(), numBits, errorReason)) {
+        return 0;
+    }
+    return reservoir.TakeValue(numBits);
+};
+
+void MeterFeeder::Driver::GetBoundedInts(FT_HANDLE handle, uint64_t bound, size_t count, uint32_t* values, string* errorReason) {
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return;
+    }
+    if (!values || bound < 1 || bound > (1ULL << 32)) {
+        makeErrorStr(errorReason, "Invalid bound %llu for integers from %s", (unsigned long long)bound, generator->GetSerialNumber().c_str());
+        return;
+    }
+
+    BitReservoir& reservoir = generator->GetReservoir();
+    lock_guard<mutex> lock(reservoir.GetMutex());
+
+    // One read for the whole batch, only rejected tries need more
+    uint64_t batchBits = (uint64_t)count * GetBoundedBits(bound);
+    if (batchBits > 0 && !refillReservoir(generator.get(), min(batchBits, (uint64_t)MF_MAX_READ_LENGTH * 8), errorReason)) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!drawBounded(generator.get(), bound, &values[i], errorReason)) {
+            return;
+        }
+    }
+};
+
+void MeterFeeder::Driver::Shuffle(FT_HANDLE handle, int32_t* items, size_t count, string* errorReason) {
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return;
+    }
+    if (!items || count > (1ULL << 32)) {
+        makeErrorStr(errorReason, "Invalid shuffle of %lu items with %s", (unsigned long)count, generator->GetSerialNumber().c_str());
+        return;
+    }
+
+    BitReservoir& reservoir = generator->GetReservoir();
+    lock_guard<mutex> lock(reservoir.GetMutex());
+
+    uint64_t batchBits = 0;
+    for (size_t i = count; i > 1; i--) {
+        batchBits += GetBoundedBits(i);
+    }
+    if (batchBits > 0 && !refillReservoir(generator.get(), min(batchBits, (uint64_t)MF_MAX_READ_LENGTH * 8), errorReason)) {
+        return;
+    }
+
+    // Fisher-Yates: swap each item from the end down with one at or before it
+    for (size_t i = count; i > 1; i--) {
+        uint32_t j;
+        if (!drawBounded(generator.get(), i, &j, errorReason)) {
+            return;
+        }
+        int32_t item = items[i - 1];
+        items[i - 1] = items[j];
+        items[j] = item;
+    }
+};
+
+void MeterFeeder::Driver::GetNormals(FT_HANDLE handle, size_t count, double* values, string* errorReason) {
+    drawVariates(handle, count, values, NormalFromWords, errorReason);
+};
+
+void MeterFeeder::Driver::GetExponentials(FT_HANDLE handle, size_t count, double* values, string* errorReason) {
+    drawVariates(handle, count, values, ExponentialFromWords, errorReason);
+};
+
+int MeterFeeder::Driver::CreateAliasTable(const double* weights, size_t count, string* errorReason) {
+    shared_ptr<AliasTable> table = make_shared<AliasTable>();
+    if (!table->Build(weights, count, errorReason)) {
+        return 0;
+    }
+
+    lock_guard<mutex> lock(_aliasTablesMutex);
+    int tableId = _nextAliasTableId++;
+    _aliasTables[tableId] = table;
+    return tableId;
+};
+
+void MeterFeeder::Driver::DestroyAliasTable(int tableId) {
+    lock_guard<mutex> lock(_aliasTablesMutex);
+    _aliasTables.erase(tableId);
+};
+
+void MeterFeeder::Driver::GetCategorical(FT_HANDLE handle, int tableId, size_t count, uint32_t* values, string* errorReason) {
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return;
+    }
+    shared_ptr<AliasTable> table;
+    {
+        lock_guard<mutex> lock(_aliasTablesMutex);
+        map<int, shared_ptr<AliasTable>>::iterator it = _aliasTables.find(tableId);
+        if (it != _aliasTables.end()) {
+            table = it->second;
+        }
+    }
+    if (!table) {
+        makeErrorStr(errorReason, "Could not find an alias table with the id %d", tableId);
+        return;
+    }
+    if (!values && count > 0) {
+        makeErrorStr(errorReason, "Invalid draw of %lu categories from %s", (unsigned long)count, generator->GetSerialNumber().c_str());
+        return;
+    }
+
+    BitReservoir& reservoir = generator->GetReservoir();
+    lock_guard<mutex> lock(reservoir.GetMutex());
+
+    uint64_t batchBits = (uint64_t)count * (GetBoundedBits(table->GetSize()) + MF_ALIAS_COIN_BITS);
+    if (batchBits > 0 && !refillReservoir(generator.get(), min(batchBits, (uint64_t)MF_MAX_READ_LENGTH * 8), errorReason)) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        uint32_t column;
+        if (!drawBounded(generator.get(), table->GetSize(), &column, errorReason)
+         || !refillReservoir(generator.get(), MF_ALIAS_COIN_BITS, errorReason)) {
+            return;
+        }
+        values[i] = table->Sample(column, (uint32_t)reservoir.TakeValue(MF_ALIAS_COIN_BITS));
+    }
+};
+
+void MeterFeeder::Driver::SetReservoirRefill(FT_HANDLE handle, size_t refillBytes, string* errorReason) {
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return;
+    }
+    if (refillBytes > MF_MAX_READ_LENGTH) {
+        makeErrorStr(errorReason, "Reservoir refill of %lu bytes is more than the %d byte maximum read", (unsigned long)refillBytes, MF_MAX_READ_LENGTH);
+        return;
+    }
+
+    BitReservoir& reservoir = generator->GetReservoir();
+    lock_guard<mutex> lock(reservoir.GetMutex());
+    reservoir.SetRefillBytes(refillBytes);
+};
+
+void MeterFeeder::Driver::ClearReservoir(FT_HANDLE handle, string* errorReason) {
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return;
+    }
+
+    BitReservoir& reservoir = generator->GetReservoir();
+    lock_guard<mutex> lock(reservoir.GetMutex());
+    reservoir.Discard();
+};
+
+// Draw an unbiased integer in [0, bound) from the reservoir, refilling it as needed.
+// Called with the reservoir mutex held.
+bool MeterFeeder::Driver::drawBounded(Generator* generator, uint64_t bound, uint32_t* value, string* errorReason) {
+    BitReservoir& reservoir = generator->GetReservoir();
+    unsigned numBits = GetBoundedBits(bound);
+    if (numBits == 0) {
+        *value = 0;
+        return true;
+    }
+
+    for (;;) {
+        if (!refillReservoir(generator, numBits, errorReason)) {
+            return false;
+        }
+        if (BoundedFromBits(reservoir.TakeValue(numBits), numBits, bound, value)) {
+            return true;
+        }
+    }
+};
+
+// Fill values from a sampler taking 32-bit words, drawing the words from the reservoir a batch at a time.
+// A sample cut short at the end of a batch is dropped along with the words it took; words left over once
+// the last value is filled are put back for the next draw.
+void MeterFeeder::Driver::drawVariates(FT_HANDLE handle, size_t count, double* values, bool (*sample)(WordStream*, double*), string* errorReason) {
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return;
+    }
+    if (!values && count > 0) {
+        makeErrorStr(errorReason, "Invalid draw of %lu variates from %s", (unsigned long)count, generator->GetSerialNumber().c_str());
+        return;
+    }
+
+    BitReservoir& reservoir = generator->GetReservoir();
+    lock_guard<mutex> lock(reservoir.GetMutex());
+
+    vector<unsigned char> bytes;
+    vector<uint32_t> words;
+    size_t done = 0;
+    while (done < count) {
+        // Slightly more than a word per variate covers the odd wedge or tail
+        size_t remaining = count - done;
+        size_t numWords = remaining + remaining / 32 + 4;
+        if (numWords > MF_MAX_READ_LENGTH / 4) {
+            numWords = MF_MAX_READ_LENGTH / 4;
+        }
+        if (!refillReservoir(generator.get(), (uint64_t)numWords * 32, errorReason)) {
+            return;
+        }
+        bytes.resize(numWords * 4);
+        words.resize(numWords);
+        reservoir.Take(&bytes[0], (uint64_t)numWords * 32);
+        for (size_t i = 0; i < numWords; i++) {
+            words[i] = ((uint32_t)bytes[i * 4] << 24) | ((uint32_t)bytes[i * 4 + 1] << 16) | ((uint32_t)bytes[i * 4 + 2] << 8) | bytes[i * 4 + 3];
+        }
+
+        WordStream stream = { &words[0], numWords, 0 };
+        while (done < count && sample(&stream, &values[done])) {
+            done++;
+        }
+        reservoir.PutBack((uint64_t)(numWords - stream.position) * 32);
+    }
+};
+
+// Make sure the reservoir holds at least numBits, reading only the whole bytes it is short of
+// (or the refill size if bigger). Called with the reservoir mutex held.
+bool MeterFeeder::Driver::refillReservoir(Generator* generator, uint64_t numBits, string* errorReason) {
+    BitReservoir& reservoir = generator->GetReservoir();
+    uint64_t availableBits = reservoir.GetAvailableBits();
+    if (availableBits >= numBits) {
+        return true;
+    }
+
+    size_t shortBytes = (size_t)((numBits - availableBits + 7) / 8);
+    size_t length = shortBytes > reservoir.GetRefillBytes() ? shortBytes : reservoir.GetRefillBytes();
+    if (length > MF_MAX_READ_LENGTH) {
+        length = shortBytes;
+    }
+
+    // Start the stream only if it isn't running, so the bytes the device already queued aren't purged, then
+    // read it in pieces short enough to arrive within the read timeout
+    lock_guard<mutex> io(generator->GetIoMutex());
+    if (!generator->IsStreaming()) {
+        FT_STATUS streamStatus = generator->StartStreaming();
+        if (streamStatus != FT_OK) {
+            makeErrorStr(errorReason, "Error instructing %s to start streaming entropy [%d]", generator->GetSerialNumber().c_str(), streamStatus);
+            return false;
+        }
+    }
+
+    double pieceBytes = generator->GetProfile().nominalBitRate / 8 * MF_RESERVOIR_PIECE_MS / 1000;
+    size_t maxPiece = pieceBytes < 1 ? 1 : (size_t)pieceBytes;
+    vector<unsigned char> bytes(length < maxPiece ? length : maxPiece);
+    for (size_t filled = 0; filled < length;) {
+        size_t piece = length - filled < bytes.size() ? length - filled : bytes.size();
+        FT_STATUS readStatus = generator->Read((DWORD)piece, &bytes[0]);
+        if (readStatus != FT_OK) {
+            readErrorStr(errorReason, generator, readStatus);
+            return false;
+        }
+        reservoir.Fill(&bytes[0], piece);
+        handOut(generator->GetHandle(), generator, &bytes[0], (DWORD)piece, generator->GetLastChunkTiming(), errorReason);
+        filled += piece;
+    }
+    return true;
+};
+
+void MeterFeeder::Driver::StartCapture(FT_HANDLE handle, DWORD historyMs, string* errorReason) {
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return;
+    }
+
+    double historyBytes = generator->GetProfile().nominalBitRate / 8 * historyMs / 1000;
+    if (historyBytes > MF_CAPTURE_MAX_HISTORY_BYTES) {
+        makeErrorStr(errorReason, "%lu ms of history from %s needs more than %d MB", (unsigned long)historyMs,
+            generator->GetSerialNumber().c_str(), MF_CAPTURE_MAX_HISTORY_BYTES >> 20);
+        return;
+    }
+
+    StopCapture(handle);
+    shared_ptr<TrialCapture> capture = make_shared<TrialCapture>(*generator, (size_t)historyBytes);
+    int status = capture->Start();
+    if (status != MF_OK) {
+        makeErrorStr(errorReason, "Error instructing %s to start streaming entropy [%d]", generator->GetSerialNumber().c_str(), status);
+        return;
+    }
+
+    lock_guard<mutex> lock(_capturesMutex);
+    _captures[handle] = capture;
+};
+
+void MeterFeeder::Driver::StopCapture(FT_HANDLE handle) {
+    shared_ptr<TrialCapture> capture;
+    {
+        lock_guard<mutex> lock(_capturesMutex);
+        map<FT_HANDLE, shared_ptr<TrialCapture>>::iterator it = _captures.find(handle);
+        if (it == _captures.end()) {
+            return;
+        }
+        capture = it->second;
+        _captures.erase(it);
+    }
+    capture->Stop();
+};
+
+void MeterFeeder::Driver::CaptureTrial(FT_HANDLE handle, int64_t triggerUtcNs, uint64_t preBits, uint64_t postBits, TrialWindow* window,
+                                       string* errorReason) {
+    // Take the time first so the lookups don't delay the trigger
+    int64_t triggerMonotonicNs = (int64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+
+    shared_ptr<TrialCapture> capture = findCapture(handle);
+    if (!capture) {
+        makeErrorStr(errorReason, "No capture running on the generator with the handle %p", handle);
+        return;
+    }
+    if (triggerUtcNs != 0) {
+        triggerMonotonicNs = capture->UtcToMonotonic(triggerUtcNs);
+    }
+
+    int status = capture->Trigger(triggerMonotonicNs, preBits, postBits, window);
+    if (status == MF_CAPTURE_GAP) {
+        makeErrorStr(errorReason, "The stream from %s has a gap in the trial window", capture->GetGenerator().GetSerialNumber().c_str());
+    } else if (status != MF_OK) {
+        makeErrorStr(errorReason, "Error capturing a trial from %s [%d]", capture->GetGenerator().GetSerialNumber().c_str(), status);
+    } else {
+        capture->GetGenerator().GetWalkView().Add(window->bits.data(), window->numBits);
+    }
+};
+
+void MeterFeeder::Driver::StartTriggerServer(int port, string* errorReason) {
+    // Look the capture up by itself, the generator list may be changing under the server thread
+    _triggerServer.Start(port, [this](const string& serialNumber) {
+        lock_guard<mutex> lock(_capturesMutex);
+        for (map<FT_HANDLE, shared_ptr<TrialCapture>>::iterator it = _captures.begin(); it != _captures.end(); ++it) {
+            if (it->second->GetGenerator().GetSerialNumber() == serialNumber) {
+                return it->second;
+            }
+        }
+        return shared_ptr<TrialCapture>();
+    }, errorReason);
+};
+
+void MeterFeeder::Driver::StopTriggerServer() {
+    _triggerServer.Stop();
+};
+
+shared_ptr<MeterFeeder::TrialCapture> MeterFeeder::Driver::findCapture(FT_HANDLE handle) {
+    lock_guard<mutex> lock(_capturesMutex);
+    map<FT_HANDLE, shared_ptr<TrialCapture>>::iterator it = _captures.find(handle);
+    return it != _captures.end() ? it->second : shared_ptr<TrialCapture>();
+};
+
+void MeterFeeder::Driver::StartRecording(FT_HANDLE handle, const string& basePath, string* errorReason) {
+    shared_ptr<Generator> generator = FindGeneratorByHandle(handle);
+    if (!generator) {
+        makeErrorStr(errorReason, "Could not find a generator by the handle %p", handle);
+        return;
+    }
+    StopRecording(handle, errorReason);
+    shared_ptr<RecordingWriter> recording = make_shared<RecordingWriter>();
+    if (!recording->Open(basePath, errorReason)) {
+        return;
+    }
+
+    lock_guard<mutex> lock(_recordingsMutex);
+    _recordings[handle] = recording;
+};
+
+void MeterFeeder::Driver::StopRecording(FT_HANDLE handle, string* errorReason) {
+    shared_ptr<RecordingWriter> recording;
+    {
+        lock_guard<mutex> lock(_recordingsMutex);
+        map<FT_HANDLE, shared_ptr<RecordingWriter>>::iterator it = _recordings.find(handle);
+        if (it == _recordings.end()) {
+            return;
+        }
+        recording = it->second;
+        _recordings.erase(it);
+    }
+    recording->Close(errorReason);
+};
+
+void MeterFeeder::Driver::stopAllCaptures() {
+    map<FT_HANDLE, shared_ptr<TrialCapture>> captures;
+    {
+        lock_guard<mutex> lock(_capturesMutex);
+        captures.swap(_captures);
+    }
+    for (map<FT_HANDLE, shared_ptr<TrialCapture>>::iterator it = captures.begin(); it != captures.end(); ++it) {
+        it->second->Stop();
+    }
+};
+
+void MeterFeeder::Driver::stopAllRecordings() {
+    map<FT_HANDLE, shared_ptr<RecordingWriter>> recordings;
+    {
+        lock_guard<mutex> lock(_recordingsMutex);
+        recordings.swap(_recordings);
+    }
+    for (map<FT_HANDLE, shared_ptr<RecordingWriter>>::iterator it = recordings.begin(); it != recordings.end(); ++it) {
+        string errorReason;
+        it->second->Close(&errorReason);
+    }
+};
+
+shared_ptr<MeterFeeder::Generator> MeterFeeder::Driver::FindGeneratorByHandle(FT_HANDLE handle) {
+    lock_guard<mutex> lock(_generatorsMutex);
+    for (size_t i = 0; i < _generators.size(); i++) {
+        if (_generators[i]->GetHandle() == handle) {
+            return _generators[i];
+        }
+    }
+
+    return nullptr;
+};
+
+shared_ptr<MeterFeeder::Generator> MeterFeeder::Driver::FindGeneratorBySerial(string serialNumber) {
+    lock_guard<mutex> lock(_generatorsMutex);
+    for (size_t i = 0; i < _generators.size(); i++) {
+        if (_generators[i]->GetSerialNumber() == serialNumber) {
+            return _generators[i];
+        }
+    }
+
+    return nullptr;
+};
+
+void MeterFeeder::Driver::readErrorStr(string* errorReason, Generator* generator, int status) {
+    if (status == MF_RESEED_FAILED) {
+        makeErrorStr(errorReason, "Error reseeding %s: %s [%d]", generator->GetSerialNumber().c_str(), generator->GetSourceError().c_str(), status);
+        return;
+    }
+    makeErrorStr(errorReason, "Error reading in entropy from %s [%d]", generator->GetSerialNumber().c_str(), status);
+};
+
+void MeterFeeder::Driver::makeErrorStr(string* errorReason, const char* format, ...) {
+    char buffer[MF_ERROR_STR_MAX_LEN];
+    va_list args;
+    va_start (args, format);
+    vsnprintf (buffer, MF_ERROR_STR_MAX_LEN-1, format, args);
+    *errorReason = buffer;
+    va_end (args);
+};
+
+/**
+ * Code below for interfacing with MeterFeeder as a library
+ */
+
+#ifdef __APPLE__
+    #define DllExport __attribute__((visibility("default")))
+#elif defined __GNUC__
+    #define DllExport __attribute__((visibility("default")))
+#else
+     #define DllExport __declspec(dllexport)
+#endif
+
+extern "C" {
+    /**
+     * Library functions exposed for consumption by Unity/C# or whomever
+     */
+
+    using namespace MeterFeeder;
+    Driver driver;
+
+    // Reads submitted with MF_GetBytesAsync without a callback finish here for MF_PollCompletion
+    CompletionQueue completions;
+
+    // Called on the driver's reactor thread when an asynchronous read finishes
+    typedef void (*MF_ReadCallback)(int64_t requestId, int status, int bytesRead, void* userData);
+
+    // Initialize the connected generators
+    DllExport int MF_Initialize(char* pErrorReason) {
+        string errorReason = "";
+        int res = driver.Initialize(&errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return res;
+    }
+
+    // Initialize only the connected generators matching the filter.
+    // Filter format: comma separated serial numbers or serial number prefixes, e.g. "QWR4A003,QWR4M"
+    DllExport int MF_InitializeWithFilter(char* filter, char* pErrorReason) {
+        vector<string> filters;
+        string remaining = filter ? filter : "";
+        size_t pos;
+        while ((pos = remaining.find(',')) != string::npos) {
+            filters.push_back(remaining.substr(0, pos));
+            remaining.erase(0, pos + 1);
+        }
+        if (!remaining.empty()) {
+            filters.push_back(remaining);
+        }
+
+        string errorReason = "";
+        int res = driver.Initialize(filters, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return res;
+    }
+
+    // Initialize simulated generators (serial numbers SIM...) instead of the connected ones, for testing without hardware.
+    // modelPrefix is the serial number prefix of the model to simulate, e.g. "QWR4A" for MED100Ks.
+    DllExport int MF_InitializeSimulated(int count, char* modelPrefix, char* pErrorReason) {
+        string errorReason = "";
+        int res = driver.InitializeSimulated(count, modelPrefix ? modelPrefix : "QWR4A", &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return res;
+    }
+
+    // Initialize generators replaying recordings instead of the connected ones. paths is a comma separated list
+    // of .hex recordings, or .bin recordings with their .walk pyramids; each generator's serial number is its
+    // file name without the extension. speed is 1 for the recorded pace, more to speed it up, 0 for full speed.
+    // Reads after the end of a recording fail with MF_REPLAY_ENDED (1006).
+    DllExport int MF_InitializeReplay(char* paths, double speed, char* pErrorReason) {
+        vector<string> recordings;
+        string remaining = paths ? paths : "";
+        size_t pos;
+        while ((pos = remaining.find(',')) != string::npos) {
+            recordings.push_back(remaining.substr(0, pos));
+            remaining.erase(0, pos + 1);
+        }
+        if (!remaining.empty()) {
+            recordings.push_back(remaining);
+        }
+
+        string errorReason = "";
+        int res = driver.InitializeReplay(recordings, speed, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return res;
+    }
+
+    // Add a virtual generator expanding seeds from the specified generator with a DRBG ("chacha20" or "aes-ctr",
+    // which needs AES-NI), for bulk consumers needing far more than the device's rate. Read it with MF_GetBytes
+    // etc. like any generator; the device's own stream is untouched apart from 64 byte seeds. It reseeds after
+    // reseedBytes of output or reseedMs, whichever comes first (0 for no budget, negative for the defaults of
+    // 256MB and 10 s). Its serial number, the generator's with "-CHACHA20" or "-AESCTR" appended, is copied
+    // to pDrbgSerialNumber (MF_ERROR_STR_MAX_LEN chars). It lasts until the next initialization.
+    DllExport bool MF_AddDrbgGenerator(char* generatorSerialNumber, char* algorithm, int64_t reseedBytes, int reseedMs,
+                                       char* pDrbgSerialNumber, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return false;
+        }
+        string name = algorithm ? algorithm : "chacha20";
+        if (name != "chacha20" && name != "aes-ctr") {
+            std::strcpy(pErrorReason, "Unknown DRBG algorithm");
+            return false;
+        }
+        string serialNumber = driver.AddDrbgGenerator(generator->GetHandle(), name == "aes-ctr" ? DRBG_AES_CTR : DRBG_CHACHA20,
+                                                      reseedBytes < 0 ? MF_DRBG_DEFAULT_RESEED_BYTES : (uint64_t)reseedBytes,
+                                                      reseedMs < 0 ? MF_DRBG_DEFAULT_RESEED_MS : reseedMs, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        std::strcpy(pDrbgSerialNumber, serialNumber.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return errorReason.empty();
+    }
+
+    // Get how many bytes a DRBG generator has produced and how many times it has been seeded.
+    DllExport bool MF_GetDrbgStats(char* generatorSerialNumber, uint64_t* pBytesGenerated, uint64_t* pReseeds) {
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            return false;
+        }
+        shared_ptr<DrbgSource> source = std::dynamic_pointer_cast<DrbgSource>(generator->GetVirtualSource());
+        if (!source) {
+            return false;
+        }
+        *pBytesGenerated = source->GetBytesGenerated();
+        *pReseeds = source->GetReseedCount();
+        return true;
+    }
+
+    // Get the per-device results of the last initialization, including the devices that failed to open.
+    // Array element format: <serial number>|<description>|<OK or error reason>
+    // (each element buffer must hold MF_ERROR_STR_MAX_LEN chars)
+    DllExport int MF_GetInitResultsWithSize(char** pResults, int arraySize) {
+        vector<InitResult>* results = driver.GetInitResults();
+        int numResults = (int)results->size();
+
+        if (arraySize < numResults) {
+            return -1;  // Array too small
+        }
+
+        for (int i = 0; i < numResults; i++) {
+            InitResult* result = &results->at(i);
+            string fullResult = result->serialNumber + "|" + result->description + "|" + (result->ok ? "OK" : result->errorReason);
+            std::strcpy(pResults[i], fullResult.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+            pResults[i][MF_ERROR_STR_MAX_LEN - 1] = '\0';
+        }
+        return numResults;
+    }
+
+    // Shutdown and de-initialize all the generators.
+    DllExport void MF_Shutdown() {
+        driver.Shutdown();
+    }
+
+    // Shutdown and re-initialize all the generators.
+    DllExport int MF_Reset(char* pErrorReason) {
+        MF_Shutdown();
+        return MF_Initialize(pErrorReason);
+    }
+
+    // Stop streaming on the specified generator.
+    DllExport bool MF_Clear(char* generatorSerialNumber, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return false;
+        }
+        driver.Clear(generator->GetHandle(), &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        if (*pErrorReason != '\0') {
+            return false;
+        }
+        return true;
+    }
+
+    // Get the number of connected and successfully initialized generators.
+    DllExport int MF_GetNumberGenerators() {
+        return driver.GetNumberGenerators();
+    }
+
+      // Get the list of connected and successfully initialized generators with serial number and device description.
+    // Array element format: <serial number>|<description>
+    DllExport int MF_GetListGeneratorsWithSize(char** pGenerators, int arraySize) {
+        vector<Generator> generators = driver.GetListGenerators();
+        int numGenerators = (int)generators.size();
+        
+        if (arraySize < numGenerators) {
+            return -1;  // Array too small
+        }
+        
+        for (int i = 0; i < numGenerators; i++) {
+            Generator generator = generators.at(i);
+            string fullGenDesc = generator.GetSerialNumber() + "|" + generator.GetDescription();
+            std::strcpy(pGenerators[i], fullGenDesc.c_str());
+        }
+        return numGenerators;
+    }
+
+    // Original function maintained for backward compatibility
+    DllExport void MF_GetListGenerators(char** pGenerators) {
+        MF_GetListGeneratorsWithSize(pGenerators, driver.GetNumberGenerators());
+    }
+
+    // Get the list of connected and successfully initialized generators.
+    // Array element format: <serial number>
+    DllExport int MF_GetSerialListGeneratorsWithSize(char** pGenerators, int arraySize) {
+        vector<Generator> generators = driver.GetListGenerators();
+        int numGenerators = (int)generators.size();
+        
+        if (arraySize < numGenerators) {
+            return -1;  // Array too small
+        }
+        
+        for (int i = 0; i < numGenerators; i++) {
+            Generator generator = generators.at(i);
+            std::strcpy(pGenerators[i], generator.GetSerialNumber().c_str());
+        }
+        return numGenerators;
+    }
+
+    // Original function maintained for backward compatibility
+    DllExport void MF_GetSerialListGenerators(char** pGenerators) {
+        MF_GetSerialListGeneratorsWithSize(pGenerators, driver.GetNumberGenerators());
+    }
+
+    // Get the transport profile in use for the specified generator.
+    // Format: <model>|<nominal bit rate>|<latency ms>|<usb transfer size>|<read chunk bytes>
+    DllExport bool MF_GetTransportProfile(char* generatorSerialNumber, char* pProfile, char* pErrorReason) {
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return false;
+        }
+        TransportProfile profile = generator->GetProfile();
+        snprintf(pProfile, MF_ERROR_STR_MAX_LEN, "%s|%.0f|%u|%lu|%lu", profile.model, profile.nominalBitRate,
+            (unsigned)profile.latencyMs, (unsigned long)profile.usbTransferSize, (unsigned long)profile.readChunkBytes);
+        *pErrorReason = '\0';
+        return true;
+    }
+
+    // Override the latency timer, USB transfer size and read chunk size for the specified generator.
+    DllExport bool MF_SetTransportProfile(char* generatorSerialNumber, int latencyMs, int usbTransferSize, int readChunkBytes, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return false;
+        }
+        if (latencyMs < 1 || latencyMs > 255 || usbTransferSize < 0 || readChunkBytes < 0) {
+            std::strcpy(pErrorReason, "Transport parameters out of range");
+            return false;
+        }
+        TransportProfile profile = generator->GetProfile();
+        profile.latencyMs = (UCHAR)latencyMs;
+        profile.usbTransferSize = usbTransferSize;
+        profile.readChunkBytes = readChunkBytes;
+        driver.SetTransportProfile(generator->GetHandle(), profile, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return errorReason.empty();
+    }
+
+    // Sweep transport parameters on the specified generator and keep the best performing ones.
+    // Takes several seconds (minutes on a MED1Kx3). The tuned profile can be read back with MF_GetTransportProfile.
+    DllExport bool MF_TuneTransport(char* generatorSerialNumber, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return false;
+        }
+        vector<TuneSample> samples;
+        driver.TuneTransport(generator->GetHandle(), &samples, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return errorReason.empty();
+    }
+
+    // Get the counters (bytes, reads, short reads, timeouts, purges, errors) and latency histograms of the
+    // specified generator, or of all generators if the serial number is null or empty, as Prometheus text.
+    // Returns the length of the text, which is truncated if it is that long or longer than bufferSize.
+    DllExport int MF_GetMetrics(char* generatorSerialNumber, char* pBuffer, int bufferSize) {
+        string text = driver.GetMetrics(generatorSerialNumber ? generatorSerialNumber : "");
+        if (pBuffer && bufferSize > 0) {
+            snprintf(pBuffer, bufferSize, "%s", text.c_str());
+        }
+        return (int)text.length();
+    }
+
+    // Write the metrics of all generators to a file every intervalMs milliseconds, e.g. for the node exporter
+    // textfile collector. The file is replaced atomically so it is never seen half written.
+    DllExport bool MF_StartMetricsExporter(char* path, int intervalMs, char* pErrorReason) {
+        string errorReason = "";
+        driver.StartMetricsExporter(path ? path : "", intervalMs > 0 ? intervalMs : 1000, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return errorReason.empty();
+    }
+
+    // Stop writing the metrics file.
+    DllExport void MF_StopMetricsExporter() {
+        driver.StopMetricsExporter();
+    }
+
+    // Get the bias of the specified generator's output in the sliding window of the given length (1000, 60000 or
+    // 3600000 ms), kept up to date as it's read: the bits counted, the z-score of the ones, and the chi-square of the
+    // byte values against uniform with its p-value. coveredMs is how long the counted bits actually span.
+    DllExport bool MF_GetBiasStats(char* generatorSerialNumber, int windowMs, int64_t* pBits, double* pZScore,
+                                   double* pChiSquare, double* pChiSquarePValue, double* pCoveredMs, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return false;
+        }
+        vector<BiasWindowStats> windows;
+        driver.GetBiasStats(generator->GetHandle(), &windows, &errorReason);
+        if (!errorReason.empty()) {
+            std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+            return false;
+        }
+        for (size_t i = 0; i < windows.size(); i++) {
+            if (windows[i].windowMs == (uint32_t)windowMs) {
+                *pBits = (int64_t)windows[i].bits;
+                *pZScore = windows[i].zScore;
+                *pChiSquare = windows[i].chiSquare;
+                *pChiSquarePValue = windows[i].chiSquarePValue;
+                *pCoveredMs = windows[i].coveredMs;
+                std::strcpy(pErrorReason, "");
+                return true;
+            }
+        }
+        std::strcpy(pErrorReason, "No bias window of that length");
+        return false;
+    }
+
+    // Turn the bias monitor of the specified generator on or off (on by default except for DRBGs).
+    DllExport bool MF_SetBiasMonitor(char* generatorSerialNumber, int enabled, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return false;
+        }
+        driver.SetBiasMonitor(generator->GetHandle(), enabled != 0, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return errorReason.empty();
+    }
+
+    // Keep a random walk over the bytes the specified generator hands out (MF_GetBytes, MF_CaptureTrial), decimated to
+    // numPoints min/max points spanning spanSteps steps, for plotting at any bit rate. 0 points stops keeping it.
+    DllExport bool MF_SetWalkView(char* generatorSerialNumber, int numPoints, int64_t spanSteps, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return false;
+        }
+        if (numPoints < 0 || spanSteps < 0) {
+            std::strcpy(pErrorReason, "Invalid walk view");
+            return false;
+        }
+        driver.SetWalkView(generator->GetHandle(), (size_t)numPoints, (uint64_t)spanSteps, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return errorReason.empty();
+    }
+
+    // Get the specified generator's random walk: the lowest and highest position of each point of the current window
+    // filled so far (pMins and pMaxs must hold maxPoints), the position now, its lowest and highest since the last
+    // reset, and the steps each point covers. Returns the number of points stored, or -1 on error.
+    DllExport int MF_GetWalkView(char* generatorSerialNumber, int maxPoints, int64_t* pMins, int64_t* pMaxs, int64_t* pPosition,
+                                 int64_t* pMin, int64_t* pMax, int64_t* pStepsPerPoint, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return -1;
+        }
+        vector<int64_t> mins, maxs;
+        WalkSummary summary;
+        driver.GetWalkView(generator->GetHandle(), &mins, &maxs, &summary, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        if (!errorReason.empty()) {
+            return -1;
+        }
+        int numPoints = (int)std::min(mins.size(), (size_t)(maxPoints > 0 ? maxPoints : 0));
+        if (numPoints > 0) {
+            std::memcpy(pMins, &mins[0], numPoints * sizeof(int64_t));
+            std::memcpy(pMaxs, &maxs[0], numPoints * sizeof(int64_t));
+        }
+        *pPosition = summary.position;
+        *pMin = summary.min;
+        *pMax = summary.max;
+        *pStepsPerPoint = (int64_t)summary.stepsPerPoint;
+        return numPoints;
+    }
+
+    // Start the specified generator's random walk over from 0 with an empty window.
+    DllExport void MF_ResetWalkView(char* generatorSerialNumber) {
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (generator) {
+            string errorReason;
+            driver.ResetWalkView(generator->GetHandle(), &errorReason);
+        }
+    }
+
+    // Start timing the phases of every read (lock wait, purge, command write, first byte, transfer),
+    // keeping the last maxEvents of them. Until this is called tracing costs next to nothing.
+    // Note that timing the first byte polls the receive queue, which adds some CPU use to blocking reads.
+    DllExport void MF_EnableTracing(int maxEvents) {
+        Tracer::Enable(maxEvents > 0 ? maxEvents : 100000);
+    }
+
+    // Stop timing read phases. What was recorded is kept for MF_DumpTrace.
+    DllExport void MF_DisableTracing() {
+        Tracer::Disable();
+    }
+
+    // Write the recorded read phases to a file as Chrome trace event JSON (open it in chrome://tracing or Perfetto).
+    DllExport bool MF_DumpTrace(char* path, char* pErrorReason) {
+        string errorReason = "";
+        Tracer::DumpChromeTrace(path ? path : "", &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return errorReason.empty();
+    }
+
+    // Get bytes of randomness.
+    DllExport void MF_GetBytes(int length, unsigned char* buffer, char* generatorSerialNumber, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return;
+        }
+        driver.GetBytes(generator->GetHandle(), length, buffer, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+    }
+
+    // Get bytes of randomness and when they were generated: the UTC and host monotonic clock times (nanoseconds)
+    // of the first bit, and the nominal time between bits. Bit i of the buffer was generated at about
+    // first + i * period, where bit 0 is the most significant bit of the first byte.
+    DllExport void MF_GetBytesTimestamped(int length, unsigned char* buffer, char* generatorSerialNumber,
+                                          int64_t* pFirstBitUtcNs, int64_t* pFirstBitMonotonicNs, double* pBitPeriodNs, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return;
+        }
+        ChunkTiming timing;
+        driver.GetBytesTimestamped(generator->GetHandle(), length, buffer, &timing, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        if (!errorReason.empty()) {
+            return;
+        }
+        *pFirstBitUtcNs = GetBitTimeNs(timing, 0, true);
+        *pFirstBitMonotonicNs = GetBitTimeNs(timing, 0, false);
+        *pBitPeriodNs = timing.bitRate > 0 ? 1e9 / timing.bitRate : 0;
+    }
+
+    // Get the UTC times (nanoseconds) at which bits of the last chunk read from the specified generator were
+    // generated: count times starting at bit firstBit, stride bits apart. A stride of 8 from bit 0 gives the
+    // time of each byte. Returns the number of times stored, fewer than count if the chunk ends first.
+    DllExport int MF_GetLastChunkBitTimes(char* generatorSerialNumber, int64_t firstBit, int count, int stride, int64_t* pUtcNs,
+                                          char* pErrorReason) {
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return 0;
+        }
+        if (firstBit < 0 || count < 0 || stride < 1) {
+            std::strcpy(pErrorReason, "Invalid bit range");
+            return 0;
+        }
+        *pErrorReason = '\0';
+
+        ChunkTiming timing = generator->GetLastChunkTiming();
+        int64_t numBits = (int64_t)timing.length * 8;
+        int stored = 0;
+        for (int64_t bit = firstBit; stored < count && bit < numBits; bit += stride) {
+            pUtcNs[stored++] = GetBitTimeNs(timing, bit, true);
+        }
+        return stored;
+    }
+
+    // Get exactly numBits bits of randomness, packed most significant bit first into buffer (which must hold
+    // (numBits + 7) / 8 bytes). Bits come from the generator's reservoir, which only reads whole bytes from the
+    // device when it runs short and keeps the leftover bits for the next call, so no bits are wasted.
+    // Bits in the reservoir may have been read a while ago; use MF_ClearReservoir to start afresh.
+    DllExport void MF_GetBits(int numBits, unsigned char* buffer, char* generatorSerialNumber, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return;
+        }
+        driver.GetBits(generator->GetHandle(), numBits > 0 ? numBits : 0, buffer, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+    }
+
+    // Get count unbiased random integers in [0, bound), unlike MF_RandInt32() % bound. The bits for the whole batch
+    // are drawn from the generator's bit reservoir at once (see MF_GetBits), using only as many bits per integer
+    // as the bound needs plus a few to make retries rare.
+    DllExport void MF_RandBounded(uint32_t bound, int count, uint32_t* pValues, char* generatorSerialNumber, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return;
+        }
+        driver.GetBoundedInts(generator->GetHandle(), bound, count > 0 ? count : 0, pValues, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+    }
+
+    // Shuffle count items into a uniformly random order in place.
+    DllExport void MF_Shuffle(int32_t* pItems, int count, char* generatorSerialNumber, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return;
+        }
+        driver.Shuffle(generator->GetHandle(), pItems, count > 0 ? count : 0, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+    }
+
+    // Get a uniformly random permutation of 0 to count - 1, e.g. an order for count trial conditions.
+    DllExport void MF_RandPermutation(int count, int32_t* pPermutation, char* generatorSerialNumber, char* pErrorReason) {
+        for (int i = 0; i < count; i++) {
+            pPermutation[i] = i;
+        }
+        MF_Shuffle(pPermutation, count, generatorSerialNumber, pErrorReason);
+    }
+
+    // Get count standard normal variates (mean 0, standard deviation 1). Much cheaper than calling MF_RandNormal
+    // count times: the ziggurat method takes about 32 bits per variate, drawn from the generator's bit reservoir
+    // for the whole batch at once, and mostly needs no log, sqrt or cos.
+    DllExport void MF_RandNormals(int count, double* pValues, char* generatorSerialNumber, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return;
+        }
+        driver.GetNormals(generator->GetHandle(), count > 0 ? count : 0, pValues, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+    }
+
+    // Get count standard exponential variates (rate 1, so mean 1), e.g. waiting times between random events.
+    // Drawn like MF_RandNormals.
+    DllExport void MF_RandExponentials(int count, double* pValues, char* generatorSerialNumber, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return;
+        }
+        driver.GetExponentials(generator->GetHandle(), count > 0 ? count : 0, pValues, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+    }
+
+    // Build an alias table for weighted choices among count categories (e.g. stimulus categories or feedback
+    // states), weights[i] being the relative weight of category i. Returns the table's id for MF_RandCategorical,
+    // or 0 on bad weights. Free it with MF_DestroyAliasTable.
+    DllExport int MF_CreateAliasTable(double* weights, int count, char* pErrorReason) {
+        string errorReason = "";
+        int tableId = driver.CreateAliasTable(weights, count > 0 ? count : 0, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return tableId;
+    }
+
+    // Free an alias table.
+    DllExport void MF_DestroyAliasTable(int tableId) {
+        driver.DestroyAliasTable(tableId);
+    }
+
+    // Get count weighted random categories from an alias table. Each takes an unbiased column index and a 32 bit
+    // coin, whatever the number of categories or weights, drawn from the generator's bit reservoir for the whole
+    // batch at once.
+    DllExport void MF_RandCategorical(int tableId, int count, uint32_t* pValues, char* generatorSerialNumber, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return;
+        }
+        driver.GetCategorical(generator->GetHandle(), tableId, count > 0 ? count : 0, pValues, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+    }
+
+    // Set how many bytes the specified generator's bit reservoir reads from the device at a time when it runs
+    // short (0 to read only the whole bytes each MF_GetBits call is short of). Defaults to 10 ms of data.
+    DllExport bool MF_SetReservoirRefill(char* generatorSerialNumber, int refillBytes, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return false;
+        }
+        driver.SetReservoirRefill(generator->GetHandle(), refillBytes > 0 ? refillBytes : 0, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return errorReason.empty();
+    }
+
+    // Discard the bits left in the specified generator's bit reservoir.
+    DllExport bool MF_ClearReservoir(char* generatorSerialNumber, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return false;
+        }
+        driver.ClearReservoir(generator->GetHandle(), &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return errorReason.empty();
+    }
+
+    // Get the bit accounting of the specified generator's reservoir: bits read from the device, handed out by
+    // MF_GetBits, discarded and still available. Filled always equals drawn + discarded + available.
+    DllExport bool MF_GetReservoirStats(char* generatorSerialNumber, uint64_t* pBitsFilled, uint64_t* pBitsDrawn, uint64_t* pBitsDiscarded,
+                                        uint64_t* pBitsAvailable) {
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            return false;
+        }
+        BitReservoir& reservoir = generator->GetReservoir();
+        std::lock_guard<std::mutex> lock(reservoir.GetMutex());
+        *pBitsFilled = reservoir.GetBitsFilled();
+        *pBitsDrawn = reservoir.GetBitsDrawn();
+        *pBitsDiscarded = reservoir.GetBitsDiscarded();
+        *pBitsAvailable = reservoir.GetAvailableBits();
+        return true;
+    }
+
+    // Start streaming the specified generator continuously into a ring keeping historyMs of history, so trials
+    // can be captured with MF_CaptureTrial (or over UDP, see MF_StartTriggerServer) without waiting for the
+    // stream to start. Don't read from the generator any other way while capturing.
+    DllExport bool MF_StartCapture(char* generatorSerialNumber, int historyMs, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return false;
+        }
+        driver.StartCapture(generator->GetHandle(), historyMs > 0 ? historyMs : 0, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return errorReason.empty();
+    }
+
+    // Stop trial capture on the specified generator.
+    DllExport void MF_StopCapture(char* generatorSerialNumber) {
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (generator) {
+            driver.StopCapture(generator->GetHandle());
+        }
+    }
+
+    // Get the bits from preBits before to postBits after a trigger from a generator being captured, packed most
+    // significant bit first into buffer (which must hold (preBits + postBits + 7) / 8 bytes). The trigger is now
+    // if triggerUtcNs is 0, otherwise that time in nanoseconds since the Unix epoch (e.g. when a key was pressed).
+    // Blocks until the bits after the trigger have arrived. Fills in the UTC time of the first bit and the index of
+    // the first bit at or after the trigger. Returns the number of bits stored, fewer than preBits + postBits if the
+    // history didn't go back far enough, or 0 on error.
+    DllExport int MF_CaptureTrial(char* generatorSerialNumber, int64_t triggerUtcNs, int preBits, int postBits, unsigned char* buffer,
+                                  int64_t* pFirstBitUtcNs, int* pTriggerBitOffset, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return 0;
+        }
+        if (preBits < 0 || postBits < 0 || preBits + postBits == 0) {
+            std::strcpy(pErrorReason, "Invalid trial window");
+            return 0;
+        }
+        TrialWindow window;
+        driver.CaptureTrial(generator->GetHandle(), triggerUtcNs, preBits, postBits, &window, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        if (!errorReason.empty()) {
+            return 0;
+        }
+        std::memcpy(buffer, &window.bits[0], window.bits.size());
+        *pFirstBitUtcNs = window.firstBitUtcNs;
+        *pTriggerBitOffset = (int)window.triggerBitOffset;
+        return (int)window.numBits;
+    }
+
+    // Take trial triggers for captured generators as UDP datagrams on 127.0.0.1:port (0 for the default port).
+    // Send "TRIGGER <serial> <pre bits> <post bits> [tag]" and the reply is
+    // "OK <tag> <serial> <trigger UTC ns> <first bit UTC ns> <bit period ns> <trigger bit offset> <bits> <hex>"
+    // or "ERR <tag> <reason>". The trigger time is when the datagram arrives.
+    DllExport bool MF_StartTriggerServer(int port, char* pErrorReason) {
+        string errorReason = "";
+        driver.StartTriggerServer(port > 0 ? port : MF_TRIGGER_DEFAULT_PORT, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return errorReason.empty();
+    }
+
+    // Stop taking trial triggers over UDP.
+    DllExport void MF_StopTriggerServer() {
+        driver.StopTriggerServer();
+    }
+
+    // Record the bytes the specified generator hands out to <basePath>.bin: by MF_GetBytes, MF_GetBytesAsync and the bit
+    // reservoir (MF_GetBits, MF_RandBounded, MF_RandNormals etc.), but not trials taken by MF_CaptureTrial. A walk pyramid
+    // is kept in <basePath>.walk for drawing the walk at any zoom (see MF_QueryWalkPyramid).
+    DllExport bool MF_StartRecording(char* generatorSerialNumber, char* basePath, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return false;
+        }
+        driver.StartRecording(generator->GetHandle(), basePath ? basePath : "", &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return errorReason.empty();
+    }
+
+    // Stop recording the specified generator and finish its walk pyramid.
+    DllExport bool MF_StopRecording(char* generatorSerialNumber, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return false;
+        }
+        driver.StopRecording(generator->GetHandle(), &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return errorReason.empty();
+    }
+
+    // Get the walk of a recording (<basePath>.walk, and <basePath>.bin when zoomed in past its finest level) from
+    // fromUtcNs to toUtcNs (0 for the start or end) to draw across the given number of pixels: the lowest and
+    // highest position and the UTC time of the first bit of each block, at least one block per pixel. The buffers
+    // must hold maxBlocks (2 * pixels + 2 is always enough). Stores the bits per block, the index of the first
+    // block's first bit and the position before it. Returns the number of blocks stored, or -1 on error.
+    DllExport int MF_QueryWalkPyramid(char* basePath, int64_t fromUtcNs, int64_t toUtcNs, int pixels, int maxBlocks, int64_t* pMins,
+                                      int64_t* pMaxs, int64_t* pFirstUtcNs, int64_t* pBlockBits, int64_t* pFirstBit,
+                                      int64_t* pStartPosition, char* pErrorReason) {
+        string errorReason = "";
+        string base = basePath ? basePath : "";
+        string rawPath = base + ".bin";
+        FILE* raw = fopen(rawPath.c_str(), "rb");
+        if (raw != nullptr) {
+            fclose(raw);
+        } else {
+            rawPath = "";
+        }
+        WalkPyramid pyramid;
+        WalkQueryResult result;
+        if (pixels <= 0 || !pyramid.Open(base + ".walk", rawPath, &errorReason)
+            || !pyramid.QueryTime(fromUtcNs, toUtcNs, (size_t)pixels, &result, &errorReason)) {
+            std::strcpy(pErrorReason, errorReason.empty() ? "Invalid pixel count" : errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+            return -1;
+        }
+        int count = (int)std::min(result.blocks.size(), (size_t)(maxBlocks > 0 ? maxBlocks : 0));
+        for (int i = 0; i < count; i++) {
+            pMins[i] = result.blocks[i].min;
+            pMaxs[i] = result.blocks[i].max;
+            pFirstUtcNs[i] = result.blocks[i].firstUtcNs;
+        }
+        *pBlockBits = (int64_t)result.blockBits;
+        *pFirstBit = (int64_t)result.firstBit;
+        *pStartPosition = result.startPosition;
+        std::strcpy(pErrorReason, "");
+        return count;
+    }
+
+    // Submit a read of bytes of randomness and return immediately without waiting for the data.
+    // Any number of reads may be outstanding, on the same or different generators; reads on the same
+    // generator are serviced in order. With restart 0 a read continues the stream left running by the
+    // previous one, so back-to-back reads keep the pipe full and return contiguous data.
+    // The buffer must stay valid until the read finishes. When it does, the callback is called on a
+    // driver thread with the status (MF_OK or the reason it failed) and the number of bytes stored,
+    // or if the callback is null the result is queued for MF_PollCompletion.
+    // Returns the request id (for MF_CancelRead), or 0 on failure to submit.
+    DllExport int64_t MF_GetBytesAsync(int length, unsigned char* buffer, char* generatorSerialNumber, int timeoutMs, int restart,
+                                       MF_ReadCallback callback, void* userData, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return 0;
+        }
+        if (timeoutMs < 0) {
+            timeoutMs = FTDI_DEVICE_TX_TIMEOUT_MS;
+        }
+
+        Reactor::Completion completion;
+        if (callback) {
+            completion = [callback, userData](uint64_t id, int status, DWORD bytesRead) {
+                callback((int64_t)id, status, (int)bytesRead, userData);
+            };
+        } else {
+            completion = [](uint64_t id, int status, DWORD bytesRead) {
+                completions.Push(id, status, bytesRead);
+            };
+        }
+
+        uint64_t id = driver.SubmitRead(generator->GetHandle(), length, buffer, timeoutMs, restart != 0, completion, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return (int64_t)id;
+    }
+
+    // Wait up to timeoutMs for a read submitted without a callback to finish.
+    // Returns 1 and fills in the request id, status and number of bytes read if one finished, 0 on timeout.
+    DllExport int MF_PollCompletion(int64_t* pRequestId, int* pStatus, int* pBytesRead, int timeoutMs) {
+        CompletionQueue::Completed completed;
+        if (!completions.Pop(&completed, timeoutMs > 0 ? timeoutMs : 0)) {
+            return 0;
+        }
+        *pRequestId = (int64_t)completed.id;
+        *pStatus = completed.status;
+        *pBytesRead = (int)completed.bytesRead;
+        return 1;
+    }
+
+    // Cancel an outstanding read. It finishes with status MF_READ_CANCELLED.
+    // Returns true if the read was still outstanding.
+    DllExport bool MF_CancelRead(int64_t requestId) {
+        return driver.CancelRead((uint64_t)requestId);
+    }
+
+    // Get bytes of randomness by a deadline, keeping whatever arrived instead of failing the whole read.
+    // Returns as soon as minLength bytes have arrived (with anything else already queued, up to maxLength), or
+    // after timeoutMs with what did arrive. Pass the same value for both lengths to read as much as possible by the
+    // deadline. The error reason is set if fewer than minLength bytes arrived.
+    // Returns the number of bytes stored in the buffer (which holds maxLength bytes), even on error.
+    DllExport int MF_GetBytesWithDeadline(int minLength, int maxLength, unsigned char* buffer, char* generatorSerialNumber, int timeoutMs, char* pErrorReason) {
+        string errorReason = "";
+        shared_ptr<Generator> generator = driver.FindGeneratorBySerial(generatorSerialNumber);
+        if (!generator) {
+            std::strcpy(pErrorReason, "Generator not found");
+            return 0;
+        }
+        int bytesRead = driver.GetBytesWithDeadline(generator->GetHandle(), minLength, maxLength, buffer, timeoutMs > 0 ? timeoutMs : 0, &errorReason);
+        std::strcpy(pErrorReason, errorReason.substr(0, MF_ERROR_STR_MAX_LEN - 1).c_str());
+        return bytesRead;
     }
 
     // Get a byte of randomness.
@@ -295,8 +2054,8 @@ extern "C" {
 
     // Get a random floating point number between [0,1)
     DllExport double MF_RandUniform(char* generatorSerialNumber, char* pErrorReason) {
-        int sizeofUint48 = 6; // value for the mantissa part of double
-        UCHAR *buffer = (UCHAR*)malloc(sizeof(sizeofUint48));
+        const int sizeofUint48 = 6; // value for the mantissa part of double
+        UCHAR *buffer = (UCHAR*)malloc(sizeofUint48);
         MF_GetBytes(sizeofUint48, buffer, generatorSerialNumber, pErrorReason);
 
         uint64_t mantissa = 0;
@@ -313,9 +2072,10 @@ extern "C" {
         return uniform;
     }
 
-    // Get a random normal number with mean zero and standard deviation one
+    // Get a random normal number with mean zero and standard deviation one (Box-Muller). For more than a few,
+    // MF_RandNormals is far cheaper.
     DllExport double MF_RandNormal(char* generatorSerialNumber, char* pErrorReason) {
-        // TODO: Not confident in the accuracy of the implementation here - should be checked one day
+        // Checked against the normal CDF alongside the ziggurat by meterfeeder --bench-variates
 
         // first half of calculation: create normU1
         double normU1 = MF_RandUniform(generatorSerialNumber, pErrorReason);
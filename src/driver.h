@@ -13,15 +13,39 @@
 #include <vector>
 #include <math.h>
 #include <cstdint>
+#include <thread>
+#include <chrono>
+#include <map>
 
 #include "../ftd2xx/ftd2xx.h"
 
+#include "capture.h"
 #include "constants.h"
+#include "drbg.h"
 #include "generator.h"
+#include "metrics.h"
+#include "profile.h"
+#include "reactor.h"
+#include "recording.h"
+#include "replay.h"
+#include "simulated.h"
+#include "timing.h"
+#include "trace.h"
+#include "variates.h"
 
 using namespace std;
 
 namespace MeterFeeder {
+    /**
+     * Outcome of opening and configuring a single generator during initialization.
+     */
+    struct InitResult {
+        string serialNumber;
+        string description;
+        bool ok;
+        string errorReason;
+    };
+
     /**
      * Driver for MeterFeeder Library.
      * 
@@ -38,6 +62,82 @@ namespace MeterFeeder {
          */
         bool Initialize(string* errorReason);
 
+        /**
+         * Initialize only the connected generators matching the filter.
+         * Devices are opened and configured concurrently so startup is bounded by the slowest
+         * device rather than the sum of all of them. A device failing to open does not stop
+         * the others from being initialized; see GetInitResults() for per-device outcomes.
+         * 
+         * @param filters: Serial numbers or serial number prefixes (e.g. "QWR4A" for all MED100Ks)
+         *                 to initialize. Empty to initialize all the connected generators.
+         * @param errorReason: Contains error reason string if no generator could be initialized.
+         * 
+         * @return true if at least one generator was initialized, false on failure
+         */
+        bool Initialize(const vector<string>& filters, string* errorReason);
+
+        /**
+         * Get the per-device results of the last initialization,
+         * including the devices that failed to open.
+         *
+         * @return The list of results in device enumeration order.
+         */
+        vector<InitResult>* GetInitResults();
+
+        /**
+         * Initialize simulated generators instead of the connected ones, for exercising and
+         * benchmarking the library without hardware. They produce pseudorandom bytes at the
+         * model's nominal rate and have serial numbers with "SIM" in place of "QWR", e.g. SIM4A001.
+         * 
+         * @param Number of simulated generators.
+         * @param Serial number prefix of the model to simulate, e.g. "QWR4A" for MED100Ks.
+         * @param errorReason: Contains error reason string if the generators could not be created.
+         * 
+         * @return true on successful initialization, false on failure
+         */
+        bool InitializeSimulated(int count, const string& modelPrefix, string* errorReason);
+
+        /**
+         * Initialize generators replaying recordings instead of the connected ones, for rerunning
+         * analyses and testing consumers on recorded data. Each has the serial number its recording is
+         * named after, e.g. QWR4A003 for entropy_data/QWR4A003.hex, and hands out the recorded bytes
+         * paced as they were recorded. See ReplaySource.
+         * 
+         * @param Paths of the recordings: .hex files, or .bin files with their .walk pyramids.
+         * @param Playback speed: 1 for real time, more to speed it up, 0 for as fast as it's read.
+         * @param errorReason: Contains error reason string if a recording could not be opened.
+         * 
+         * @return true on successful initialization, false on failure
+         */
+        bool InitializeReplay(const vector<string>& paths, double speed, string* errorReason);
+
+        /**
+         * Add a generator backed by a VirtualSource rather than a USB device.
+         * 
+         * @param Serial number for the generator. Must not already be in use.
+         * @param Description of the generator.
+         * @param Where the generator's I/O goes.
+         * @param Transport profile (nominal rate, read chunk size) to report for the generator.
+         * @param Error reason upon failure to add the generator.
+         */
+        void AddVirtualGenerator(const string& serialNumber, const string& description, shared_ptr<VirtualSource> source,
+                                 const TransportProfile& profile, string* errorReason);
+
+        /**
+         * Add a virtual generator expanding seeds from a generator with a DRBG, for bulk consumers
+         * that need more than the device's rate. Its serial number is the generator's with "-CHACHA20"
+         * or "-AESCTR" appended. It lasts until the next initialization.
+         * 
+         * @param Handle of the generator to seed from.
+         * @param The cipher.
+         * @param Output after which to reseed in bytes (0 for no byte budget).
+         * @param Time after which to reseed in milliseconds (0 for no time budget).
+         * @param Error reason upon an unsupported cipher or failure to get the first seed.
+         * 
+         * @return Serial number of the DRBG generator, empty on failure.
+         */
+        string AddDrbgGenerator(FT_HANDLE handle, DrbgAlgorithm algorithm, uint64_t reseedBytes, DWORD reseedMs, string* errorReason);
+
         /**
          * Shutdown and de-initialize all the generators.
          */
@@ -62,27 +162,27 @@ namespace MeterFeeder {
         /**
          * Get the list of connected and successfully initialized generators.
          *
-         * @return The list of Generators.
+         * @return Copies of the Generators, sharing their state.
          */
-        vector<Generator>* GetListGenerators();
+        vector<Generator> GetListGenerators();
 
         /**
          * Find generator specified by FT_HANDLE.
          * 
          * @param FT_HANDLE determined when the device was opened.
          * 
-         * @return The Generator object if found, else null.
+         * @return The Generator object if found, else null. Holding it keeps it alive while it's used.
          */
-        Generator* FindGeneratorByHandle(FT_HANDLE handle);
+        shared_ptr<Generator> FindGeneratorByHandle(FT_HANDLE handle);
 
         /**
          * Find generator specified by serial number.
          * 
          * @param Serial number identifying the device.
          * 
-         * @return The Generator object if found, else null.
+         * @return The Generator object if found, else null. Holding it keeps it alive while it's used.
          */
-        Generator* FindGeneratorBySerial(string serialNumber);
+        shared_ptr<Generator> FindGeneratorBySerial(string serialNumber);
 
         /**
          * Get a byte of randomness.
@@ -105,8 +205,363 @@ namespace MeterFeeder {
          */
         void GetBytes(FT_HANDLE handle, int length, unsigned char *entropyBytes, string* errorReason);
 
+        /**
+         * Get bytes of randomness along with when they were generated.
+         * 
+         * @param Handle of the generator.
+         * @param Length in bytes to read.
+         * @param Pointer where to store the bytes.
+         * @param Where to store the timing of the bytes (may be null). See GetBitTimeNs().
+         * @param Error reason upon failure to retrieve data.
+         */
+        void GetBytesTimestamped(FT_HANDLE handle, int length, unsigned char *entropyBytes, ChunkTiming* timing, string* errorReason);
+
+        /**
+         * Queue a read on the driver's reactor and return without waiting for it.
+         * Any number of reads can be outstanding, across generators and on the same generator,
+         * and all of them are serviced by a single thread.
+         * 
+         * @param Handle of the generator.
+         * @param Length in bytes to read.
+         * @param Pointer where to store the bytes. Must stay valid until completion.
+         * @param Time allowed for the read in milliseconds.
+         * @param true to purge and restart streaming first (like GetBytes), false to continue the
+         *        stream left running by the previous read so back-to-back reads are contiguous.
+         * @param Called on the reactor thread when the read finishes.
+         * @param Error reason upon failure to queue the read.
+         * 
+         * @return Id of the read for cancelling it, or 0 on failure.
+         */
+        uint64_t SubmitRead(FT_HANDLE handle, int length, unsigned char *entropyBytes, DWORD timeoutMs, bool restart,
+                            Reactor::Completion completion, string* errorReason);
+
+        /**
+         * Queue a read of at least minLength and up to maxLength bytes on the driver's reactor.
+         * See Reactor::Submit for when such a read finishes.
+         */
+        uint64_t SubmitRead(FT_HANDLE handle, int minLength, int maxLength, unsigned char *entropyBytes, DWORD timeoutMs, bool restart,
+                            Reactor::Completion completion, string* errorReason);
+
+        /**
+         * Get bytes of randomness by a deadline, keeping whatever arrived rather than failing
+         * the whole read. Returns as soon as minLength bytes have arrived (with anything else already
+         * queued, up to maxLength), or at the deadline with what did arrive. Pass the same value for
+         * both lengths to read as much as possible of that length by the deadline.
+         * 
+         * @param Handle of the generator.
+         * @param Minimum length in bytes.
+         * @param Maximum length in bytes. The buffer must hold this many.
+         * @param Pointer where to store the bytes.
+         * @param Deadline in milliseconds from now.
+         * @param Error reason if fewer than minLength bytes arrived or reading failed.
+         * 
+         * @return Number of bytes stored, even on error.
+         */
+        int GetBytesWithDeadline(FT_HANDLE handle, int minLength, int maxLength, unsigned char *entropyBytes, DWORD timeoutMs, string* errorReason);
+
+        /**
+         * Cancel a read queued with SubmitRead. Its completion is called with MF_READ_CANCELLED.
+         * 
+         * @param Id of the read.
+         * 
+         * @return true if the read was still pending, false otherwise.
+         */
+        bool CancelRead(uint64_t id);
+
+        /**
+         * Override the transport parameters of a generator.
+         * 
+         * @param Handle of the generator.
+         * @param The transport profile to apply.
+         * @param Error reason upon failure to configure the device.
+         */
+        void SetTransportProfile(FT_HANDLE handle, const TransportProfile& profile, string* errorReason);
+
+        /**
+         * Sweep latency timer and USB transfer size settings on a generator, timing packet sized
+         * and chunk sized reads for each, then apply the highest throughput settings (preferring
+         * lower latency among near ties) to the generator.
+         * 
+         * @param Handle of the generator.
+         * @param Where to store the measurements of every configuration tried.
+         * @param Error reason upon failure to configure or read from the device.
+         */
+        void TuneTransport(FT_HANDLE handle, vector<TuneSample>* samples, string* errorReason);
+
+        /**
+         * Get the counters and latency histograms of the generators in the Prometheus text exposition format.
+         * 
+         * @param Serial number of the generator, or empty for all generators.
+         * 
+         * @return The metrics, empty if there is no such generator.
+         */
+        string GetMetrics(const string& serialNumber);
+
+        /**
+         * Periodically write the metrics of all generators to a file, replacing it atomically each time.
+         * 
+         * @param Path of the file, e.g. in a node exporter textfile collector directory.
+         * @param Interval between writes in milliseconds.
+         * @param Error reason if the file could not be written.
+         */
+        void StartMetricsExporter(const string& path, DWORD intervalMs, string* errorReason);
+
+        /**
+         * Stop writing the metrics file.
+         */
+        void StopMetricsExporter();
+
+        /**
+         * Get the bias and byte chi-square of a generator's output over the last second, minute and hour,
+         * kept up to date as it's read.
+         * 
+         * @param Handle of the generator.
+         * @param Where to store the windows' statistics, shortest first.
+         * @param Error reason if the generator is not found or its monitor is off.
+         */
+        void GetBiasStats(FT_HANDLE handle, vector<BiasWindowStats>* windows, string* errorReason);
+
+        /**
+         * Turn a generator's bias monitor on or off. It's on for every generator but the DRBGs, whose
+         * output is deterministic; turning it off forgets the counts.
+         * 
+         * @param Handle of the generator.
+         * @param true to count the output, false not to.
+         * @param Error reason if the generator is not found.
+         */
+        void SetBiasMonitor(FT_HANDLE handle, bool enabled, string* errorReason);
+
+        /**
+         * Keep a random walk over the bits a generator hands out by GetBytes and CaptureTrial, decimated
+         * to a fixed number of min/max points for plotting (see WalkView). Starts the walk over.
+         * 
+         * @param Handle of the generator.
+         * @param Number of points, 0 to stop keeping the walk.
+         * @param Steps the window of points spans before it starts over.
+         * @param Error reason if the generator is not found or the size is out of range.
+         */
+        void SetWalkView(FT_HANDLE handle, size_t numPoints, uint64_t spanSteps, string* errorReason);
+
+        /**
+         * Get the points of a generator's random walk filled so far in the current window.
+         * 
+         * @param Handle of the generator.
+         * @param Where to store each point's lowest position.
+         * @param Where to store each point's highest position.
+         * @param Where to store the walk's position, extremes and sizes.
+         * @param Error reason if the generator is not found or isn't keeping a walk.
+         */
+        void GetWalkView(FT_HANDLE handle, vector<int64_t>* mins, vector<int64_t>* maxs, WalkSummary* summary, string* errorReason);
+
+        /**
+         * Start a generator's random walk over from 0 with an empty window.
+         * 
+         * @param Handle of the generator.
+         * @param Error reason if the generator is not found.
+         */
+        void ResetWalkView(FT_HANDLE handle, string* errorReason);
+
+        /**
+         * Get exactly the bits asked for from the generator's bit reservoir, reading whole bytes
+         * from the device only when the reservoir runs short. Leftover bits stay for the next draw.
+         * 
+         * @param Handle of the generator.
+         * @param Number of bits to get.
+         * @param Where to store the bits, packed most significant bit first.
+         * @param Error reason upon failure to refill the reservoir.
+         */
+        void GetBits(FT_HANDLE handle, uint64_t numBits, unsigned char* bits, string* errorReason);
+
+        /**
+         * Get up to 64 bits from the generator's bit reservoir as an integer.
+         * 
+         * @param Handle of the generator.
+         * @param Number of bits to get (1 to 64).
+         * @param Error reason upon failure to refill the reservoir.
+         * 
+         * @return The bits, the first one being the most significant.
+         */
+        uint64_t GetBitsValue(FT_HANDLE handle, unsigned numBits, string* errorReason);
+
+        /**
+         * Get unbiased random integers in [0, bound) using Lemire's multiply-shift method with rejection,
+         * drawing the bits for the whole batch from the generator's bit reservoir in one go.
+         * 
+         * @param Handle of the generator.
+         * @param Upper bound (exclusive), 1 to 2^32.
+         * @param Number of integers to get.
+         * @param Where to store the integers.
+         * @param Error reason upon failure to refill the reservoir.
+         */
+        void GetBoundedInts(FT_HANDLE handle, uint64_t bound, size_t count, uint32_t* values, string* errorReason);
+
+        /**
+         * Shuffle items into a uniformly random order (Fisher-Yates), drawing the bits for all the
+         * swaps from the generator's bit reservoir in one go.
+         * 
+         * @param Handle of the generator.
+         * @param The items to shuffle in place.
+         * @param Number of items.
+         * @param Error reason upon failure to refill the reservoir. The items may be partly shuffled.
+         */
+        void Shuffle(FT_HANDLE handle, int32_t* items, size_t count, string* errorReason);
+
+        /**
+         * Get standard normal variates from the ziggurat method, drawing about 32 bits each from the
+         * generator's bit reservoir in bulk.
+         * 
+         * @param Handle of the generator.
+         * @param Number of variates to get.
+         * @param Where to store the variates.
+         * @param Error reason upon failure to refill the reservoir.
+         */
+        void GetNormals(FT_HANDLE handle, size_t count, double* values, string* errorReason);
+
+        /**
+         * Get standard exponential variates (rate 1) from the ziggurat method, drawing about 32 bits
+         * each from the generator's bit reservoir in bulk.
+         * 
+         * @param Handle of the generator.
+         * @param Number of variates to get.
+         * @param Where to store the variates.
+         * @param Error reason upon failure to refill the reservoir.
+         */
+        void GetExponentials(FT_HANDLE handle, size_t count, double* values, string* errorReason);
+
+        /**
+         * Build an alias table for weighted choices with GetCategorical().
+         * 
+         * @param Weights of the categories, not negative and not all zero.
+         * @param Number of categories.
+         * @param Error reason upon bad weights.
+         * 
+         * @return Id of the table, 0 on failure.
+         */
+        int CreateAliasTable(const double* weights, size_t count, string* errorReason);
+
+        /**
+         * Free an alias table.
+         * 
+         * @param Id of the table.
+         */
+        void DestroyAliasTable(int tableId);
+
+        /**
+         * Get weighted random categories from an alias table in O(1) each, drawing the bits for the
+         * whole batch from the generator's bit reservoir in one go.
+         * 
+         * @param Handle of the generator.
+         * @param Id of the table.
+         * @param Number of categories to get.
+         * @param Where to store the categories.
+         * @param Error reason upon an unknown table or failure to refill the reservoir.
+         */
+        void GetCategorical(FT_HANDLE handle, int tableId, size_t count, uint32_t* values, string* errorReason);
+
+        /**
+         * Set how many bytes a generator's bit reservoir reads at a time when it runs short.
+         * 
+         * @param Handle of the generator.
+         * @param Number of bytes, 0 to read only what each draw needs.
+         * @param Error reason if the generator is not found or the size is too big.
+         */
+        void SetReservoirRefill(FT_HANDLE handle, size_t refillBytes, string* errorReason);
+
+        /**
+         * Discard the bits left in a generator's bit reservoir so the next draw gets fresh ones.
+         * 
+         * @param Handle of the generator.
+         * @param Error reason if the generator is not found.
+         */
+        void ClearReservoir(FT_HANDLE handle, string* errorReason);
+
+        /**
+         * Start streaming a generator continuously into a history ring for trial capture.
+         * Nothing else should read from the generator until StopCapture().
+         * 
+         * @param Handle of the generator.
+         * @param Milliseconds of history to keep at the generator's nominal rate.
+         * @param Error reason upon failure to start streaming.
+         */
+        void StartCapture(FT_HANDLE handle, DWORD historyMs, string* errorReason);
+
+        /**
+         * Stop trial capture on a generator.
+         * 
+         * @param Handle of the generator.
+         */
+        void StopCapture(FT_HANDLE handle);
+
+        /**
+         * Get the bits around a trial trigger from a generator being captured, waiting for the
+         * bits after the trigger to arrive.
+         * 
+         * @param Handle of the generator.
+         * @param Time of the trigger (UTC nanoseconds since the Unix epoch), or 0 for now.
+         * @param Bits to return from before the trigger (fewer if the history doesn't go back that far).
+         * @param Bits to return from the trigger on.
+         * @param Where to store the window.
+         * @param Error reason upon failure.
+         */
+        void CaptureTrial(FT_HANDLE handle, int64_t triggerUtcNs, uint64_t preBits, uint64_t postBits, TrialWindow* window, string* errorReason);
+
+        /**
+         * Take trial triggers for captured generators as UDP datagrams on 127.0.0.1 (see TriggerServer).
+         * 
+         * @param UDP port.
+         * @param Error reason if the port could not be opened.
+         */
+        void StartTriggerServer(int port, string* errorReason);
+
+        /**
+         * Stop taking trial triggers over UDP.
+         */
+        void StopTriggerServer();
+
+        /**
+         * Record the bytes a generator hands out to <base>.bin, with the walk pyramid (see WalkPyramid)
+         * in <base>.walk, until StopRecording(): those read by GetBytes, through the reactor (SubmitRead,
+         * GetBytesWithDeadline) and into the bit reservoir. Trials taken from a capture aren't recorded.
+         * 
+         * @param Handle of the generator.
+         * @param Path of the files without the extension.
+         * @param Error reason if the generator is not found or the files can't be created.
+         */
+        void StartRecording(FT_HANDLE handle, const string& basePath, string* errorReason);
+
+        /**
+         * Stop recording a generator, finishing the walk pyramid.
+         * 
+         * @param Handle of the generator.
+         * @param Error reason upon a write error.
+         */
+        void StopRecording(FT_HANDLE handle, string* errorReason);
+
         private:
-            vector<Generator> _generators;
+            // Guards the generator list against the metrics exporter thread and generators added while running
+            mutex _generatorsMutex;
+            vector<shared_ptr<Generator>> _generators;
+            vector<InitResult> _initResults;
+            Reactor _reactor;
+            MetricsExporter _metricsExporter;
+            mutex _capturesMutex;
+            map<FT_HANDLE, shared_ptr<TrialCapture>> _captures;
+            TriggerServer _triggerServer;
+            mutex _recordingsMutex;
+            map<FT_HANDLE, shared_ptr<RecordingWriter>> _recordings;
+            mutex _aliasTablesMutex;
+            map<int, shared_ptr<AliasTable>> _aliasTables;
+            int _nextAliasTableId = 1;
+            shared_ptr<TrialCapture> findCapture(FT_HANDLE handle);
+            bool refillReservoir(Generator* generator, uint64_t numBits, string* errorReason);
+            bool drawBounded(Generator* generator, uint64_t bound, uint32_t* value, string* errorReason);
+            void drawVariates(FT_HANDLE handle, size_t count, double* values, bool (*sample)(WordStream*, double*), string* errorReason);
+            void stopAllCaptures();
+            void stopAllRecordings();
+            bool matchesFilter(const string& serialNumber, const vector<string>& filters);
+            FT_HANDLE openGenerator(FT_DEVICE_LIST_INFO_NODE* devInfo, InitResult* result);
+            void handOut(FT_HANDLE handle, Generator* generator, const UCHAR* bytes, DWORD length, ChunkTiming chunk, string* errorReason);
+            void readErrorStr(string* errorReason, Generator* generator, int status);
             void makeErrorStr(string* errorReason, const char* format, ...);
     };
 }
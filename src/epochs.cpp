@@ -0,0 +1,174 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "epochs.h"
+
+#include "walk.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const char EPOCHS_MAGIC[8] = "MFEPOCH";
+static const char HISTOGRAMS_MAGIC[8] = "MFHIST";
+
+MeterFeeder::EpochSummaryWriter::~EpochSummaryWriter() {
+    std::string errorReason;
+    Close(&errorReason);
+}
+
+bool MeterFeeder::EpochSummaryWriter::Open(const std::string& basePath, uint32_t epochMs, std::string* errorReason) {
+    Close(errorReason);
+    if (epochMs == 0) {
+        *errorReason = "Epochs must be at least 1 ms";
+        return false;
+    }
+    basePath_ = basePath;
+    table_ = fopen((basePath + ".epochs").c_str(), "wb");
+    histograms_ = fopen((basePath + ".hist").c_str(), "wb");
+    EpochFileHeader header = EpochFileHeader();
+    header.epochMs = epochMs;
+    memcpy(header.magic, EPOCHS_MAGIC, sizeof(header.magic));
+    bool ok = table_ != nullptr && fwrite(&header, sizeof(header), 1, table_) == 1;
+    memcpy(header.magic, HISTOGRAMS_MAGIC, sizeof(header.magic));
+    ok = ok && histograms_ != nullptr && fwrite(&header, sizeof(header), 1, histograms_) == 1;
+    if (!ok) {
+        *errorReason = "Couldn't create the epoch summaries " + basePath + ".epochs";
+        Close(errorReason);
+        return false;
+    }
+    epochNs_ = (int64_t)epochMs * 1000000;
+    row_ = EpochSummary();
+    memset(histogram_, 0, sizeof(histogram_));
+    return true;
+}
+
+bool MeterFeeder::EpochSummaryWriter::Add(const unsigned char* bytes, size_t length, int64_t firstBitUtcNs, double bitPeriodNs,
+                                          std::string* errorReason) {
+    if (table_ == nullptr) {
+        *errorReason = "The epoch summaries aren't open";
+        return false;
+    }
+    const WalkByteSteps& steps = WalkByteSteps::Get();
+    double bytePeriodNs = bitPeriodNs * 8;
+    size_t i = 0;
+    while (i < length) {
+        // The run of bytes starting in the same epoch as this one
+        int64_t startNs = firstBitUtcNs + (int64_t)(i * bytePeriodNs);
+        int64_t epoch = startNs >= 0 ? startNs / epochNs_ : (startNs + 1) / epochNs_ - 1;
+        size_t end = length;
+        if (bytePeriodNs > 0) {
+            double untilNext = (double)((epoch + 1) * epochNs_ - firstBitUtcNs) / bytePeriodNs;
+            end = (size_t)std::min((double)length, std::max(std::ceil(untilNext), (double)i + 1));
+        }
+
+        if (row_.bitCount > 0 && epoch != row_.epoch && !writeRow(errorReason)) {
+            return false;
+        }
+        if (row_.bitCount == 0) {
+            row_.epoch = epoch;
+            row_.firstUtcNs = startNs;
+        }
+        uint64_t ones = 0;
+        for (size_t j = i; j < end; j++) {
+            ones += (uint64_t)(steps.end[bytes[j]] + 8) / 2;
+            histogram_[bytes[j]]++;
+        }
+        row_.bitCount += (end - i) * 8;
+        row_.bitSum += ones;
+        row_.lastUtcNs = firstBitUtcNs + (int64_t)((end * 8 - 1) * bitPeriodNs);
+        i = end;
+    }
+    return true;
+}
+
+bool MeterFeeder::EpochSummaryWriter::Close(std::string* errorReason) {
+    bool ok = true;
+    if (table_ != nullptr && histograms_ != nullptr && row_.bitCount > 0) {
+        ok = writeRow(errorReason);
+    }
+    if (table_ != nullptr) {
+        ok = fclose(table_) == 0 && ok;
+        table_ = nullptr;
+    }
+    if (histograms_ != nullptr) {
+        ok = fclose(histograms_) == 0 && ok;
+        histograms_ = nullptr;
+    }
+    if (!ok && errorReason->empty()) {
+        *errorReason = "Couldn't write the epoch summaries " + basePath_ + ".epochs";
+    }
+    return ok;
+}
+
+// Append the epoch's row to both files, flushed so a reader sees whole epochs while recording
+bool MeterFeeder::EpochSummaryWriter::writeRow(std::string* errorReason) {
+    if (fwrite(&row_, sizeof(row_), 1, table_) != 1 || fwrite(histogram_, sizeof(histogram_), 1, histograms_) != 1
+        || fflush(table_) != 0 || fflush(histograms_) != 0) {
+        *errorReason = "Couldn't write the epoch summaries " + basePath_ + ".epochs";
+        return false;
+    }
+    row_ = EpochSummary();
+    memset(histogram_, 0, sizeof(histogram_));
+    return true;
+}
+
+MeterFeeder::EpochSummaryReader::~EpochSummaryReader() {
+    Close();
+}
+
+bool MeterFeeder::EpochSummaryReader::Open(const std::string& path, bool withHistograms, std::string* errorReason) {
+    Close();
+    table_ = fopen(path.c_str(), "rb");
+    if (table_ == nullptr) {
+        *errorReason = "Couldn't open " + path;
+        return false;
+    }
+    EpochFileHeader header;
+    if (fread(&header, sizeof(header), 1, table_) != 1 || memcmp(header.magic, EPOCHS_MAGIC, sizeof(header.magic)) != 0
+        || header.epochMs == 0) {
+        *errorReason = "Not an epoch summary table: " + path;
+        Close();
+        return false;
+    }
+    epochMs_ = header.epochMs;
+
+    if (withHistograms) {
+        std::string histogramsPath = path.substr(0, path.rfind('.')) + ".hist";
+        histograms_ = fopen(histogramsPath.c_str(), "rb");
+        if (histograms_ == nullptr || fread(&header, sizeof(header), 1, histograms_) != 1
+            || memcmp(header.magic, HISTOGRAMS_MAGIC, sizeof(header.magic)) != 0) {
+            *errorReason = "Couldn't open the byte histograms " + histogramsPath;
+            Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MeterFeeder::EpochSummaryReader::Next(EpochSummary* summary, uint32_t* histogram, std::string* errorReason) {
+    if (table_ == nullptr || fread(summary, sizeof(*summary), 1, table_) != 1) {
+        return false;
+    }
+    if (histogram != nullptr) {
+        if (histograms_ == nullptr || fread(histogram, sizeof(uint32_t) * 256, 1, histograms_) != 1) {
+            *errorReason = "The byte histograms are shorter than the epoch summaries";
+            return false;
+        }
+    }
+    return true;
+}
+
+void MeterFeeder::EpochSummaryReader::Close() {
+    if (table_ != nullptr) {
+        fclose(table_);
+        table_ = nullptr;
+    }
+    if (histograms_ != nullptr) {
+        fclose(histograms_);
+        histograms_ = nullptr;
+    }
+}
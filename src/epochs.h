@@ -0,0 +1,139 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace MeterFeeder {
+    /**
+     * What a device produced in one epoch: a row of a recording's <base>.epochs table. Its byte
+     * histogram is the same row of <base>.hist, 256 uint32 counts.
+     */
+    struct EpochSummary {
+        // UTC time of the epoch's start divided by the epoch length
+        int64_t epoch;
+
+        uint64_t bitCount;
+
+        // Number of one bits
+        uint64_t bitSum;
+
+        // UTC times of the epoch's first bit and of the last bit of its last byte (nanoseconds since the Unix epoch)
+        int64_t firstUtcNs;
+        int64_t lastUtcNs;
+    };
+
+    /**
+     * Header of the .epochs and .hist files, followed by a row per epoch with any bits.
+     */
+    struct EpochFileHeader {
+        char magic[8];
+        uint32_t epochMs;
+        uint32_t reserved;
+    };
+
+    /**
+     * Writes per-epoch summaries of a recording as it's made, so analyses that work on per-epoch bit sums
+     * (Z-scores, network variance, coherence) needn't read the raw bits. Bytes go to the epoch their first
+     * bit was generated in. The .epochs table is 40 bytes per epoch; the histograms are in their own file
+     * so reading the table alone stays cheap.
+     */
+    class EpochSummaryWriter {
+        public:
+            EpochSummaryWriter() {}
+            ~EpochSummaryWriter();
+            EpochSummaryWriter(const EpochSummaryWriter&) = delete;
+            EpochSummaryWriter& operator=(const EpochSummaryWriter&) = delete;
+
+            /**
+             * Create <base>.epochs and <base>.hist.
+             * 
+             * @param Path of the files without the extension.
+             * @param Epoch length (milliseconds).
+             * @param Error reason upon failure.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool Open(const std::string& basePath, uint32_t epochMs, std::string* errorReason);
+
+            /**
+             * Add a chunk of the recording.
+             * 
+             * @param The bytes.
+             * @param Number of bytes.
+             * @param UTC time of the chunk's first bit (nanoseconds since the Unix epoch).
+             * @param Time between bits (nanoseconds), 0 to put the whole chunk in its first bit's epoch.
+             * @param Error reason upon a write error.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool Add(const unsigned char* bytes, size_t length, int64_t firstBitUtcNs, double bitPeriodNs, std::string* errorReason);
+
+            /**
+             * Write the last epoch and close the files.
+             * 
+             * @param Error reason upon a write error.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool Close(std::string* errorReason);
+
+        private:
+            bool writeRow(std::string* errorReason);
+
+            FILE* table_ = nullptr;
+            FILE* histograms_ = nullptr;
+            std::string basePath_;
+            int64_t epochNs_ = 0;
+            EpochSummary row_ = EpochSummary();
+            uint32_t histogram_[256];
+    };
+
+    /**
+     * Reads a recording's per-epoch summaries in order.
+     */
+    class EpochSummaryReader {
+        public:
+            EpochSummaryReader() {}
+            ~EpochSummaryReader();
+            EpochSummaryReader(const EpochSummaryReader&) = delete;
+            EpochSummaryReader& operator=(const EpochSummaryReader&) = delete;
+
+            /**
+             * Open a .epochs table, and the .hist next to it if the histograms are wanted.
+             * 
+             * @param Path of the .epochs file.
+             * @param true to read the byte histograms too.
+             * @param Error reason upon failure.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool Open(const std::string& path, bool withHistograms, std::string* errorReason);
+
+            /**
+             * Read the next epoch.
+             * 
+             * @param Where to store the summary.
+             * @param Where to store the byte histogram (256 counts), or null.
+             * @param Error reason upon a read error.
+             * 
+             * @return true if an epoch was read, false at the end or on error.
+             */
+            bool Next(EpochSummary* summary, uint32_t* histogram, std::string* errorReason);
+
+            uint32_t GetEpochMs() const { return epochMs_; }
+
+            void Close();
+
+        private:
+            FILE* table_ = nullptr;
+            FILE* histograms_ = nullptr;
+            uint32_t epochMs_ = 0;
+    };
+}
@@ -0,0 +1,191 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "fft.h"
+
+#include <cmath>
+
+#define MF_PI 3.14159265358979323846
+
+MeterFeeder::Fft::Fft(size_t size) {
+    size_ = size;
+
+    // Pairs of indices to swap into bit-reversed order
+    for (size_t i = 1, j = 0; i < size; i++) {
+        size_t bit = size >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            swaps_.push_back(i);
+            swaps_.push_back(j);
+        }
+    }
+
+    twiddles_.resize(size > 1 ? size - 1 : 0);
+    for (size_t half = 1; half < size; half <<= 1) {
+        for (size_t k = 0; k < half; k++) {
+            double angle = -MF_PI * k / half;
+            twiddles_[half - 1 + k] = std::complex<double>(cos(angle), sin(angle));
+        }
+    }
+}
+
+void MeterFeeder::Fft::Forward(std::complex<double>* data) const {
+    transform(data, false);
+}
+
+void MeterFeeder::Fft::Inverse(std::complex<double>* data) const {
+    transform(data, true);
+    double scale = 1.0 / size_;
+    for (size_t i = 0; i < size_; i++) {
+        data[i] *= scale;
+    }
+}
+
+// Size of the blocks done through all the early stages while they're in cache (points)
+#define MF_FFT_BLOCK 2048
+
+// Iterative decimation in time. The butterflies work on the real and imaginary parts directly,
+// as std::complex multiplication checks for infinities and doesn't vectorize.
+void MeterFeeder::Fft::transform(std::complex<double>* data, bool inverse) const {
+    for (size_t i = 0; i < swaps_.size(); i += 2) {
+        std::swap(data[swaps_[i]], data[swaps_[i + 1]]);
+    }
+
+    // Stages that stay within a block are done block by block, the rest over the whole array
+    double* d = reinterpret_cast<double*>(data);
+    size_t block = size_ < MF_FFT_BLOCK ? size_ : MF_FFT_BLOCK;
+    for (size_t offset = 0; offset < size_; offset += block) {
+        stages(d + offset * 2, block, 1, block, inverse);
+    }
+    stages(d, size_, block, size_, inverse);
+}
+
+// Stages from half size firstHalf up to endHalf, two at a time where possible
+void MeterFeeder::Fft::stages(double* d, size_t length, size_t firstHalf, size_t endHalf, bool inverse) const {
+    size_t half = firstHalf;
+    while (half < endHalf) {
+        if (half * 4 <= endHalf) {
+            butterflies4(d, length, half, inverse);
+            half *= 4;
+        } else {
+            butterflies2(d, length, half, inverse);
+            half *= 2;
+        }
+    }
+}
+
+// Two radix-2 stages at once (half sizes h and 2h) on each group of four points j, j + h, j + 2h and j + 3h,
+// halving the passes over the data. The second stage's twiddle for the odd pair is -i times the even one's.
+void MeterFeeder::Fft::butterflies4(double* d, size_t length, size_t half, bool inverse) const {
+    const double* w1 = reinterpret_cast<const double*>(&twiddles_[half - 1]);
+    const double* w2 = reinterpret_cast<const double*>(&twiddles_[half * 2 - 1]);
+    double sign = inverse ? -1.0 : 1.0;
+    for (size_t start = 0; start < length; start += half * 4) {
+        double* a = d + start * 2;
+        double* b = a + half * 2;
+        double* c = b + half * 2;
+        double* e = c + half * 2;
+        for (size_t k = 0; k < half; k++) {
+            double w1r = w1[k * 2], w1i = sign * w1[k * 2 + 1];
+            double w2r = w2[k * 2], w2i = sign * w2[k * 2 + 1];
+
+            double br = b[k * 2] * w1r - b[k * 2 + 1] * w1i, bi = b[k * 2] * w1i + b[k * 2 + 1] * w1r;
+            double er = e[k * 2] * w1r - e[k * 2 + 1] * w1i, ei = e[k * 2] * w1i + e[k * 2 + 1] * w1r;
+            double a1r = a[k * 2] + br, a1i = a[k * 2 + 1] + bi;
+            double b1r = a[k * 2] - br, b1i = a[k * 2 + 1] - bi;
+            double c1r = c[k * 2] + er, c1i = c[k * 2 + 1] + ei;
+            double e1r = c[k * 2] - er, e1i = c[k * 2 + 1] - ei;
+
+            double cr = c1r * w2r - c1i * w2i, ci = c1r * w2i + c1i * w2r;
+            // (-i or +i) * w2 * e1
+            double tr = e1r * w2r - e1i * w2i, ti = e1r * w2i + e1i * w2r;
+            double dr = sign * ti, di = -sign * tr;
+            a[k * 2] = a1r + cr;
+            a[k * 2 + 1] = a1i + ci;
+            c[k * 2] = a1r - cr;
+            c[k * 2 + 1] = a1i - ci;
+            b[k * 2] = b1r + dr;
+            b[k * 2 + 1] = b1i + di;
+            e[k * 2] = b1r - dr;
+            e[k * 2 + 1] = b1i - di;
+        }
+    }
+}
+
+void MeterFeeder::Fft::butterflies2(double* d, size_t length, size_t half, bool inverse) const {
+    const double* w = reinterpret_cast<const double*>(&twiddles_[half - 1]);
+    double sign = inverse ? -1.0 : 1.0;
+    for (size_t start = 0; start < length; start += half * 2) {
+        double* a = d + start * 2;
+        double* b = a + half * 2;
+        for (size_t k = 0; k < half; k++) {
+            double wr = w[k * 2], wi = sign * w[k * 2 + 1];
+            double br = b[k * 2] * wr - b[k * 2 + 1] * wi;
+            double bi = b[k * 2] * wi + b[k * 2 + 1] * wr;
+            double ar = a[k * 2], ai = a[k * 2 + 1];
+            a[k * 2] = ar + br;
+            a[k * 2 + 1] = ai + bi;
+            b[k * 2] = ar - br;
+            b[k * 2 + 1] = ai - bi;
+        }
+    }
+}
+
+MeterFeeder::RealFft::RealFft(size_t size) : half_(size / 2) {
+    size_ = size;
+    twiddles_.resize(size / 2 + 1);
+    for (size_t k = 0; k <= size / 2; k++) {
+        double angle = -2 * MF_PI * k / size;
+        twiddles_[k] = std::complex<double>(cos(angle), sin(angle));
+    }
+}
+
+// Pack even points as real parts and odd as imaginary parts, transform, then separate the two spectra:
+// X[k] = E[k] + e^(-2 pi i k / n) O[k], where E and O are recovered from Z[k] and conj(Z[n/2 - k])
+void MeterFeeder::RealFft::Forward(const double* in, std::complex<double>* out) const {
+    size_t n = size_ / 2;
+    for (size_t j = 0; j < n; j++) {
+        out[j] = std::complex<double>(in[j * 2], in[j * 2 + 1]);
+    }
+    half_.Forward(out);
+    out[n] = out[0];
+
+    for (size_t k = 0; k <= n / 2; k++) {
+        double zr = out[k].real(), zi = out[k].imag();
+        double cr = out[n - k].real(), ci = -out[n - k].imag();
+        double er = (zr + cr) / 2, ei = (zi + ci) / 2;
+        double orr = (zi - ci) / 2, oi = -(zr - cr) / 2;
+        double wr = twiddles_[k].real(), wi = twiddles_[k].imag();
+        double tr = orr * wr - oi * wi, ti = orr * wi + oi * wr;
+        out[k] = std::complex<double>(er + tr, ei + ti);
+
+        // The mirror frequency n - k, from the same pair with the roles swapped
+        double wr2 = twiddles_[n - k].real(), wi2 = twiddles_[n - k].imag();
+        double er2 = er, ei2 = -ei, or2 = orr, oi2 = -oi;
+        double tr2 = or2 * wr2 - oi2 * wi2, ti2 = or2 * wi2 + oi2 * wr2;
+        out[n - k] = std::complex<double>(er2 + tr2, ei2 + ti2);
+    }
+}
+
+void MeterFeeder::RealFft::Inverse(std::complex<double>* in, double* out) const {
+    size_t n = size_ / 2;
+    for (size_t k = 0; k <= n / 2; k++) {
+        std::complex<double> x = in[k], y = std::conj(in[n - k]);
+        std::complex<double> e = (x + y) * 0.5, o = (x - y) * 0.5 * std::conj(twiddles_[k]);
+        std::complex<double> x2 = in[n - k], y2 = std::conj(in[k]);
+        std::complex<double> e2 = (x2 + y2) * 0.5, o2 = (x2 - y2) * 0.5 * std::conj(twiddles_[n - k]);
+        in[k] = e + std::complex<double>(-o.imag(), o.real());
+        in[n - k] = e2 + std::complex<double>(-o2.imag(), o2.real());
+    }
+    half_.Inverse(in);
+    for (size_t j = 0; j < n; j++) {
+        out[j * 2] = in[j].real();
+        out[j * 2 + 1] = in[j].imag();
+    }
+}
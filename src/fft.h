@@ -0,0 +1,97 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+namespace MeterFeeder {
+    /**
+     * Radix-2 fast Fourier transform of a fixed power of two size, for the spectral tests and analyses.
+     * The tables are built once; transforms are const so threads can share one Fft with their own buffers.
+     */
+    class Fft {
+        public:
+            /**
+             * @param Number of points, a power of two.
+             */
+            explicit Fft(size_t size);
+
+            /**
+             * Get the number of points.
+             */
+            size_t GetSize() const { return size_; }
+
+            /**
+             * Transform in place, unnormalized: X[k] = sum of x[j] e^(-2 pi i jk / n).
+             * 
+             * @param The size points.
+             */
+            void Forward(std::complex<double>* data) const;
+
+            /**
+             * Inverse transform in place, scaled by 1/n so it undoes Forward().
+             * 
+             * @param The size points.
+             */
+            void Inverse(std::complex<double>* data) const;
+
+            /**
+             * Check if a number of points is a power of two.
+             */
+            static bool IsPowerOfTwo(size_t size) { return size >= 1 && (size & (size - 1)) == 0; }
+
+        private:
+            void transform(std::complex<double>* data, bool inverse) const;
+            void stages(double* data, size_t length, size_t firstHalf, size_t endHalf, bool inverse) const;
+            void butterflies2(double* data, size_t length, size_t half, bool inverse) const;
+            void butterflies4(double* data, size_t length, size_t half, bool inverse) const;
+
+            size_t size_;
+            std::vector<size_t> swaps_;
+            // Twiddles of each stage in turn, the stage of half size h starting at h - 1
+            std::vector<std::complex<double>> twiddles_;
+    };
+
+    /**
+     * FFT of real data through a complex FFT of half the size.
+     */
+    class RealFft {
+        public:
+            /**
+             * @param Number of real points, a power of two, at least 2.
+             */
+            explicit RealFft(size_t size);
+
+            /**
+             * Get the number of real points.
+             */
+            size_t GetSize() const { return size_; }
+
+            /**
+             * Transform real points to the non-negative frequency half of their spectrum.
+             * 
+             * @param The size real points.
+             * @param Where to store the size / 2 + 1 frequencies, from 0 to the Nyquist frequency.
+             */
+            void Forward(const double* in, std::complex<double>* out) const;
+
+            /**
+             * Inverse of Forward(), scaled by 1/n.
+             * 
+             * @param The size / 2 + 1 frequencies, overwritten.
+             * @param Where to store the size real points.
+             */
+            void Inverse(std::complex<double>* in, double* out) const;
+
+        private:
+            size_t size_;
+            Fft half_;
+            std::vector<std::complex<double>> twiddles_;
+    };
+}
@@ -6,14 +6,36 @@
 
 #include "generator.h"
 
+#include <chrono>
+#include <thread>
+
+namespace MeterFeeder {
+    static uint64_t microsSince(std::chrono::steady_clock::time_point start) {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
 MeterFeeder::Generator::Generator(char* serialNumber, char* description, FT_HANDLE handle) {
     serialNumber_ = serialNumber;
     description_ = description;
-    ftHandle_ = handle;
-    isClosed_ = false;
+    state_ = std::make_shared<State>();
+    state_->ftHandle = handle;
+    state_->profile = FindTransportProfile(serialNumber_, description_);
+    initReservoir();
 };
 
-std::string MeterFeeder::Generator::GetSerialNumber() {
+MeterFeeder::Generator::Generator(const std::string& serialNumber, const std::string& description,
+                                  std::shared_ptr<VirtualSource> source, const TransportProfile& profile) {
+    serialNumber_ = serialNumber;
+    description_ = description;
+    state_ = std::make_shared<State>();
+    state_->source = source;
+    state_->ftHandle = (FT_HANDLE)source.get();
+    state_->profile = profile;
+    initReservoir();
+};
+
+const std::string& MeterFeeder::Generator::GetSerialNumber() {
     return serialNumber_;
 };
 
@@ -22,60 +44,128 @@ std::string MeterFeeder::Generator::GetDescription() {
 };
 
 FT_HANDLE MeterFeeder::Generator::GetHandle() {
-    if (isClosed_) {
+    if (state_->isClosed) {
         throw std::runtime_error("Generator is closed");
     }
-    return ftHandle_;
+    return state_->ftHandle;
 };
 
+int MeterFeeder::Generator::ApplyProfile(const TransportProfile& profile) {
+    if (state_->isClosed) {
+        throw std::runtime_error("Generator is closed");
+    }
+
+    if (state_->source) {
+        std::lock_guard<std::mutex> lock(state_->profileMutex);
+        state_->profile = profile;
+        return MF_OK;
+    }
+
+    FT_STATUS ftdiStatus = FT_SetLatencyTimer(state_->ftHandle, profile.latencyMs);
+    if (ftdiStatus != FT_OK) {
+        return ftdiStatus;
+    }
+    ftdiStatus = FT_SetUSBParameters(state_->ftHandle, profile.usbTransferSize, FTDI_DEVICE_PACKET_USB_SIZE_BYTES);
+    if (ftdiStatus != FT_OK) {
+        return ftdiStatus;
+    }
+
+    std::lock_guard<std::mutex> lock(state_->profileMutex);
+    state_->profile = profile;
+    return MF_OK;
+}
+
+MeterFeeder::TransportProfile MeterFeeder::Generator::GetProfile() const {
+    std::lock_guard<std::mutex> lock(state_->profileMutex);
+    return state_->profile;
+}
+
 int MeterFeeder::Generator::StartStreaming() {
-    if (isClosed_) {
+    if (state_->isClosed) {
         throw std::runtime_error("Generator is closed");
     }
 
+    GeneratorMetrics& metrics = state_->metrics;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    if (state_->source) {
+        int sourceStatus = state_->source->StartStreaming();
+        state_->isStreaming = sourceStatus == MF_OK;
+        if (sourceStatus != MF_OK) {
+            metrics.errors++;
+        } else {
+            metrics.purges++;
+            metrics.startStreamingLatency.Record(microsSince(start));
+        }
+        return sourceStatus;
+    }
+
     UCHAR startCommand = FTDI_DEVICE_START_STREAMING_COMMAND;
     DWORD bytesTxd = 0;
 
     // Purge before writing
-    FT_STATUS ftdiStatus = FT_Purge(ftHandle_, FT_PURGE_RX | FT_PURGE_TX);
+    TraceSpan purge("purge", serialNumber_);
+    FT_STATUS ftdiStatus = FT_Purge(state_->ftHandle, FT_PURGE_RX | FT_PURGE_TX);
+    purge.End(ftdiStatus, 0);
     if (ftdiStatus != FT_OK) {
+        metrics.errors++;
         return ftdiStatus;
     }
+    metrics.purges++;
 
     // WRITE TO DEVICE
-    ftdiStatus = FT_Write(ftHandle_, &startCommand, 1, &bytesTxd);
+    TraceSpan commandWrite("command_write", serialNumber_);
+    ftdiStatus = FT_Write(state_->ftHandle, &startCommand, 1, &bytesTxd);
+    commandWrite.End(ftdiStatus, bytesTxd);
     if (ftdiStatus != FT_OK || bytesTxd != 1) {
+        metrics.errors++;
         return ftdiStatus;
     }
 
+    state_->isStreaming = true;
+    metrics.startStreamingLatency.Record(microsSince(start));
     return MF_OK;
 }
 
 int MeterFeeder::Generator::StopStreaming() {
-    if (isClosed_) {
+    if (state_->isClosed) {
         throw std::runtime_error("Generator is closed");
     }
 
+    if (state_->source) {
+        state_->isStreaming = false;
+        state_->metrics.purges++;
+        return state_->source->StopStreaming();
+    }
+
     UCHAR stopCommand = FTDI_DEVICE_STOP_STREAMING_COMMAND;
     DWORD bytesTxd = 0;
 
     // Purge before writing
-    FT_STATUS ftdiStatus = FT_Purge(ftHandle_, FT_PURGE_RX | FT_PURGE_TX);
+    TraceSpan purge("purge", serialNumber_);
+    FT_STATUS ftdiStatus = FT_Purge(state_->ftHandle, FT_PURGE_RX | FT_PURGE_TX);
+    purge.End(ftdiStatus, 0);
     if (ftdiStatus != FT_OK) {
+        state_->metrics.errors++;
         return ftdiStatus;
     }
+    state_->metrics.purges++;
 
     // WRITE TO DEVICE
-    ftdiStatus = FT_Write(ftHandle_, &stopCommand, 1, &bytesTxd);
+    TraceSpan commandWrite("command_write", serialNumber_);
+    ftdiStatus = FT_Write(state_->ftHandle, &stopCommand, 1, &bytesTxd);
+    commandWrite.End(ftdiStatus, bytesTxd);
     if (ftdiStatus != FT_OK || bytesTxd != 1) {
+        state_->metrics.errors++;
         return ftdiStatus;
     }
 
+    state_->isStreaming = false;
     return MF_OK;
 }
 
 int MeterFeeder::Generator::Read(DWORD length, UCHAR* dxData) {
-    if (isClosed_) {
+    if (state_->isClosed) {
         throw std::runtime_error("Generator is closed");
     }
 
@@ -90,24 +180,143 @@ int MeterFeeder::Generator::Read(DWORD length, UCHAR* dxData) {
         throw std::runtime_error("Length exceeds maximum allowed size");
     }
 
+    GeneratorMetrics& metrics = state_->metrics;
     DWORD bytesRxd = 0;
 
     // READ FROM DEVICE
-    FT_STATUS ftdiStatus = FT_Read(ftHandle_, dxData, length, &bytesRxd);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (Tracer::IsEnabled()) {
+        // FT_Read can't tell us when the first byte came in, so watch the queue for it
+        TraceSpan firstByte("first_byte", serialNumber_);
+        firstByte.End(waitForFirstByte(FTDI_DEVICE_TX_TIMEOUT_MS), 0);
+    }
+    TraceSpan transfer("transfer", serialNumber_);
+    FT_STATUS ftdiStatus = state_->source ? state_->source->Read(length, dxData, &bytesRxd, FTDI_DEVICE_TX_TIMEOUT_MS)
+                                   : FT_Read(state_->ftHandle, dxData, length, &bytesRxd);
+    transfer.End(ftdiStatus, bytesRxd);
+    metrics.readLatency.Record(microsSince(start));
+    metrics.reads++;
+    metrics.bytesRead += bytesRxd;
+    if (ftdiStatus != FT_OK) {
+        metrics.errors++;
+        return ftdiStatus;
+    }
     if (bytesRxd != length) {
+        metrics.shortReads++;
         return MF_RXD_BYTES_LENGTH_WRONG;
     }
+    stampChunk(dxData, bytesRxd);
+
+    return MF_OK;
+}
+
+int MeterFeeder::Generator::GetQueueStatus(DWORD* bytesAvailable) {
+    if (state_->isClosed) {
+        throw std::runtime_error("Generator is closed");
+    }
+
+    if (state_->source) {
+        return state_->source->GetQueueStatus(bytesAvailable);
+    }
+    return FT_GetQueueStatus(state_->ftHandle, bytesAvailable);
+}
+
+int MeterFeeder::Generator::ReadAvailable(DWORD maxLength, UCHAR* dxData, DWORD* bytesRxd) {
+    *bytesRxd = 0;
+
+    GeneratorMetrics& metrics = state_->metrics;
+    DWORD bytesAvailable = 0;
+    FT_STATUS ftdiStatus = GetQueueStatus(&bytesAvailable);
     if (ftdiStatus != FT_OK) {
+        metrics.errors++;
+        return ftdiStatus;
+    }
+    metrics.rxQueueBytes = bytesAvailable;
+    if (bytesAvailable == 0) {
         return ftdiStatus;
     }
 
-    return MF_OK;
+    // Only ask for what is queued so FT_Read returns immediately
+    DWORD length = bytesAvailable < maxLength ? bytesAvailable : maxLength;
+    TraceSpan transfer("transfer", serialNumber_);
+    ftdiStatus = state_->source ? state_->source->Read(length, dxData, bytesRxd, 0)
+                                : FT_Read(state_->ftHandle, dxData, length, bytesRxd);
+    transfer.End(ftdiStatus, *bytesRxd);
+    if (ftdiStatus != FT_OK) {
+        metrics.errors++;
+    } else if (*bytesRxd > 0) {
+        stampChunk(dxData, *bytesRxd);
+    }
+    metrics.bytesRead += *bytesRxd;
+    return ftdiStatus;
+}
+
+MeterFeeder::ChunkTiming MeterFeeder::Generator::GetLastChunkTiming() {
+    std::lock_guard<std::mutex> lock(state_->timingMutex);
+    return state_->lastChunk;
+}
+
+// Refill the bit reservoir MF_RESERVOIR_REFILL_MS worth of data at a time by default
+void MeterFeeder::Generator::initReservoir() {
+    TransportProfile profile = GetProfile();
+    double refillBytes = profile.nominalBitRate / 8 * MF_RESERVOIR_REFILL_MS / 1000;
+    if (refillBytes > profile.readChunkBytes) {
+        refillBytes = profile.readChunkBytes;
+    }
+    state_->reservoir.SetRefillBytes(refillBytes < 1 ? 1 : (size_t)refillBytes);
+}
+
+// Timestamp a chunk that was just read, taking the bytes queued after it into account, and count it for the bias monitor
+void MeterFeeder::Generator::stampChunk(const UCHAR* data, DWORD length) {
+    DWORD backlogBytes = 0;
+    if ((state_->source && state_->source->IsOnDemand()) || GetQueueStatus(&backlogBytes) != FT_OK) {
+        backlogBytes = 0;
+    }
+    TransportProfile profile = GetProfile();
+    ChunkTiming timing = StampChunk(length, backlogBytes, profile.nominalBitRate, profile.latencyMs);
+    state_->metrics.bias.Add(data, length, timing.lastBitMonotonicNs);
+
+    std::lock_guard<std::mutex> lock(state_->timingMutex);
+    state_->lastChunk = timing;
+}
+
+// Poll the receive queue until something arrives, only used when tracing
+int MeterFeeder::Generator::waitForFirstByte(DWORD timeoutMs) {
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    DWORD bytesAvailable = 0;
+    for (;;) {
+        int status = GetQueueStatus(&bytesAvailable);
+        if (status != FT_OK || bytesAvailable > 0) {
+            return status;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return MF_READ_TIMEOUT;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+int MeterFeeder::Generator::SetRxEventNotification(PVOID event) {
+    if (state_->isClosed) {
+        throw std::runtime_error("Generator is closed");
+    }
+
+    if (state_->source) {
+        // Virtual generators are polled
+        return MF_OK;
+    }
+    return FT_SetEventNotification(state_->ftHandle, FT_EVENT_RXCHAR, event);
 }
 
 void MeterFeeder::Generator::Close() {
-    if (!isClosed_) {
-        FT_Close(ftHandle_);
-        ftHandle_ = nullptr;
-        isClosed_ = true;
+    if (!state_->isClosed) {
+        if (state_->source) {
+            state_->source->Close();
+        } else {
+            FT_Close(state_->ftHandle);
+        }
+        state_->ftHandle = nullptr;
+        state_->isClosed = true;
+        state_->isStreaming = false;
     }
 }
\ No newline at end of file
@@ -8,10 +8,20 @@
 
 #include <string>
 #include <stdexcept>
+#include <atomic>
+#include <memory>
+#include <mutex>
 
 #include "../ftd2xx/ftd2xx.h"
 
 #include "constants.h"
+#include "metrics.h"
+#include "trace.h"
+#include "profile.h"
+#include "reservoir.h"
+#include "source.h"
+#include "timing.h"
+#include "walk.h"
 
 namespace MeterFeeder {
     /**
@@ -23,17 +33,26 @@ namespace MeterFeeder {
      * and bias amplification can help boost th effect size of the
      * postulated idea that mental thought (intention) can have a
      * measurable effect on the the output of the random numbers.
+     *
+     * Copies of a Generator refer to the same device and share its state.
      */
     class Generator {
         public:
             Generator(char* serialNumber, char* description, FT_HANDLE handle);
 
+            /**
+             * Create a virtual generator whose I/O goes to a VirtualSource instead of an FTDI device.
+             * Its handle is unique but is not an FT_HANDLE.
+             */
+            Generator(const std::string& serialNumber, const std::string& description,
+                      std::shared_ptr<VirtualSource> source, const TransportProfile& profile);
+
             /**
              * Get the generator's serial number. E.g. "QWR4A003"
              * 
              * @return The serial number of the generator device.
              */
-            std::string GetSerialNumber();
+            const std::string& GetSerialNumber();
 
             /**
              * Get the generator's description. E.g. "MED100K 100 kHz v1.0"
@@ -42,6 +61,23 @@ namespace MeterFeeder {
              */
             std::string GetDescription();
 
+            /**
+             * Get the FTDI transport parameters in use for the generator.
+             * 
+             * @return The transport profile.
+             */
+            TransportProfile GetProfile() const;
+
+            /**
+             * Configure the generator's latency timer and USB transfer size from a profile.
+             * 
+             * @param The transport profile to apply.
+             * 
+             * @return FT_STATUS on error communicating with the generator.
+             * @throws std::runtime_error if the generator is closed
+             */
+            int ApplyProfile(const TransportProfile& profile);
+
             /**
              * Get the handle for interacting with the generator.
              * 
@@ -77,6 +113,39 @@ namespace MeterFeeder {
              */
             int Read(DWORD length, UCHAR* dxData);
 
+            /**
+             * Get the number of streamed bytes waiting in the receive queue.
+             * 
+             * @param Where to store the number of bytes available.
+             * 
+             * @return FT_STATUS on error communicating with the generator.
+             * @throws std::runtime_error if the generator is closed
+             */
+            int GetQueueStatus(DWORD* bytesAvailable);
+
+            /**
+             * Read in whatever streamed entropy is already queued, up to a maximum length.
+             * Never blocks waiting for the device.
+             * 
+             * @param Maximum length in bytes to read.
+             * @param Pointer to where to store the streamed data.
+             * @param Where to store the number of bytes read.
+             * 
+             * @return FT_STATUS on error communicating with the generator.
+             * @throws std::runtime_error if the generator is closed
+             */
+            int ReadAvailable(DWORD maxLength, UCHAR* dxData, DWORD* bytesRxd);
+
+            /**
+             * Have the driver signal an event whenever the generator receives data.
+             * 
+             * @param Pointer to the event (an EVENT_HANDLE on Linux/Mac, a HANDLE on Windows).
+             * 
+             * @return FT_STATUS on error communicating with the generator.
+             * @throws std::runtime_error if the generator is closed
+             */
+            int SetRxEventNotification(PVOID event);
+
             /**
              * Close the generator.
              * Can be called multiple times safely.
@@ -88,12 +157,98 @@ namespace MeterFeeder {
              * 
              * @return true if the generator is closed, false otherwise
              */
-            bool IsClosed() const { return isClosed_; }
+            bool IsClosed() const { return state_->isClosed; }
+
+            /**
+             * Get why a virtual source's last read failed, if its status alone doesn't say.
+             * 
+             * @return The reason, or empty if there is none.
+             */
+            std::string GetSourceError() const { return state_->source ? state_->source->GetLastError() : ""; }
+
+            /**
+             * Check if the generator is virtual (simulated, replayed etc.) rather than a USB device.
+             * 
+             * @return true if the generator is virtual, false otherwise
+             */
+            bool IsVirtual() const { return state_->source != nullptr; }
+
+            /**
+             * Get where a virtual generator's I/O goes.
+             * 
+             * @return The source, or null for a USB device.
+             */
+            std::shared_ptr<VirtualSource> GetVirtualSource() const { return state_->source; }
+
+            /**
+             * Check if the generator was told to start streaming and hasn't been told to stop since.
+             * 
+             * @return true if the generator is streaming, false otherwise
+             */
+            bool IsStreaming() const { return state_->isStreaming; }
+
+            /**
+             * Get the mutex serializing I/O on the generator between threads.
+             * 
+             * @return The I/O mutex.
+             */
+            std::mutex& GetIoMutex() { return state_->ioMutex; }
+
+            /**
+             * Get the counters and latency histograms for the generator.
+             * 
+             * @return The generator's metrics.
+             */
+            GeneratorMetrics& GetMetrics() { return state_->metrics; }
+
+            /**
+             * Get when the chunk returned by the last successful read was generated.
+             * For reads through the reactor this covers the last piece read, not the whole request.
+             * 
+             * @return Timing of the last chunk, with a length of 0 if nothing was read yet.
+             */
+            ChunkTiming GetLastChunkTiming();
+
+            /**
+             * Get the generator's store of bits read but not yet handed out.
+             * Lock its mutex while using it.
+             * 
+             * @return The bit reservoir.
+             */
+            BitReservoir& GetReservoir() { return state_->reservoir; }
+
+            /**
+             * Get the random walk over the bits handed out by GetBytes and trial captures.
+             * 
+             * @return The walk view.
+             */
+            WalkView& GetWalkView() { return state_->walk; }
 
         private:
+            int waitForFirstByte(DWORD timeoutMs);
+            void stampChunk(const UCHAR* data, DWORD length);
+            void initReservoir();
+
+            // Device state shared by all copies of the Generator
+            struct State {
+                std::mutex ioMutex;
+                FT_HANDLE ftHandle = nullptr;
+
+                // Read while profiles are applied, e.g. by chunk timing on the reactor thread
+                mutable std::mutex profileMutex;
+                TransportProfile profile;
+                std::shared_ptr<VirtualSource> source;
+                std::atomic<bool> isClosed{false};
+                std::atomic<bool> isStreaming{false};
+                GeneratorMetrics metrics;
+                std::mutex timingMutex;
+                ChunkTiming lastChunk = ChunkTiming();
+                BitReservoir reservoir;
+                WalkView walk;
+            };
+
             std::string serialNumber_;
             std::string description_;
-            FT_HANDLE ftHandle_;
-            bool isClosed_ = false;
+            std::shared_ptr<State> state_;
     };
 }
\ No newline at end of file
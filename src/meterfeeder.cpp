@@ -5,26 +5,1111 @@
  */
 
 #include "driver.h"
+#include "coherence.h"
+#include "convert.h"
+#include "coro.h"
+#include "minentropy.h"
+#include "nist.h"
+#include "recording.h"
+#include "spectral.h"
 
 #include  <iomanip>
 #include  <chrono>
 #include  <climits>
+#include  <condition_variable>
+#include  <algorithm>
+#include  <bitset>
+#include  <cmath>
+
+#ifdef MF_HAS_COROUTINES
+// Compare coroutine reads sharing a small executor with a thread per caller blocking in Driver::GetBytes
+static int runAsyncBenchmark(MeterFeeder::Driver* driver, int numTasks, int readsPerTask, int length) {
+    using namespace MeterFeeder;
+    using namespace std::chrono;
+    vector<Generator> generators = driver->GetListGenerators();
+    cout << numTasks << " tasks x " << readsPerTask << " reads x " << length << " bytes over "
+         << generators.size() << " generator(s)" << endl;
+
+    // Blocking path: one thread per task
+    std::atomic<int> failures(0);
+    auto start = steady_clock::now();
+    {
+        vector<std::thread> threads;
+        for (int t = 0; t < numTasks; t++) {
+            threads.push_back(std::thread([&, t]() {
+                FT_HANDLE handle = generators.at(t % generators.size()).GetHandle();
+                vector<UCHAR> buffer(length);
+                for (int r = 0; r < readsPerTask; r++) {
+                    string errorReason;
+                    driver->GetBytes(handle, length, &buffer[0], &errorReason);
+                    if (!errorReason.empty()) {
+                        failures++;
+                    }
+                }
+            }));
+        }
+        for (size_t t = 0; t < threads.size(); t++) {
+            threads[t].join();
+        }
+    }
+    double blockingSeconds = duration<double>(steady_clock::now() - start).count();
+    cout << "blocking GetBytes:\t" << numTasks << " threads\t" << fixed << setprecision(3) << blockingSeconds << " s\t"
+         << setprecision(0) << (numTasks * readsPerTask / blockingSeconds) << " reads/s\t" << failures << " failed" << endl;
+
+    // Coroutine path: all the tasks share a two thread executor
+    failures = 0;
+    Executor executor(2);
+    auto trial = [&](int t) -> Task<bool> {
+        co_await executor.Schedule();
+        AsyncGeneratorReader reader(driver, generators.at(t % generators.size()).GetHandle(), &executor);
+        vector<UCHAR> buffer(length);
+        for (int r = 0; r < readsPerTask; r++) {
+            AsyncReadResult result = co_await reader.Read(std::span<UCHAR>(buffer));
+            if (result.status != MF_OK) {
+                failures++;
+            }
+        }
+        co_return true;
+    };
+    vector<Task<bool>> tasks;
+    for (int t = 0; t < numTasks; t++) {
+        tasks.push_back(trial(t));
+    }
+    start = steady_clock::now();
+    SyncWait(WhenAll(std::move(tasks)));
+    double asyncSeconds = duration<double>(steady_clock::now() - start).count();
+    cout << "co_await Read:\t\t2 threads\t" << fixed << setprecision(3) << asyncSeconds << " s\t"
+         << setprecision(0) << (numTasks * readsPerTask / asyncSeconds) << " reads/s\t" << failures << " failed" << endl;
+    return 0;
+}
+
+// Abandon chunk streams with their read-ahead in flight, after a varying number of chunks, then check the
+// generator still reads. A read-ahead completing into a destroyed stream shows up as a crash (or under ASan)
+static int runAbandonCheck(MeterFeeder::Driver* driver, int rounds, int chunkSize) {
+    using namespace MeterFeeder;
+    vector<Generator> generators = driver->GetListGenerators();
+    Executor executor(2);
+    std::atomic<int> failures(0);
+    auto trial = [&](int round) -> Task<bool> {
+        co_await executor.Schedule();
+        AsyncGeneratorReader reader(driver, generators.at(round % generators.size()).GetHandle(), &executor);
+        {
+            AsyncGenerator<std::span<unsigned char>> chunks = reader.Chunks(chunkSize);
+            for (int c = 0; c <= round % 3; c++) {
+                if (!co_await chunks.Next() || chunks.Value().size() != (size_t)chunkSize) {
+                    failures++;
+                    break;
+                }
+            }
+        }
+        co_return true;
+    };
+    for (int round = 0; round < rounds; round++) {
+        SyncWait(trial(round));
+    }
+
+    vector<UCHAR> buffer(chunkSize);
+    for (size_t i = 0; i < generators.size(); i++) {
+        string errorReason;
+        driver->GetBytes(generators[i].GetHandle(), chunkSize, &buffer[0], &errorReason);
+        if (!errorReason.empty()) {
+            cout << generators[i].GetSerialNumber() << ": " << errorReason << endl;
+            failures++;
+        }
+    }
+    cout << rounds << " streams abandoned mid-flight\t" << failures << " failed" << endl;
+    return failures == 0 ? 0 : -1;
+}
+#endif
+
+// Kolmogorov-Smirnov distance between sorted samples and a CDF
+static double ksDistance(vector<double>& samples, double (*cdf)(double)) {
+    std::sort(samples.begin(), samples.end());
+    double n = (double)samples.size(), distance = 0;
+    for (size_t i = 0; i < samples.size(); i++) {
+        double f = cdf(samples[i]);
+        distance = std::max(distance, std::max(f - i / n, (i + 1) / n - f));
+    }
+    return distance;
+}
+
+static double normalCdf(double x) {
+    return 0.5 * erfc(-x / sqrt(2.0));
+}
+
+static double exponentialCdf(double x) {
+    return x < 0 ? 0 : 1 - exp(-x);
+}
+
+// Print the moments and KS distance of samples against the expected ones. Fails if any is off by more than
+// about 4 standard errors (or the KS test's 0.1% critical value)
+static bool checkVariates(const char* name, vector<double>& samples, double mean, double variance, double skewness,
+                          double kurtosis, double (*cdf)(double)) {
+    double n = (double)samples.size(), m1 = 0, m2 = 0, m3 = 0, m4 = 0;
+    for (size_t i = 0; i < samples.size(); i++) {
+        m1 += samples[i];
+    }
+    m1 /= n;
+    for (size_t i = 0; i < samples.size(); i++) {
+        double d = samples[i] - m1;
+        m2 += d * d;
+        m3 += d * d * d;
+        m4 += d * d * d * d;
+    }
+    m2 /= n;
+    double skew = m3 / n / pow(m2, 1.5), kurt = m4 / n / (m2 * m2) - 3;
+    double ks = ksDistance(samples, cdf) * sqrt(n);
+
+    // Standard errors for the exponential's moments are larger, scale them by its variance and kurtosis
+    double scale = kurtosis > 0 ? 5 : 1;
+    bool ok = fabs(m1 - mean) < 4 * sqrt(variance / n) && fabs(m2 - variance) < 4 * scale * sqrt(2 * variance * variance / n)
+           && fabs(skew - skewness) < 4 * scale * sqrt(6 / n) && fabs(kurt - kurtosis) < 4 * scale * scale * sqrt(24 / n) && ks < 1.95;
+    cout << name << ":\tmean " << fixed << setprecision(4) << m1 << "\tvariance " << m2 << "\tskewness " << skew
+         << "\texcess kurtosis " << kurt << "\tKS " << setprecision(3) << ks << "\t" << (ok ? "ok" : "FAILED") << endl;
+    return ok;
+}
+
+// Time samplers over the same words, then check their output
+static bool benchmarkSampler(const char* name, bool (*sample)(MeterFeeder::WordStream*, double*), const vector<uint32_t>& words,
+                             size_t count, double mean, double variance, double skewness, double kurtosis, double (*cdf)(double)) {
+    using namespace std::chrono;
+    vector<double> samples(count);
+    MeterFeeder::WordStream stream = { &words[0], words.size(), 0 };
+    auto start = steady_clock::now();
+    size_t done = 0;
+    while (done < count && sample(&stream, &samples[done])) {
+        done++;
+    }
+    double seconds = duration<double>(steady_clock::now() - start).count();
+    samples.resize(done);
+    cout << name << ":\t" << fixed << setprecision(1) << (done / seconds / 1e6) << " M/s\t" << setprecision(2)
+         << (32.0 * stream.position / done) << " bits each" << endl;
+    return checkVariates(name, samples, mean, variance, skewness, kurtosis, cdf);
+}
+
+// Compare the ziggurat samplers with Box-Muller on pseudorandom words, then draw from the first generator
+static int runVariateBenchmark(MeterFeeder::Driver* driver, size_t count) {
+    using namespace MeterFeeder;
+    using namespace std::chrono;
+
+    // splitmix64, only to time the samplers without waiting for a device
+    vector<uint32_t> words(count * 4 + 64);
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < words.size(); i += 2) {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z ^= z >> 31;
+        words[i] = (uint32_t)(z >> 32);
+        words[i + 1] = (uint32_t)z;
+    }
+    cout << count << " variates from pseudorandom words" << endl;
+    bool ok = benchmarkSampler("ziggurat normal", NormalFromWords, words, count, 0, 1, 0, 0, normalCdf);
+    ok = benchmarkSampler("ziggurat exponential", ExponentialFromWords, words, count, 1, 1, 2, 6, exponentialCdf) && ok;
+    ok = benchmarkSampler("Box-Muller normal", BoxMullerFromWords, words, count, 0, 1, 0, 0, normalCdf) && ok;
+
+    vector<Generator> generators = driver->GetListGenerators();
+    if (generators.empty()) {
+        return ok ? 0 : -1;
+    }
+
+    // From the device, where the bits are the limit: the ziggurat needs about a third of Box-Muller's 96
+    Generator& generator = generators.at(0);
+    size_t deviceCount = std::min(count, (size_t)(generator.GetProfile().nominalBitRate / 32 * 5));
+    cout << deviceCount << " normals from " << generator.GetSerialNumber() << endl;
+    string errorReason;
+    vector<double> samples(deviceCount);
+    auto start = steady_clock::now();
+    driver->GetNormals(generator.GetHandle(), deviceCount, &samples[0], &errorReason);
+    double seconds = duration<double>(steady_clock::now() - start).count();
+    if (!errorReason.empty()) {
+        cout << errorReason << endl;
+        return -1;
+    }
+    cout << "GetNormals:\t" << fixed << setprecision(0) << (deviceCount / seconds) << " /s" << endl;
+    ok = checkVariates("GetNormals", samples, 0, 1, 0, 0, normalCdf) && ok;
+
+    // MF_RandNormal's way, two separate 6 byte reads per variate
+    size_t boxMullerCount = std::min(deviceCount, (size_t)100);
+    start = steady_clock::now();
+    for (size_t i = 0; i < boxMullerCount; i++) {
+        UCHAR bytes[12];
+        driver->GetBytes(generator.GetHandle(), 6, bytes, &errorReason);
+        driver->GetBytes(generator.GetHandle(), 6, bytes + 6, &errorReason);
+        if (!errorReason.empty()) {
+            cout << errorReason << endl;
+            return -1;
+        }
+    }
+    seconds = duration<double>(steady_clock::now() - start).count();
+    cout << "MF_RandNormal:\t" << fixed << setprecision(0) << (boxMullerCount / seconds) << " /s" << endl;
+    return ok ? 0 : -1;
+}
+
+// Run the SP 800-22 battery over a recording, or over sequences read from a generator, and print a table of the results
+static int runNistBattery(MeterFeeder::Driver* driver, const string& source, size_t maxSequences, size_t sequenceBits) {
+    using namespace MeterFeeder;
+    using namespace std::chrono;
+
+    NistOptions options;
+    if (sequenceBits > 0) {
+        options.sequenceBits = sequenceBits;
+    }
+    string errorReason;
+    if (!NistBattery::CheckOptions(options, &errorReason)) {
+        cout << errorReason << endl;
+        return -1;
+    }
+
+    NistBattery battery(options);
+    size_t bytesAdded = 0;
+    auto start = steady_clock::now();
+    if (driver == nullptr) {
+        RecordingReader reader;
+        if (!reader.Open(source, &errorReason)) {
+            cout << errorReason << endl;
+            return -1;
+        }
+        vector<unsigned char> chunk;
+        size_t maxBytes = maxSequences > 0 ? maxSequences * (options.sequenceBits / 8) : SIZE_MAX;
+        while (bytesAdded < maxBytes && reader.ReadChunk(&chunk, nullptr, &errorReason)) {
+            size_t length = std::min(chunk.size(), maxBytes - bytesAdded);
+            battery.Add(&chunk[0], length);
+            bytesAdded += length;
+        }
+        if (!errorReason.empty()) {
+            cout << errorReason << endl;
+            return -1;
+        }
+    } else {
+        shared_ptr<Generator> generator = driver->FindGeneratorBySerial(source);
+        if (generator == nullptr) {
+            cout << "Generator not found: " << source << endl;
+            return -1;
+        }
+        size_t sequenceBytes = options.sequenceBits / 8;
+        vector<unsigned char> sequence(sequenceBytes);
+        for (size_t s = 0; s < (maxSequences > 0 ? maxSequences : 10); s++) {
+            for (size_t offset = 0; offset < sequenceBytes; offset += MF_MAX_READ_LENGTH) {
+                size_t length = std::min(sequenceBytes - offset, (size_t)MF_MAX_READ_LENGTH);
+                driver->GetBytes(generator->GetHandle(), (int)length, &sequence[offset], &errorReason);
+                if (!errorReason.empty()) {
+                    cout << errorReason << endl;
+                    return -1;
+                }
+            }
+            battery.Add(&sequence[0], sequenceBytes);
+            bytesAdded += sequenceBytes;
+        }
+    }
+
+    vector<NistTestResult> results = battery.Finish();
+    double seconds = duration<double>(steady_clock::now() - start).count();
+    size_t sequences = battery.GetSequenceCount();
+    cout << sequences << " sequences of " << options.sequenceBits << " bits in " << fixed << setprecision(2) << seconds
+         << " s (" << setprecision(1) << (bytesAdded / seconds / 1e6) << " MB/s)" << endl;
+    if (sequences == 0) {
+        cout << "Not enough bits for a sequence" << endl;
+        return -1;
+    }
+
+    bool ok = true;
+    cout << left << setw(28) << "test" << right << setw(12) << "passed" << setw(12) << "min" << setw(14) << "uniformity" << endl;
+    for (size_t i = 0; i < results.size(); i++) {
+        const NistTestResult& r = results[i];
+        cout << left << setw(28) << r.name << right << setw(12) << setprecision(4) << r.proportion << setw(12) << r.minProportion
+             << setw(14) << setprecision(6) << r.uniformityPValue << "  " << (r.ok ? "ok" : "FAILED") << endl;
+        ok = ok && r.ok;
+    }
+    return ok ? 0 : -1;
+}
+
+// Estimate the min-entropy of the first bits of a recording, or of bits read from a generator, the SP 800-90B way
+static int runMinEntropy(MeterFeeder::Driver* driver, const string& source, size_t numBits) {
+    using namespace MeterFeeder;
+    using namespace std::chrono;
+
+    string errorReason;
+    size_t numBytes = (numBits + 7) / 8;
+    vector<unsigned char> bytes;
+    bytes.reserve(numBytes);
+    if (driver == nullptr) {
+        RecordingReader reader;
+        if (!reader.Open(source, &errorReason)) {
+            cout << errorReason << endl;
+            return -1;
+        }
+        vector<unsigned char> chunk;
+        while (bytes.size() < numBytes && reader.ReadChunk(&chunk, nullptr, &errorReason)) {
+            bytes.insert(bytes.end(), chunk.begin(), chunk.begin() + std::min(chunk.size(), numBytes - bytes.size()));
+        }
+        if (!errorReason.empty()) {
+            cout << errorReason << endl;
+            return -1;
+        }
+        numBits = std::min(numBits, bytes.size() * 8);
+    } else {
+        shared_ptr<Generator> generator = driver->FindGeneratorBySerial(source);
+        if (generator == nullptr) {
+            cout << "Generator not found: " << source << endl;
+            return -1;
+        }
+        bytes.resize(numBytes);
+        for (size_t offset = 0; offset < numBytes; offset += MF_MAX_READ_LENGTH) {
+            size_t length = std::min(numBytes - offset, (size_t)MF_MAX_READ_LENGTH);
+            driver->GetBytes(generator->GetHandle(), (int)length, &bytes[offset], &errorReason);
+            if (!errorReason.empty()) {
+                cout << errorReason << endl;
+                return -1;
+            }
+        }
+    }
+
+    vector<MinEntropyEstimate> estimates;
+    auto start = steady_clock::now();
+    if (!EstimateMinEntropy(bytes.empty() ? nullptr : &bytes[0], numBits, 0, &estimates, &errorReason)) {
+        cout << errorReason << endl;
+        return -1;
+    }
+    double seconds = duration<double>(steady_clock::now() - start).count();
+
+    cout << numBits << " bits in " << fixed << setprecision(2) << seconds << " s" << endl;
+    cout << left << setw(28) << "estimator" << right << setw(12) << "p" << setw(14) << "min-entropy" << endl;
+    double minEntropy = 1;
+    for (size_t i = 0; i < estimates.size(); i++) {
+        cout << left << setw(28) << estimates[i].name << right << setprecision(6) << setw(12) << estimates[i].probability
+             << setw(14) << estimates[i].minEntropy << endl;
+        minEntropy = std::min(minEntropy, estimates[i].minEntropy);
+    }
+    cout << "min-entropy: " << minEntropy << " bits per bit" << endl;
+    return 0;
+}
+
+// Look for periodic structure in a recording or in blocks read from a generator, flagging lags and frequencies
+// that stand out and the transport periods they fit
+static int runSpectralAnalysis(MeterFeeder::Driver* driver, const string& source, size_t maxBlocks, size_t blockBits) {
+    using namespace MeterFeeder;
+    using namespace std::chrono;
+
+    SpectralOptions options;
+    if (blockBits > 0) {
+        options.blockBits = blockBits;
+        options.maxLag = std::min(options.maxLag, blockBits / 2);
+    }
+    string errorReason;
+    if (!SpectralAnalyzer::CheckOptions(options, &errorReason)) {
+        cout << errorReason << endl;
+        return -1;
+    }
+
+    size_t blockBytes = options.blockBits / 8;
+    size_t maxBytes = maxBlocks > 0 ? maxBlocks * blockBytes : SIZE_MAX;
+    size_t bytesAdded = 0;
+    auto start = steady_clock::now();
+    unique_ptr<SpectralAnalyzer> analyzer;
+    if (driver == nullptr) {
+        // Recordings are named after the generator, which tells its transport
+        size_t slash = source.find_last_of("/\\");
+        string name = source.substr(slash == string::npos ? 0 : slash + 1);
+        options.periods = SpectralAnalyzer::TransportPeriods(FindTransportProfile(name.substr(0, name.find('.')), ""));
+        analyzer.reset(new SpectralAnalyzer(options));
+
+        RecordingReader reader;
+        if (!reader.Open(source, &errorReason)) {
+            cout << errorReason << endl;
+            return -1;
+        }
+        vector<unsigned char> chunk;
+        while (bytesAdded < maxBytes && reader.ReadChunk(&chunk, nullptr, &errorReason)) {
+            size_t length = std::min(chunk.size(), maxBytes - bytesAdded);
+            analyzer->Add(&chunk[0], length);
+            bytesAdded += length;
+        }
+        if (!errorReason.empty()) {
+            cout << errorReason << endl;
+            return -1;
+        }
+    } else {
+        shared_ptr<Generator> generator = driver->FindGeneratorBySerial(source);
+        if (generator == nullptr) {
+            cout << "Generator not found: " << source << endl;
+            return -1;
+        }
+        options.periods = SpectralAnalyzer::TransportPeriods(generator->GetProfile());
+        analyzer.reset(new SpectralAnalyzer(options));
+
+        // Whole blocks as the generator streams them, so any transport structure is kept
+        if (maxBlocks == 0) {
+            maxBytes = 64 * blockBytes;
+        }
+        vector<unsigned char> block(std::min(blockBytes, (size_t)MF_MAX_READ_LENGTH));
+        while (bytesAdded < maxBytes) {
+            size_t length = std::min(block.size(), maxBytes - bytesAdded);
+            driver->GetBytes(generator->GetHandle(), (int)length, &block[0], &errorReason);
+            if (!errorReason.empty()) {
+                cout << errorReason << endl;
+                return -1;
+            }
+            analyzer->Add(&block[0], length);
+            bytesAdded += length;
+        }
+    }
+
+    SpectralReport report = analyzer->Finish();
+    double seconds = duration<double>(steady_clock::now() - start).count();
+    cout << report.blocks << " blocks of " << options.blockBits << " bits in " << fixed << setprecision(2) << seconds
+         << " s (" << setprecision(1) << (bytesAdded / seconds / 1e6) << " MB/s)" << endl;
+    if (report.blocks == 0) {
+        cout << "Not enough bits for a block" << endl;
+        return -1;
+    }
+
+    cout << report.lagPeaks.size() << " significant autocorrelation lags" << endl;
+    for (size_t i = 0; i < report.lagPeaks.size() && i < 20; i++) {
+        const SpectralPeak& peak = report.lagPeaks[i];
+        cout << "  lag " << setprecision(0) << peak.periodBits << "\tz " << setprecision(2) << peak.value
+             << "\tp " << scientific << setprecision(2) << peak.pValue << fixed << "\t" << peak.suspect << endl;
+    }
+    cout << report.frequencyPeaks.size() << " significant spectral peaks" << endl;
+    for (size_t i = 0; i < report.frequencyPeaks.size() && i < 20; i++) {
+        const SpectralPeak& peak = report.frequencyPeaks[i];
+        cout << "  period " << setprecision(2) << peak.periodBits << " bits\tpower " << peak.value
+             << "\tp " << scientific << setprecision(2) << peak.pValue << fixed << "\t" << peak.suspect << endl;
+    }
+    return report.lagPeaks.empty() && report.frequencyPeaks.empty() ? 0 : 1;
+}
+
+// Bin each recording's bits into epochs by their timestamps and stream the Z-scores through a coherence analysis.
+// A recording is a .hex file, a binary recording timed by its walk pyramid, or a binary recording's .epochs summaries.
+static int runCoherence(const vector<string>& paths, double epochSeconds, size_t windowEpochs) {
+    using namespace MeterFeeder;
+
+    CoherenceOptions options;
+    options.sampleRateHz = 1 / epochSeconds;
+    options.windowEpochs = windowEpochs;
+    string errorReason;
+    if (!CoherenceAnalyzer::CheckOptions(paths.size(), options, &errorReason)) {
+        cout << errorReason << endl;
+        return -1;
+    }
+
+    // The first line or summary of each recording, to find when the session starts
+    size_t numDevices = paths.size();
+    int64_t epochNs = (int64_t)(epochSeconds * 1e9);
+    vector<RecordingReader> readers(numDevices);
+    vector<EpochSummaryReader> summaries(numDevices);
+    vector<bool> isSummary(numDevices, false);
+    vector<vector<unsigned char>> chunk(numDevices);
+    vector<uint64_t> pendingOnes(numDevices, 0), pendingBits(numDevices, 0);
+    vector<int64_t> pendingNs(numDevices, 0);
+    vector<bool> more(numDevices, true);
+    auto readNext = [&](size_t d) {
+        if (isSummary[d]) {
+            EpochSummary summary;
+            more[d] = summaries[d].Next(&summary, nullptr, &errorReason);
+            pendingOnes[d] = summary.bitSum;
+            pendingBits[d] = summary.bitCount;
+            pendingNs[d] = summary.firstUtcNs;
+            return;
+        }
+        // Lines without a timestamp can't be placed in an epoch
+        do {
+            more[d] = readers[d].ReadChunk(&chunk[d], &pendingNs[d], &errorReason);
+        } while (more[d] && pendingNs[d] == 0);
+        pendingOnes[d] = 0;
+        for (size_t i = 0; i < chunk[d].size(); i++) {
+            pendingOnes[d] += std::bitset<8>(chunk[d][i]).count();
+        }
+        pendingBits[d] = chunk[d].size() * 8;
+    };
+    int64_t startNs = INT64_MAX;
+    for (size_t d = 0; d < numDevices; d++) {
+        const string& path = paths[d];
+        isSummary[d] = path.size() > 7 && path.compare(path.size() - 7, 7, ".epochs") == 0;
+        if (isSummary[d]) {
+            if (!summaries[d].Open(path, false, &errorReason)) {
+                cout << errorReason << endl;
+                return -1;
+            }
+            int64_t summaryNs = (int64_t)summaries[d].GetEpochMs() * 1000000;
+            if (epochNs % summaryNs != 0) {
+                cout << "Epochs of " << epochSeconds << " s can't be made from the " << summaries[d].GetEpochMs()
+                     << " ms summaries in " << path << endl;
+                return -1;
+            }
+        } else {
+            if (!readers[d].Open(path, &errorReason)) {
+                cout << errorReason << endl;
+                return -1;
+            }
+            if (!readers[d].IsTimed()) {
+                cout << "Not a timestamped recording (.hex, or .bin with its .walk) or epoch summaries (.epochs): " << path << endl;
+                return -1;
+            }
+        }
+        readNext(d);
+        if (more[d]) {
+            startNs = std::min(startNs, pendingNs[d]);
+        }
+    }
+    if (startNs == INT64_MAX) {
+        cout << "No timestamped bits in the recordings" << endl;
+        return -1;
+    }
+    startNs -= startNs % 1000000000;
+
+    CoherenceAnalyzer analyzer(numDevices, options);
+    vector<CoherenceWindow> windows;
+    vector<double> zScores(numDevices);
+    for (int64_t epochEndNs = startNs + epochNs; ; epochEndNs += epochNs) {
+        bool any = false;
+        for (size_t d = 0; d < numDevices; d++) {
+            uint64_t ones = 0, bits = 0;
+            while (more[d] && pendingNs[d] < epochEndNs) {
+                ones += pendingOnes[d];
+                bits += pendingBits[d];
+                readNext(d);
+            }
+            if (!errorReason.empty()) {
+                cout << errorReason << endl;
+                return -1;
+            }
+            zScores[d] = bits > 0 ? (ones - bits / 2.0) / sqrt(bits / 4.0) : NAN;
+            any = any || more[d];
+        }
+        analyzer.AddEpoch(&zScores[0]);
+        vector<CoherenceWindow> done = analyzer.TakeWindows();
+        windows.insert(windows.end(), done.begin(), done.end());
+        if (!any) {
+            break;
+        }
+    }
+    analyzer.Finish();
+    vector<CoherenceWindow> done = analyzer.TakeWindows();
+    windows.insert(windows.end(), done.begin(), done.end());
+
+    cout << analyzer.GetEpochCount() << " epochs of " << epochSeconds << " s over " << numDevices << " devices, "
+         << windows.size() << " windows of " << windowEpochs << " epochs" << endl;
+    if (windows.empty()) {
+        cout << "Not enough epochs for a window" << endl;
+        return -1;
+    }
+    double phaseLocking = 0, amplitudeCoherence = 0;
+    for (size_t i = 0; i < windows.size(); i++) {
+        phaseLocking += windows[i].phaseLocking;
+        amplitudeCoherence += windows[i].amplitudeCoherence;
+    }
+    cout << fixed << setprecision(4) << "Mean PLV " << phaseLocking / windows.size() << "\tmean amplitude coherence "
+         << amplitudeCoherence / windows.size() << endl;
+    return 0;
+}
+
+// Record a generator to <base>.bin with its walk pyramid for a number of seconds
+static int runRecording(MeterFeeder::Driver* driver, const string& serialNumber, const string& basePath, double seconds, int chunkBytes) {
+    using namespace MeterFeeder;
+    using namespace std::chrono;
+
+    shared_ptr<Generator> generator = driver->FindGeneratorBySerial(serialNumber);
+    if (generator == nullptr) {
+        cout << "Generator not found: " << serialNumber << endl;
+        return -1;
+    }
+    string errorReason;
+    driver->StartRecording(generator->GetHandle(), basePath, &errorReason);
+    if (!errorReason.empty()) {
+        cout << errorReason << endl;
+        return -1;
+    }
+    vector<unsigned char> chunk(chunkBytes);
+    uint64_t bytesRecorded = 0;
+    auto start = steady_clock::now();
+    while (duration<double>(steady_clock::now() - start).count() < seconds && errorReason.empty()) {
+        driver->GetBytes(generator->GetHandle(), chunkBytes, &chunk[0], &errorReason);
+        bytesRecorded += chunkBytes;
+    }
+    string stopError;
+    driver->StopRecording(generator->GetHandle(), &stopError);
+    if (!errorReason.empty() || !stopError.empty()) {
+        cout << (errorReason.empty() ? stopError : errorReason) << endl;
+        return -1;
+    }
+    cout << "Recorded " << bytesRecorded << " bytes to " << basePath << ".bin and " << basePath << ".walk" << endl;
+    return 0;
+}
+
+// Query a walk pyramid the way a viewer zooming in would, from the whole recording down to single bits
+static int runWalkQuery(const string& basePath, size_t pixels, uint64_t firstBit, uint64_t numBits) {
+    using namespace MeterFeeder;
+
+    string rawPath = basePath + ".bin";
+    FILE* raw = fopen(rawPath.c_str(), "rb");
+    if (raw != nullptr) {
+        fclose(raw);
+    } else {
+        rawPath = "";
+    }
+    WalkPyramid pyramid;
+    string errorReason;
+    if (!pyramid.Open(basePath + ".walk", rawPath, &errorReason)) {
+        cout << errorReason << endl;
+        return -1;
+    }
+    cout << pyramid.GetTotalBits() << " bits, " << pyramid.GetLevelCount() << " levels" << endl;
+    if (numBits == 0 && firstBit < pyramid.GetTotalBits()) {
+        numBits = pyramid.GetTotalBits() - firstBit;
+    }
+
+    // Each step zooms in 16 times on the middle of the range
+    for (;;) {
+        WalkQueryResult result;
+        uint64_t bytesBefore = pyramid.GetBytesRead();
+        if (!pyramid.Query(firstBit, numBits, pixels, &result, &errorReason)) {
+            cout << errorReason << endl;
+            return -1;
+        }
+        int64_t low = INT64_MAX, high = INT64_MIN;
+        for (size_t i = 0; i < result.blocks.size(); i++) {
+            low = std::min(low, result.blocks[i].min);
+            high = std::max(high, result.blocks[i].max);
+        }
+        cout << "  bits " << firstBit << "+" << numBits << ": level " << result.level << ", " << result.blocks.size() << " blocks of "
+             << result.blockBits << " bits, walk " << low << " to " << high << ", read " << (pyramid.GetBytesRead() - bytesBefore)
+             << " bytes" << endl;
+        if (numBits <= pixels) {
+            return 0;
+        }
+        uint64_t zoomed = std::max(numBits / 16, (uint64_t)pixels);
+        firstBit += (numBits - zoomed) / 2;
+        numBits = zoomed;
+    }
+}
+
+// Convert .hex recordings to binary ones named after them, with each generator's nominal bit rate timing the bits
+static int runConversion(const vector<string>& paths, const string& outputDir, unsigned threads) {
+    using namespace MeterFeeder;
+
+    int rc = 0;
+    for (size_t i = 0; i < paths.size(); i++) {
+        size_t nameStart = paths[i].find_last_of("/\\");
+        string name = paths[i].substr(nameStart == string::npos ? 0 : nameStart + 1);
+        string serialNumber = name.substr(0, name.rfind('.'));
+        string directory = outputDir.empty() ? paths[i].substr(0, nameStart == string::npos ? 0 : nameStart + 1) : outputDir + "/";
+        string basePath = directory + serialNumber;
+
+        ConversionStats stats;
+        string errorReason;
+        double bitRate = FindTransportProfile(serialNumber, "").nominalBitRate;
+        if (!ConvertHexRecording(paths[i], basePath, bitRate, threads, &stats, &errorReason)) {
+            cout << paths[i] << ": " << errorReason << endl;
+            rc = -1;
+            continue;
+        }
+        cout << paths[i] << " -> " << basePath << ".bin: " << stats.bytes << " bytes from " << stats.lines << " lines ("
+             << stats.skippedLines << " skipped, " << stats.untimedLines << " untimed) in " << fixed << setprecision(2)
+             << stats.seconds << " s, " << stats.hexBytes / 1e6 / stats.seconds << " MB/s of hex" << endl;
+    }
+    return rc;
+}
 
 int main(int argc, char *argv[]) {
     using namespace MeterFeeder;
     Driver* driver = new Driver();
     string errorReason = "";
-    if (!driver->Initialize(&errorReason)) {
+
+    // Use simulated generators instead of the connected ones
+    // args: --simulate <count> [model serial prefix, default QWR4A] <any of the other args>
+    int numSimulated = 0;
+    string simulatedModel = "QWR4A";
+    if (argc >= 3 && string(argv[1]) == "--simulate") {
+        numSimulated = atoi(argv[2]);
+        int shift = 2;
+        if (argc >= 4 && string(argv[3]).find("QWR") == 0) {
+            simulatedModel = argv[3];
+            shift = 3;
+        }
+        argc -= shift;
+        argv += shift;
+    }
+
+    // Replay recordings as generators named after them instead of using the connected ones
+    // args: --replay <speed, 1 for the recorded pace, or max> <recording path>[,<recording path>...] <any of the other args>
+    vector<string> replayPaths;
+    double replaySpeed = 1;
+    if (argc >= 4 && string(argv[1]) == "--replay") {
+        replaySpeed = string(argv[2]) == "max" ? 0 : atof(argv[2]);
+        string remaining = argv[3];
+        size_t pos;
+        while ((pos = remaining.find(',')) != string::npos) {
+            replayPaths.push_back(remaining.substr(0, pos));
+            remaining.erase(0, pos + 1);
+        }
+        if (!remaining.empty()) {
+            replayPaths.push_back(remaining);
+        }
+        argc -= 3;
+        argv += 3;
+    }
+
+    // Write the generators' metrics to a file every second
+    // args: --metrics <file path> <any of the other args>
+    string metricsPath;
+    if (argc >= 3 && string(argv[1]) == "--metrics") {
+        metricsPath = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+
+    // Record the phases of every read and write them as Chrome trace JSON on exit
+    // args: --trace <file path> <any of the other args>
+    string tracePath;
+    if (argc >= 3 && string(argv[1]) == "--trace") {
+        tracePath = argv[2];
+        Tracer::Enable(1000000);
+        argc -= 2;
+        argv += 2;
+    }
+    // Capture trials from all (or the given) generators, triggered over UDP, until killed
+    // args: --capture <history ms> [serial number]
+    int captureHistoryMs = 0;
+    if (argc >= 3 && string(argv[1]) == "--capture") {
+        captureHistoryMs = atoi(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
+
+    // Initialize the replayed, simulated or connected (matching the filters) generators
+    auto initialize = [&](const vector<string>& filters) {
+        if (!replayPaths.empty()) {
+            return driver->InitializeReplay(replayPaths, replaySpeed, &errorReason);
+        }
+        if (numSimulated > 0) {
+            return driver->InitializeSimulated(numSimulated, simulatedModel, &errorReason);
+        }
+        return filters.empty() ? driver->Initialize(&errorReason) : driver->Initialize(filters, &errorReason);
+    };
+
+    auto dumpTrace = [&tracePath]() {
+        string traceError;
+        if (!tracePath.empty() && !Tracer::DumpChromeTrace(tracePath, &traceError)) {
+            cout << traceError << endl;
+        }
+    };
+
+    // Benchmark coroutine reads against blocking reads
+    // args: --bench-async <tasks> <reads per task> <length>
+    if (argc >= 5 && string(argv[1]) == "--bench-async") {
+#ifdef MF_HAS_COROUTINES
+        bool initialized = initialize(vector<string>());
+        if (!initialized) {
+            cout << errorReason << endl;
+            delete driver;
+            return -1;
+        }
+        int rc = runAsyncBenchmark(driver, atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+        driver->Shutdown();
+        dumpTrace();
+        delete driver;
+        return rc;
+#else
+        cout << "Built without C++20 coroutine support" << endl;
+        delete driver;
+        return -1;
+#endif
+    }
+
+    // Destroy coroutine chunk streams while their read-ahead is in flight
+    // args: --abandon-async <rounds> <chunk size>
+    if (argc >= 4 && string(argv[1]) == "--abandon-async") {
+#ifdef MF_HAS_COROUTINES
+        bool initialized = initialize(vector<string>());
+        if (!initialized) {
+            cout << errorReason << endl;
+            delete driver;
+            return -1;
+        }
+        int rc = runAbandonCheck(driver, atoi(argv[2]), atoi(argv[3]));
+        driver->Shutdown();
+        dumpTrace();
+        delete driver;
+        return rc;
+#else
+        cout << "Built without C++20 coroutine support" << endl;
+        delete driver;
+        return -1;
+#endif
+    }
+
+    // Check the DRBG ciphers' keystream against published known answers, on every path this CPU runs
+    // args: --check-drbg
+    if (argc >= 2 && string(argv[1]) == "--check-drbg") {
+        string checked;
+        bool passed = DrbgSource::SelfTest(&checked, &errorReason);
+        cout << (passed ? "Passed: " + checked : "Failed: " + errorReason) << endl;
+        delete driver;
+        return passed ? 0 : -1;
+    }
+
+    // Benchmark and check the normal and exponential samplers
+    // args: --bench-variates <count>
+    if (argc >= 3 && string(argv[1]) == "--bench-variates") {
+        bool initialized = initialize(vector<string>());
+        if (!initialized) {
+            cout << errorReason << endl;
+            errorReason = "";
+        }
+        long count = atol(argv[2]);
+        int rc = runVariateBenchmark(driver, count > 0 ? (size_t)count : 1000000);
+        driver->Shutdown();
+        dumpTrace();
+        delete driver;
+        return rc;
+    }
+
+    // Run the NIST SP 800-22 statistical tests over a recording (.hex or raw binary) or a generator
+    // args: --nist <file path or serial number> [max sequences, 0 for all] [sequence bits, default 1048576]
+    if (argc >= 3 && string(argv[1]) == "--nist") {
+        string source = argv[2];
+        size_t maxSequences = argc >= 4 ? (size_t)atol(argv[3]) : 0;
+        size_t sequenceBits = argc >= 5 ? (size_t)atol(argv[4]) : 0;
+        FILE* file = fopen(source.c_str(), "rb");
+        if (file != nullptr) {
+            fclose(file);
+            int rc = runNistBattery(nullptr, source, maxSequences, sequenceBits);
+            delete driver;
+            return rc;
+        }
+        bool initialized = initialize(vector<string>());
+        if (!initialized) {
+            cout << errorReason << endl;
+            delete driver;
+            return -1;
+        }
+        int rc = runNistBattery(driver, source, maxSequences, sequenceBits);
+        driver->Shutdown();
+        dumpTrace();
+        delete driver;
+        return rc;
+    }
+
+    // Estimate min-entropy with the SP 800-90B non-IID estimators over a recording (.hex or raw binary) or a generator
+    // args: --min-entropy <file path or serial number> [bits, default 1000000]
+    if (argc >= 3 && string(argv[1]) == "--min-entropy") {
+        string source = argv[2];
+        size_t numBits = argc >= 4 ? (size_t)atol(argv[3]) : 1000000;
+        FILE* file = fopen(source.c_str(), "rb");
+        if (file != nullptr) {
+            fclose(file);
+            int rc = runMinEntropy(nullptr, source, numBits);
+            delete driver;
+            return rc;
+        }
+        bool initialized = initialize(vector<string>());
+        if (!initialized) {
+            cout << errorReason << endl;
+            delete driver;
+            return -1;
+        }
+        int rc = runMinEntropy(driver, source, numBits);
+        driver->Shutdown();
+        dumpTrace();
+        delete driver;
+        return rc;
+    }
+
+    // Look for periodic artifacts (packet size, latency timer) in a recording (.hex or raw binary) or a generator
+    // args: --spectral <file path or serial number> [max blocks, 0 for all] [block bits, default 65536]
+    if (argc >= 3 && string(argv[1]) == "--spectral") {
+        string source = argv[2];
+        size_t maxBlocks = argc >= 4 ? (size_t)atol(argv[3]) : 0;
+        size_t blockBits = argc >= 5 ? (size_t)atol(argv[4]) : 0;
+        FILE* file = fopen(source.c_str(), "rb");
+        if (file != nullptr) {
+            fclose(file);
+            int rc = runSpectralAnalysis(nullptr, source, maxBlocks, blockBits);
+            delete driver;
+            return rc;
+        }
+        bool initialized = initialize(vector<string>());
+        if (!initialized) {
+            cout << errorReason << endl;
+            delete driver;
+            return -1;
+        }
+        int rc = runSpectralAnalysis(driver, source, maxBlocks, blockBits);
+        driver->Shutdown();
+        dumpTrace();
+        delete driver;
+        return rc;
+    }
+
+    // GCP2-style phase and amplitude coherence between devices, from recordings made at the same time
+    // args: --coherence <.hex, .bin or .epochs file path> <.hex, .bin or .epochs file path> [...] [--epoch <seconds, default 1>] [--window <epochs, default 60>]
+    if (argc >= 2 && string(argv[1]) == "--coherence") {
+        vector<string> paths;
+        double epochSeconds = 1;
+        size_t windowEpochs = 60;
+        for (int i = 2; i < argc; i++) {
+            if (string(argv[i]) == "--epoch" && i + 1 < argc) {
+                epochSeconds = atof(argv[++i]);
+            } else if (string(argv[i]) == "--window" && i + 1 < argc) {
+                windowEpochs = (size_t)atol(argv[++i]);
+            } else {
+                paths.push_back(argv[i]);
+            }
+        }
+        if (!(epochSeconds >= 1e-3)) {
+            cout << "Epochs must be at least 1 ms" << endl;
+            delete driver;
+            return -1;
+        }
+        int rc = runCoherence(paths, epochSeconds, windowEpochs);
+        delete driver;
+        return rc;
+    }
+
+    // Record a generator's bytes with a walk pyramid for zooming through the session
+    // args: --record <serial number> <file path without extension> <seconds> [bytes per read, default 1024]
+    if (argc >= 5 && string(argv[1]) == "--record") {
+        int chunkBytes = argc >= 6 ? atoi(argv[5]) : 1024;
+        if (chunkBytes <= 0 || chunkBytes > MF_MAX_READ_LENGTH) {
+            cout << "Bytes per read must be 1 to " << MF_MAX_READ_LENGTH << endl;
+            delete driver;
+            return -1;
+        }
+        bool initialized = initialize(vector<string>());
+        if (!initialized) {
+            cout << errorReason << endl;
+            delete driver;
+            return -1;
+        }
+        int rc = runRecording(driver, argv[2], argv[3], atof(argv[4]), chunkBytes);
+        driver->Shutdown();
+        dumpTrace();
+        delete driver;
+        return rc;
+    }
+
+    // Zoom into a recording's walk pyramid, reporting the level used and the bytes read at each step
+    // args: --walk <file path without extension> [pixels, default 2000] [first bit] [bits, 0 for the rest]
+    if (argc >= 3 && string(argv[1]) == "--walk") {
+        size_t pixels = argc >= 4 ? (size_t)atol(argv[3]) : 2000;
+        uint64_t firstBit = argc >= 5 ? (uint64_t)atoll(argv[4]) : 0;
+        uint64_t numBits = argc >= 6 ? (uint64_t)atoll(argv[5]) : 0;
+        int rc = runWalkQuery(argv[2], pixels, firstBit, numBits);
+        delete driver;
+        return rc;
+    }
+
+    // Convert .hex recordings to binary recordings (.bin, .walk, .epochs and .hist) on all cores
+    // args: --convert <.hex file path> [...] [--out <directory, default the .hex file's>] [--threads <count, default all cores>]
+    if (argc >= 3 && string(argv[1]) == "--convert") {
+        vector<string> paths;
+        string outputDir;
+        unsigned threads = 0;
+        for (int i = 2; i < argc; i++) {
+            if (string(argv[i]) == "--out" && i + 1 < argc) {
+                outputDir = argv[++i];
+            } else if (string(argv[i]) == "--threads" && i + 1 < argc) {
+                threads = (unsigned)atoi(argv[++i]);
+            } else {
+                paths.push_back(argv[i]);
+            }
+        }
+        int rc = runConversion(paths, outputDir, threads);
+        delete driver;
+        return rc;
+    }
+
+    // Transport tuning mode
+    // args: --tune <serial number>
+    bool tune = argc >= 2 && string(argv[1]) == "--tune";
+    if (tune && argc < 3) {
+        cout << "Usage: meterfeeder --tune <serial number>" << endl;
+        delete driver;
+        return -1;
+    }
+
+    // Only claim the requested device so other processes can read from the rest
+    vector<string> filters;
+    if (argc >= 2) {
+        filters.push_back(tune ? argv[2] : argv[1]);
+    }
+    bool initialized = initialize(filters);
+    if (!initialized) {
         cout << errorReason << endl;
         delete driver;
         return -1;
     }
+    if (!metricsPath.empty()) {
+        driver->StartMetricsExporter(metricsPath, 1000, &errorReason);
+        if (!errorReason.empty()) {
+            cout << errorReason << endl;
+            errorReason = "";
+        }
+    }
+
+    if (captureHistoryMs > 0) {
+        vector<Generator> generators = driver->GetListGenerators();
+        for (size_t i = 0; i < generators.size(); i++) {
+            driver->StartCapture(generators.at(i).GetHandle(), captureHistoryMs, &errorReason);
+            if (!errorReason.empty()) {
+                cout << errorReason << endl;
+                delete driver;
+                return -1;
+            }
+            cout << "Capturing " << generators.at(i).GetSerialNumber() << endl;
+        }
+        driver->StartTriggerServer(MF_TRIGGER_DEFAULT_PORT, &errorReason);
+        if (!errorReason.empty()) {
+            cout << errorReason << endl;
+            delete driver;
+            return -1;
+        }
+        cout << "Send \"TRIGGER <serial> <pre bits> <post bits> [tag]\" to UDP 127.0.0.1:" << MF_TRIGGER_DEFAULT_PORT << endl;
+        for (;;) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+    }
+
+    if (tune) {
+        shared_ptr<Generator> generator = driver->FindGeneratorBySerial(argv[2]);
+        if (!generator) {
+            cout << "Generator not found: " << argv[2] << endl;
+            delete driver;
+            return -1;
+        }
+
+        TransportProfile profile = generator->GetProfile();
+        cout << "Tuning " << generator->GetSerialNumber() << " (" << profile.model << "), "
+             << profile.readChunkBytes << " byte chunks" << endl;
+        vector<TuneSample> samples;
+        driver->TuneTransport(generator->GetHandle(), &samples, &errorReason);
+        cout << "latency ms\ttransfer\tpacket read ms\tthroughput B/s" << endl;
+        for (size_t i = 0; i < samples.size(); i++) {
+            cout << (unsigned)samples[i].latencyMs << "\t\t" << samples[i].usbTransferSize << "\t\t"
+                 << fixed << setprecision(2) << samples[i].packetReadMs << "\t\t"
+                 << setprecision(0) << samples[i].throughput << endl;
+        }
+        if (errorReason.length() != 0) {
+            cout << errorReason << endl;
+            delete driver;
+            return -1;
+        }
+
+        profile = generator->GetProfile();
+        cout << "Best: latency " << (unsigned)profile.latencyMs << " ms, transfer size "
+             << profile.usbTransferSize << " bytes" << endl;
+        driver->Shutdown();
+        dumpTrace();
+        delete driver;
+        return 0;
+    }
 
     // If invoked with command line arguments to specify the device serial number
     // and length of entropy (in bytes) to read only read from that device
-    // args: <serial number> [length to read in bytes] [1 to run in infinite loop]
+    // args: <serial number> [length to read in bytes] [1 to run in infinite loop] [deadline in ms to print whatever arrived by then]
     if (argc >= 2) {
-        Generator *generator = driver->FindGeneratorBySerial(argv[1]);
+        shared_ptr<Generator> generator = driver->FindGeneratorBySerial(argv[1]);
         if (!generator) {
             cout << "Generator not found: " << argv[1] << endl;
             delete driver;
@@ -81,16 +1166,27 @@ int main(int argc, char *argv[]) {
         else
             cont = false;
 
+        int deadlineMs = argc >= 5 ? atoi(argv[4]) : 0;
+
         do {
             using namespace std::chrono;
             auto start = high_resolution_clock::now();
 
-            driver->GetBytes(generator->GetHandle(), len, bytes, &errorReason);
+            int numRead = len;
+            if (deadlineMs > 0) {
+                numRead = driver->GetBytesWithDeadline(generator->GetHandle(), len, len, bytes, deadlineMs, &errorReason);
+                if (numRead > 0) {
+                    // Partial data is still good data
+                    errorReason = "";
+                }
+            } else {
+                driver->GetBytes(generator->GetHandle(), len, bytes, &errorReason);
+            }
 
             if (errorReason.length() != 0) {
                 cout << errorReason << endl;
             } else {
-                for (int i = 0; i < len; i++) {
+                for (int i = 0; i < numRead; i++) {
                     cout << setfill('0') << setw(2) << right << hex << (unsigned int)bytes[i];
                 }
             }
@@ -100,34 +1196,64 @@ int main(int argc, char *argv[]) {
         } while (cont);
             
         free(bytes);
+        dumpTrace();
         delete driver;
         return 0;
     }
 
     // Else, read entropy from all the connected devices
-    vector<Generator>* generators = driver->GetListGenerators();
-    if (generators->size() == 0) {
+    vector<InitResult>* results = driver->GetInitResults();
+    for (size_t i = 0; i < results->size(); i++) {
+        if (!results->at(i).ok) {
+            cout << results->at(i).errorReason << endl;
+        }
+    }
+    vector<Generator> generators = driver->GetListGenerators();
+    if (generators.size() == 0) {
         cout << "No generators" << endl;
         return -1;
     }
-    for (size_t i = 0; i < generators->size(); i++) {
-        Generator *generator = &generators->at(i);
-        int len = 1;
-        UCHAR* bytes = (UCHAR*)malloc(len * sizeof(UCHAR));
-        driver->GetBytes(generator->GetHandle(), len, bytes, &errorReason);
-        if (errorReason.length() != 0) {
-            cout << errorReason << endl;
-            errorReason = ""; // reset error for next device
+
+    // Read from all of them at once on the driver's reactor
+    int len = 1;
+    vector<UCHAR> bytes(generators.size() * len);
+    vector<int> statuses(generators.size(), MF_OK);
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    size_t numDone = 0;
+    for (size_t i = 0; i < generators.size(); i++) {
+        Generator *generator = &generators.at(i);
+        uint64_t id = driver->SubmitRead(generator->GetHandle(), len, &bytes[i * len], FTDI_DEVICE_TX_TIMEOUT_MS, true,
+            [&, i](uint64_t, int status, DWORD) {
+                std::lock_guard<std::mutex> lock(doneMutex);
+                statuses[i] = status;
+                numDone++;
+                doneCondition.notify_one();
+            }, &errorReason);
+        if (id == 0) {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            statuses[i] = -1;
+            numDone++;
+        }
+    }
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        doneCondition.wait(lock, [&]() { return numDone == generators.size(); });
+    }
+
+    for (size_t i = 0; i < generators.size(); i++) {
+        Generator *generator = &generators.at(i);
+        if (statuses[i] != MF_OK) {
+            cout << "Error reading in entropy from " << generator->GetSerialNumber() << " [" << statuses[i] << "]" << endl;
             continue;
         }
         cout << generator->GetSerialNumber() << " (" << generator->GetDescription() << "): ";
         for (int j = 0; j < len; j++) {
-            cout << (int)*(bytes+j) << " ";
+            cout << (int)bytes[i * len + j] << " ";
         }
         cout << endl;
-
-        delete bytes;
     }
     driver->Shutdown();
+    dumpTrace();
     delete driver;
 }
\ No newline at end of file
@@ -0,0 +1,295 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "metrics.h"
+
+#include <cstdarg>
+#include <chrono>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+MeterFeeder::LatencyHistogram::LatencyHistogram() {
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        buckets_[i] = 0;
+    }
+    count_ = 0;
+    sum_ = 0;
+    max_ = 0;
+}
+
+void MeterFeeder::LatencyHistogram::Record(uint64_t micros) {
+    buckets_[bucketIndex(micros)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(micros, std::memory_order_relaxed);
+
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (micros > max && !max_.compare_exchange_weak(max, micros, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t MeterFeeder::LatencyHistogram::GetCount() const {
+    return count_.load(std::memory_order_relaxed);
+}
+
+uint64_t MeterFeeder::LatencyHistogram::GetSum() const {
+    return sum_.load(std::memory_order_relaxed);
+}
+
+uint64_t MeterFeeder::LatencyHistogram::GetMax() const {
+    return max_.load(std::memory_order_relaxed);
+}
+
+uint64_t MeterFeeder::LatencyHistogram::GetPercentile(double percentile) const {
+    uint64_t count = GetCount();
+    if (count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t upper = bucketUpperBound(i);
+            uint64_t max = GetMax();
+            return upper < max ? upper : max;
+        }
+    }
+    return GetMax();
+}
+
+uint64_t MeterFeeder::LatencyHistogram::GetCountAtOrBelow(uint64_t micros) const {
+    uint64_t count = 0;
+    for (int i = 0; i < NUM_BUCKETS && bucketUpperBound(i) <= micros + 1; i++) {
+        count += buckets_[i].load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+// Buckets 0-7 hold 0-7 us exactly, after that each power of two is split into 8 equal sub-buckets
+int MeterFeeder::LatencyHistogram::bucketIndex(uint64_t micros) {
+    if (micros < 8) {
+        return (int)micros;
+    }
+
+#ifdef _MSC_VER
+    unsigned long msb;
+    _BitScanReverse64(&msb, micros);
+#else
+    int msb = 63 - __builtin_clzll(micros);
+#endif
+    int index = ((int)msb - 2) * 8 + (int)((micros >> (msb - 3)) & 7);
+    return index < NUM_BUCKETS ? index : NUM_BUCKETS - 1;
+}
+
+// Exclusive upper bound of the values in a bucket
+uint64_t MeterFeeder::LatencyHistogram::bucketUpperBound(int index) {
+    if (index < 8) {
+        return (uint64_t)index + 1;
+    }
+
+    int msb = index / 8 + 2;
+    uint64_t width = 1ULL << (msb - 3);
+    return (8 + (uint64_t)(index % 8)) * width + width;
+}
+
+namespace MeterFeeder {
+    static void appendLine(std::string* text, const char* format, ...) {
+        char line[512];
+        va_list args;
+        va_start(args, format);
+        vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+        *text += line;
+    }
+
+    static void appendValues(std::string* text, const char* name, const char* help, const char* type,
+                             const std::vector<MetricsEntry>& generators, uint64_t (*value)(const GeneratorMetrics&)) {
+        appendLine(text, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+        for (size_t i = 0; i < generators.size(); i++) {
+            appendLine(text, "%s{serial=\"%s\"} %llu\n", name, generators[i].first.c_str(),
+                (unsigned long long)value(*generators[i].second));
+        }
+    }
+
+    static void appendHistograms(std::string* text, const char* name, const char* help,
+                                 const std::vector<MetricsEntry>& generators, const LatencyHistogram& (*histogramOf)(const GeneratorMetrics&)) {
+        // Prometheus buckets in seconds, coarser than the histogram's own
+        static const double bounds[] = { 0.0001, 0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1, 2, 5, 10 };
+
+        appendLine(text, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+        for (size_t g = 0; g < generators.size(); g++) {
+            const char* serial = generators[g].first.c_str();
+            const LatencyHistogram& histogram = histogramOf(*generators[g].second);
+            for (size_t i = 0; i < sizeof(bounds) / sizeof(bounds[0]); i++) {
+                appendLine(text, "%s_bucket{serial=\"%s\",le=\"%g\"} %llu\n", name, serial, bounds[i],
+                    (unsigned long long)histogram.GetCountAtOrBelow((uint64_t)(bounds[i] * 1e6)));
+            }
+            appendLine(text, "%s_bucket{serial=\"%s\",le=\"+Inf\"} %llu\n", name, serial, (unsigned long long)histogram.GetCount());
+            appendLine(text, "%s_sum{serial=\"%s\"} %.6f\n", name, serial, histogram.GetSum() / 1e6);
+            appendLine(text, "%s_count{serial=\"%s\"} %llu\n", name, serial, (unsigned long long)histogram.GetCount());
+        }
+    }
+
+    static std::string windowLabel(uint32_t ms) {
+        char label[16];
+        if (ms % 3600000 == 0) {
+            snprintf(label, sizeof(label), "%uh", ms / 3600000);
+        } else if (ms % 60000 == 0) {
+            snprintf(label, sizeof(label), "%um", ms / 60000);
+        } else if (ms % 1000 == 0) {
+            snprintf(label, sizeof(label), "%us", ms / 1000);
+        } else {
+            snprintf(label, sizeof(label), "%ums", ms);
+        }
+        return label;
+    }
+
+    // A gauge per bias monitor window, labelled e.g. window="1m"
+    static void appendBiasWindows(std::string* text, const char* name, const char* help,
+                                  const std::vector<MetricsEntry>& generators, double (*value)(const BiasWindowStats&)) {
+        appendLine(text, "# HELP %s %s\n# TYPE %s gauge\n", name, help, name);
+        for (size_t g = 0; g < generators.size(); g++) {
+            const BiasMonitor& monitor = generators[g].second->bias;
+            if (!monitor.IsEnabled()) {
+                continue;
+            }
+            std::vector<BiasWindowStats> windows;
+            monitor.GetWindows(&windows);
+            for (size_t i = 0; i < windows.size(); i++) {
+                appendLine(text, "%s{serial=\"%s\",window=\"%s\"} %.15g\n", name, generators[g].first.c_str(),
+                    windowLabel(windows[i].windowMs).c_str(), value(windows[i]));
+            }
+        }
+    }
+
+    static uint64_t bytesRead(const GeneratorMetrics& m) { return m.bytesRead; }
+    static uint64_t reads(const GeneratorMetrics& m) { return m.reads; }
+    static uint64_t shortReads(const GeneratorMetrics& m) { return m.shortReads; }
+    static uint64_t timeouts(const GeneratorMetrics& m) { return m.timeouts; }
+    static uint64_t cancellations(const GeneratorMetrics& m) { return m.cancellations; }
+    static uint64_t purges(const GeneratorMetrics& m) { return m.purges; }
+    static uint64_t errors(const GeneratorMetrics& m) { return m.errors; }
+    static uint64_t rxQueueBytes(const GeneratorMetrics& m) { return m.rxQueueBytes; }
+    static uint64_t pendingReads(const GeneratorMetrics& m) { int64_t n = m.pendingReads; return n > 0 ? (uint64_t)n : 0; }
+    static double biasBits(const BiasWindowStats& w) { return (double)w.bits; }
+    static double biasZScore(const BiasWindowStats& w) { return w.zScore; }
+    static double biasChiSquarePValue(const BiasWindowStats& w) { return w.chiSquarePValue; }
+    static const LatencyHistogram& readLatency(const GeneratorMetrics& m) { return m.readLatency; }
+    static const LatencyHistogram& requestLatency(const GeneratorMetrics& m) { return m.requestLatency; }
+    static const LatencyHistogram& startStreamingLatency(const GeneratorMetrics& m) { return m.startStreamingLatency; }
+}
+
+void MeterFeeder::FormatMetrics(std::string* text, const std::vector<MetricsEntry>& generators) {
+    appendValues(text, "meterfeeder_bytes_read_total", "Bytes read from the generator.", "counter", generators, bytesRead);
+    appendValues(text, "meterfeeder_reads_total", "Reads completed.", "counter", generators, reads);
+    appendValues(text, "meterfeeder_short_reads_total", "Reads returning fewer bytes than asked for.", "counter", generators, shortReads);
+    appendValues(text, "meterfeeder_timeouts_total", "Reads reaching their deadline short of their minimum length.", "counter", generators, timeouts);
+    appendValues(text, "meterfeeder_cancellations_total", "Reads cancelled.", "counter", generators, cancellations);
+    appendValues(text, "meterfeeder_purges_total", "Receive/transmit buffer purges.", "counter", generators, purges);
+    appendValues(text, "meterfeeder_errors_total", "Failed FTDI calls.", "counter", generators, errors);
+    appendValues(text, "meterfeeder_rx_queue_bytes", "Bytes waiting in the receive queue when last checked.", "gauge", generators, rxQueueBytes);
+    appendValues(text, "meterfeeder_pending_reads", "Reactor reads queued or in flight.", "gauge", generators, pendingReads);
+    appendHistograms(text, "meterfeeder_read_latency_seconds", "Time spent in FT_Read by blocking reads.", generators, readLatency);
+    appendHistograms(text, "meterfeeder_request_latency_seconds", "Time from submitting a reactor read to its completion.", generators, requestLatency);
+    appendHistograms(text, "meterfeeder_start_streaming_latency_seconds", "Time to purge and send the start streaming command.", generators, startStreamingLatency);
+    appendBiasWindows(text, "meterfeeder_bias_window_bits", "Bits counted in the sliding window.", generators, biasBits);
+    appendBiasWindows(text, "meterfeeder_bias_z_score", "Z-score of the ones in the sliding window.", generators, biasZScore);
+    appendBiasWindows(text, "meterfeeder_bias_chi_square_p_value", "p-value of the byte chi-square in the sliding window.", generators, biasChiSquarePValue);
+}
+
+MeterFeeder::MetricsExporter::MetricsExporter() {
+}
+
+MeterFeeder::MetricsExporter::~MetricsExporter() {
+    Stop();
+}
+
+bool MeterFeeder::MetricsExporter::Start(const std::string& path, uint32_t intervalMs, Collect collect, std::string* errorReason) {
+    Stop();
+
+    path_ = path;
+    intervalMs_ = intervalMs > 0 ? intervalMs : 1;
+    collect_ = collect;
+    if (!write(errorReason)) {
+        return false;
+    }
+
+    running_ = true;
+    thread_ = std::thread(&MetricsExporter::run, this);
+    return true;
+}
+
+void MeterFeeder::MetricsExporter::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    stop_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+
+        // Leave the final counts behind
+        std::string errorReason;
+        write(&errorReason);
+    }
+}
+
+bool MeterFeeder::MetricsExporter::write(std::string* errorReason) {
+    std::string text = collect_();
+    std::string tmpPath = path_ + ".tmp";
+
+    FILE* file = fopen(tmpPath.c_str(), "wb");
+    if (!file) {
+        *errorReason = "Could not open " + tmpPath + " for writing: " + strerror(errno);
+        return false;
+    }
+    bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        *errorReason = "Could not write metrics to " + tmpPath;
+        remove(tmpPath.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    bool renamed = MoveFileExA(tmpPath.c_str(), path_.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool renamed = rename(tmpPath.c_str(), path_.c_str()) == 0;
+#endif
+    if (!renamed) {
+        *errorReason = "Could not rename " + tmpPath + " to " + path_;
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+void MeterFeeder::MetricsExporter::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        if (stop_.wait_for(lock, std::chrono::milliseconds(intervalMs_), [this]() { return !running_; })) {
+            break;
+        }
+
+        // A failed snapshot (e.g. disk full) is retried on the next interval
+        lock.unlock();
+        std::string errorReason;
+        write(&errorReason);
+        lock.lock();
+    }
+}
@@ -0,0 +1,178 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "monitor.h"
+
+namespace MeterFeeder {
+    /**
+     * Lock-free latency histogram with HDR-style log-linear buckets: 8 sub-buckets per power
+     * of two, so any recorded value is known to within 12.5%, from 1 us up to about 12 days.
+     */
+    class LatencyHistogram {
+        public:
+            LatencyHistogram();
+
+            /**
+             * Record a latency.
+             * 
+             * @param Latency in microseconds.
+             */
+            void Record(uint64_t micros);
+
+            /**
+             * Get the number of recorded latencies.
+             */
+            uint64_t GetCount() const;
+
+            /**
+             * Get the sum of the recorded latencies in microseconds.
+             */
+            uint64_t GetSum() const;
+
+            /**
+             * Get the largest recorded latency in microseconds.
+             */
+            uint64_t GetMax() const;
+
+            /**
+             * Get the latency at a percentile, to within the bucket resolution.
+             * 
+             * @param Percentile between 0 and 100.
+             * 
+             * @return Upper bound of the bucket holding the percentile in microseconds, 0 if nothing recorded.
+             */
+            uint64_t GetPercentile(double percentile) const;
+
+            /**
+             * Get the number of recorded latencies less than or equal to a value,
+             * to within the bucket resolution.
+             * 
+             * @param Latency in microseconds.
+             */
+            uint64_t GetCountAtOrBelow(uint64_t micros) const;
+
+        private:
+            static const int NUM_BUCKETS = 304;
+            static int bucketIndex(uint64_t micros);
+            static uint64_t bucketUpperBound(int index);
+
+            std::atomic<uint64_t> buckets_[NUM_BUCKETS];
+            std::atomic<uint64_t> count_;
+            std::atomic<uint64_t> sum_;
+            std::atomic<uint64_t> max_;
+    };
+
+    /**
+     * Counters, gauges and latency histograms for one generator.
+     * Updated with relaxed atomics from whichever thread does the I/O.
+     */
+    struct GeneratorMetrics {
+        // Bytes read from the generator
+        std::atomic<uint64_t> bytesRead{0};
+
+        // Reads completed, blocking or through the reactor
+        std::atomic<uint64_t> reads{0};
+
+        // Reads returning fewer bytes than asked for
+        std::atomic<uint64_t> shortReads{0};
+
+        // Reactor reads that hit their deadline short of their minimum length
+        std::atomic<uint64_t> timeouts{0};
+
+        // Reactor reads cancelled
+        std::atomic<uint64_t> cancellations{0};
+
+        // Receive/transmit buffer purges (one per start or stop streaming command)
+        std::atomic<uint64_t> purges{0};
+
+        // Failed FTDI calls
+        std::atomic<uint64_t> errors{0};
+
+        // Bytes waiting in the receive queue when last checked
+        std::atomic<uint64_t> rxQueueBytes{0};
+
+        // Reactor reads queued or in flight
+        std::atomic<int64_t> pendingReads{0};
+
+        // Time spent in FT_Read by blocking reads
+        LatencyHistogram readLatency;
+
+        // Time from submitting a reactor read to its completion
+        LatencyHistogram requestLatency;
+
+        // Time to purge and send the start streaming command
+        LatencyHistogram startStreamingLatency;
+
+        // Bias and byte chi-square of the output over the last second, minute and hour
+        BiasMonitor bias;
+    };
+
+    typedef std::pair<std::string, const GeneratorMetrics*> MetricsEntry;
+
+    /**
+     * Append generators' metrics to a document in the Prometheus text exposition format.
+     * 
+     * @param Where to append the metrics.
+     * @param Serial numbers, used as the "serial" label, and metrics of the generators.
+     */
+    void FormatMetrics(std::string* text, const std::vector<MetricsEntry>& generators);
+
+    /**
+     * Periodically writes metrics to a text file for a Prometheus node exporter textfile
+     * collector (or anything else) to pick up. Each snapshot is written to a temporary file
+     * then renamed over the target so readers never see a partial file.
+     */
+    class MetricsExporter {
+        public:
+            typedef std::function<std::string()> Collect;
+
+            MetricsExporter();
+            ~MetricsExporter();
+            MetricsExporter(const MetricsExporter&) = delete;
+            MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+            /**
+             * Start exporting, replacing any exporter already running.
+             * 
+             * @param Path of the file to write.
+             * @param Interval between snapshots in milliseconds.
+             * @param Function producing the text to write.
+             * @param Error reason if the file could not be written.
+             * 
+             * @return true if the first snapshot was written, false otherwise.
+             */
+            bool Start(const std::string& path, uint32_t intervalMs, Collect collect, std::string* errorReason);
+
+            /**
+             * Stop exporting after writing a final snapshot, which is left in place.
+             */
+            void Stop();
+
+        private:
+            bool write(std::string* errorReason);
+            void run();
+
+            std::mutex mutex_;
+            std::condition_variable stop_;
+            std::thread thread_;
+            bool running_ = false;
+            std::string path_;
+            uint32_t intervalMs_ = 0;
+            Collect collect_;
+    };
+}
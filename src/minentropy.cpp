@@ -0,0 +1,558 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "minentropy.h"
+
+#include "constants.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+// Normal quantile for the 99% upper confidence bounds throughout SP 800-90B
+#define MF_90B_Z 2.576
+
+// Counts a tuple needs for the t-tuple estimate, and below which the LRS estimate starts
+#define MF_90B_TUPLE_CUTOFF 35
+
+// Compression estimator block length, dictionary blocks and variance correction
+#define MF_90B_COMPRESSION_BITS 6
+#define MF_90B_COMPRESSION_DICTIONARY 1000
+#define MF_90B_COMPRESSION_C 0.5907
+
+// Predictor parameters: MultiMCW window count, lags, MultiMMC orders, LZ78Y context length and dictionary size
+#define MF_90B_MCW_WINDOWS 4
+#define MF_90B_LAGS 128
+#define MF_90B_MMC_ORDERS 16
+#define MF_90B_LZ78Y_LENGTH 16
+#define MF_90B_LZ78Y_MAX_DICTIONARY 65536
+
+namespace MeterFeeder {
+    static double upperBound(double p, double n) {
+        return std::min(1.0, p + MF_90B_Z * sqrt(p * (1 - p) / (n - 1)));
+    }
+
+    static MinEntropyEstimate makeEstimate(const char* name, double probability) {
+        MinEntropyEstimate estimate;
+        estimate.name = name;
+        estimate.probability = probability;
+        estimate.minEntropy = std::max(0.0, -log2(probability));
+        return estimate;
+    }
+
+    // 6.3.1
+    static MinEntropyEstimate mostCommonValue(const unsigned char* s, size_t n) {
+        size_t ones = 0;
+        for (size_t i = 0; i < n; i++) {
+            ones += s[i];
+        }
+        return makeEstimate("Most common value", upperBound((double)std::max(ones, n - ones) / n, (double)n));
+    }
+
+    // 6.3.2. With binary samples a collision always comes within three, and the expected time to one
+    // is 3 - p^2 - q^2, so the search for p the standard describes has a closed form.
+    static MinEntropyEstimate collision(const unsigned char* s, size_t n) {
+        double count = 0, sum = 0, sumSquares = 0;
+        size_t i = 0;
+        while (i + 1 < n) {
+            unsigned t;
+            if (s[i] == s[i + 1]) {
+                t = 2;
+            } else if (i + 2 < n) {
+                t = 3;
+            } else {
+                break;
+            }
+            count++;
+            sum += t;
+            sumSquares += t * t;
+            i += t;
+        }
+        double mean = sum / count;
+        double sd = sqrt((sumSquares - count * mean * mean) / (count - 1));
+        double lowMean = mean - MF_90B_Z * sd / sqrt(count);
+
+        double p;
+        if (lowMean >= 2.5) {
+            p = 0.5;
+        } else if (lowMean <= 2) {
+            p = 1;
+        } else {
+            // p^2 + (1 - p)^2 = 3 - lowMean, taking p >= 1/2
+            p = (1 + sqrt(2 * (3 - lowMean) - 1)) / 2;
+        }
+        return makeEstimate("Collision", p);
+    }
+
+    // 6.3.3
+    static MinEntropyEstimate markov(const unsigned char* s, size_t n) {
+        double ones = 0, transitions[2][2] = { { 0, 0 }, { 0, 0 } };
+        for (size_t i = 0; i + 1 < n; i++) {
+            ones += s[i];
+            transitions[s[i]][s[i + 1]]++;
+        }
+        ones += s[n - 1];
+
+        // Logs of the initial and transition probabilities, to keep 128 bit sequences from underflowing
+        double logP[2] = { log((n - ones) / n), log(ones / n) };
+        double logT[2][2];
+        for (int a = 0; a < 2; a++) {
+            double from = transitions[a][0] + transitions[a][1];
+            for (int b = 0; b < 2; b++) {
+                logT[a][b] = from > 0 ? log(transitions[a][b] / from) : -INFINITY;
+            }
+        }
+
+        // The most likely 128 bit sequences are among these six
+        double candidates[6] = {
+            logP[0] + 127 * logT[0][0],
+            logP[0] + 64 * logT[0][1] + 63 * logT[1][0],
+            logP[0] + logT[0][1] + 126 * logT[1][1],
+            logP[1] + logT[1][0] + 126 * logT[0][0],
+            logP[1] + 64 * logT[1][0] + 63 * logT[0][1],
+            logP[1] + 127 * logT[1][1]
+        };
+        double logMax = *std::max_element(candidates, candidates + 6);
+        return makeEstimate("Markov", std::max(0.5, exp(logMax / 128)));
+    }
+
+    // 6.3.4. G(z) is summed per distance u rather than per test block, making it O(n) instead of O(n^2)
+    static double compressionExpectation(double z, size_t d, size_t n, const std::vector<double>& log2u) {
+        double sum = 0, power = 1;
+        double v = (double)(n - d);
+        for (size_t u = 1; u <= n; u++) {
+            double weight = z * z * (double)(n - std::max(u, d)) + (u > d ? z : 0);
+            sum += log2u[u] * power * weight;
+            power *= 1 - z;
+            if (power < 1e-300) {
+                break;
+            }
+        }
+        return sum / v;
+    }
+
+    static MinEntropyEstimate compression(const unsigned char* s, size_t n) {
+        const size_t b = MF_90B_COMPRESSION_BITS, d = MF_90B_COMPRESSION_DICTIONARY;
+        size_t blocks = n / b;
+        double v = (double)(blocks - d);
+
+        size_t dictionary[1 << MF_90B_COMPRESSION_BITS] = { 0 };
+        double sum = 0, sumSquares = 0;
+        for (size_t i = 1; i <= blocks; i++) {
+            unsigned value = 0;
+            for (size_t j = 0; j < b; j++) {
+                value = (value << 1) | s[(i - 1) * b + j];
+            }
+            if (i > d) {
+                double distance = log2((double)(dictionary[value] > 0 ? i - dictionary[value] : i));
+                sum += distance;
+                sumSquares += distance * distance;
+            }
+            dictionary[value] = i;
+        }
+        double mean = sum / v;
+        double sd = MF_90B_COMPRESSION_C * sqrt(std::max(0.0, sumSquares / (v - 1) - mean * mean));
+        double lowMean = mean - MF_90B_Z * sd / sqrt(v);
+
+        std::vector<double> log2u(blocks + 1);
+        for (size_t u = 1; u <= blocks; u++) {
+            log2u[u] = log2((double)u);
+        }
+        const double others = (double)((1 << b) - 1);
+        auto expectation = [&](double p) {
+            return compressionExpectation(p, d, blocks, log2u) + others * compressionExpectation((1 - p) / others, d, blocks, log2u);
+        };
+
+        // The expectation falls as p rises from uniform
+        double low = 1.0 / (1 << b), high = 1;
+        double p = low;
+        if (lowMean < expectation(low)) {
+            for (int i = 0; i < 50; i++) {
+                double mid = (low + high) / 2;
+                if (expectation(mid) > lowMean) {
+                    low = mid;
+                } else {
+                    high = mid;
+                }
+            }
+            p = (low + high) / 2;
+        }
+        return makeEstimate("Compression", pow(p, 1.0 / b));
+    }
+
+    // Suffix array by prefix doubling with radix sorts, then the LCP array (Kasai et al.). lcp[i] is the
+    // length of the prefix shared by the suffixes at sa[i - 1] and sa[i]
+    static void buildSuffixArray(const unsigned char* s, uint32_t n, std::vector<uint32_t>* sa, std::vector<uint32_t>* lcp) {
+        std::vector<uint32_t> rank(n), other(n), counts(std::max<uint32_t>(n, 2) + 1);
+        sa->resize(n);
+
+        // Ranks from 1, leaving 0 for past the end
+        uint32_t ones = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            ones += s[i];
+        }
+        uint32_t zero = 0, one = n - ones;
+        for (uint32_t i = 0; i < n; i++) {
+            rank[i] = s[i] + 1;
+            (*sa)[s[i] ? one++ : zero++] = i;
+        }
+
+        uint32_t maxRank = ones > 0 && ones < n ? 2 : 1;
+        for (uint32_t k = 1; maxRank < n; k <<= 1) {
+            // Order by the rank k on, suffixes shorter than k first, then stably by rank
+            uint32_t p = 0;
+            for (uint32_t i = n - std::min(k, n); i < n; i++) {
+                other[p++] = i;
+            }
+            for (uint32_t j = 0; j < n; j++) {
+                if ((*sa)[j] >= k) {
+                    other[p++] = (*sa)[j] - k;
+                }
+            }
+            std::fill(counts.begin(), counts.begin() + maxRank + 2, 0);
+            for (uint32_t i = 0; i < n; i++) {
+                counts[rank[i]]++;
+            }
+            for (uint32_t r = 1; r <= maxRank + 1; r++) {
+                counts[r] += counts[r - 1];
+            }
+            for (uint32_t j = n; j-- > 0;) {
+                (*sa)[--counts[rank[other[j]]]] = other[j];
+            }
+
+            auto second = [&](uint32_t i) { return i + k < n ? rank[i + k] : 0; };
+            other[(*sa)[0]] = 1;
+            for (uint32_t j = 1; j < n; j++) {
+                uint32_t a = (*sa)[j - 1], b = (*sa)[j];
+                other[b] = other[a] + (rank[a] != rank[b] || second(a) != second(b));
+            }
+            maxRank = other[(*sa)[n - 1]];
+            rank.swap(other);
+        }
+
+        for (uint32_t j = 0; j < n; j++) {
+            rank[(*sa)[j]] = j;
+        }
+        lcp->assign(n, 0);
+        uint32_t h = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            if (rank[i] > 0) {
+                uint32_t j = (*sa)[rank[i] - 1];
+                while (i + h < n && j + h < n && s[i + h] == s[j + h]) {
+                    h++;
+                }
+                (*lcp)[rank[i]] = h;
+                h = h > 0 ? h - 1 : 0;
+            } else {
+                h = 0;
+            }
+        }
+    }
+
+    // 6.3.5 and 6.3.6. Each interval of the suffix array sharing a prefix of length l, inside one sharing
+    // only l' < l, is a set of c positions where each tuple of length l' + 1 to l occurs: so the largest
+    // count of every tuple length and the sum of their pairs come from one pass over the LCP array.
+    static void tupleEstimates(const unsigned char* s, size_t n, std::vector<MinEntropyEstimate>* estimates) {
+        std::vector<uint32_t> sa, lcp;
+        buildSuffixArray(s, (uint32_t)n, &sa, &lcp);
+        std::vector<uint32_t>().swap(sa);
+
+        uint32_t longest = 0;
+        for (size_t i = 1; i < n; i++) {
+            longest = std::max(longest, lcp[i]);
+        }
+        std::vector<uint64_t> largest(longest + 2, 1), pairs(longest + 2, 0);
+
+        std::vector<std::pair<uint32_t, uint32_t>> stack;
+        stack.push_back(std::make_pair(0u, 0u));
+        for (uint32_t i = 1; i <= n; i++) {
+            uint32_t h = i < n ? lcp[i] : 0;
+            uint32_t lb = i - 1;
+            while (h < stack.back().first) {
+                std::pair<uint32_t, uint32_t> top = stack.back();
+                stack.pop_back();
+                uint64_t count = i - top.second;
+                uint32_t parent = std::max(h, stack.back().first);
+                largest[top.first] = std::max(largest[top.first], count);
+                // Added over tuple lengths parent + 1 to top.first as differences, wrapping is harmless
+                pairs[parent + 1] += count * (count - 1) / 2;
+                pairs[top.first + 1] -= count * (count - 1) / 2;
+                lb = top.second;
+            }
+            if (h > stack.back().first) {
+                stack.push_back(std::make_pair(h, lb));
+            }
+        }
+        for (uint32_t w = longest; w-- > 1;) {
+            largest[w] = std::max(largest[w], largest[w + 1]);
+        }
+        for (uint32_t w = 1; w <= longest + 1; w++) {
+            pairs[w] += pairs[w - 1];
+        }
+
+        // t-tuple: the longest tuples still counted at least the cutoff
+        uint32_t t = 0;
+        double pMax = 0;
+        while (t + 1 <= longest && largest[t + 1] >= MF_90B_TUPLE_CUTOFF) {
+            t++;
+            pMax = std::max(pMax, pow((double)largest[t] / (n - t + 1), 1.0 / t));
+        }
+        estimates->push_back(makeEstimate("t-Tuple", t > 0 ? upperBound(pMax, (double)n) : 1));
+
+        // LRS: from there to the longest repeated substring
+        uint32_t u = t + 1;
+        if (u > longest) {
+            return;
+        }
+        pMax = 0;
+        for (uint32_t w = u; w <= longest; w++) {
+            double tuples = (double)(n - w + 1);
+            double pW = (double)pairs[w] / (tuples * (tuples - 1) / 2);
+            pMax = std::max(pMax, pow(pW, 1.0 / w));
+        }
+        estimates->push_back(makeEstimate("Longest repeated substring", upperBound(pMax, (double)n)));
+    }
+
+    // Tally of a predictor's predictions, a null prediction counting as wrong
+    struct PredictionTally {
+        size_t predictions = 0;
+        size_t correct = 0;
+        size_t run = 0;
+        size_t longestRun = 0;
+
+        void Add(bool ok) {
+            predictions++;
+            correct += ok;
+            run = ok ? run + 1 : 0;
+            longestRun = std::max(longestRun, run);
+        }
+    };
+
+    // Probability of a correct prediction at which a longest run of r - 1 correct predictions in n is at the
+    // 99th percentile, found by bisection. x - 1 is kept apart as y for precision over long sequences
+    static double localProbability(size_t n, size_t r) {
+        double low = 0, high = 1;
+        for (int i = 0; i < 60; i++) {
+            double p = (low + high) / 2, q = 1 - p;
+            double y = 0;
+            for (int j = 0; j < 10; j++) {
+                y = q * pow(p, (double)r) * pow(1 + y, (double)(r + 1));
+            }
+            double ratio = (q - p * y) / ((1 - r * y) * q);
+            double logProbability = log(ratio) - (n + 1) * log1p(y);
+            if (!(ratio > 0) || !(logProbability >= log(0.99))) {
+                high = p;
+            } else {
+                low = p;
+            }
+        }
+        return low;
+    }
+
+    static MinEntropyEstimate predictorEstimate(const char* name, const PredictionTally& tally) {
+        double n = (double)tally.predictions;
+        double global = tally.correct / n;
+        double globalBound = tally.correct == 0 ? 1 - pow(0.01, 1 / n) : upperBound(global, n);
+        double local = localProbability(tally.predictions, tally.longestRun + 1);
+        return makeEstimate(name, std::max(std::max(globalBound, local), 0.5));
+    }
+
+    // 6.3.7. The windows are odd, so with binary samples the most common value in each is never tied
+    static MinEntropyEstimate multiMcw(const unsigned char* s, size_t n) {
+        static const size_t windows[MF_90B_MCW_WINDOWS] = { 63, 255, 1023, 4095 };
+        std::vector<uint32_t> ones(n + 1, 0);
+        for (size_t i = 0; i < n; i++) {
+            ones[i + 1] = ones[i] + s[i];
+        }
+
+        PredictionTally tally;
+        size_t scoreboard[MF_90B_MCW_WINDOWS] = { 0 };
+        int winner = 0;
+        for (size_t i = windows[0]; i < n; i++) {
+            int predictions[MF_90B_MCW_WINDOWS];
+            for (int j = 0; j < MF_90B_MCW_WINDOWS; j++) {
+                predictions[j] = i >= windows[j] ? (ones[i] - ones[i - windows[j]]) * 2 > windows[j] : -1;
+            }
+            tally.Add(predictions[winner] == s[i]);
+            for (int j = 0; j < MF_90B_MCW_WINDOWS; j++) {
+                if (predictions[j] == s[i]) {
+                    scoreboard[j]++;
+                    if (scoreboard[j] >= scoreboard[winner]) {
+                        winner = j;
+                    }
+                }
+            }
+        }
+        return predictorEstimate("MultiMCW prediction", tally);
+    }
+
+    // 6.3.8
+    static MinEntropyEstimate lag(const unsigned char* s, size_t n) {
+        PredictionTally tally;
+        size_t scoreboard[MF_90B_LAGS + 1] = { 0 };
+        size_t winner = 1;
+        for (size_t i = 1; i < n; i++) {
+            tally.Add(s[i - winner] == s[i]);
+            size_t lags = std::min(i, (size_t)MF_90B_LAGS);
+            for (size_t d = 1; d <= lags; d++) {
+                if (s[i - d] == s[i]) {
+                    scoreboard[d]++;
+                    if (scoreboard[d] >= scoreboard[winner]) {
+                        winner = d;
+                    }
+                }
+            }
+        }
+        return predictorEstimate("Lag prediction", tally);
+    }
+
+    // 6.3.9. With binary samples every context of up to 16 bits has a slot, well within the standard's
+    // 100,000 entries per order, so the models are flat arrays of follower counts indexed by context
+    static MinEntropyEstimate multiMmc(const unsigned char* s, size_t n) {
+        std::vector<uint32_t> models[MF_90B_MMC_ORDERS + 1];
+        for (int d = 1; d <= MF_90B_MMC_ORDERS; d++) {
+            models[d].assign((size_t)2 << d, 0);
+        }
+
+        PredictionTally tally;
+        size_t scoreboard[MF_90B_MMC_ORDERS + 1] = { 0 };
+        int winner = 1;
+        uint32_t history = (s[0] << 1) | s[1];
+        for (size_t i = 2; i < n; i++) {
+            // Learn the bit before from the contexts ending before it
+            uint32_t previous = history >> 1;
+            for (int d = 1; d <= MF_90B_MMC_ORDERS && (size_t)d < i; d++) {
+                models[d][((previous & ((1u << d) - 1)) << 1) | s[i - 1]]++;
+            }
+
+            int predictions[MF_90B_MMC_ORDERS + 1];
+            for (int d = 1; d <= MF_90B_MMC_ORDERS; d++) {
+                predictions[d] = -1;
+                if ((size_t)d <= i) {
+                    const uint32_t* counts = &models[d][(history & ((1u << d) - 1)) << 1];
+                    if (counts[0] > 0 || counts[1] > 0) {
+                        predictions[d] = counts[1] >= counts[0];
+                    }
+                }
+            }
+            tally.Add(predictions[winner] == s[i]);
+            for (int d = 1; d <= MF_90B_MMC_ORDERS; d++) {
+                if (predictions[d] == s[i]) {
+                    scoreboard[d]++;
+                    if (scoreboard[d] >= scoreboard[winner]) {
+                        winner = d;
+                    }
+                }
+            }
+            history = (history << 1) | s[i];
+        }
+        return predictorEstimate("MultiMMC prediction", tally);
+    }
+
+    // 6.3.10. Contexts of every length share one array, keyed by the context's bits under a leading one
+    static MinEntropyEstimate lz78y(const unsigned char* s, size_t n) {
+        const int b = MF_90B_LZ78Y_LENGTH;
+        std::vector<unsigned char> inDictionary((size_t)2 << b, 0);
+        std::vector<uint32_t> counts((size_t)4 << b, 0);
+        size_t dictionarySize = 0;
+
+        PredictionTally tally;
+        uint32_t history = 0;
+        for (int i = 0; i <= b; i++) {
+            history = (history << 1) | s[i];
+        }
+        for (size_t i = b + 1; i < n; i++) {
+            uint32_t previous = history >> 1;
+            for (int j = b; j >= 1; j--) {
+                uint32_t key = (1u << j) | (previous & ((1u << j) - 1));
+                if (!inDictionary[key] && dictionarySize < MF_90B_LZ78Y_MAX_DICTIONARY) {
+                    inDictionary[key] = 1;
+                    dictionarySize++;
+                }
+                if (inDictionary[key]) {
+                    counts[(key << 1) | s[i - 1]]++;
+                }
+            }
+
+            int prediction = -1;
+            uint32_t maxCount = 0;
+            for (int j = b; j >= 1; j--) {
+                uint32_t key = (1u << j) | (history & ((1u << j) - 1));
+                if (inDictionary[key]) {
+                    int y = counts[(key << 1) | 1] >= counts[key << 1];
+                    if (counts[(key << 1) | y] > maxCount) {
+                        prediction = y;
+                        maxCount = counts[(key << 1) | y];
+                    }
+                }
+            }
+            tally.Add(prediction == s[i]);
+            history = (history << 1) | s[i];
+        }
+        return predictorEstimate("LZ78Y prediction", tally);
+    }
+}
+
+bool MeterFeeder::EstimateMinEntropy(const unsigned char* bytes, size_t numBits, unsigned threads,
+                                     std::vector<MinEntropyEstimate>* estimates, std::string* errorReason) {
+    if (numBits < MF_MIN_ENTROPY_MIN_BITS) {
+        *errorReason = "Too few bits for the estimators, need at least " + std::to_string(MF_MIN_ENTROPY_MIN_BITS);
+        return false;
+    }
+    if (numBits >= UINT32_MAX) {
+        *errorReason = "Too many bits for the suffix array";
+        return false;
+    }
+
+    std::vector<unsigned char> bits(numBits);
+    for (size_t i = 0; i < numBits; i++) {
+        bits[i] = (bytes[i >> 3] >> (7 - (i & 7))) & 1;
+    }
+    const unsigned char* s = &bits[0];
+    size_t n = numBits;
+
+    // Each task fills its own slot, in the standard's order, and the slowest are started first
+    std::vector<MinEntropyEstimate> results[8];
+    std::vector<std::function<void()>> tasks = {
+        [&]() { tupleEstimates(s, n, &results[3]); },
+        [&]() { results[7].push_back(lz78y(s, n)); },
+        [&]() { results[6].push_back(multiMmc(s, n)); },
+        [&]() { results[5].push_back(lag(s, n)); },
+        [&]() { results[4].push_back(multiMcw(s, n)); },
+        [&]() { results[2].push_back(compression(s, n)); },
+        [&]() {
+            results[0].push_back(mostCommonValue(s, n));
+            results[0].push_back(collision(s, n));
+            results[1].push_back(markov(s, n));
+        }
+    };
+
+    unsigned numThreads = threads > 0 ? threads : std::thread::hardware_concurrency();
+    numThreads = std::max(1u, std::min(numThreads, (unsigned)tasks.size()));
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t task; (task = next++) < tasks.size();) {
+            tasks[task]();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < numThreads; i++) {
+        workers.push_back(std::thread(work));
+    }
+    work();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+
+    estimates->clear();
+    for (int i = 0; i < 8; i++) {
+        estimates->insert(estimates->end(), results[i].begin(), results[i].end());
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace MeterFeeder {
+    /**
+     * Result of one SP 800-90B min-entropy estimator.
+     */
+    struct MinEntropyEstimate {
+        const char* name;
+
+        // Upper bound on the probability of the most likely bit the estimate comes from
+        double probability;
+
+        // Min-entropy per bit, -log2(probability)
+        double minEntropy;
+    };
+
+    /**
+     * Estimate the min-entropy of binary samples with the SP 800-90B non-IID estimators (section 6.3):
+     * most common value, collision, Markov, compression, t-tuple, longest repeated substring and the
+     * MultiMCW, lag, MultiMMC and LZ78Y predictors. The estimators run in parallel; the t-tuple and LRS
+     * counts both come from one suffix array with 32-bit indices (about 16 bytes per bit while built).
+     * The assessed min-entropy is the lowest of the estimates.
+     * 
+     * @param The samples, packed eight to a byte, most significant bit first.
+     * @param Number of samples (bits), at least MF_MIN_ENTROPY_MIN_BITS. SP 800-90B asks for 1,000,000.
+     * @param Worker threads, 0 for one per core.
+     * @param Where to store the estimates, in the order of the standard. LRS is left out when no
+     *        substring long enough to be uncommon repeats.
+     * @param Error reason upon bad arguments.
+     * 
+     * @return true on success, otherwise false.
+     */
+    bool EstimateMinEntropy(const unsigned char* bytes, size_t numBits, unsigned threads,
+                            std::vector<MinEntropyEstimate>* estimates, std::string* errorReason);
+}
@@ -0,0 +1,127 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "monitor.h"
+
+#include "constants.h"
+#include "nist.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace MeterFeeder {
+    static const uint32_t windowLengthsMs[BiasMonitor::NUM_WINDOWS] = { 1000, 60 * 1000, 60 * 60 * 1000 };
+}
+
+MeterFeeder::BiasMonitor::BiasMonitor() {
+    for (int i = 0; i < NUM_WINDOWS; i++) {
+        scales_[i].windowNs = (int64_t)windowLengthsMs[i] * 1000000;
+        scales_[i].bucketNs = scales_[i].windowNs / MF_BIAS_WINDOW_BUCKETS;
+        // Enough snapshots a bucket apart to reach back a whole window
+        scales_[i].ring.resize(MF_BIAS_WINDOW_BUCKETS + 2);
+    }
+    Reset();
+}
+
+void MeterFeeder::BiasMonitor::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    started_ = false;
+    lastNs_ = 0;
+    memset(counts_, 0, sizeof(counts_));
+    for (int i = 0; i < NUM_WINDOWS; i++) {
+        scales_[i].newest = 0;
+        scales_[i].size = 0;
+        scales_[i].nextSnapshotNs = 0;
+    }
+}
+
+void MeterFeeder::BiasMonitor::SetEnabled(bool enabled) {
+    enabled_ = enabled;
+    if (!enabled) {
+        Reset();
+    }
+}
+
+// Called with the mutex held
+void MeterFeeder::BiasMonitor::snapshot(Scale* scale) {
+    scale->newest = (scale->newest + 1) % scale->ring.size();
+    scale->size = scale->size < scale->ring.size() ? scale->size + 1 : scale->size;
+    Snapshot& snapshot = scale->ring[scale->newest];
+    snapshot.monotonicNs = lastNs_;
+    memcpy(snapshot.counts, counts_, sizeof(counts_));
+    scale->nextSnapshotNs = lastNs_ + scale->bucketNs;
+}
+
+void MeterFeeder::BiasMonitor::Add(const unsigned char* bytes, size_t length, int64_t monotonicNs) {
+    if (!enabled_ || length == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!started_) {
+        started_ = true;
+        lastNs_ = monotonicNs;
+        for (int i = 0; i < NUM_WINDOWS; i++) {
+            snapshot(&scales_[i]);
+        }
+    }
+
+    // Snapshots hold the counts up to the previous chunk, stamped with its time
+    for (int i = 0; i < NUM_WINDOWS; i++) {
+        if (monotonicNs >= scales_[i].nextSnapshotNs) {
+            snapshot(&scales_[i]);
+        }
+    }
+    for (size_t i = 0; i < length; i++) {
+        counts_[bytes[i]]++;
+    }
+    lastNs_ = monotonicNs > lastNs_ ? monotonicNs : lastNs_;
+}
+
+void MeterFeeder::BiasMonitor::GetWindows(std::vector<BiasWindowStats>* windows) const {
+    windows->assign(NUM_WINDOWS, BiasWindowStats());
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int w = 0; w < NUM_WINDOWS; w++) {
+        const Scale& scale = scales_[w];
+        BiasWindowStats& stats = (*windows)[w];
+        stats.windowMs = windowLengthsMs[w];
+        stats.chiSquarePValue = 1;
+        if (scale.size == 0) {
+            continue;
+        }
+
+        // The oldest snapshot within the window, or the newest if there's been a gap longer than it
+        size_t start = scale.newest;
+        for (size_t i = 1; i < scale.size; i++) {
+            size_t index = (scale.newest + scale.ring.size() - i) % scale.ring.size();
+            if (scale.ring[index].monotonicNs < lastNs_ - scale.windowNs) {
+                break;
+            }
+            start = index;
+        }
+        const Snapshot& from = scale.ring[start];
+
+        uint64_t bytes = 0;
+        double sumSquares = 0;
+        for (int b = 0; b < 256; b++) {
+            uint64_t count = counts_[b] - from.counts[b];
+            unsigned ones = 0;
+            for (int v = b; v != 0; v >>= 1) {
+                ones += v & 1;
+            }
+            bytes += count;
+            stats.ones += count * ones;
+            sumSquares += (double)count * count;
+        }
+        stats.coveredMs = (lastNs_ - from.monotonicNs) / 1e6;
+        stats.bits = bytes * 8;
+        if (bytes > 0) {
+            stats.zScore = (2.0 * stats.ones - (double)stats.bits) / sqrt((double)stats.bits);
+            stats.chiSquare = 256.0 * sumSquares / bytes - (double)bytes;
+            stats.chiSquarePValue = Igamc(255 / 2.0, stats.chiSquare / 2);
+        }
+    }
+}
@@ -0,0 +1,104 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace MeterFeeder {
+    /**
+     * Statistics of the bits a generator produced in a sliding window ending at its latest chunk.
+     */
+    struct BiasWindowStats {
+        // Nominal window length (milliseconds)
+        uint32_t windowMs;
+
+        // Time the counted bits actually span, within a bucket of the window (milliseconds)
+        double coveredMs;
+
+        uint64_t bits;
+        uint64_t ones;
+
+        // (ones - bits / 2) / sqrt(bits / 4), 0 with no bits
+        double zScore;
+
+        // Chi-square of the byte values against uniform (255 degrees of freedom) and its p-value
+        double chiSquare;
+        double chiSquarePValue;
+    };
+
+    /**
+     * Streaming bias monitor: running byte counts of a generator's output with snapshots at a
+     * bucket spacing for each window length, so the counts over the last second, minute or hour
+     * are the current ones less a snapshot's. Adding a chunk costs a counter increment per byte;
+     * the ones and chi-square come out of the byte counts when queried.
+     */
+    class BiasMonitor {
+        public:
+            // Window lengths tracked: 1 s, 1 min and 1 h
+            static const int NUM_WINDOWS = 3;
+
+            BiasMonitor();
+            BiasMonitor(const BiasMonitor&) = delete;
+            BiasMonitor& operator=(const BiasMonitor&) = delete;
+
+            /**
+             * Count a chunk of output.
+             * 
+             * @param The bytes.
+             * @param Number of bytes.
+             * @param Monotonic clock time of the chunk's last bit (nanoseconds).
+             */
+            void Add(const unsigned char* bytes, size_t length, int64_t monotonicNs);
+
+            /**
+             * Get the statistics of each window, shortest first.
+             * 
+             * @param Where to store the NUM_WINDOWS windows' statistics.
+             */
+            void GetWindows(std::vector<BiasWindowStats>* windows) const;
+
+            /**
+             * Turn counting on or off. Turning it off forgets the counts.
+             */
+            void SetEnabled(bool enabled);
+            bool IsEnabled() const { return enabled_; }
+
+            /**
+             * Forget the counts and snapshots.
+             */
+            void Reset();
+
+        private:
+            struct Snapshot {
+                // Time of the last bit counted (nanoseconds)
+                int64_t monotonicNs;
+                uint64_t counts[256];
+            };
+
+            // Ring of snapshots at least a bucket apart for one window length
+            struct Scale {
+                int64_t windowNs;
+                int64_t bucketNs;
+                int64_t nextSnapshotNs;
+                std::vector<Snapshot> ring;
+                size_t newest;
+                size_t size;
+            };
+
+            void snapshot(Scale* scale);
+
+            mutable std::mutex mutex_;
+            std::atomic<bool> enabled_{true};
+            bool started_ = false;
+            int64_t lastNs_ = 0;
+            uint64_t counts_[256];
+            Scale scales_[NUM_WINDOWS];
+    };
+}
@@ -0,0 +1,521 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "nist.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+// Cephes constants (the SP 800-22 reference code uses the Cephes incomplete gamma functions)
+#define MF_MACHEP 1.11022302462515654042e-16
+#define MF_MAXLOG 7.09782712893383996843e2
+#define MF_BIG 4.503599627370496e15
+#define MF_BIGINV 2.22044604925031308085e-16
+
+namespace MeterFeeder {
+    static const char* nistTestNames[NIST_NUM_PVALUES] = {
+        "Frequency", "BlockFrequency", "Runs", "LongestRun", "CumulativeSums (forward)", "CumulativeSums (backward)",
+        "ApproximateEntropy", "Serial (1)", "Serial (2)", "FFT"
+    };
+
+    // Per byte value, bits most significant first: ones, leading and trailing ones, longest run of ones,
+    // and the walk's net step and highest and lowest points (+1 for a one, -1 for a zero)
+    struct ByteTables {
+        unsigned char ones[256];
+        unsigned char leadingOnes[256];
+        unsigned char trailingOnes[256];
+        unsigned char longestRun[256];
+        signed char walkStep[256];
+        signed char walkMax[256];
+        signed char walkMin[256];
+
+        ByteTables() {
+            for (int b = 0; b < 256; b++) {
+                int run = 0, longest = 0, lead = -1, walk = 0, high = -8, low = 8;
+                ones[b] = 0;
+                for (int bit = 7; bit >= 0; bit--) {
+                    bool one = (b >> bit) & 1;
+                    ones[b] += one;
+                    run = one ? run + 1 : 0;
+                    longest = run > longest ? run : longest;
+                    if (!one && lead < 0) {
+                        lead = 7 - bit;
+                    }
+                    walk += one ? 1 : -1;
+                    high = walk > high ? walk : high;
+                    low = walk < low ? walk : low;
+                }
+                leadingOnes[b] = (unsigned char)(lead < 0 ? 8 : lead);
+                trailingOnes[b] = (unsigned char)run;
+                longestRun[b] = (unsigned char)longest;
+                walkStep[b] = (signed char)walk;
+                walkMax[b] = (signed char)high;
+                walkMin[b] = (signed char)low;
+            }
+        }
+    };
+
+    static const ByteTables& byteTables() {
+        static const ByteTables tables;
+        return tables;
+    }
+
+    static inline int popcount64(uint64_t x) {
+#if defined(__GNUC__)
+        return __builtin_popcountll(x);
+#else
+        x = x - ((x >> 1) & 0x5555555555555555ULL);
+        x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+        x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+        return (int)((x * 0x0101010101010101ULL) >> 56);
+#endif
+    }
+
+    static inline uint64_t loadWord(const unsigned char* bytes) {
+        uint64_t word = 0;
+        for (int i = 0; i < 8; i++) {
+            word = (word << 8) | bytes[i];
+        }
+        return word;
+    }
+
+    static double normalCdf(double x) {
+        return 0.5 * erfc(-x / sqrt(2.0));
+    }
+
+    static double igam(double a, double x) {
+        if (x <= 0 || a <= 0) {
+            return 0;
+        }
+        if (x > 1 && x > a) {
+            return 1 - Igamc(a, x);
+        }
+        double ax = a * log(x) - x - lgamma(a);
+        if (ax < -MF_MAXLOG) {
+            return 0;
+        }
+        ax = exp(ax);
+        double r = a, c = 1, sum = 1;
+        do {
+            r += 1;
+            c *= x / r;
+            sum += c;
+        } while (c / sum > MF_MACHEP);
+        return sum * ax / a;
+    }
+
+    // Count the circular windows of numBits bits (the sequence followed by its first numBits - 1 bits again)
+    static void countWindows(const unsigned char* bytes, size_t n, unsigned numBits, std::vector<uint32_t>* counts) {
+        counts->assign((size_t)1 << numBits, 0);
+        uint32_t mask = (uint32_t)((1ULL << numBits) - 1);
+        uint32_t window = 0;
+        for (unsigned i = 0; i + 1 < numBits; i++) {
+            window = (window << 1) | ((bytes[i >> 3] >> (7 - (i & 7))) & 1);
+        }
+        size_t i = numBits - 1;
+        // Whole bytes while they're in the sequence, then bit by bit around the wrap
+        for (; (i & 7) != 0 && i < n; i++) {
+            window = ((window << 1) | ((bytes[i >> 3] >> (7 - (i & 7))) & 1)) & mask;
+            (*counts)[window]++;
+        }
+        // Shifting in a byte at a time leaves the eight windows ending in it independent of each other
+        uint32_t* c = &(*counts)[0];
+        uint64_t wide = window;
+        for (; i + 8 <= n; i += 8) {
+            wide = (wide << 8) | bytes[i >> 3];
+            for (int bit = 7; bit >= 0; bit--) {
+                c[(wide >> bit) & mask]++;
+            }
+        }
+        window = (uint32_t)wide & mask;
+        for (; i < n + numBits - 1; i++) {
+            size_t j = i % n;
+            window = ((window << 1) | ((bytes[j >> 3] >> (7 - (j & 7))) & 1)) & mask;
+            (*counts)[window]++;
+        }
+    }
+
+    // Fold counts of numBits-bit windows into counts of the (numBits - 1)-bit windows they start with
+    static void foldWindows(std::vector<uint32_t>* counts) {
+        size_t half = counts->size() / 2;
+        for (size_t i = 0; i < half; i++) {
+            (*counts)[i] = (*counts)[i * 2] + (*counts)[i * 2 + 1];
+        }
+        counts->resize(half);
+    }
+
+    static double psiSquared(const std::vector<uint32_t>& counts, size_t n) {
+        if (counts.size() <= 1) {
+            return 0;
+        }
+        double sum = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            sum += (double)counts[i] * counts[i];
+        }
+        return sum * counts.size() / n - n;
+    }
+
+    static double phi(const std::vector<uint32_t>& counts, size_t n) {
+        double sum = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            if (counts[i] > 0) {
+                double c = (double)counts[i] / n;
+                sum += c * log(c);
+            }
+        }
+        return sum;
+    }
+
+    static double cusumPValue(size_t n, double z) {
+        double sqrtN = sqrt((double)n);
+        double sum1 = 0, sum2 = 0;
+        for (int k = (int)((-(double)n / z + 1) / 4); k <= (int)(((double)n / z - 1) / 4); k++) {
+            sum1 += normalCdf((4 * k + 1) * z / sqrtN) - normalCdf((4 * k - 1) * z / sqrtN);
+        }
+        for (int k = (int)((-(double)n / z - 3) / 4); k <= (int)(((double)n / z - 1) / 4); k++) {
+            sum2 += normalCdf((4 * k + 3) * z / sqrtN) - normalCdf((4 * k + 1) * z / sqrtN);
+        }
+        return 1 - sum1 + sum2;
+    }
+
+    static double longestRunPValue(const unsigned char* bytes, size_t n) {
+        const ByteTables& t = byteTables();
+
+        // Block length, the classes of longest runs and their probabilities, by sequence length
+        static const double pi8[] = { 0.2148, 0.3672, 0.2305, 0.1875 };
+        static const double pi128[] = { 0.1174, 0.2430, 0.2493, 0.1752, 0.1027, 0.1124 };
+        static const double pi10000[] = { 0.0882, 0.2092, 0.2483, 0.1933, 0.1208, 0.0675, 0.0727 };
+        size_t blockBits;
+        int lowest, classes;
+        const double* pi;
+        if (n >= 750000) {
+            blockBits = 10000, lowest = 10, classes = 7, pi = pi10000;
+        } else if (n >= 6272) {
+            blockBits = 128, lowest = 4, classes = 6, pi = pi128;
+        } else if (n >= 128) {
+            blockBits = 8, lowest = 1, classes = 4, pi = pi8;
+        } else {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+
+        size_t numBlocks = n / blockBits;
+        double counts[7] = { 0 };
+        for (size_t block = 0; block < numBlocks; block++) {
+            const unsigned char* p = bytes + block * blockBits / 8;
+            int run = 0, longest = 0;
+            for (size_t i = 0; i < blockBits / 8; i++) {
+                unsigned char b = p[i];
+                if (b == 0xff) {
+                    run += 8;
+                    continue;
+                }
+                int candidate = run + t.leadingOnes[b];
+                longest = candidate > longest ? candidate : longest;
+                longest = t.longestRun[b] > longest ? t.longestRun[b] : longest;
+                run = t.trailingOnes[b];
+            }
+            longest = run > longest ? run : longest;
+            int c = longest - lowest;
+            counts[c < 0 ? 0 : c >= classes ? classes - 1 : c]++;
+        }
+
+        double chi2 = 0;
+        for (int i = 0; i < classes; i++) {
+            double expected = numBlocks * pi[i];
+            chi2 += (counts[i] - expected) * (counts[i] - expected) / expected;
+        }
+        return Igamc((classes - 1) / 2.0, chi2 / 2);
+    }
+}
+
+double MeterFeeder::Igamc(double a, double x) {
+    if (x <= 0 || a <= 0) {
+        return 1;
+    }
+    if (x < 1 || x < a) {
+        return 1 - igam(a, x);
+    }
+
+    double ax = a * log(x) - x - lgamma(a);
+    if (ax < -MF_MAXLOG) {
+        return 0;
+    }
+    ax = exp(ax);
+
+    // Continued fraction
+    double y = 1 - a, z = x + y + 1, c = 0;
+    double pkm2 = 1, qkm2 = x, pkm1 = x + 1, qkm1 = z * x;
+    double ans = pkm1 / qkm1, t;
+    do {
+        c += 1;
+        y += 1;
+        z += 2;
+        double yc = y * c;
+        double pk = pkm1 * z - pkm2 * yc;
+        double qk = qkm1 * z - qkm2 * yc;
+        if (qk != 0) {
+            double r = pk / qk;
+            t = fabs((ans - r) / r);
+            ans = r;
+        } else {
+            t = 1;
+        }
+        pkm2 = pkm1;
+        pkm1 = pk;
+        qkm2 = qkm1;
+        qkm1 = qk;
+        if (fabs(pk) > MF_BIG) {
+            pkm2 *= MF_BIGINV;
+            pkm1 *= MF_BIGINV;
+            qkm2 *= MF_BIGINV;
+            qkm1 *= MF_BIGINV;
+        }
+    } while (t > MF_MACHEP);
+    return ans * ax;
+}
+
+MeterFeeder::NistBattery::NistBattery(const NistOptions& options) {
+    options_ = options;
+    size_t fftSize = 1;
+    while (fftSize * 2 <= options.sequenceBits) {
+        fftSize *= 2;
+    }
+    fft_.reset(new RealFft(fftSize));
+
+    unsigned threads = options.threads > 0 ? options.threads : std::thread::hardware_concurrency();
+    threads = threads > 0 ? threads : 1;
+    maxQueue_ = threads * 2;
+    for (unsigned i = 0; i < threads; i++) {
+        workers_.push_back(std::thread(&NistBattery::work, this));
+    }
+}
+
+MeterFeeder::NistBattery::~NistBattery() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finishing_ = true;
+    }
+    queued_.notify_all();
+    for (size_t i = 0; i < workers_.size(); i++) {
+        workers_[i].join();
+    }
+}
+
+bool MeterFeeder::NistBattery::CheckOptions(const NistOptions& options, std::string* errorReason) {
+    if (options.sequenceBits < 1024 || options.sequenceBits % 64 != 0) {
+        *errorReason = "Sequence length must be a multiple of 64 bits, at least 1024";
+    } else if (options.blockFrequencyBits < 8 || options.blockFrequencyBits % 8 != 0 || options.blockFrequencyBits > options.sequenceBits) {
+        *errorReason = "Block frequency block length must be a multiple of 8 bits, no longer than a sequence";
+    } else if (options.approximateEntropyBits < 1 || options.approximateEntropyBits > 24) {
+        *errorReason = "Approximate entropy pattern length must be 1 to 24 bits";
+    } else if (options.serialBits < 3 || options.serialBits > 24) {
+        *errorReason = "Serial pattern length must be 3 to 24 bits";
+    } else if (!(options.alpha > 0 && options.alpha < 1)) {
+        *errorReason = "Significance level must be between 0 and 1";
+    } else {
+        return true;
+    }
+    return false;
+}
+
+void MeterFeeder::NistBattery::Add(const unsigned char* bytes, size_t length) {
+    size_t sequenceBytes = options_.sequenceBits / 8;
+    while (length > 0) {
+        size_t take = sequenceBytes - partial_.size();
+        take = take < length ? take : length;
+        partial_.insert(partial_.end(), bytes, bytes + take);
+        bytes += take;
+        length -= take;
+        if (partial_.size() < sequenceBytes) {
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        taken_.wait(lock, [this]() { return queue_.size() < maxQueue_; });
+        Sequence sequence;
+        sequence.index = sequences_++;
+        sequence.bytes.swap(partial_);
+        queue_.push_back(std::move(sequence));
+        lock.unlock();
+        queued_.notify_one();
+        partial_.reserve(sequenceBytes);
+    }
+}
+
+size_t MeterFeeder::NistBattery::GetSequenceCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sequences_;
+}
+
+std::vector<MeterFeeder::NistTestResult> MeterFeeder::NistBattery::Finish() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return queue_.empty() && busy_ == 0; });
+
+    std::vector<NistTestResult> results;
+    size_t s = pValues_.size();
+    for (int test = 0; test < NIST_NUM_PVALUES; test++) {
+        NistTestResult result;
+        result.name = nistTestNames[test];
+        result.passed = 0;
+        size_t bins[10] = { 0 };
+        for (size_t i = 0; i < s; i++) {
+            double p = pValues_[i][test];
+            result.pValues.push_back(p);
+            if (p >= options_.alpha) {
+                result.passed++;
+            }
+            if (p >= 0 && p <= 1) {
+                bins[p >= 1 ? 9 : (int)(p * 10)]++;
+            }
+        }
+
+        double expected = 1 - options_.alpha;
+        result.proportion = s > 0 ? (double)result.passed / s : 0;
+        result.minProportion = s > 0 ? expected - 3 * sqrt(options_.alpha * expected / s) : 1;
+        double chi2 = 0;
+        for (int b = 0; b < 10; b++) {
+            chi2 += (bins[b] - s / 10.0) * (bins[b] - s / 10.0) / (s / 10.0);
+        }
+        result.uniformityPValue = s > 0 ? Igamc(4.5, chi2 / 2) : 0;
+        result.ok = s > 0 && result.proportion >= result.minProportion && (s < 55 || result.uniformityPValue >= 0.0001);
+        results.push_back(result);
+    }
+    return results;
+}
+
+void MeterFeeder::NistBattery::work() {
+    for (;;) {
+        Sequence sequence;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            queued_.wait(lock, [this]() { return finishing_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            sequence = std::move(queue_.front());
+            queue_.pop_front();
+            busy_++;
+        }
+        taken_.notify_one();
+
+        std::vector<double> pValues(NIST_NUM_PVALUES);
+        TestSequence(&sequence.bytes[0], options_, *fft_, &pValues[0]);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (pValues_.size() <= sequence.index) {
+                pValues_.resize(sequence.index + 1);
+            }
+            pValues_[sequence.index].swap(pValues);
+            busy_--;
+        }
+        done_.notify_all();
+    }
+}
+
+void MeterFeeder::NistBattery::TestSequence(const unsigned char* bytes, const NistOptions& options, const RealFft& fft, double* pValues) {
+    const ByteTables& t = byteTables();
+    size_t n = options.sequenceBits;
+    double sqrtN = sqrt((double)n);
+
+    // Frequency and runs, a word at a time: runs end where a bit differs from the next
+    size_t ones = 0, changes = 0;
+    uint64_t previous = 0;
+    for (size_t i = 0; i < n / 64; i++) {
+        uint64_t word = loadWord(bytes + i * 8);
+        ones += popcount64(word);
+        changes += popcount64((word ^ (word >> 1)) & 0x7fffffffffffffffULL);
+        if (i > 0 && (previous & 1) != (word >> 63)) {
+            changes++;
+        }
+        previous = word;
+    }
+    double sum = 2.0 * ones - (double)n;
+    pValues[NIST_FREQUENCY] = erfc(fabs(sum) / sqrtN / sqrt(2.0));
+
+    double pi = (double)ones / n;
+    if (fabs(pi - 0.5) >= 2 / sqrtN) {
+        // Too biased for the runs test to apply
+        pValues[NIST_RUNS] = 0;
+    } else {
+        double runs = changes + 1.0;
+        pValues[NIST_RUNS] = erfc(fabs(runs - 2 * n * pi * (1 - pi)) / (2 * sqrt(2.0 * n) * pi * (1 - pi)));
+    }
+
+    // Block frequency
+    size_t blockBytes = options.blockFrequencyBits / 8;
+    size_t numBlocks = n / options.blockFrequencyBits;
+    double chi2 = 0;
+    for (size_t block = 0; block < numBlocks; block++) {
+        unsigned blockOnes = 0;
+        for (size_t i = 0; i < blockBytes; i++) {
+            blockOnes += t.ones[bytes[block * blockBytes + i]];
+        }
+        double deviation = (double)blockOnes / options.blockFrequencyBits - 0.5;
+        chi2 += deviation * deviation;
+    }
+    chi2 *= 4.0 * options.blockFrequencyBits;
+    pValues[NIST_BLOCK_FREQUENCY] = Igamc(numBlocks / 2.0, chi2 / 2);
+
+    pValues[NIST_LONGEST_RUN] = longestRunPValue(bytes, n);
+
+    // Cumulative sums, a byte of the walk at a time. Backwards, the partial sums are the total less each forward one
+    long walk = 0, high = 0, low = 0;
+    for (size_t i = 0; i < n / 8; i++) {
+        unsigned char b = bytes[i];
+        high = walk + t.walkMax[b] > high ? walk + t.walkMax[b] : high;
+        low = walk + t.walkMin[b] < low ? walk + t.walkMin[b] : low;
+        walk += t.walkStep[b];
+    }
+    double zForward = (double)(high > -low ? high : -low);
+    double zBackward = (double)(walk - low > high - walk ? walk - low : high - walk);
+    pValues[NIST_CUSUM_FORWARD] = cusumPValue(n, zForward > 0 ? zForward : 1);
+    pValues[NIST_CUSUM_BACKWARD] = cusumPValue(n, zBackward > 0 ? zBackward : 1);
+
+    // Approximate entropy, from the counts of windows of m + 1 bits folded down to m
+    std::vector<uint32_t> counts;
+    unsigned m = options.approximateEntropyBits;
+    countWindows(bytes, n, m + 1, &counts);
+    double phiMPlus1 = phi(counts, n);
+    foldWindows(&counts);
+    double apEn = phi(counts, n) - phiMPlus1;
+    pValues[NIST_APPROXIMATE_ENTROPY] = Igamc(pow(2.0, m - 1), n * (log(2.0) - apEn));
+
+    // Serial
+    m = options.serialBits;
+    countWindows(bytes, n, m, &counts);
+    double psi0 = psiSquared(counts, n);
+    foldWindows(&counts);
+    double psi1 = psiSquared(counts, n);
+    foldWindows(&counts);
+    double psi2 = psiSquared(counts, n);
+    pValues[NIST_SERIAL_1] = Igamc(pow(2.0, m - 2), (psi0 - psi1) / 2);
+    pValues[NIST_SERIAL_2] = Igamc(pow(2.0, m - 3), (psi0 - 2 * psi1 + psi2) / 2);
+
+    // DFT spectral: the proportion of peaks under the 95% threshold
+    size_t fftN = fft.GetSize();
+    std::vector<double> x(fftN);
+    for (size_t i = 0; i < fftN / 8; i++) {
+        unsigned char b = bytes[i];
+        for (int bit = 0; bit < 8; bit++) {
+            x[i * 8 + bit] = (double)(((b >> (7 - bit)) & 1) * 2) - 1.0;
+        }
+    }
+    std::vector<std::complex<double>> spectrum(fftN / 2 + 1);
+    fft.Forward(&x[0], &spectrum[0]);
+    // Compared squared, as std::abs goes through hypot
+    double threshold2 = log(1 / 0.05) * fftN;
+    size_t under = 0;
+    for (size_t i = 0; i < fftN / 2; i++) {
+        if (std::norm(spectrum[i]) < threshold2) {
+            under++;
+        }
+    }
+    double expected = 0.95 * fftN / 2;
+    double d = (under - expected) / sqrt(fftN * 0.95 * 0.05 / 4);
+    pValues[NIST_FFT] = erfc(fabs(d) / sqrt(2.0));
+}
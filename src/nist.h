@@ -0,0 +1,162 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fft.h"
+
+namespace MeterFeeder {
+    /**
+     * The p-values each sequence gets, one per test (two for cumulative sums and serial).
+     */
+    enum {
+        NIST_FREQUENCY,
+        NIST_BLOCK_FREQUENCY,
+        NIST_RUNS,
+        NIST_LONGEST_RUN,
+        NIST_CUSUM_FORWARD,
+        NIST_CUSUM_BACKWARD,
+        NIST_APPROXIMATE_ENTROPY,
+        NIST_SERIAL_1,
+        NIST_SERIAL_2,
+        NIST_FFT,
+        NIST_NUM_PVALUES
+    };
+
+    /**
+     * Parameters of a run of the battery, defaulting to those recommended by SP 800-22.
+     */
+    struct NistOptions {
+        // Length of each sequence tested (bits, a multiple of 64). The FFT test uses the largest power of two in it
+        size_t sequenceBits = 1 << 20;
+
+        // Block length for the block frequency test (bits, a multiple of 8)
+        unsigned blockFrequencyBits = 128;
+
+        // Pattern lengths for the approximate entropy and serial tests
+        unsigned approximateEntropyBits = 10;
+        unsigned serialBits = 16;
+
+        // Significance level of each test
+        double alpha = 0.01;
+
+        // Worker threads, 0 for one per core
+        unsigned threads = 0;
+    };
+
+    /**
+     * Result of one test over all the sequences, judged the SP 800-22 way: the proportion of sequences
+     * passing must be within three standard deviations of 1 - alpha, and the p-values must be uniform.
+     */
+    struct NistTestResult {
+        const char* name;
+
+        // p-value of each sequence in order
+        std::vector<double> pValues;
+
+        size_t passed;
+        double proportion;
+        double minProportion;
+
+        // p-value of a chi-square test of the p-values falling evenly in ten bins (needs at least 55 sequences)
+        double uniformityPValue;
+
+        bool ok;
+    };
+
+    /**
+     * Multi-threaded NIST SP 800-22 statistical test battery: frequency, block frequency, runs, longest run
+     * of ones, cumulative sums, approximate entropy, serial and DFT spectral. Bits are fed in as they're read
+     * from a recording or generator and split into sequences, which the workers test as they fill.
+     */
+    class NistBattery {
+        public:
+            /**
+             * @param Test parameters, see CheckOptions().
+             */
+            explicit NistBattery(const NistOptions& options);
+            ~NistBattery();
+
+            /**
+             * Check test parameters.
+             * 
+             * @param The parameters.
+             * @param Error reason upon bad parameters.
+             * 
+             * @return true if usable, otherwise false.
+             */
+            static bool CheckOptions(const NistOptions& options, std::string* errorReason);
+
+            /**
+             * Add bits, most significant bit of each byte first. Blocks while the workers are behind.
+             * 
+             * @param The bytes.
+             * @param Number of bytes.
+             */
+            void Add(const unsigned char* bytes, size_t length);
+
+            /**
+             * Wait for the sequences added so far to be tested and get the results.
+             * Bits short of a whole sequence at the end are left out.
+             * 
+             * @return A result for each of the NIST_NUM_PVALUES p-values.
+             */
+            std::vector<NistTestResult> Finish();
+
+            /**
+             * Get the number of whole sequences added so far.
+             */
+            size_t GetSequenceCount();
+
+            /**
+             * Test one sequence.
+             * 
+             * @param The sequence, options.sequenceBits long.
+             * @param Test parameters.
+             * @param FFT for the spectral test, sized to the largest power of two in the sequence.
+             * @param Where to store the NIST_NUM_PVALUES p-values.
+             */
+            static void TestSequence(const unsigned char* bytes, const NistOptions& options, const RealFft& fft, double* pValues);
+
+        private:
+            struct Sequence {
+                size_t index;
+                std::vector<unsigned char> bytes;
+            };
+
+            void work();
+
+            NistOptions options_;
+            std::unique_ptr<RealFft> fft_;
+            std::vector<std::thread> workers_;
+            std::mutex mutex_;
+            std::condition_variable queued_;
+            std::condition_variable taken_;
+            std::condition_variable done_;
+            std::deque<Sequence> queue_;
+            size_t maxQueue_;
+            bool finishing_ = false;
+            size_t busy_ = 0;
+            std::vector<unsigned char> partial_;
+            size_t sequences_ = 0;
+            std::vector<std::vector<double>> pValues_;
+    };
+
+    /**
+     * Regularized upper incomplete gamma function Q(a, x), for chi-square p-values: the p-value of
+     * a statistic chi2 with k degrees of freedom is Igamc(k / 2, chi2 / 2).
+     */
+    double Igamc(double a, double x);
+}
@@ -0,0 +1,46 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "profile.h"
+
+#include <cstring>
+
+namespace MeterFeeder {
+    // Known models, most specific entries first. Rates are from MED_DEVICES.md.
+    // The slow devices fill a 64 byte transfer every few milliseconds so they keep the small
+    // transfer size for low latency; the fast PQ devices need big transfers to keep up.
+    static const TransportProfile transportProfiles[] = {
+        // prefix  hint      model          bit rate     latency  transfer  chunk
+        { "QWR4A", nullptr,  "MED100K",     98765.0,     2,       64,       1024 },
+        { "QWR4B", nullptr,  "MED100Kx3",   99896.0,     2,       64,       1024 },
+        { "QWR4C", nullptr,  "MED1Kx3",     999.0,       2,       64,       128 },
+        { "QWR4D", nullptr,  "MED100Kx4",   98765.0,     2,       64,       1024 },
+        { "QWR4E", nullptr,  "MED100Kx8",   100382.0,    2,       64,       1024 },
+        { "QWR4P", nullptr,  "MED100KP",    100000.0,    2,       64,       1024 },
+        { "QWR4R", nullptr,  "MED100KR",    100000.0,    2,       64,       1024 },
+        { "QWR4X", nullptr,  "MED100KX",    100000.0,    2,       64,       1024 },
+        { "QWR4M", nullptr,  "PQ4000KM",    4000000.0,   2,       4096,     16384 },
+        { "QWR7",  "32M",    "PQ32MU",      32000000.0,  2,       65536,    131072 },
+        { "QWR7",  nullptr,  "PQ128MU",     128000000.0, 2,       65536,    524288 },
+    };
+
+    static const TransportProfile defaultTransportProfile =
+        { "QWR", nullptr, "Unknown", 100000.0, FTDI_DEVICE_LATENCY_MS, FTDI_DEVICE_PACKET_USB_SIZE_BYTES, 1024 };
+
+    TransportProfile FindTransportProfile(const std::string& serialNumber, const std::string& description) {
+        for (size_t i = 0; i < sizeof(transportProfiles) / sizeof(transportProfiles[0]); i++) {
+            const TransportProfile& profile = transportProfiles[i];
+            if (serialNumber.compare(0, strlen(profile.serialPrefix), profile.serialPrefix) != 0) {
+                continue;
+            }
+            if (profile.descriptionHint && description.find(profile.descriptionHint) == std::string::npos) {
+                continue;
+            }
+            return profile;
+        }
+        return defaultTransportProfile;
+    }
+}
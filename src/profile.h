@@ -0,0 +1,68 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <string>
+
+#include "../ftd2xx/ftd2xx.h"
+
+#include "constants.h"
+
+namespace MeterFeeder {
+    /**
+     * FTDI transport parameters for a model of generator.
+     * The models are told apart by their serial number prefix (see MED_DEVICES.md), so a
+     * 1 kHz MED1Kx3 and a 128 MHz PQ128MU don't have to share the same USB transfer settings.
+     */
+    struct TransportProfile {
+        // Serial number prefix identifying the model, e.g. "QWR4A"
+        const char* serialPrefix;
+
+        // Substring of the device description telling apart models sharing a prefix (or null)
+        const char* descriptionHint;
+
+        // Model name, e.g. "MED100K"
+        const char* model;
+
+        // Nominal output rate in bits per second
+        double nominalBitRate;
+
+        // Latency timer (milliseconds)
+        UCHAR latencyMs;
+
+        // USB transfer size for in transfers (multiple of 64, 64 to 65536)
+        DWORD usbTransferSize;
+
+        // Preferred number of bytes to read at a time when streaming continuously
+        DWORD readChunkBytes;
+    };
+
+    /**
+     * Measurement of a single candidate transport configuration from a tuning sweep.
+     */
+    struct TuneSample {
+        UCHAR latencyMs;
+        DWORD usbTransferSize;
+
+        // Mean time to read a single USB packet worth of data (milliseconds)
+        double packetReadMs;
+
+        // Throughput reading the profile's chunk size (bytes per second)
+        double throughput;
+    };
+
+    /**
+     * Find the transport profile for a generator.
+     * 
+     * @param Serial number identifying the device.
+     * @param Description of the device.
+     * 
+     * @return The matching profile, or the default profile (the original fixed
+     *         64 byte/2 ms transport parameters) if the model is unknown.
+     */
+    TransportProfile FindTransportProfile(const std::string& serialNumber, const std::string& description);
+}
@@ -0,0 +1,358 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "pyramid.h"
+
+#include "recording.h"
+#include "walk.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const char WALK_MAGIC[8] = "MFWALK1";
+
+MeterFeeder::WalkPyramidWriter::~WalkPyramidWriter() {
+    std::string errorReason;
+    Close(&errorReason);
+}
+
+bool MeterFeeder::WalkPyramidWriter::Open(const std::string& path, std::string* errorReason) {
+    Close(errorReason);
+    file_ = fopen(path.c_str(), "wb+");
+    if (file_ == nullptr) {
+        *errorReason = "Couldn't create " + path;
+        return false;
+    }
+    path_ = path;
+    memset(&header_, 0, sizeof(header_));
+    memcpy(header_.magic, WALK_MAGIC, sizeof(header_.magic));
+    header_.baseBits = MF_PYRAMID_BASE_BITS;
+    header_.numLevels = 1;
+    header_.levels[0].offset = sizeof(header_);
+    blockBits_ = 0;
+    position_ = 0;
+    pending_.clear();
+    return writeHeader(errorReason);
+}
+
+bool MeterFeeder::WalkPyramidWriter::Add(const unsigned char* bytes, size_t length, int64_t firstBitUtcNs, double bitPeriodNs,
+                                         std::string* errorReason) {
+    if (file_ == nullptr) {
+        *errorReason = "Walk pyramid isn't open";
+        return false;
+    }
+    const WalkByteSteps& steps = WalkByteSteps::Get();
+    for (size_t i = 0; i < length; i++) {
+        unsigned char b = bytes[i];
+        if (blockBits_ == 0) {
+            block_.firstUtcNs = firstBitUtcNs + (int64_t)(i * 8 * bitPeriodNs);
+            block_.min = position_ + steps.low[b];
+            block_.max = position_ + steps.high[b];
+        } else {
+            block_.min = std::min(block_.min, position_ + steps.low[b]);
+            block_.max = std::max(block_.max, position_ + steps.high[b]);
+        }
+        position_ += steps.end[b];
+        block_.last = position_;
+        blockBits_ += 8;
+        if (blockBits_ == MF_PYRAMID_BASE_BITS) {
+            pending_.push_back(block_);
+            blockBits_ = 0;
+            if (pending_.size() >= MF_PYRAMID_FLUSH_BLOCKS && !flush(errorReason)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool MeterFeeder::WalkPyramidWriter::Close(std::string* errorReason) {
+    if (file_ == nullptr) {
+        return true;
+    }
+    uint64_t partialBits = blockBits_;
+    if (blockBits_ > 0) {
+        pending_.push_back(block_);
+        blockBits_ = 0;
+    }
+    bool ok = flush(errorReason);
+    if (ok && partialBits > 0) {
+        header_.totalBits -= MF_PYRAMID_BASE_BITS - partialBits;
+    }
+
+    // Each level above has a block per two of the one below, built from it a run of blocks at a time
+    std::vector<WalkBlock> below, above;
+    unsigned level = 0;
+    while (ok && header_.levels[level].count > 1 && level + 1 < MF_PYRAMID_MAX_LEVELS) {
+        uint64_t count = header_.levels[level].count;
+        uint64_t readOffset = header_.levels[level].offset;
+        uint64_t writeOffset = readOffset + count * sizeof(WalkBlock);
+        header_.levels[level + 1].offset = writeOffset;
+        header_.levels[level + 1].count = (count + 1) / 2;
+        for (uint64_t done = 0; ok && done < count;) {
+            size_t run = (size_t)std::min(count - done, (uint64_t)MF_PYRAMID_FLUSH_BLOCKS * 2);
+            below.resize(run);
+            ok = SeekFile(file_, readOffset + done * sizeof(WalkBlock)) && fread(&below[0], sizeof(WalkBlock), run, file_) == run;
+            above.clear();
+            for (size_t i = 0; i < run; i += 2) {
+                WalkBlock block = below[i];
+                if (i + 1 < run) {
+                    block.min = std::min(block.min, below[i + 1].min);
+                    block.max = std::max(block.max, below[i + 1].max);
+                    block.last = below[i + 1].last;
+                }
+                above.push_back(block);
+            }
+            ok = ok && SeekFile(file_, writeOffset + done / 2 * sizeof(WalkBlock))
+                    && fwrite(&above[0], sizeof(WalkBlock), above.size(), file_) == above.size();
+            done += run;
+        }
+        if (ok) {
+            header_.numLevels = ++level + 1;
+        }
+    }
+    if (!ok) {
+        *errorReason = "Couldn't write the walk pyramid " + path_;
+    }
+    ok = writeHeader(errorReason) && ok;
+    fclose(file_);
+    file_ = nullptr;
+    return ok;
+}
+
+// Append the completed level 0 blocks and list them in the header
+bool MeterFeeder::WalkPyramidWriter::flush(std::string* errorReason) {
+    if (pending_.empty()) {
+        return true;
+    }
+    uint64_t count = header_.levels[0].count;
+    if (!SeekFile(file_, header_.levels[0].offset + count * sizeof(WalkBlock))
+        || fwrite(&pending_[0], sizeof(WalkBlock), pending_.size(), file_) != pending_.size()) {
+        *errorReason = "Couldn't write the walk pyramid " + path_;
+        return false;
+    }
+    header_.levels[0].count += pending_.size();
+    header_.totalBits = header_.levels[0].count * MF_PYRAMID_BASE_BITS;
+    pending_.clear();
+    return writeHeader(errorReason);
+}
+
+bool MeterFeeder::WalkPyramidWriter::writeHeader(std::string* errorReason) {
+    if (!SeekFile(file_, 0) || fwrite(&header_, sizeof(header_), 1, file_) != 1 || fflush(file_) != 0) {
+        *errorReason = "Couldn't write the walk pyramid " + path_;
+        return false;
+    }
+    return true;
+}
+
+MeterFeeder::WalkPyramid::~WalkPyramid() {
+    Close();
+}
+
+bool MeterFeeder::WalkPyramid::Open(const std::string& path, const std::string& rawPath, std::string* errorReason) {
+    Close();
+    file_ = fopen(path.c_str(), "rb");
+    if (file_ == nullptr) {
+        *errorReason = "Couldn't open " + path;
+        return false;
+    }
+    if (fread(&header_, sizeof(header_), 1, file_) != 1 || memcmp(header_.magic, WALK_MAGIC, sizeof(header_.magic)) != 0
+        || header_.baseBits != MF_PYRAMID_BASE_BITS || header_.numLevels < 1 || header_.numLevels > MF_PYRAMID_MAX_LEVELS) {
+        *errorReason = "Not a walk pyramid: " + path;
+        Close();
+        return false;
+    }
+    bytesRead_ = sizeof(header_);
+    if (!rawPath.empty()) {
+        raw_ = fopen(rawPath.c_str(), "rb");
+        if (raw_ == nullptr) {
+            *errorReason = "Couldn't open " + rawPath;
+            Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void MeterFeeder::WalkPyramid::Close() {
+    if (file_ != nullptr) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+    if (raw_ != nullptr) {
+        fclose(raw_);
+        raw_ = nullptr;
+    }
+    header_ = WalkPyramidHeader();
+}
+
+bool MeterFeeder::WalkPyramid::Query(uint64_t firstBit, uint64_t numBits, size_t pixels, WalkQueryResult* result, std::string* errorReason) {
+    uint64_t totalBits = header_.totalBits;
+    if (pixels == 0 || firstBit >= totalBits) {
+        *errorReason = "Nothing to draw: the range is empty or starts past the end";
+        return false;
+    }
+    if (numBits == 0 || numBits > totalBits - firstBit) {
+        numBits = totalBits - firstBit;
+    }
+    uint64_t bitsPerPixel = numBits / pixels;
+    if (bitsPerPixel < MF_PYRAMID_BASE_BITS && raw_ != nullptr) {
+        return queryRaw(firstBit, numBits, pixels, result, errorReason);
+    }
+
+    // The coarsest level with a block per pixel or more
+    unsigned level = 0;
+    while (level + 1 < header_.numLevels && ((uint64_t)MF_PYRAMID_BASE_BITS << (level + 1)) <= bitsPerPixel) {
+        level++;
+    }
+    uint64_t blockBits = (uint64_t)MF_PYRAMID_BASE_BITS << level;
+    uint64_t first = firstBit / blockBits;
+    uint64_t end = std::min((firstBit + numBits - 1) / blockBits + 1, header_.levels[level].count);
+    if (first >= end) {
+        *errorReason = "The walk pyramid is shorter than its header says";
+        return false;
+    }
+
+    // With the block before for the start position
+    uint64_t from = first > 0 ? first - 1 : 0;
+    if (!readBlocks(level, from, (size_t)(end - from), &result->blocks, errorReason)) {
+        return false;
+    }
+    result->startPosition = 0;
+    if (first > 0) {
+        result->startPosition = result->blocks[0].last;
+        result->blocks.erase(result->blocks.begin());
+    }
+    result->level = (int)level;
+    result->blockBits = blockBits;
+    result->firstBit = first * blockBits;
+    return true;
+}
+
+bool MeterFeeder::WalkPyramid::QueryTime(int64_t fromUtcNs, int64_t toUtcNs, size_t pixels, WalkQueryResult* result, std::string* errorReason) {
+    uint64_t firstBit = 0, endBit = header_.totalBits;
+    if ((fromUtcNs != 0 && !FindBit(fromUtcNs, &firstBit, errorReason)) || (toUtcNs != 0 && !FindBit(toUtcNs, &endBit, errorReason))) {
+        return false;
+    }
+    if (endBit <= firstBit) {
+        *errorReason = "No bits in the time range";
+        return false;
+    }
+    return Query(firstBit, endBit - firstBit, pixels, result, errorReason);
+}
+
+bool MeterFeeder::WalkPyramid::ReadBaseBlocks(uint64_t first, size_t count, std::vector<WalkBlock>* blocks, std::string* errorReason) {
+    uint64_t total = header_.levels[0].count;
+    return readBlocks(0, first, first < total ? (size_t)std::min((uint64_t)count, total - first) : 0, blocks, errorReason);
+}
+
+bool MeterFeeder::WalkPyramid::FindBit(int64_t utcNs, uint64_t* bit, std::string* errorReason) {
+    uint64_t count = header_.levels[0].count;
+    if (count == 0) {
+        *bit = 0;
+        return true;
+    }
+
+    // The last level 0 block starting at or before the time
+    uint64_t low = 0, high = count;
+    std::vector<WalkBlock> blocks;
+    while (high - low > 1) {
+        uint64_t middle = low + (high - low) / 2;
+        if (!readBlocks(0, middle, 1, &blocks, errorReason)) {
+            return false;
+        }
+        if (blocks[0].firstUtcNs <= utcNs) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    // Between it and the next one, at the spacing of the last two for the last
+    uint64_t from = low + 1 < count || low == 0 ? low : low - 1;
+    if (!readBlocks(0, from, (size_t)std::min(count - from, (uint64_t)2), &blocks, errorReason)) {
+        return false;
+    }
+    const WalkBlock& block = blocks[(size_t)(low - from)];
+    double blockNs = blocks.size() == 2 ? (double)(blocks[1].firstUtcNs - blocks[0].firstUtcNs) : 0;
+    double offset = blockNs > 0 ? (utcNs - block.firstUtcNs) / blockNs * MF_PYRAMID_BASE_BITS : 0;
+    offset = std::max(0.0, std::min(offset, (double)MF_PYRAMID_BASE_BITS));
+    *bit = std::min(low * MF_PYRAMID_BASE_BITS + (uint64_t)offset, header_.totalBits);
+    return true;
+}
+
+bool MeterFeeder::WalkPyramid::readBlocks(unsigned level, uint64_t first, size_t count, std::vector<WalkBlock>* blocks,
+                                          std::string* errorReason) {
+    blocks->resize(count);
+    if (count > 0 && (!SeekFile(file_, header_.levels[level].offset + first * sizeof(WalkBlock))
+                      || fread(&(*blocks)[0], sizeof(WalkBlock), count, file_) != count)) {
+        *errorReason = "Couldn't read the walk pyramid";
+        return false;
+    }
+    bytesRead_ += count * sizeof(WalkBlock);
+    return true;
+}
+
+// Walk the raw bits for blocks shorter than level 0's, starting from the position at the level 0 block
+// the range starts in and timing the blocks between level 0 blocks
+bool MeterFeeder::WalkPyramid::queryRaw(uint64_t firstBit, uint64_t numBits, size_t pixels, WalkQueryResult* result,
+                                        std::string* errorReason) {
+    uint64_t blockBits = std::max((numBits + pixels - 1) / pixels, (uint64_t)1);
+    uint64_t base = firstBit / MF_PYRAMID_BASE_BITS;
+    uint64_t baseEnd = std::min((firstBit + numBits - 1) / MF_PYRAMID_BASE_BITS + 2, header_.levels[0].count);
+    uint64_t from = base > 0 ? base - 1 : 0;
+    if (base >= baseEnd) {
+        *errorReason = "The walk pyramid is shorter than its header says";
+        return false;
+    }
+    std::vector<WalkBlock> baseBlocks;
+    if (!readBlocks(0, from, (size_t)(baseEnd - from), &baseBlocks, errorReason)) {
+        return false;
+    }
+    int64_t position = base > 0 ? baseBlocks[0].last : 0;
+    auto bitTime = [&](uint64_t bit) {
+        size_t i = (size_t)(bit / MF_PYRAMID_BASE_BITS - from);
+        i = std::min(i, baseBlocks.size() - 1);
+        double periodNs = i + 1 < baseBlocks.size() ? (double)(baseBlocks[i + 1].firstUtcNs - baseBlocks[i].firstUtcNs) / MF_PYRAMID_BASE_BITS
+                        : i > 0 ? (double)(baseBlocks[i].firstUtcNs - baseBlocks[i - 1].firstUtcNs) / MF_PYRAMID_BASE_BITS : 0;
+        return baseBlocks[i].firstUtcNs + (int64_t)((bit - (from + i) * MF_PYRAMID_BASE_BITS) * periodNs);
+    };
+
+    uint64_t startBit = base * MF_PYRAMID_BASE_BITS, endBit = firstBit + numBits;
+    std::vector<unsigned char> bytes((size_t)((endBit + 7) / 8 - startBit / 8));
+    if (!SeekFile(raw_, startBit / 8) || fread(&bytes[0], 1, bytes.size(), raw_) != bytes.size()) {
+        *errorReason = "Couldn't read the raw recording";
+        return false;
+    }
+    bytesRead_ += bytes.size();
+
+    result->blocks.clear();
+    result->startPosition = position;
+    WalkBlock block = WalkBlock();
+    for (uint64_t bit = startBit; bit < endBit; bit++) {
+        uint64_t i = bit - startBit;
+        position += (bytes[(size_t)(i / 8)] >> (7 - i % 8)) & 1 ? 1 : -1;
+        if (bit < firstBit) {
+            result->startPosition = position;
+            continue;
+        }
+        if ((bit - firstBit) % blockBits == 0) {
+            if (bit > firstBit) {
+                result->blocks.push_back(block);
+            }
+            block.min = block.max = position;
+            block.firstUtcNs = bitTime(bit);
+        }
+        block.min = std::min(block.min, position);
+        block.max = std::max(block.max, position);
+        block.last = position;
+    }
+    result->blocks.push_back(block);
+    result->level = -1;
+    result->blockBits = blockBits;
+    result->firstBit = firstBit;
+    return true;
+}
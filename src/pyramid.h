@@ -0,0 +1,214 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+
+namespace MeterFeeder {
+    /**
+     * Summary of the random walk (+1 for each one bit, -1 for each zero) over a block of a recording.
+     * Positions count from the start of the recording.
+     */
+    struct WalkBlock {
+        int64_t min;
+        int64_t max;
+
+        // Position after the block's last bit
+        int64_t last;
+
+        // UTC time of the block's first bit (nanoseconds since the Unix epoch)
+        int64_t firstUtcNs;
+    };
+
+    /**
+     * Blocks of a walk pyramid covering a range, at the level picked for the resolution asked for.
+     */
+    struct WalkQueryResult {
+        // Pyramid level, or -1 if the blocks were computed from the raw recording
+        int level;
+
+        // Bits each block covers (the last may cover fewer) and the index of the first block's first bit
+        uint64_t blockBits;
+        uint64_t firstBit;
+
+        // Position before the first block's first bit
+        int64_t startPosition;
+
+        std::vector<WalkBlock> blocks;
+    };
+
+    /**
+     * On-disk layout of a .walk file: this header, then each level's blocks one after another.
+     * Level 0 has a block per MF_PYRAMID_BASE_BITS bits, each level above one per two of the level below.
+     * While recording only level 0 is listed; the levels above are added when the recording is closed.
+     */
+    struct WalkPyramidHeader {
+        char magic[8];
+        uint32_t baseBits;
+        uint32_t numLevels;
+        uint64_t totalBits;
+        struct {
+            uint64_t offset;
+            uint64_t count;
+        } levels[MF_PYRAMID_MAX_LEVELS];
+    };
+
+    /**
+     * Builds the .walk pyramid of a recording as it's written, so any zoom level can be drawn later by
+     * reading about as many blocks as there are pixels. Level 0 is appended as it fills, the levels above
+     * are built from it on Close() a level at a time, so memory stays small however long the recording.
+     * If the recorder dies before Close() the file still has level 0.
+     */
+    class WalkPyramidWriter {
+        public:
+            WalkPyramidWriter() {}
+            ~WalkPyramidWriter();
+            WalkPyramidWriter(const WalkPyramidWriter&) = delete;
+            WalkPyramidWriter& operator=(const WalkPyramidWriter&) = delete;
+
+            /**
+             * Create the pyramid file.
+             * 
+             * @param Path of the file.
+             * @param Error reason upon failure.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool Open(const std::string& path, std::string* errorReason);
+
+            /**
+             * Walk a chunk of the recording.
+             * 
+             * @param The bytes.
+             * @param Number of bytes.
+             * @param UTC time of the chunk's first bit (nanoseconds since the Unix epoch).
+             * @param Time between bits (nanoseconds).
+             * @param Error reason upon a write error.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool Add(const unsigned char* bytes, size_t length, int64_t firstBitUtcNs, double bitPeriodNs, std::string* errorReason);
+
+            /**
+             * Write the last, partial, block and the levels above level 0, and close the file.
+             * 
+             * @param Error reason upon a write error.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool Close(std::string* errorReason);
+
+        private:
+            bool flush(std::string* errorReason);
+            bool writeHeader(std::string* errorReason);
+
+            FILE* file_ = nullptr;
+            std::string path_;
+            WalkPyramidHeader header_;
+            WalkBlock block_;
+            uint64_t blockBits_ = 0;
+            int64_t position_ = 0;
+            std::vector<WalkBlock> pending_;
+    };
+
+    /**
+     * Reads a recording's .walk pyramid to draw its walk at any zoom: Query() picks the coarsest level
+     * with at least a block per pixel, so a view reads a few thousand blocks whatever the range. Zoomed in
+     * past level 0, the blocks are computed from the raw recording (.bin) when there is one.
+     */
+    class WalkPyramid {
+        public:
+            WalkPyramid() {}
+            ~WalkPyramid();
+            WalkPyramid(const WalkPyramid&) = delete;
+            WalkPyramid& operator=(const WalkPyramid&) = delete;
+
+            /**
+             * Open a pyramid, and the raw recording next to it if there is one.
+             * 
+             * @param Path of the .walk file.
+             * @param Path of the raw recording, or empty for none.
+             * @param Error reason upon failure.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool Open(const std::string& path, const std::string& rawPath, std::string* errorReason);
+
+            void Close();
+
+            /**
+             * Get the blocks covering a range of bits at a resolution.
+             * 
+             * @param Index of the range's first bit.
+             * @param Number of bits in the range, 0 for the rest of the recording.
+             * @param Number of pixels to draw the range across.
+             * @param Where to store the blocks.
+             * @param Error reason upon failure.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool Query(uint64_t firstBit, uint64_t numBits, size_t pixels, WalkQueryResult* result, std::string* errorReason);
+
+            /**
+             * Get the blocks covering a time range at a resolution.
+             * 
+             * @param UTC start of the range (nanoseconds since the Unix epoch), 0 for the start of the recording.
+             * @param UTC end of the range, 0 for the end of the recording.
+             * @param Number of pixels to draw the range across.
+             * @param Where to store the blocks.
+             * @param Error reason upon failure.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool QueryTime(int64_t fromUtcNs, int64_t toUtcNs, size_t pixels, WalkQueryResult* result, std::string* errorReason);
+
+            /**
+             * Find the bit generated at a time, interpolating between level 0 blocks.
+             * 
+             * @param UTC time (nanoseconds since the Unix epoch).
+             * @param Where to store the bit's index, clamped to the recording.
+             * @param Error reason upon a read error.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool FindBit(int64_t utcNs, uint64_t* bit, std::string* errorReason);
+
+            /**
+             * Read level 0 blocks, which time the recording a block of MF_PYRAMID_BASE_BITS bits at a time.
+             * 
+             * @param Index of the first block.
+             * @param Most blocks to read, fewer past the end of level 0.
+             * @param Where to store the blocks.
+             * @param Error reason upon a read error.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool ReadBaseBlocks(uint64_t first, size_t count, std::vector<WalkBlock>* blocks, std::string* errorReason);
+
+            uint64_t GetTotalBits() const { return header_.totalBits; }
+            unsigned GetLevelCount() const { return header_.numLevels; }
+
+            /**
+             * Get the bytes read from the files since opening.
+             */
+            uint64_t GetBytesRead() const { return bytesRead_; }
+
+        private:
+            bool readBlocks(unsigned level, uint64_t first, size_t count, std::vector<WalkBlock>* blocks, std::string* errorReason);
+            bool queryRaw(uint64_t firstBit, uint64_t numBits, size_t pixels, WalkQueryResult* result, std::string* errorReason);
+
+            FILE* file_ = nullptr;
+            FILE* raw_ = nullptr;
+            WalkPyramidHeader header_ = WalkPyramidHeader();
+            uint64_t bytesRead_ = 0;
+    };
+}
@@ -0,0 +1,363 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "reactor.h"
+
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+MeterFeeder::RxEvent::RxEvent() {
+#ifdef _WIN32
+    event_ = CreateEvent(NULL, FALSE, FALSE, NULL);
+#else
+    pthread_mutex_init(&event_.eMutex, NULL);
+    pthread_cond_init(&event_.eCondVar, NULL);
+    event_.iVar = 0;
+#endif
+}
+
+MeterFeeder::RxEvent::~RxEvent() {
+#ifdef _WIN32
+    CloseHandle(event_);
+#else
+    pthread_cond_destroy(&event_.eCondVar);
+    pthread_mutex_destroy(&event_.eMutex);
+#endif
+}
+
+void MeterFeeder::RxEvent::Wait(DWORD timeoutMs) {
+#ifdef _WIN32
+    WaitForSingleObject(event_, timeoutMs);
+#else
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    long long nsec = (long long)now.tv_usec * 1000 + (long long)(timeoutMs % 1000) * 1000000;
+    struct timespec abstime;
+    abstime.tv_sec = now.tv_sec + timeoutMs / 1000 + nsec / 1000000000;
+    abstime.tv_nsec = nsec % 1000000000;
+
+    pthread_mutex_lock(&event_.eMutex);
+    if (event_.iVar == 0) {
+        pthread_cond_timedwait(&event_.eCondVar, &event_.eMutex, &abstime);
+    }
+    event_.iVar = 0;
+    pthread_mutex_unlock(&event_.eMutex);
+#endif
+}
+
+void MeterFeeder::RxEvent::Signal() {
+#ifdef _WIN32
+    SetEvent(event_);
+#else
+    pthread_mutex_lock(&event_.eMutex);
+    event_.iVar = 1;
+    pthread_cond_signal(&event_.eCondVar);
+    pthread_mutex_unlock(&event_.eMutex);
+#endif
+}
+
+PVOID MeterFeeder::RxEvent::Native() {
+#ifdef _WIN32
+    return event_;
+#else
+    return &event_;
+#endif
+}
+
+void MeterFeeder::CompletionQueue::Push(uint64_t id, int status, DWORD bytesRead) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Completed completed = { id, status, bytesRead };
+    completed_.push_back(completed);
+    available_.notify_one();
+}
+
+bool MeterFeeder::CompletionQueue::Pop(Completed* completed, DWORD timeoutMs) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!available_.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]() { return !completed_.empty(); })) {
+        return false;
+    }
+    *completed = completed_.front();
+    completed_.pop_front();
+    return true;
+}
+
+MeterFeeder::Reactor::Reactor() {
+}
+
+MeterFeeder::Reactor::~Reactor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    idle_.notify_all();
+    rxEvent_.Signal();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+uint64_t MeterFeeder::Reactor::Submit(const Generator& generator, DWORD length, UCHAR* buffer, DWORD timeoutMs, bool restart, Completion completion) {
+    return Submit(generator, length, length, buffer, timeoutMs, restart, completion);
+}
+
+uint64_t MeterFeeder::Reactor::Submit(const Generator& generator, DWORD minLength, DWORD maxLength, UCHAR* buffer, DWORD timeoutMs, bool restart,
+                                      Completion completion) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Start the reactor thread on first use
+    if (!thread_.joinable()) {
+        thread_ = std::thread(&Reactor::run, this);
+    }
+
+    ReadRequest request(nextId_++, generator);
+    request.buffer = buffer;
+    request.minLength = minLength < maxLength ? minLength : maxLength;
+    request.length = maxLength;
+    request.restart = restart;
+    request.submitted = std::chrono::steady_clock::now();
+    request.traceStartUs = Tracer::IsRecording() ? Tracer::Now() : 0;
+    request.deadline = request.submitted + std::chrono::milliseconds(timeoutMs);
+    request.completion = completion;
+    queues_[request.generator.GetHandle()].push_back(request);
+    request.generator.GetMetrics().pendingReads++;
+
+    idle_.notify_all();
+    rxEvent_.Signal();
+    return request.id;
+}
+
+bool MeterFeeder::Reactor::Cancel(uint64_t id) {
+    std::vector<Finished> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = queues_.begin(); it != queues_.end() && cancelled.empty(); ++it) {
+            std::deque<ReadRequest>& queue = it->second;
+            for (size_t i = 0; i < queue.size(); i++) {
+                if (queue[i].id == id) {
+                    Finished finished = { queue[i], MF_READ_CANCELLED };
+                    cancelled.push_back(finished);
+                    queue.erase(queue.begin() + i);
+                    break;
+                }
+            }
+        }
+
+        // A read being serviced is finished by the reactor thread once its I/O returns
+        if (cancelled.empty() && inService_.find(id) != inService_.end()) {
+            cancelled_.insert(id);
+            return true;
+        }
+    }
+
+    finish(&cancelled);
+    return !cancelled.empty();
+}
+
+void MeterFeeder::Reactor::CancelAll() {
+    std::vector<Finished> cancelled;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (auto it = queues_.begin(); it != queues_.end(); ++it) {
+            for (size_t i = 0; i < it->second.size(); i++) {
+                Finished finished = { it->second[i], MF_READ_CANCELLED };
+                cancelled.push_back(finished);
+            }
+        }
+        queues_.clear();
+        attached_.clear();
+        cancelled_.insert(inService_.begin(), inService_.end());
+
+        // Don't return while the reactor thread is still servicing reads or handing back ones it finished
+        idle_.wait(lock, [this]() { return !busy_; });
+    }
+
+    finish(&cancelled);
+}
+
+size_t MeterFeeder::Reactor::GetNumberPending() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t pending = 0;
+    for (auto it = queues_.begin(); it != queues_.end(); ++it) {
+        pending += it->second.size();
+    }
+    return pending + inService_.size();
+}
+
+void MeterFeeder::Reactor::run() {
+    struct Serviced {
+        ReadRequest request;
+        bool attach;
+        bool done;
+        int status;
+    };
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        if (queues_.empty()) {
+            idle_.wait(lock, [this]() { return !running_ || !queues_.empty(); });
+            continue;
+        }
+
+        // Take the read at the head of each generator's queue and service them without holding the lock,
+        // so submitting, cancelling and the other generators' reads don't wait behind USB I/O
+        std::vector<Serviced> serviced;
+        for (auto it = queues_.begin(); it != queues_.end(); ++it) {
+            if (it->second.empty()) {
+                // Emptied by a cancellation, dropped below
+                continue;
+            }
+            Serviced head = { it->second.front(), attached_.find(it->first) == attached_.end(), false, MF_OK };
+            serviced.push_back(head);
+            inService_.insert(head.request.id);
+            it->second.pop_front();
+        }
+        busy_ = true;
+        lock.unlock();
+        for (size_t i = 0; i < serviced.size(); i++) {
+            serviced[i].done = service(&serviced[i].request, &serviced[i].attach, &serviced[i].status);
+        }
+        lock.lock();
+
+        // Finish the reads that are done or were cancelled meanwhile, putting the rest back at the head of their queues
+        std::vector<Finished> finished;
+        for (size_t i = 0; i < serviced.size(); i++) {
+            ReadRequest& request = serviced[i].request;
+            FT_HANDLE handle = request.generator.GetHandle();
+            if (serviced[i].attach) {
+                attached_.insert(handle);
+            }
+            inService_.erase(request.id);
+            if (cancelled_.erase(request.id) > 0) {
+                Finished done = { request, MF_READ_CANCELLED };
+                finished.push_back(done);
+            } else if (serviced[i].done) {
+                Finished done = { request, serviced[i].status };
+                finished.push_back(done);
+            } else {
+                queues_[handle].push_front(request);
+            }
+        }
+        for (auto it = queues_.begin(); it != queues_.end();) {
+            if (it->second.empty()) {
+                it = queues_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        // Hand back finished reads without holding the lock so completions can submit more
+        if (!finished.empty()) {
+            lock.unlock();
+            finish(&finished);
+            lock.lock();
+        }
+        busy_ = false;
+        idle_.notify_all();
+
+        if (finished.empty() && !queues_.empty()) {
+            // Sleep until a generator receives data (or a read is submitted)
+            lock.unlock();
+            rxEvent_.Wait(MF_REACTOR_POLL_MS);
+            lock.lock();
+        }
+    }
+}
+
+// Called without the lock. Attaches the generator's rx event first if attach is set, clearing it if it didn't get that far.
+bool MeterFeeder::Reactor::service(ReadRequest* request, bool* attach, int* status) {
+    // Whatever arrived by the deadline is kept, it's a timeout only if that's short of the minimum
+    bool expired = std::chrono::steady_clock::now() >= request->deadline;
+
+    if (request->generator.IsClosed()) {
+        *attach = false;
+        *status = MF_GENERATOR_CLOSED;
+        return true;
+    }
+
+    // Leave the generator alone while a blocking read is using it
+    std::unique_lock<std::mutex> io(request->generator.GetIoMutex(), std::try_to_lock);
+    if (!io.owns_lock()) {
+        *attach = false;
+        if (expired) {
+            *status = request->bytesRead >= request->minLength ? MF_OK : MF_READ_TIMEOUT;
+            return true;
+        }
+        return false;
+    }
+
+    try {
+        if (*attach) {
+            // Without notifications the reactor still polls every MF_REACTOR_POLL_MS
+            request->generator.SetRxEventNotification(rxEvent_.Native());
+        }
+
+        if (!request->started) {
+            if (request->restart || !request->generator.IsStreaming()) {
+                int streamStatus = request->generator.StartStreaming();
+                if (streamStatus != FT_OK) {
+                    *status = streamStatus;
+                    return true;
+                }
+            }
+            request->started = true;
+        }
+
+        DWORD bytesRxd = 0;
+        int readStatus = request->generator.ReadAvailable(request->length - request->bytesRead, request->buffer + request->bytesRead, &bytesRxd);
+        request->bytesRead += bytesRxd;
+        if (readStatus != FT_OK) {
+            *status = readStatus;
+            return true;
+        }
+    } catch (const std::runtime_error&) {
+        *attach = false;
+        *status = MF_GENERATOR_CLOSED;
+        return true;
+    }
+
+    // Done once full, or in at-least-N mode once N have arrived (along with anything else queued)
+    if (request->bytesRead == request->length || (request->minLength < request->length && request->bytesRead >= request->minLength)) {
+        *status = MF_OK;
+        return true;
+    }
+    if (expired) {
+        *status = request->bytesRead >= request->minLength ? MF_OK : MF_READ_TIMEOUT;
+        return true;
+    }
+    return false;
+}
+
+void MeterFeeder::Reactor::finish(std::vector<Finished>* finished) {
+    for (size_t i = 0; i < finished->size(); i++) {
+        Finished* done = &finished->at(i);
+
+        GeneratorMetrics& metrics = done->request.generator.GetMetrics();
+        metrics.pendingReads--;
+        if (done->status == MF_READ_CANCELLED) {
+            metrics.cancellations++;
+        } else {
+            metrics.reads++;
+            metrics.requestLatency.Record((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - done->request.submitted).count());
+            if (done->status == MF_READ_TIMEOUT) {
+                metrics.timeouts++;
+            }
+            if (done->request.bytesRead < done->request.length) {
+                metrics.shortReads++;
+            }
+        }
+
+        if (Tracer::IsRecording() && done->request.traceStartUs != 0) {
+            Tracer::Record("request", done->request.generator.GetSerialNumber(), done->request.traceStartUs, Tracer::Now(),
+                done->status, done->request.bytesRead);
+        }
+
+        if (done->request.completion) {
+            done->request.completion(done->request.id, done->status, done->request.bytesRead);
+        }
+    }
+}
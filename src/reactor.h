@@ -0,0 +1,213 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "../ftd2xx/ftd2xx.h"
+
+#include "constants.h"
+#include "generator.h"
+
+namespace MeterFeeder {
+    /**
+     * Event the FTDI driver signals when any of the attached generators receives data.
+     * Wraps a Windows event or the pthread based EVENT_HANDLE used by libftd2xx elsewhere.
+     */
+    class RxEvent {
+        public:
+            RxEvent();
+            ~RxEvent();
+
+            /**
+             * Wait until signalled or the timeout expires.
+             * 
+             * @param Timeout in milliseconds.
+             */
+            void Wait(DWORD timeoutMs);
+
+            /**
+             * Wake up a waiting thread.
+             */
+            void Signal();
+
+            /**
+             * Get the pointer to pass to FT_SetEventNotification.
+             */
+            PVOID Native();
+
+        private:
+#ifdef _WIN32
+            HANDLE event_;
+#else
+            EVENT_HANDLE event_;
+#endif
+    };
+
+    /**
+     * Thread-safe queue of finished reads for callers that would rather poll than take a callback.
+     */
+    class CompletionQueue {
+        public:
+            struct Completed {
+                uint64_t id;
+                int status;
+                DWORD bytesRead;
+            };
+
+            /**
+             * Add a finished read to the queue and wake a waiting Pop().
+             */
+            void Push(uint64_t id, int status, DWORD bytesRead);
+
+            /**
+             * Take the oldest finished read off the queue.
+             * 
+             * @param Where to store the finished read.
+             * @param Time to wait for one in milliseconds (0 to not wait).
+             * 
+             * @return true if a finished read was taken, false if the wait timed out.
+             */
+            bool Pop(Completed* completed, DWORD timeoutMs);
+
+        private:
+            std::mutex mutex_;
+            std::condition_variable available_;
+            std::deque<Completed> completed_;
+    };
+
+    /**
+     * Event-driven read engine servicing any number of generators from a single thread.
+     *
+     * Reads are queued per generator and serviced in order. Rather than blocking in FT_Read,
+     * the reactor thread sleeps on an FT_EVENT_RXCHAR notification shared by all the generators
+     * and then drains whatever each receive queue holds. Every read has a deadline and can be
+     * cancelled while in flight.
+     */
+    class Reactor {
+        public:
+            /**
+             * Called on the reactor thread when a read finishes (or on the thread cancelling it).
+             * 
+             * @param Id of the read.
+             * @param MF_OK, MF_READ_TIMEOUT, MF_READ_CANCELLED, MF_GENERATOR_CLOSED or an FT_STATUS.
+             * @param Number of bytes stored in the buffer. Whatever arrived is kept even when the read failed.
+             */
+            typedef std::function<void(uint64_t id, int status, DWORD bytesRead)> Completion;
+
+            Reactor();
+            ~Reactor();
+
+            /**
+             * Queue a read.
+             * 
+             * @param The generator to read from.
+             * @param Length in bytes to read.
+             * @param Pointer to where to store the data. Must stay valid until completion.
+             * @param Time allowed for the read in milliseconds, measured from when it is submitted.
+             * @param true to purge and restart streaming before reading (like Driver::GetBytes),
+             *        false to carry on reading the stream left running by the previous read.
+             * @param Called when the read finishes.
+             * 
+             * @return Id of the read.
+             */
+            uint64_t Submit(const Generator& generator, DWORD length, UCHAR* buffer, DWORD timeoutMs, bool restart, Completion completion);
+
+            /**
+             * Queue a read of at least minLength and at most maxLength bytes. It finishes as soon
+             * as minLength bytes have arrived, taking whatever else is already queued up to maxLength.
+             * At the deadline it finishes with the bytes that did arrive: MF_OK if that's at least
+             * minLength, otherwise MF_READ_TIMEOUT (the partial data is still in the buffer).
+             * With minLength equal to maxLength this reads as much as possible by the deadline.
+             * 
+             * @param The generator to read from.
+             * @param Minimum length in bytes.
+             * @param Maximum length in bytes. The buffer must hold this many.
+             * @param Pointer to where to store the data. Must stay valid until completion.
+             * @param Time allowed for the read in milliseconds, measured from when it is submitted.
+             * @param true to purge and restart streaming before reading, false to carry on the stream.
+             * @param Called when the read finishes.
+             * 
+             * @return Id of the read.
+             */
+            uint64_t Submit(const Generator& generator, DWORD minLength, DWORD maxLength, UCHAR* buffer, DWORD timeoutMs, bool restart,
+                            Completion completion);
+
+            /**
+             * Cancel a pending read. Its completion is called with MF_READ_CANCELLED: right away if
+             * it's queued, or on the reactor thread once I/O already under way for it returns.
+             * 
+             * @param Id of the read.
+             * 
+             * @return true if the read was still pending, false otherwise.
+             */
+            bool Cancel(uint64_t id);
+
+            /**
+             * Cancel every pending read, e.g. before the generators are closed.
+             * Waits for the cancelled reads' completions to return, so must not be called from a completion.
+             */
+            void CancelAll();
+
+            /**
+             * Get the number of reads queued or in flight.
+             */
+            size_t GetNumberPending();
+
+        private:
+            struct ReadRequest {
+                ReadRequest(uint64_t id, const Generator& generator)
+                    : id(id), generator(generator), buffer(nullptr), minLength(0), length(0), bytesRead(0), restart(false),
+                      started(false), traceStartUs(0) {}
+
+                uint64_t id;
+                Generator generator;
+                UCHAR* buffer;
+                DWORD minLength;
+                DWORD length;
+                DWORD bytesRead;
+                bool restart;
+                bool started;
+                std::chrono::steady_clock::time_point submitted;
+                uint64_t traceStartUs;
+                std::chrono::steady_clock::time_point deadline;
+                Completion completion;
+            };
+
+            struct Finished {
+                ReadRequest request;
+                int status;
+            };
+
+            void run();
+            bool service(ReadRequest* request, bool* attach, int* status);
+            void finish(std::vector<Finished>* finished);
+
+            std::mutex mutex_;
+            std::condition_variable idle_;
+            std::map<FT_HANDLE, std::deque<ReadRequest> > queues_;
+            std::set<FT_HANDLE> attached_;
+
+            // Reads taken off their queues while the reactor thread services them, and those of them cancelled meanwhile
+            std::set<uint64_t> inService_;
+            std::set<uint64_t> cancelled_;
+            RxEvent rxEvent_;
+            std::thread thread_;
+            uint64_t nextId_ = 1;
+            bool running_ = true;
+            bool busy_ = false;
+    };
+}
@@ -0,0 +1,357 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "recording.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MF_RECORDING_SSE2
+#include <emmintrin.h>
+#endif
+
+// Size of the chunks raw binary recordings without a walk pyramid are read in
+#define MF_RECORDING_CHUNK_BYTES 65536
+
+// Level 0 blocks of a walk pyramid read at a time to time a binary recording
+#define MF_RECORDING_TIMING_BLOCKS 1024
+
+MeterFeeder::RecordingReader::~RecordingReader() {
+    Close();
+}
+
+bool MeterFeeder::RecordingReader::Open(const std::string& path, std::string* errorReason) {
+    Close();
+    file_ = fopen(path.c_str(), "rb");
+    if (file_ == nullptr) {
+        *errorReason = "Couldn't open " + path;
+        return false;
+    }
+    // The extension decides, as a raw recording's first byte can be '[' too; only other files are sniffed
+    size_t extension = path.size() >= 4 ? path.size() - 4 : 0;
+    bool bin = path.compare(extension, 4, ".bin") == 0;
+    if (bin) {
+        hex_ = false;
+    } else if (path.compare(extension, 4, ".hex") == 0) {
+        hex_ = true;
+    } else {
+        int first = fgetc(file_);
+        hex_ = first == '[';
+        if (first != EOF) {
+            ungetc(first, file_);
+        }
+    }
+
+    // A binary recording's walk pyramid has the time of every block
+    if (bin) {
+        std::string walkError;
+        timed_ = walk_.Open(path.substr(0, extension) + ".walk", "", &walkError);
+        nextBlock_ = 0;
+        blocks_.clear();
+        blockIndex_ = 0;
+    }
+    return true;
+}
+
+void MeterFeeder::RecordingReader::Close() {
+    if (file_ != nullptr) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+    walk_.Close();
+    timed_ = false;
+}
+
+bool MeterFeeder::RecordingReader::ReadChunk(std::vector<unsigned char>* bytes, int64_t* utcNs, std::string* errorReason) {
+    bytes->clear();
+    if (utcNs != nullptr) {
+        *utcNs = 0;
+    }
+    if (file_ == nullptr) {
+        *errorReason = "Recording not open";
+        return false;
+    }
+
+    if (!hex_ && timed_) {
+        // A block at a time while level 0 lasts; anything after it (if the recorder died) is untimed
+        if (blockIndex_ == blocks_.size()) {
+            if (!walk_.ReadBaseBlocks(nextBlock_, MF_RECORDING_TIMING_BLOCKS, &blocks_, errorReason)) {
+                return false;
+            }
+            nextBlock_ += blocks_.size();
+            blockIndex_ = 0;
+        }
+        if (blockIndex_ < blocks_.size()) {
+            bytes->resize(MF_PYRAMID_BASE_BITS / 8);
+            size_t got = fread(&(*bytes)[0], 1, bytes->size(), file_);
+            bytes->resize(got);
+            if (got == 0 && ferror(file_)) {
+                *errorReason = "Error reading recording";
+            }
+            if (utcNs != nullptr) {
+                *utcNs = blocks_[blockIndex_].firstUtcNs;
+            }
+            blockIndex_++;
+            return got > 0;
+        }
+    }
+
+    if (!hex_) {
+        bytes->resize(MF_RECORDING_CHUNK_BYTES);
+        size_t got = fread(&(*bytes)[0], 1, bytes->size(), file_);
+        bytes->resize(got);
+        if (got == 0 && ferror(file_)) {
+            *errorReason = "Error reading recording";
+        }
+        return got > 0;
+    }
+
+    char buffer[65536];
+    for (;;) {
+        // Gather a whole line, however long
+        line_.clear();
+        bool any = false;
+        while (fgets(buffer, sizeof(buffer), file_) != nullptr) {
+            any = true;
+            line_ += buffer;
+            if (!line_.empty() && line_[line_.size() - 1] == '\n') {
+                break;
+            }
+        }
+        if (!any) {
+            if (ferror(file_)) {
+                *errorReason = "Error reading recording";
+            }
+            return false;
+        }
+
+        int64_t lineUtcNs = 0;
+        if (ParseLine(line_.c_str(), line_.size(), bytes, &lineUtcNs)) {
+            if (utcNs != nullptr) {
+                *utcNs = lineUtcNs;
+            }
+            return true;
+        }
+    }
+}
+
+bool MeterFeeder::RecordingReader::ParseLine(const char* line, size_t length, std::vector<unsigned char>* bytes, int64_t* utcNs) {
+    *utcNs = 0;
+    size_t end = length;
+    while (end > 0 && (line[end - 1] == '\n' || line[end - 1] == '\r' || line[end - 1] == ' ')) {
+        end--;
+    }
+    if (end == 0 || line[0] != '[') {
+        return false;
+    }
+
+    // The hex follows the "] " closing the time, or the read time after it
+    const char* close = (const char*)memchr(line, ']', end);
+    if (close == nullptr || (size_t)(close - line) + 2 > end || close[1] != ' ') {
+        return false;
+    }
+    size_t hexStart = close - line + 2;
+    if (hexStart < end && line[hexStart] == '[') {
+        const char* readClose = (const char*)memchr(line + hexStart, ']', end - hexStart);
+        if (readClose == nullptr || (size_t)(readClose - line) + 2 > end || readClose[1] != ' ') {
+            return false;
+        }
+        hexStart = readClose - line + 2;
+    }
+    if (!DecodeHex(line + hexStart, end - hexStart, bytes)) {
+        return false;
+    }
+    if (!ParseUtc(line + 1, close - line - 1, utcNs)) {
+        *utcNs = 0;
+    }
+    return true;
+}
+
+bool MeterFeeder::RecordingReader::DecodeHex(const char* text, size_t length, std::vector<unsigned char>* bytes) {
+    if (length % 2 != 0) {
+        return false;
+    }
+    struct HexDigits {
+        signed char values[256];
+        HexDigits() {
+            memset(values, -1, sizeof(values));
+            for (int i = 0; i < 10; i++) {
+                values['0' + i] = (signed char)i;
+            }
+            for (int i = 0; i < 6; i++) {
+                values['a' + i] = values['A' + i] = (signed char)(10 + i);
+            }
+        }
+    };
+    static const HexDigits digits;
+    const signed char* values = digits.values;
+
+    size_t start = bytes->size();
+    bytes->resize(start + length / 2);
+    if (length == 0) {
+        return true;
+    }
+    unsigned char* out = &(*bytes)[0] + start;
+    size_t i = 0;
+#ifdef MF_RECORDING_SSE2
+    // 32 digits at a time: each lane's nibble, or a flag for a lane that isn't a hex digit, then pairs of
+    // nibbles shifted together into bytes
+    int invalid = 0;
+    auto nibbles = [&invalid](__m128i c) {
+        __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+        __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+        invalid |= ~_mm_movemask_epi8(_mm_or_si128(digit, letter)) & 0xFFFF;
+        __m128i values = _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+                                      _mm_and_si128(letter, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+        return _mm_or_si128(_mm_slli_epi16(_mm_and_si128(values, _mm_set1_epi16(0x00FF)), 4), _mm_srli_epi16(values, 8));
+    };
+    for (; i + 32 <= length; i += 32) {
+        __m128i first = nibbles(_mm_loadu_si128((const __m128i*)(text + i)));
+        __m128i second = nibbles(_mm_loadu_si128((const __m128i*)(text + i + 16)));
+        _mm_storeu_si128((__m128i*)(out + i / 2), _mm_packus_epi16(first, second));
+    }
+    if (invalid != 0) {
+        bytes->resize(start);
+        return false;
+    }
+#endif
+    for (; i < length; i += 2) {
+        int high = values[(unsigned char)text[i]], low = values[(unsigned char)text[i + 1]];
+        if (high < 0 || low < 0) {
+            bytes->resize(start);
+            return false;
+        }
+        out[i / 2] = (unsigned char)((high << 4) | low);
+    }
+    return true;
+}
+
+bool MeterFeeder::RecordingReader::ParseUtc(const char* text, size_t length, int64_t* utcNs) {
+    // YYYY-MM-DDThh:mm:ss[.fraction]Z
+    if (length < 20) {
+        return false;
+    }
+    int fields[6];
+    static const int offsets[6] = { 0, 5, 8, 11, 14, 17 };
+    static const int widths[6] = { 4, 2, 2, 2, 2, 2 };
+    for (int f = 0; f < 6; f++) {
+        int value = 0;
+        for (int i = 0; i < widths[f]; i++) {
+            char c = text[offsets[f] + i];
+            if (c < '0' || c > '9') {
+                return false;
+            }
+            value = value * 10 + (c - '0');
+        }
+        fields[f] = value;
+    }
+
+    // Up to 9 digits of fraction, scaled to ns once
+    static const int64_t scales[10] = { 1000000000, 100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10, 1 };
+    int64_t ns = 0;
+    int digits = 0;
+    size_t i = 19;
+    if (text[i] == '.') {
+        for (i++; i < length && text[i] >= '0' && text[i] <= '9'; i++) {
+            if (digits < 9) {
+                ns = ns * 10 + (text[i] - '0');
+                digits++;
+            }
+        }
+        ns *= scales[digits];
+    }
+
+    // Days from the civil date (proleptic Gregorian)
+    int y = fields[0] - (fields[1] <= 2);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (fields[1] + (fields[1] > 2 ? -3 : 9)) + 2) / 5 + fields[2] - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int64_t days = (int64_t)era * 146097 + doe - 719468;
+
+    *utcNs = ((days * 24 + fields[3]) * 60 + fields[4]) * 60 + fields[5];
+    *utcNs = *utcNs * 1000000000 + ns;
+    return true;
+}
+
+MeterFeeder::RecordingWriter::~RecordingWriter() {
+    std::string errorReason;
+    Close(&errorReason);
+}
+
+bool MeterFeeder::RecordingWriter::Open(const std::string& basePath, std::string* errorReason) {
+    Close(errorReason);
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = basePath + ".bin";
+    FILE* existing = fopen(path_.c_str(), "rb");
+    if (existing != nullptr) {
+        fclose(existing);
+        *errorReason = "There's already a recording at " + path_;
+        return false;
+    }
+    file_ = fopen(path_.c_str(), "wb");
+    if (file_ == nullptr) {
+        *errorReason = "Couldn't create " + path_;
+        return false;
+    }
+    if (!walk_.Open(basePath + ".walk", errorReason)) {
+        fclose(file_);
+        file_ = nullptr;
+        return false;
+    }
+    if (!epochs_.Open(basePath, MF_RECORDING_EPOCH_MS, errorReason)) {
+        walk_.Close(errorReason);
+        fclose(file_);
+        file_ = nullptr;
+        return false;
+    }
+    bytesWritten_ = 0;
+    return true;
+}
+
+bool MeterFeeder::RecordingWriter::Write(const unsigned char* bytes, size_t length, int64_t firstBitUtcNs, double bitPeriodNs,
+                                         std::string* errorReason) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_ == nullptr) {
+        *errorReason = "The recording is closed";
+        return false;
+    }
+    if (fwrite(bytes, 1, length, file_) != length) {
+        *errorReason = "Couldn't write to " + path_;
+        return false;
+    }
+    bytesWritten_ += length;
+    return walk_.Add(bytes, length, firstBitUtcNs, bitPeriodNs, errorReason)
+        && epochs_.Add(bytes, length, firstBitUtcNs, bitPeriodNs, errorReason);
+}
+
+bool MeterFeeder::RecordingWriter::Close(std::string* errorReason) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_ == nullptr) {
+        return true;
+    }
+    bool ok = fclose(file_) == 0;
+    file_ = nullptr;
+    if (!ok) {
+        *errorReason = "Couldn't write to " + path_;
+    }
+    ok = walk_.Close(errorReason) && ok;
+    return epochs_.Close(errorReason) && ok;
+}
+
+uint64_t MeterFeeder::RecordingWriter::GetBytesWritten() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytesWritten_;
+}
+
+bool MeterFeeder::SeekFile(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
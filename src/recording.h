@@ -0,0 +1,174 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "epochs.h"
+#include "pyramid.h"
+
+namespace MeterFeeder {
+    /**
+     * Reader of entropy recordings: record_entropy.py's .hex files, with a line per read of
+     * "[<UTC time of the first bit>] [<read time>] <hex>" (or without the read time), or raw binary.
+     * The format is told from the extension, or for other files from the first byte, as .hex lines start
+     * with '['. A <base>.bin recording with a <base>.walk pyramid is timed by its level 0 blocks.
+     */
+    class RecordingReader {
+        public:
+            RecordingReader() {}
+            ~RecordingReader();
+
+            /**
+             * Open a recording.
+             * 
+             * @param Path of the file.
+             * @param Error reason upon failure.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool Open(const std::string& path, std::string* errorReason);
+
+            /**
+             * Read the next chunk: a line's bytes for .hex, a level 0 block's for timed binary, a fixed size
+             * block for other raw binary.
+             * Lines that aren't entries, or are malformed, are skipped.
+             * 
+             * @param Where to store the bytes.
+             * @param Where to store the UTC time of the first bit in ns since the epoch, or 0 when unknown (may be null).
+             * @param Error reason upon a read error.
+             * 
+             * @return true if a chunk was read, false at the end of the file or on error.
+             */
+            bool ReadChunk(std::vector<unsigned char>* bytes, int64_t* utcNs, std::string* errorReason);
+
+            /**
+             * Check if the recording is a .hex file (rather than raw binary).
+             */
+            bool IsHex() const { return hex_; }
+
+            /**
+             * Check if the chunks' times are known: .hex files, and binary recordings with a walk pyramid.
+             */
+            bool IsTimed() const { return hex_ || timed_; }
+
+            void Close();
+
+            /**
+             * Parse an ISO 8601 UTC time like "2026-02-15T07:30:01.729037Z".
+             * 
+             * @param The text.
+             * @param Its length.
+             * @param Where to store ns since the epoch.
+             * 
+             * @return true if parsed, otherwise false.
+             */
+            static bool ParseUtc(const char* text, size_t length, int64_t* utcNs);
+
+            /**
+             * Decode hex digits to bytes.
+             * 
+             * @param The text, an even number of hex digits.
+             * @param Its length.
+             * @param Where to store the bytes, appended.
+             * 
+             * @return true if all were hex digits, otherwise false.
+             */
+            static bool DecodeHex(const char* text, size_t length, std::vector<unsigned char>* bytes);
+
+            /**
+             * Parse a .hex line.
+             * 
+             * @param The line, with or without its line ending.
+             * @param Its length.
+             * @param Where to store the bytes, appended.
+             * @param Where to store the UTC time of the first bit in ns since the epoch, or 0 when it's malformed.
+             * 
+             * @return true if it's an entry, false for other or malformed lines.
+             */
+            static bool ParseLine(const char* line, size_t length, std::vector<unsigned char>* bytes, int64_t* utcNs);
+
+        private:
+            FILE* file_ = nullptr;
+            bool hex_ = false;
+            std::string line_;
+            bool timed_ = false;
+            WalkPyramid walk_;
+            std::vector<WalkBlock> blocks_;
+            uint64_t nextBlock_ = 0;
+            size_t blockIndex_ = 0;
+    };
+
+    /**
+     * Writer of binary recordings: the raw bytes in <base>.bin, which RecordingReader reads, the walk
+     * pyramid in <base>.walk, whose level 0 blocks also time the bytes, and per-epoch summaries in
+     * <base>.epochs and <base>.hist. Chunks may be written from one thread while another closes the recording.
+     */
+    class RecordingWriter {
+        public:
+            RecordingWriter() {}
+            ~RecordingWriter();
+            RecordingWriter(const RecordingWriter&) = delete;
+            RecordingWriter& operator=(const RecordingWriter&) = delete;
+
+            /**
+             * Start a recording. An existing recording at the path is left alone.
+             * 
+             * @param Path of the files without the extension, e.g. entropy_data/QWR4A003.
+             * @param Error reason upon failure.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool Open(const std::string& basePath, std::string* errorReason);
+
+            /**
+             * Append a chunk.
+             * 
+             * @param The bytes.
+             * @param Number of bytes.
+             * @param UTC time of the chunk's first bit (nanoseconds since the Unix epoch).
+             * @param Time between bits (nanoseconds).
+             * @param Error reason upon a write error.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool Write(const unsigned char* bytes, size_t length, int64_t firstBitUtcNs, double bitPeriodNs, std::string* errorReason);
+
+            /**
+             * Finish the walk pyramid and the epoch summaries, and close the files.
+             * 
+             * @param Error reason upon a write error.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool Close(std::string* errorReason);
+
+            /**
+             * Get the number of bytes recorded.
+             */
+            uint64_t GetBytesWritten();
+
+        private:
+            std::mutex mutex_;
+            FILE* file_ = nullptr;
+            std::string path_;
+            uint64_t bytesWritten_ = 0;
+            WalkPyramidWriter walk_;
+            EpochSummaryWriter epochs_;
+    };
+
+    /**
+     * Seek to a byte offset from the start of a file, past 2 GB too.
+     * 
+     * @return true on success, otherwise false.
+     */
+    bool SeekFile(FILE* file, uint64_t offset);
+}
@@ -0,0 +1,171 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "replay.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+// Most a replay reads ahead of its reader, however far behind the reader is
+#define MF_REPLAY_QUEUE_MAX_BYTES (4 * 1024 * 1024)
+
+MeterFeeder::ReplaySource::ReplaySource(double speed) {
+    speed_ = speed;
+}
+
+bool MeterFeeder::ReplaySource::Open(const std::string& path, std::string* errorReason) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!reader_.Open(path, errorReason)) {
+        return false;
+    }
+    if (speed_ > 0 && !reader_.IsTimed()) {
+        *errorReason = path + " has no times to replay it by, it can only be replayed at full speed";
+        return false;
+    }
+    readNext();
+    if (!haveNext_) {
+        *errorReason = failed_ ? "Error reading " + path : "Nothing to replay in " + path;
+        return false;
+    }
+    return true;
+}
+
+int MeterFeeder::ReplaySource::StartStreaming() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!streaming_) {
+        streaming_ = true;
+        resumed_ = std::chrono::steady_clock::now();
+    }
+    return MF_OK;
+}
+
+int MeterFeeder::ReplaySource::StopStreaming() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pausedNs_ = playhead();
+    streaming_ = false;
+    return MF_OK;
+}
+
+int MeterFeeder::ReplaySource::GetQueueStatus(DWORD* bytesAvailable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fill();
+    *bytesAvailable = (DWORD)queued_;
+    if (finished()) {
+        return failed_ ? (int)FT_IO_ERROR : (int)MF_REPLAY_ENDED;
+    }
+    return MF_OK;
+}
+
+int MeterFeeder::ReplaySource::Read(DWORD length, UCHAR* dxData, DWORD* bytesRxd, DWORD timeoutMs) {
+    using namespace std::chrono;
+    steady_clock::time_point deadline = steady_clock::now() + milliseconds(timeoutMs);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    *bytesRxd = 0;
+    for (;;) {
+        fill();
+        while (*bytesRxd < length && !queue_.empty()) {
+            std::vector<UCHAR>& chunk = queue_.front();
+            size_t count = std::min((size_t)(length - *bytesRxd), chunk.size() - queueOffset_);
+            memcpy(dxData + *bytesRxd, &chunk[queueOffset_], count);
+            *bytesRxd += (DWORD)count;
+            queueOffset_ += count;
+            queued_ -= count;
+            if (queueOffset_ == chunk.size()) {
+                queue_.pop_front();
+                queueOffset_ = 0;
+            }
+        }
+        if (*bytesRxd == length) {
+            break;
+        }
+        if (finished()) {
+            return failed_ ? (int)FT_IO_ERROR : (int)MF_REPLAY_ENDED;
+        }
+
+        // Sleep until the next chunk is due, or the timeout
+        steady_clock::time_point now = steady_clock::now();
+        if (now >= deadline || !streaming_) {
+            break;
+        }
+        if (speed_ <= 0 || nextNs_ <= playhead()) {
+            continue;
+        }
+        steady_clock::time_point due = resumed_ + duration_cast<steady_clock::duration>(duration<double>((nextNs_ - pausedNs_) / speed_ / 1e9));
+        lock.unlock();
+        std::this_thread::sleep_until(due < deadline ? due : deadline);
+        lock.lock();
+    }
+
+    return MF_OK;
+}
+
+void MeterFeeder::ReplaySource::Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    reader_.Close();
+    queue_.clear();
+    queueOffset_ = 0;
+    queued_ = 0;
+    haveNext_ = false;
+    ended_ = true;
+    streaming_ = false;
+}
+
+// Time into the recording the replay has reached
+int64_t MeterFeeder::ReplaySource::playhead() {
+    if (speed_ <= 0) {
+        return INT64_MAX;
+    }
+    if (!streaming_) {
+        return pausedNs_;
+    }
+    double elapsedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - resumed_).count();
+    return pausedNs_ + (int64_t)(elapsedNs * speed_);
+}
+
+// Queue the chunks that are due, reading ahead no more than MF_REPLAY_QUEUE_MAX_BYTES
+void MeterFeeder::ReplaySource::fill() {
+    int64_t now = playhead();
+    while (queued_ < MF_REPLAY_QUEUE_MAX_BYTES) {
+        if (!haveNext_) {
+            readNext();
+            if (!haveNext_) {
+                return;
+            }
+        }
+        if (nextNs_ > now) {
+            return;
+        }
+        queued_ += next_.size();
+        queue_.push_back(std::move(next_));
+        next_ = std::vector<UCHAR>();
+        haveNext_ = false;
+    }
+}
+
+// Read the next chunk from the recording, which is due when the last timed one was if it has no time of its own
+void MeterFeeder::ReplaySource::readNext() {
+    while (!ended_) {
+        int64_t utcNs = 0;
+        std::string errorReason;
+        if (!reader_.ReadChunk(&next_, &utcNs, &errorReason)) {
+            ended_ = true;
+            failed_ = !errorReason.empty();
+            return;
+        }
+        if (utcNs != 0) {
+            if (firstUtcNs_ == 0) {
+                firstUtcNs_ = utcNs;
+            }
+            nextNs_ = utcNs - firstUtcNs_;
+        }
+        if (!next_.empty()) {
+            haveNext_ = true;
+            return;
+        }
+    }
+}
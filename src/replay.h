@@ -0,0 +1,77 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "recording.h"
+#include "source.h"
+
+namespace MeterFeeder {
+    /**
+     * Generator replaying a recording: a .hex file, or a .bin with its .walk pyramid to time it.
+     * Each chunk becomes available when as much time has passed since the replay started as had
+     * passed in the recording, divided by the speed, so consumers see the recorded pacing.
+     * Unlike a device nothing is ever purged or dropped: every recorded byte is handed out once,
+     * in order, so replays are repeatable, and a reader that falls behind gets the backlog at once.
+     * The clock only runs while streaming. Reads past the end fail with MF_REPLAY_ENDED.
+     */
+    class ReplaySource : public VirtualSource {
+        public:
+            /**
+             * @param Playback speed: 1 for real time, more to speed it up, 0 for as fast as it's read.
+             */
+            ReplaySource(double speed);
+
+            /**
+             * Open the recording.
+             * 
+             * @param Path of the recording.
+             * @param Error reason upon failure.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool Open(const std::string& path, std::string* errorReason);
+
+            int StartStreaming();
+            int StopStreaming();
+            int GetQueueStatus(DWORD* bytesAvailable);
+            int Read(DWORD length, UCHAR* dxData, DWORD* bytesRxd, DWORD timeoutMs);
+            void Close();
+
+        private:
+            int64_t playhead();
+            void fill();
+            void readNext();
+            bool finished() const { return ended_ && !haveNext_ && queued_ == 0; }
+
+            std::mutex mutex_;
+            double speed_;
+            RecordingReader reader_;
+            bool ended_ = false;
+            bool failed_ = false;
+
+            // Time into the recording when the clock last stopped, and when it started again
+            bool streaming_ = false;
+            int64_t pausedNs_ = 0;
+            std::chrono::steady_clock::time_point resumed_;
+
+            // Chunks due, the offset into the first, and the next chunk with its time into the recording
+            std::deque<std::vector<UCHAR>> queue_;
+            size_t queueOffset_ = 0;
+            uint64_t queued_ = 0;
+            std::vector<UCHAR> next_;
+            int64_t nextNs_ = 0;
+            bool haveNext_ = false;
+            int64_t firstUtcNs_ = 0;
+    };
+}
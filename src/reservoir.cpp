@@ -0,0 +1,75 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "reservoir.h"
+
+#include <cstring>
+
+MeterFeeder::BitReservoir::BitReservoir()
+    : bitPosition_(0), bitsFilled_(0), bitsDrawn_(0), bitsDiscarded_(0), refillBytes_(0) {
+}
+
+void MeterFeeder::BitReservoir::Fill(const unsigned char* bytes, size_t length) {
+    // Drop the bytes already used up before growing
+    size_t usedBytes = (size_t)(bitPosition_ / 8);
+    if (usedBytes > 0) {
+        bytes_.erase(bytes_.begin(), bytes_.begin() + usedBytes);
+        bitPosition_ -= (uint64_t)usedBytes * 8;
+    }
+
+    bytes_.insert(bytes_.end(), bytes, bytes + length);
+    bitsFilled_ += (uint64_t)length * 8;
+}
+
+void MeterFeeder::BitReservoir::Take(unsigned char* bits, uint64_t numBits) {
+    size_t numBytes = (size_t)((numBits + 7) / 8);
+    size_t first = (size_t)(bitPosition_ / 8);
+    unsigned shift = (unsigned)(bitPosition_ % 8);
+
+    if (shift == 0) {
+        memcpy(bits, &bytes_[first], numBytes);
+    } else {
+        size_t lastByte = (size_t)((bitPosition_ + numBits - 1) / 8);
+        for (size_t i = 0; i < numBytes; i++) {
+            unsigned value = (unsigned)bytes_[first + i] << shift;
+            if (first + i + 1 <= lastByte) {
+                value |= bytes_[first + i + 1] >> (8 - shift);
+            }
+            bits[i] = (unsigned char)value;
+        }
+    }
+
+    // Clear the bits past the end
+    if (numBits % 8 != 0) {
+        bits[numBytes - 1] &= (unsigned char)(0xff << (8 - numBits % 8));
+    }
+
+    bitPosition_ += numBits;
+    bitsDrawn_ += numBits;
+}
+
+uint64_t MeterFeeder::BitReservoir::TakeValue(unsigned numBits) {
+    unsigned char bits[8];
+    Take(bits, numBits);
+
+    uint64_t value = 0;
+    for (unsigned i = 0; i < (numBits + 7) / 8; i++) {
+        value = (value << 8) | bits[i];
+    }
+    // Drop the padding at the end of the last byte
+    return value >> ((8 - numBits % 8) % 8);
+}
+
+void MeterFeeder::BitReservoir::PutBack(uint64_t numBits) {
+    bitPosition_ -= numBits;
+    bitsDrawn_ -= numBits;
+}
+
+void MeterFeeder::BitReservoir::Discard() {
+    bitsDiscarded_ += GetAvailableBits();
+    bytes_.clear();
+    bitPosition_ = 0;
+}
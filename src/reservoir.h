@@ -0,0 +1,103 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace MeterFeeder {
+    /**
+     * Per-generator store of bits read from the device but not yet handed out, so consumers
+     * can take exactly the bits they need (1, 7, 200...) and leave the rest for the next one.
+     * Every bit read in is accounted for: it is either drawn, discarded or still available.
+     */
+    class BitReservoir {
+        public:
+            BitReservoir();
+
+            /**
+             * Add bytes read from the device.
+             * 
+             * @param The bytes.
+             * @param Number of bytes.
+             */
+            void Fill(const unsigned char* bytes, size_t length);
+
+            /**
+             * Take bits, oldest first.
+             * 
+             * @param Where to store the bits, packed most significant bit first.
+             * @param Number of bits to take. Must not be more than GetAvailableBits().
+             */
+            void Take(unsigned char* bits, uint64_t numBits);
+
+            /**
+             * Take up to 64 bits as an integer, the first bit taken being the most significant.
+             * 
+             * @param Number of bits to take (1 to 64). Must not be more than GetAvailableBits().
+             * 
+             * @return The bits.
+             */
+            uint64_t TakeValue(unsigned numBits);
+
+            /**
+             * Put back the last bits taken, unused, so they are the next ones taken and no longer count as drawn.
+             * 
+             * @param Number of bits. Must not be more than were taken since the last Fill() or Discard().
+             */
+            void PutBack(uint64_t numBits);
+
+            /**
+             * Throw away the bits still available, e.g. because they're too old for the next trial.
+             */
+            void Discard();
+
+            /**
+             * Get the number of bits available to take.
+             */
+            uint64_t GetAvailableBits() const { return bitsFilled_ - bitsDrawn_ - bitsDiscarded_; }
+
+            /**
+             * Get the number of bits ever filled, drawn and discarded.
+             */
+            uint64_t GetBitsFilled() const { return bitsFilled_; }
+            uint64_t GetBitsDrawn() const { return bitsDrawn_; }
+            uint64_t GetBitsDiscarded() const { return bitsDiscarded_; }
+
+            /**
+             * Get the number of bytes to read from the device when refilling, beyond what a draw needs.
+             */
+            size_t GetRefillBytes() const { return refillBytes_; }
+
+            /**
+             * Set the number of bytes to read from the device when refilling. Refills read the
+             * larger of this and the whole bytes a draw is short of.
+             * 
+             * @param Number of bytes, 0 to read only what each draw needs.
+             */
+            void SetRefillBytes(size_t refillBytes) { refillBytes_ = refillBytes; }
+
+            /**
+             * Get the mutex serializing draws (and the refills they trigger) between threads.
+             */
+            std::mutex& GetMutex() { return mutex_; }
+
+        private:
+            std::mutex mutex_;
+            std::vector<unsigned char> bytes_;
+
+            // Bits of bytes_ already taken
+            uint64_t bitPosition_;
+
+            uint64_t bitsFilled_;
+            uint64_t bitsDrawn_;
+            uint64_t bitsDiscarded_;
+            size_t refillBytes_;
+    };
+}
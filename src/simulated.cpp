@@ -0,0 +1,93 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "simulated.h"
+
+#include <thread>
+
+// Most a simulated device buffers while nobody reads from it, like the FTDI receive buffer
+#define MF_SIMULATED_QUEUE_MAX_BYTES (1024 * 1024)
+
+MeterFeeder::SimulatedSource::SimulatedSource(double bitRate, uint64_t seed) {
+    bitRate_ = bitRate;
+    state_ = seed;
+}
+
+int MeterFeeder::SimulatedSource::StartStreaming() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    streaming_ = true;
+    start_ = std::chrono::steady_clock::now();
+    consumed_ = 0;
+    return MF_OK;
+}
+
+int MeterFeeder::SimulatedSource::StopStreaming() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    streaming_ = false;
+    consumed_ = 0;
+    return MF_OK;
+}
+
+int MeterFeeder::SimulatedSource::GetQueueStatus(DWORD* bytesAvailable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    *bytesAvailable = available();
+    return MF_OK;
+}
+
+int MeterFeeder::SimulatedSource::Read(DWORD length, UCHAR* dxData, DWORD* bytesRxd, DWORD timeoutMs) {
+    using namespace std::chrono;
+    steady_clock::time_point deadline = steady_clock::now() + milliseconds(timeoutMs);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    *bytesRxd = 0;
+    while (*bytesRxd < length) {
+        DWORD count = available();
+        if (count > length - *bytesRxd) {
+            count = length - *bytesRxd;
+        }
+
+        // splitmix64
+        for (DWORD i = 0; i < count; i++) {
+            uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            dxData[*bytesRxd + i] = (UCHAR)(z ^ (z >> 31));
+        }
+        *bytesRxd += count;
+        consumed_ += count;
+        if (*bytesRxd == length) {
+            break;
+        }
+
+        // Sleep until the rest should have arrived, or the timeout
+        steady_clock::time_point now = steady_clock::now();
+        if (now >= deadline || !streaming_) {
+            break;
+        }
+        double secondsNeeded = (length - *bytesRxd) * 8.0 / bitRate_;
+        steady_clock::time_point wake = now + duration_cast<steady_clock::duration>(duration<double>(secondsNeeded));
+        lock.unlock();
+        std::this_thread::sleep_until(wake < deadline ? wake : deadline);
+        lock.lock();
+    }
+
+    return MF_OK;
+}
+
+DWORD MeterFeeder::SimulatedSource::available() {
+    if (!streaming_) {
+        return 0;
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    uint64_t produced = (uint64_t)(elapsed * bitRate_ / 8.0);
+    uint64_t queued = produced - consumed_;
+    if (queued > MF_SIMULATED_QUEUE_MAX_BYTES) {
+        // Like a full receive buffer, the oldest data is lost
+        consumed_ = produced - MF_SIMULATED_QUEUE_MAX_BYTES;
+        queued = MF_SIMULATED_QUEUE_MAX_BYTES;
+    }
+    return (DWORD)queued;
+}
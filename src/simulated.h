@@ -0,0 +1,45 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "source.h"
+
+namespace MeterFeeder {
+    /**
+     * Simulated generator producing pseudorandom bytes at a device's nominal bit rate.
+     * Bytes become available as time passes just like a streaming device, so code can be
+     * exercised and benchmarked with realistic pacing and without hardware.
+     */
+    class SimulatedSource : public VirtualSource {
+        public:
+            /**
+             * @param Output rate in bits per second.
+             * @param Seed for the pseudorandom output.
+             */
+            SimulatedSource(double bitRate, uint64_t seed);
+
+            int StartStreaming();
+            int StopStreaming();
+            int GetQueueStatus(DWORD* bytesAvailable);
+            int Read(DWORD length, UCHAR* dxData, DWORD* bytesRxd, DWORD timeoutMs);
+
+        private:
+            DWORD available();
+
+            std::mutex mutex_;
+            double bitRate_;
+            uint64_t state_;
+            bool streaming_ = false;
+            std::chrono::steady_clock::time_point start_;
+            uint64_t consumed_ = 0;
+    };
+}
@@ -0,0 +1,69 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <string>
+
+#include "../ftd2xx/ftd2xx.h"
+
+#include "constants.h"
+
+namespace MeterFeeder {
+    /**
+     * Stand-in for the FTDI transport of a generator that isn't backed by a USB device.
+     * A Generator given a VirtualSource routes all of its I/O to it, so virtual generators
+     * are driven through exactly the same Driver and MF_* paths as real ones.
+     * Methods return FT_STATUS/MF_STATUS codes like their FTDI counterparts.
+     */
+    class VirtualSource {
+        public:
+            virtual ~VirtualSource() {}
+
+            /**
+             * Purge anything buffered and start streaming.
+             */
+            virtual int StartStreaming() = 0;
+
+            /**
+             * Purge anything buffered and stop streaming.
+             */
+            virtual int StopStreaming() = 0;
+
+            /**
+             * Get the number of bytes that can be read without waiting.
+             * 
+             * @param Where to store the number of bytes available.
+             */
+            virtual int GetQueueStatus(DWORD* bytesAvailable) = 0;
+
+            /**
+             * Check if the source makes its bytes as they're read rather than queueing them as they arrive.
+             * What an on-demand source reports as available isn't a backlog, so isn't used to time chunks.
+             */
+            virtual bool IsOnDemand() const { return false; }
+
+            /**
+             * Get why the last failed read failed, when its status alone doesn't say (e.g. MF_RESEED_FAILED).
+             */
+            virtual std::string GetLastError() { return ""; }
+
+            /**
+             * Read streamed bytes, waiting up to the timeout for them to arrive (like FT_Read).
+             * 
+             * @param Length in bytes to read.
+             * @param Pointer to where to store the data.
+             * @param Where to store the number of bytes read.
+             * @param Time to wait for the data in milliseconds.
+             */
+            virtual int Read(DWORD length, UCHAR* dxData, DWORD* bytesRxd, DWORD timeoutMs) = 0;
+
+            /**
+             * Release any resources. Called once when the generator is closed.
+             */
+            virtual void Close() {}
+    };
+}
@@ -0,0 +1,241 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "spectral.h"
+
+#include "nist.h"
+
+#include <algorithm>
+#include <cmath>
+
+MeterFeeder::SpectralAnalyzer::SpectralAnalyzer(const SpectralOptions& options) {
+    options_ = options;
+
+    // Longest first, see suspectOfLag() and suspectOfFrequency()
+    std::sort(options_.periods.begin(), options_.periods.end(),
+        [](const SpectralPeriod& a, const SpectralPeriod& b) { return a.bits > b.bits; });
+
+    fft_.reset(new RealFft(options.blockBits * 2));
+    unsigned threads = options.threads > 0 ? options.threads : std::thread::hardware_concurrency();
+    threads = threads > 0 ? threads : 1;
+    maxQueue_ = threads * 2;
+    for (unsigned i = 0; i < threads; i++) {
+        std::unique_ptr<Worker> worker(new Worker());
+        worker->power.assign(options.blockBits + 1, 0);
+        worker->thread = std::thread(&SpectralAnalyzer::work, this, worker.get());
+        workers_.push_back(std::move(worker));
+    }
+}
+
+MeterFeeder::SpectralAnalyzer::~SpectralAnalyzer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finishing_ = true;
+    }
+    queued_.notify_all();
+    for (size_t i = 0; i < workers_.size(); i++) {
+        workers_[i]->thread.join();
+    }
+}
+
+bool MeterFeeder::SpectralAnalyzer::CheckOptions(const SpectralOptions& options, std::string* errorReason) {
+    if (options.blockBits < 64 || !Fft::IsPowerOfTwo(options.blockBits)) {
+        *errorReason = "Block length must be a power of two, at least 64 bits";
+    } else if (options.maxLag < 1 || options.maxLag >= options.blockBits) {
+        *errorReason = "Largest lag must be at least 1 and less than the block length";
+    } else if (!(options.alpha > 0 && options.alpha < 1)) {
+        *errorReason = "Significance level must be between 0 and 1";
+    } else {
+        return true;
+    }
+    return false;
+}
+
+std::vector<MeterFeeder::SpectralPeriod> MeterFeeder::SpectralAnalyzer::TransportPeriods(const TransportProfile& profile) {
+    // FTDI full speed packets are 64 bytes, the first two of which are modem status rather than data
+    std::vector<SpectralPeriod> periods = {
+        { "byte", 8 },
+        { "USB packet payload (62 bytes)", 62 * 8 },
+        { "USB packet (64 bytes)", 64 * 8 },
+    };
+    if (profile.usbTransferSize > 64) {
+        periods.push_back({ "USB transfer (" + std::to_string(profile.usbTransferSize) + " bytes)", profile.usbTransferSize * 8.0 });
+    }
+    if (profile.readChunkBytes > 0) {
+        periods.push_back({ "read chunk (" + std::to_string(profile.readChunkBytes) + " bytes)", profile.readChunkBytes * 8.0 });
+    }
+    if (profile.latencyMs > 0 && profile.nominalBitRate > 0) {
+        periods.push_back({ "latency timer (" + std::to_string(profile.latencyMs) + " ms)", profile.latencyMs * profile.nominalBitRate / 1000 });
+    }
+    return periods;
+}
+
+void MeterFeeder::SpectralAnalyzer::Add(const unsigned char* bytes, size_t length) {
+    size_t blockBytes = options_.blockBits / 8;
+    while (length > 0) {
+        size_t take = std::min(blockBytes - partial_.size(), length);
+        partial_.insert(partial_.end(), bytes, bytes + take);
+        bytes += take;
+        length -= take;
+        if (partial_.size() < blockBytes) {
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        taken_.wait(lock, [this]() { return queue_.size() < maxQueue_; });
+        queue_.push_back(std::vector<unsigned char>());
+        queue_.back().swap(partial_);
+        lock.unlock();
+        queued_.notify_one();
+        partial_.reserve(blockBytes);
+    }
+}
+
+void MeterFeeder::SpectralAnalyzer::work(Worker* worker) {
+    size_t n = options_.blockBits;
+    std::vector<double> x(n * 2, 0);
+    std::vector<std::complex<double>> spectrum(n + 1);
+    for (;;) {
+        std::vector<unsigned char> block;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            queued_.wait(lock, [this]() { return finishing_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            block.swap(queue_.front());
+            queue_.pop_front();
+            busy_++;
+        }
+        taken_.notify_one();
+
+        // +/-1 less the block's mean, so bias doesn't swamp the structure. The second half stays zero
+        size_t ones = 0;
+        for (size_t i = 0; i < n / 8; i++) {
+            unsigned char b = block[i];
+            for (int bit = 0; bit < 8; bit++) {
+                unsigned one = (b >> (7 - bit)) & 1;
+                ones += one;
+                x[i * 8 + bit] = one ? 1.0 : -1.0;
+            }
+        }
+        double mean = (2.0 * ones - (double)n) / n;
+        for (size_t i = 0; i < n; i++) {
+            x[i] -= mean;
+        }
+
+        fft_->Forward(&x[0], &spectrum[0]);
+        for (size_t k = 0; k <= n; k++) {
+            worker->power[k] += std::norm(spectrum[k]);
+        }
+        worker->variance += 1 - mean * mean;
+        worker->blocks++;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            busy_--;
+        }
+        done_.notify_all();
+    }
+}
+
+// The largest period the lag is a whole multiple of, to within a bit
+std::string MeterFeeder::SpectralAnalyzer::suspectOfLag(size_t lag) const {
+    for (size_t i = 0; i < options_.periods.size(); i++) {
+        double period = options_.periods[i].bits;
+        double multiple = floor(lag / period + 0.5);
+        if (multiple >= 1 && fabs(lag - multiple * period) <= 0.5) {
+            return options_.periods[i].name;
+        }
+    }
+    return "";
+}
+
+// The shortest period the frequency k / blockBits is a harmonic of, at the nearest bin. Shorter periods have
+// sparser harmonics, as longer ones have sparser multiples, so each picks the most telling fit
+std::string MeterFeeder::SpectralAnalyzer::suspectOfFrequency(size_t k) const {
+    double n = (double)options_.blockBits;
+    for (size_t i = options_.periods.size(); i-- > 0;) {
+        double period = options_.periods[i].bits;
+        double harmonic = floor(k * period / n + 0.5);
+        if (harmonic >= 1 && fabs(k - harmonic * n / period) <= 0.5) {
+            return options_.periods[i].name;
+        }
+    }
+    return "";
+}
+
+MeterFeeder::SpectralReport MeterFeeder::SpectralAnalyzer::Finish() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return queue_.empty() && busy_ == 0; });
+
+    size_t n = options_.blockBits;
+    std::vector<double> power(n + 1, 0);
+    double variance = 0;
+    SpectralReport report;
+    report.blocks = 0;
+    for (size_t w = 0; w < workers_.size(); w++) {
+        for (size_t k = 0; k <= n; k++) {
+            power[k] += workers_[w]->power[k];
+        }
+        variance += workers_[w]->variance;
+        report.blocks += workers_[w]->blocks;
+    }
+    lock.unlock();
+    if (report.blocks == 0) {
+        return report;
+    }
+    double blocks = (double)report.blocks;
+    variance /= blocks;
+
+    // The even bins of the padded spectrum are the block's own DFT: relative power there is a mean of
+    // exponentials, so its tail probability is that of a gamma with the blocks as the shape
+    double lagAlpha = options_.alpha / 2 / options_.maxLag;
+    double frequencyAlpha = options_.alpha / 2 / (n / 2 - 1);
+    report.power.assign(n / 2 + 1, 0);
+    for (size_t k = 1; k <= n / 2; k++) {
+        double relative = power[k * 2] / (blocks * n * variance);
+        report.power[k] = relative;
+        if (k == n / 2) {
+            continue;
+        }
+        double pValue = Igamc(blocks, blocks * relative);
+        if (pValue < frequencyAlpha) {
+            SpectralPeak peak = { (double)n / k, relative, pValue, suspectOfFrequency(k) };
+            report.frequencyPeaks.push_back(peak);
+        }
+    }
+
+    // Autocorrelation from the inverse transform of the summed power (Wiener-Khinchin), the padding
+    // keeping lags from wrapping around the block
+    std::vector<std::complex<double>> spectrum(n + 1);
+    for (size_t k = 0; k <= n; k++) {
+        spectrum[k] = std::complex<double>(power[k], 0);
+    }
+    std::vector<double> sums(n * 2);
+    fft_->Inverse(&spectrum[0], &sums[0]);
+    report.autocorrelation.assign(options_.maxLag + 1, 0);
+    for (size_t lag = 1; lag <= options_.maxLag; lag++) {
+        double z = sums[lag] / (variance * sqrt(blocks * (n - lag)));
+        report.autocorrelation[lag] = z;
+        double pValue = erfc(fabs(z) / sqrt(2.0));
+        if (pValue < lagAlpha) {
+            SpectralPeak peak = { (double)lag, z, pValue, suspectOfLag(lag) };
+            report.lagPeaks.push_back(peak);
+        }
+    }
+
+    auto moreSignificant = [](const SpectralPeak& a, const SpectralPeak& b) { return a.pValue < b.pValue; };
+    std::sort(report.lagPeaks.begin(), report.lagPeaks.end(), moreSignificant);
+    std::sort(report.frequencyPeaks.begin(), report.frequencyPeaks.end(), moreSignificant);
+    if (report.lagPeaks.size() > MF_SPECTRAL_MAX_PEAKS) {
+        report.lagPeaks.resize(MF_SPECTRAL_MAX_PEAKS);
+    }
+    if (report.frequencyPeaks.size() > MF_SPECTRAL_MAX_PEAKS) {
+        report.frequencyPeaks.resize(MF_SPECTRAL_MAX_PEAKS);
+    }
+    return report;
+}
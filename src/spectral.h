@@ -0,0 +1,159 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fft.h"
+#include "profile.h"
+
+namespace MeterFeeder {
+    /**
+     * A period at which the transport could imprint structure on the data, e.g. the USB packet size.
+     */
+    struct SpectralPeriod {
+        std::string name;
+
+        // Length of the period in bits
+        double bits;
+    };
+
+    /**
+     * Parameters of a spectral analysis.
+     */
+    struct SpectralOptions {
+        // Bits per block transformed, a power of two. Longer blocks resolve longer periods and finer frequencies
+        size_t blockBits = 1 << 16;
+
+        // Largest autocorrelation lag tested (bits), less than blockBits
+        size_t maxLag = 8192;
+
+        // Chance of flagging anything in unstructured data, split over the lags and the frequencies tested
+        double alpha = 0.01;
+
+        // Worker threads, 0 for one per core
+        unsigned threads = 0;
+
+        // Periods peaks are attributed to, see TransportPeriods()
+        std::vector<SpectralPeriod> periods;
+    };
+
+    /**
+     * A significant autocorrelation lag or spectral peak.
+     */
+    struct SpectralPeak {
+        // The lag, or the period of the frequency, in bits
+        double periodBits;
+
+        // Z-score of the autocorrelation, or power relative to that expected of random bits
+        double value;
+
+        // p-value before correcting for the number tested
+        double pValue;
+
+        // Name of the transport period the peak is a multiple or harmonic of, empty if none
+        std::string suspect;
+    };
+
+    /**
+     * Result of a spectral analysis.
+     */
+    struct SpectralReport {
+        size_t blocks;
+
+        // Z-score of the autocorrelation at each lag from 0 to maxLag (0 at lag 0)
+        std::vector<double> autocorrelation;
+
+        // Mean power at each frequency k / blockBits cycles per bit, k from 0 to blockBits / 2,
+        // relative to that expected of random bits (so about 1, and 0 at k = 0)
+        std::vector<double> power;
+
+        // Significant lags and frequencies, most significant first, at most MF_SPECTRAL_MAX_PEAKS each
+        std::vector<SpectralPeak> lagPeaks;
+        std::vector<SpectralPeak> frequencyPeaks;
+    };
+
+    /**
+     * Detector of periodic artifacts in bit streams. Bits are fed in as they're read from a recording or
+     * generator and cut into blocks; workers take each block's mean out and add its power spectrum, zero
+     * padded to twice the length, to their own running sum. The averaged spectrum, and by its inverse
+     * transform the autocorrelation at every lag, come out of one pass over the data in O(n log blockBits).
+     */
+    class SpectralAnalyzer {
+        public:
+            /**
+             * @param Analysis parameters, see CheckOptions().
+             */
+            explicit SpectralAnalyzer(const SpectralOptions& options);
+            ~SpectralAnalyzer();
+
+            /**
+             * Check analysis parameters.
+             * 
+             * @param The parameters.
+             * @param Error reason upon bad parameters.
+             * 
+             * @return true if usable, otherwise false.
+             */
+            static bool CheckOptions(const SpectralOptions& options, std::string* errorReason);
+
+            /**
+             * Get the periods a generator's transport could imprint: bytes, USB packets, transfers,
+             * read chunks and the latency timer at the nominal rate.
+             * 
+             * @param The generator's transport profile.
+             */
+            static std::vector<SpectralPeriod> TransportPeriods(const TransportProfile& profile);
+
+            /**
+             * Add bits, most significant bit of each byte first. Blocks while the workers are behind.
+             * 
+             * @param The bytes.
+             * @param Number of bytes.
+             */
+            void Add(const unsigned char* bytes, size_t length);
+
+            /**
+             * Wait for the blocks added so far to be analyzed and get the report.
+             * Bits short of a whole block at the end are left out.
+             */
+            SpectralReport Finish();
+
+        private:
+            struct Worker {
+                std::thread thread;
+                // Sum of the padded power spectra, and of the blocks' variances
+                std::vector<double> power;
+                double variance = 0;
+                size_t blocks = 0;
+            };
+
+            void work(Worker* worker);
+            std::string suspectOfLag(size_t lag) const;
+            std::string suspectOfFrequency(size_t k) const;
+
+            SpectralOptions options_;
+            std::unique_ptr<RealFft> fft_;
+            std::vector<std::unique_ptr<Worker>> workers_;
+            std::mutex mutex_;
+            std::condition_variable queued_;
+            std::condition_variable taken_;
+            std::condition_variable done_;
+            std::deque<std::vector<unsigned char>> queue_;
+            size_t maxQueue_;
+            bool finishing_ = false;
+            size_t busy_ = 0;
+            std::vector<unsigned char> partial_;
+    };
+}
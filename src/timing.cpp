@@ -0,0 +1,47 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "timing.h"
+
+#include <chrono>
+
+MeterFeeder::ChunkTiming MeterFeeder::StampChunk(uint32_t length, uint32_t backlogBytes, double bitRate, unsigned latencyMs) {
+    using namespace std::chrono;
+
+    // Read the wall clock between two monotonic reads and pair it with their midpoint
+    int64_t before = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    int64_t utc = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+    int64_t after = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+
+    ChunkTiming timing;
+    timing.completedMonotonicNs = before + (after - before) / 2;
+    timing.completedUtcNs = utc;
+    timing.backlogBytes = backlogBytes;
+    timing.length = length;
+    timing.bitRate = bitRate;
+
+    int64_t backlogNs = bitRate > 0 ? (int64_t)(backlogBytes * 8.0 * 1e9 / bitRate) : 0;
+    timing.lastBitMonotonicNs = timing.completedMonotonicNs - backlogNs;
+    timing.lastBitUtcNs = timing.completedUtcNs - backlogNs;
+
+    // Latency timer plus a 1 ms USB frame
+    timing.uncertaintyNs = ((int64_t)latencyMs + 1) * 1000000;
+    return timing;
+}
+
+int64_t MeterFeeder::GetBitTimeNs(const ChunkTiming& timing, uint64_t bitIndex, bool utc) {
+    int64_t lastBit = utc ? timing.lastBitUtcNs : timing.lastBitMonotonicNs;
+    uint64_t lastIndex = timing.length > 0 ? (uint64_t)timing.length * 8 - 1 : 0;
+    if (timing.bitRate <= 0) {
+        return lastBit;
+    }
+    double bitsBefore = (double)lastIndex - (double)bitIndex;
+    return lastBit - (int64_t)(bitsBefore * 1e9 / timing.bitRate);
+}
+
+int64_t MeterFeeder::GetByteTimeNs(const ChunkTiming& timing, uint64_t byteIndex, bool utc) {
+    return GetBitTimeNs(timing, byteIndex * 8, utc);
+}
@@ -0,0 +1,80 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace MeterFeeder {
+    /**
+     * When a chunk of entropy was generated, for lining bits up with stimulus events.
+     * 
+     * The clocks are read as the read that received the last byte of the chunk returns. Bytes
+     * still queued behind the chunk at that moment were generated after it, so the time of its
+     * last bit is taken back by how long the generator takes to produce them at its nominal rate.
+     * Earlier bits are spaced back from there one bit period at a time.
+     * 
+     * The device holds bytes for up to its latency timer before sending them, so the estimate
+     * can be late by up to uncertaintyNs.
+     */
+    struct ChunkTiming {
+        // Host monotonic (steady) clock when the read completed (nanoseconds)
+        int64_t completedMonotonicNs;
+
+        // UTC when the read completed (nanoseconds since the Unix epoch)
+        int64_t completedUtcNs;
+
+        // Bytes already queued behind the chunk when the read completed
+        uint32_t backlogBytes;
+
+        // Length of the chunk in bytes
+        uint32_t length;
+
+        // Nominal output rate of the generator (bits per second)
+        double bitRate;
+
+        // Estimated generation time of the chunk's last bit on each clock (nanoseconds)
+        int64_t lastBitMonotonicNs;
+        int64_t lastBitUtcNs;
+
+        // How late the estimate may be (nanoseconds)
+        int64_t uncertaintyNs;
+    };
+
+    /**
+     * Timestamp a chunk as its read completes.
+     * 
+     * @param Length of the chunk in bytes.
+     * @param Bytes already queued behind the chunk.
+     * @param Nominal output rate of the generator (bits per second).
+     * @param Latency timer of the device (milliseconds).
+     * 
+     * @return The chunk's timing.
+     */
+    ChunkTiming StampChunk(uint32_t length, uint32_t backlogBytes, double bitRate, unsigned latencyMs);
+
+    /**
+     * Get the estimated generation time of a bit in a chunk.
+     * 
+     * @param The chunk's timing.
+     * @param Index of the bit in the chunk, 0 being the most significant bit of the first byte.
+     * @param true for UTC, false for the host monotonic clock.
+     * 
+     * @return Time in nanoseconds.
+     */
+    int64_t GetBitTimeNs(const ChunkTiming& timing, uint64_t bitIndex, bool utc);
+
+    /**
+     * Get the estimated generation time of a byte in a chunk (that of its first bit).
+     * 
+     * @param The chunk's timing.
+     * @param Index of the byte in the chunk.
+     * @param true for UTC, false for the host monotonic clock.
+     * 
+     * @return Time in nanoseconds.
+     */
+    int64_t GetByteTimeNs(const ChunkTiming& timing, uint64_t byteIndex, bool utc);
+}
@@ -0,0 +1,114 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "trace.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <thread>
+
+#ifdef MF_USDT
+// Counts the tracers attached to meterfeeder:phase, kept in .probes where they find it
+volatile unsigned short meterfeeder_phase_semaphore __attribute__((section(".probes"))) = 0;
+#endif
+
+std::atomic<bool> MeterFeeder::Tracer::enabled_(false);
+std::mutex MeterFeeder::Tracer::mutex_;
+std::vector<MeterFeeder::TraceEvent> MeterFeeder::Tracer::events_;
+size_t MeterFeeder::Tracer::maxEvents_ = 0;
+size_t MeterFeeder::Tracer::next_ = 0;
+
+namespace MeterFeeder {
+    static const std::chrono::steady_clock::time_point traceEpoch = std::chrono::steady_clock::now();
+}
+
+void MeterFeeder::Tracer::Enable(size_t maxEvents) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.clear();
+    events_.reserve(maxEvents < 65536 ? maxEvents : 65536);
+    maxEvents_ = maxEvents > 0 ? maxEvents : 1;
+    next_ = 0;
+    enabled_ = true;
+}
+
+void MeterFeeder::Tracer::Disable() {
+    enabled_ = false;
+}
+
+uint64_t MeterFeeder::Tracer::Now() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - traceEpoch).count();
+}
+
+void MeterFeeder::Tracer::Record(const char* name, const std::string& serialNumber, uint64_t startUs, uint64_t endUs, int status, uint64_t bytes) {
+    TraceEvent event = { name, serialNumber, startUs, endUs - startUs,
+                         (uint64_t)std::hash<std::thread::id>()(std::this_thread::get_id()), status, bytes };
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!enabled_) {
+        return;
+    }
+    if (events_.size() < maxEvents_) {
+        events_.push_back(event);
+    } else {
+        // Full, overwrite the oldest
+        events_[next_] = event;
+        next_ = (next_ + 1) % maxEvents_;
+    }
+}
+
+std::vector<MeterFeeder::TraceEvent> MeterFeeder::Tracer::GetEvents() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<TraceEvent> events(events_.begin() + next_, events_.end());
+    events.insert(events.end(), events_.begin(), events_.begin() + next_);
+    return events;
+}
+
+bool MeterFeeder::Tracer::DumpChromeTrace(const std::string& path, std::string* errorReason) {
+    std::vector<TraceEvent> events = GetEvents();
+
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        *errorReason = "Could not open " + path + " for writing: " + strerror(errno);
+        return false;
+    }
+
+    // One track (tid) per generator, named after its serial number, so phases of
+    // concurrent reads on different generators don't overlap
+    std::map<std::string, int> tracks;
+    for (size_t i = 0; i < events.size(); i++) {
+        if (tracks.find(events[i].serialNumber) == tracks.end()) {
+            int track = (int)tracks.size() + 1;
+            tracks[events[i].serialNumber] = track;
+        }
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (std::map<std::string, int>::iterator it = tracks.begin(); it != tracks.end(); ++it) {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",\n", it->second, it->first.c_str());
+        first = false;
+    }
+    for (size_t i = 0; i < events.size(); i++) {
+        const TraceEvent* event = &events[i];
+        fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"meterfeeder\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%llu,\"dur\":%llu,"
+            "\"args\":{\"status\":%d,\"bytes\":%llu,\"thread\":\"%llx\"}}",
+            first ? "" : ",\n", event->name, tracks[event->serialNumber], (unsigned long long)event->startUs,
+            (unsigned long long)event->durationUs, event->status, (unsigned long long)event->bytes,
+            (unsigned long long)event->threadId);
+        first = false;
+    }
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) != 0) {
+        *errorReason = "Could not write the trace to " + path;
+        return false;
+    }
+    return true;
+}
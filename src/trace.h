@@ -0,0 +1,154 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef MF_USDT
+// Probes check a semaphore that tracers raise while attached, so spans are only timed when someone is watching
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+extern "C" volatile unsigned short meterfeeder_phase_semaphore;
+#endif
+
+namespace MeterFeeder {
+    /**
+     * One timed phase of a read, e.g. the purge or the wait for the first byte.
+     */
+    struct TraceEvent {
+        const char* name;
+        std::string serialNumber;
+        uint64_t startUs;
+        uint64_t durationUs;
+        uint64_t threadId;
+        int status;
+        uint64_t bytes;
+    };
+
+    /**
+     * Process-wide recorder of read phase timings, dumped as Chrome trace event JSON
+     * (load it in chrome://tracing or Perfetto).
+     * 
+     * Disabled by default, when a span costs one relaxed atomic load. Builds with MF_USDT
+     * defined also fire a meterfeeder:phase USDT probe for every span so bpftrace etc. can
+     * watch phases without enabling the recorder, while a tracer is attached to the probe.
+     */
+    class Tracer {
+        public:
+            /**
+             * Start recording, discarding anything recorded before.
+             * 
+             * @param Number of events to keep. Once full the oldest are overwritten.
+             */
+            static void Enable(size_t maxEvents);
+
+            /**
+             * Stop recording. What was recorded is kept for DumpChromeTrace().
+             */
+            static void Disable();
+
+            /**
+             * Check if spans need timing, either for the recorder or for an attached USDT tracer.
+             */
+            static bool IsEnabled() {
+#ifdef MF_USDT
+                return enabled_.load(std::memory_order_relaxed) || meterfeeder_phase_semaphore > 0;
+#else
+                return enabled_.load(std::memory_order_relaxed);
+#endif
+            }
+
+            /**
+             * Check if the recorder is on.
+             */
+            static bool IsRecording() { return enabled_.load(std::memory_order_relaxed); }
+
+            /**
+             * Microseconds on the trace clock (steady, from when the library was loaded).
+             */
+            static uint64_t Now();
+
+            /**
+             * Record a finished phase.
+             * 
+             * @param Phase name. Must be a string literal.
+             * @param Serial number of the generator.
+             * @param Start time from Now().
+             * @param End time from Now().
+             * @param FT_STATUS or MF_STATUS the phase ended with.
+             * @param Bytes moved in the phase, if any.
+             */
+            static void Record(const char* name, const std::string& serialNumber, uint64_t startUs, uint64_t endUs, int status, uint64_t bytes);
+
+            /**
+             * Get a copy of the recorded events, oldest first.
+             */
+            static std::vector<TraceEvent> GetEvents();
+
+            /**
+             * Write the recorded events to a file as Chrome trace event JSON, one track per generator.
+             * 
+             * @param Path of the file.
+             * @param Error reason if the file could not be written.
+             * 
+             * @return true on success, false otherwise.
+             */
+            static bool DumpChromeTrace(const std::string& path, std::string* errorReason);
+
+        private:
+            static std::atomic<bool> enabled_;
+            static std::mutex mutex_;
+            static std::vector<TraceEvent> events_;
+            static size_t maxEvents_;
+            static size_t next_;
+    };
+
+    /**
+     * Times a phase from construction until End() (or destruction) if tracing is enabled.
+     */
+    class TraceSpan {
+        public:
+            TraceSpan(const char* name, const std::string& serialNumber)
+                : name_(name), serialNumber_(serialNumber), startUs_(Tracer::IsEnabled() ? Tracer::Now() : 0), ended_(!Tracer::IsEnabled()) {
+            }
+
+            ~TraceSpan() {
+                End(0, 0);
+            }
+
+            /**
+             * Finish the phase. Later calls do nothing.
+             * 
+             * @param FT_STATUS or MF_STATUS the phase ended with.
+             * @param Bytes moved in the phase, if any.
+             */
+            void End(int status, uint64_t bytes) {
+                if (ended_) {
+                    return;
+                }
+                ended_ = true;
+                uint64_t endUs = Tracer::Now();
+#ifdef MF_USDT
+                DTRACE_PROBE5(meterfeeder, phase, name_, serialNumber_.c_str(), endUs - startUs_, status, bytes);
+#endif
+                if (Tracer::IsRecording()) {
+                    Tracer::Record(name_, serialNumber_, startUs_, endUs, status, bytes);
+                }
+            }
+
+        private:
+            const char* name_;
+            const std::string& serialNumber_;
+            uint64_t startUs_;
+            bool ended_;
+    };
+}
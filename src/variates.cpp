@@ -0,0 +1,252 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "variates.h"
+
+#include "constants.h"
+
+#include <cmath>
+
+unsigned MeterFeeder::GetBoundedBits(uint64_t bound) {
+    unsigned bitLength = 0;
+    while (bitLength < 64 && (1ULL << bitLength) < bound) {
+        bitLength++;
+    }
+
+    if ((1ULL << bitLength) == bound) {
+        return bitLength;
+    }
+    return bitLength + MF_BOUNDED_EXTRA_BITS < 32 ? bitLength + MF_BOUNDED_EXTRA_BITS : 32;
+}
+
+// See D. Lemire, "Fast Random Integer Generation in an Interval", ACM TOMACS 2019, generalized
+// to numBits-bit words so slow generators aren't made to spend 32 bits on every small integer
+bool MeterFeeder::BoundedFromBits(uint64_t bits, unsigned numBits, uint64_t bound, uint32_t* value) {
+    uint64_t product = bits * bound;
+    uint64_t mask = numBits < 64 ? (1ULL << numBits) - 1 : ~0ULL;
+    uint64_t low = product & mask;
+
+    if (low < bound) {
+        // Reject the products whose low word would make some results more likely than others
+        uint64_t threshold = ((mask - bound) + 1) & mask;
+        threshold %= bound;
+        if (low < threshold) {
+            return false;
+        }
+    }
+
+    *value = (uint32_t)(product >> numBits);
+    return true;
+}
+
+// See M. D. Vose, "A Linear Algorithm for Generating Random Numbers with a Given Distribution",
+// IEEE TSE 1991: pair each column short of the average with one over it, in one pass
+bool MeterFeeder::AliasTable::Build(const double* weights, size_t count, std::string* errorReason) {
+    if (!weights || count < 1 || count > 0x7fffffff) {
+        *errorReason = "Invalid number of categories " + std::to_string(count);
+        return false;
+    }
+    double sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!(weights[i] >= 0) || std::isinf(weights[i])) {
+            *errorReason = "Invalid weight for category " + std::to_string(i);
+            return false;
+        }
+        sum += weights[i];
+    }
+    if (!(sum > 0) || std::isinf(sum)) {
+        *errorReason = "Weights must sum to more than zero";
+        return false;
+    }
+
+    std::vector<double> scaled(count);
+    std::vector<uint32_t> small, large;
+    for (size_t i = 0; i < count; i++) {
+        scaled[i] = weights[i] * count / sum;
+        (scaled[i] < 1 ? small : large).push_back((uint32_t)i);
+    }
+
+    const double coins = (double)(1ULL << MF_ALIAS_COIN_BITS);
+    thresholds.assign(count, 1ULL << MF_ALIAS_COIN_BITS);
+    aliases.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        aliases[i] = (uint32_t)i;
+    }
+    while (!small.empty() && !large.empty()) {
+        uint32_t less = small.back(), more = large.back();
+        small.pop_back();
+        thresholds[less] = (uint64_t)(scaled[less] * coins + 0.5);
+        aliases[less] = more;
+        scaled[more] -= 1 - scaled[less];
+        if (scaled[more] < 1) {
+            large.pop_back();
+            small.push_back(more);
+        }
+    }
+    // Whatever is left is only off one through rounding, so always keeps its column
+    return true;
+}
+
+size_t MeterFeeder::AliasTable::GetSize() {
+    return thresholds.size();
+}
+
+uint32_t MeterFeeder::AliasTable::Sample(uint32_t column, uint32_t coin) {
+    return coin < thresholds[column] ? column : aliases[column];
+}
+
+namespace MeterFeeder {
+    // Layer tables for the ziggurats, for 24-bit magnitudes (the low 8 bits of a word pick the layer and sign)
+    struct ZigguratTables {
+        uint32_t kn[128];
+        double wn[128];
+        double fn[128];
+        uint32_t ke[256];
+        double we[256];
+        double fe[256];
+
+        ZigguratTables() {
+            const double m1 = 16777216.0; // 2^24
+            double dn = MF_ZIGGURAT_NORMAL_R, tn = dn, vn = 9.91256303526217e-3;
+            double q = vn / exp(-0.5 * dn * dn);
+            kn[0] = (uint32_t)((dn / q) * m1);
+            kn[1] = 0;
+            wn[0] = q / m1;
+            wn[127] = dn / m1;
+            fn[0] = 1.0;
+            fn[127] = exp(-0.5 * dn * dn);
+            for (int i = 126; i >= 1; i--) {
+                dn = sqrt(-2.0 * log(vn / dn + exp(-0.5 * dn * dn)));
+                kn[i + 1] = (uint32_t)((dn / tn) * m1);
+                tn = dn;
+                fn[i] = exp(-0.5 * dn * dn);
+                wn[i] = dn / m1;
+            }
+
+            double de = MF_ZIGGURAT_EXPONENTIAL_R, te = de, ve = 3.949659822581572e-3;
+            q = ve / exp(-de);
+            ke[0] = (uint32_t)((de / q) * m1);
+            ke[1] = 0;
+            we[0] = q / m1;
+            we[255] = de / m1;
+            fe[0] = 1.0;
+            fe[255] = exp(-de);
+            for (int i = 254; i >= 1; i--) {
+                de = -log(ve / de + exp(-de));
+                ke[i + 1] = (uint32_t)((de / te) * m1);
+                te = de;
+                fe[i] = exp(-de);
+                we[i] = de / m1;
+            }
+        }
+    };
+
+    static const ZigguratTables& zigguratTables() {
+        static const ZigguratTables tables;
+        return tables;
+    }
+
+    // Uniform in (0, 1)
+    static bool uniformFromWords(WordStream* words, double* value) {
+        uint32_t word;
+        if (!words->Next(&word)) {
+            return false;
+        }
+        *value = ((double)word + 0.5) / 4294967296.0;
+        return true;
+    }
+}
+
+bool MeterFeeder::NormalFromWords(WordStream* words, double* value) {
+    const ZigguratTables& t = zigguratTables();
+    for (;;) {
+        uint32_t word;
+        if (!words->Next(&word)) {
+            return false;
+        }
+        unsigned layer = word & 127;
+        bool negative = (word & 128) != 0;
+        uint32_t magnitude = word >> 8;
+        double x = magnitude * t.wn[layer];
+
+        // Inside the layer's rectangle, the usual case
+        if (magnitude < t.kn[layer]) {
+            *value = negative ? -x : x;
+            return true;
+        }
+
+        if (layer == 0) {
+            // Tail beyond R, by Marsaglia's method
+            double u1, u2, y;
+            do {
+                if (!uniformFromWords(words, &u1) || !uniformFromWords(words, &u2)) {
+                    return false;
+                }
+                x = -log(u1) / MF_ZIGGURAT_NORMAL_R;
+                y = -log(u2);
+            } while (y + y < x * x);
+            *value = negative ? -(MF_ZIGGURAT_NORMAL_R + x) : MF_ZIGGURAT_NORMAL_R + x;
+            return true;
+        }
+
+        // Wedge between the rectangle and the curve
+        double u;
+        if (!uniformFromWords(words, &u)) {
+            return false;
+        }
+        if (t.fn[layer] + u * (t.fn[layer - 1] - t.fn[layer]) < exp(-0.5 * x * x)) {
+            *value = negative ? -x : x;
+            return true;
+        }
+    }
+}
+
+bool MeterFeeder::ExponentialFromWords(WordStream* words, double* value) {
+    const ZigguratTables& t = zigguratTables();
+    for (;;) {
+        uint32_t word;
+        if (!words->Next(&word)) {
+            return false;
+        }
+        unsigned layer = word & 255;
+        uint32_t magnitude = word >> 8;
+        double x = magnitude * t.we[layer];
+
+        if (magnitude < t.ke[layer]) {
+            *value = x;
+            return true;
+        }
+
+        double u;
+        if (!uniformFromWords(words, &u)) {
+            return false;
+        }
+        if (layer == 0) {
+            // The tail beyond R is itself exponential
+            *value = MF_ZIGGURAT_EXPONENTIAL_R - log(u);
+            return true;
+        }
+        if (t.fe[layer] + u * (t.fe[layer - 1] - t.fe[layer]) < exp(-x)) {
+            *value = x;
+            return true;
+        }
+    }
+}
+
+bool MeterFeeder::BoxMullerFromWords(WordStream* words, double* value) {
+    uint32_t w[4];
+    for (int i = 0; i < 4; i++) {
+        if (!words->Next(&w[i])) {
+            return false;
+        }
+    }
+
+    // Two 48-bit uniforms, nudged off zero
+    double u1 = ((double)(((uint64_t)w[0] << 16) | (w[1] >> 16)) / 281474976710656.0) + FTDI_DEVICE_HALF_OF_UNIFORM_LSB;
+    double u2 = ((double)(((uint64_t)w[2] << 16) | (w[3] >> 16)) / 281474976710656.0) + FTDI_DEVICE_HALF_OF_UNIFORM_LSB;
+    *value = cos(FTDI_DEVICE_2_PI * u2) * sqrt(-2.0 * log(u1));
+    return true;
+}
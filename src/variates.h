@@ -0,0 +1,127 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace MeterFeeder {
+    /**
+     * Get how many random bits one try of Lemire's multiply-shift method takes for a bound.
+     * Powers of two take exactly their number of bits and never reject; other bounds take
+     * MF_BOUNDED_EXTRA_BITS more than they need, up to 32. That keeps rejections under 1 in 2^8
+     * only for bounds up to 2^24; past that the cap at 32 bits lets them climb toward half of
+     * all tries for bounds just over 2^31.
+     * 
+     * @param Upper bound (exclusive), 1 to 2^32.
+     * 
+     * @return Number of bits, 0 for a bound of 1.
+     */
+    unsigned GetBoundedBits(uint64_t bound);
+
+    /**
+     * One try of Lemire's multiply-shift method: map random bits to an unbiased integer in [0, bound).
+     * 
+     * @param The random bits, numBits of them.
+     * @param Number of random bits, from GetBoundedBits().
+     * @param Upper bound (exclusive), 1 to 2^32.
+     * @param Where to store the integer.
+     * 
+     * @return true if the try was accepted, false if it must be retried with fresh bits.
+     */
+    bool BoundedFromBits(uint64_t bits, unsigned numBits, uint64_t bound, uint32_t* value);
+
+    /**
+     * Random 32-bit words for the samplers to consume, e.g. drawn from a bit reservoir in bulk.
+     */
+    struct WordStream {
+        const uint32_t* words;
+        size_t count;
+        size_t position;
+
+        bool Next(uint32_t* word) {
+            if (position == count) {
+                return false;
+            }
+            *word = words[position++];
+            return true;
+        }
+    };
+
+    /**
+     * Sample a standard normal variate with the ziggurat method (Marsaglia and Tsang, 128 layers).
+     * Takes one word almost every time; the layer, sign and magnitude come from separate bits
+     * of it so they aren't correlated.
+     * 
+     * @param Words to consume.
+     * @param Where to store the variate.
+     * 
+     * @return true on success, false if the words ran out part way (the sample is lost).
+     */
+    bool NormalFromWords(WordStream* words, double* value);
+
+    /**
+     * Sample a standard exponential variate (rate 1) with the ziggurat method (256 layers).
+     * 
+     * @param Words to consume.
+     * @param Where to store the variate.
+     * 
+     * @return true on success, false if the words ran out part way (the sample is lost).
+     */
+    bool ExponentialFromWords(WordStream* words, double* value);
+
+    /**
+     * Sample a standard normal variate with the Box-Muller transform from two 48-bit uniforms,
+     * as MF_RandNormal does. Kept for comparison.
+     * 
+     * @param Words to consume (four per sample).
+     * @param Where to store the variate.
+     * 
+     * @return true on success, false if the words ran out.
+     */
+    bool BoxMullerFromWords(WordStream* words, double* value);
+
+    /**
+     * Walker's alias method, built with Vose's stable algorithm: once built, each weighted choice
+     * takes one unbiased column index and one MF_ALIAS_COIN_BITS-bit coin, whatever the weights.
+     */
+    class AliasTable {
+        public:
+            /**
+             * Build the table.
+             * 
+             * @param Weights of the categories, not negative and not all zero. Needn't sum to one.
+             * @param Number of categories, 1 to 2^31 - 1.
+             * @param Error reason upon bad weights.
+             * 
+             * @return true on success, otherwise false.
+             */
+            bool Build(const double* weights, size_t count, std::string* errorReason);
+
+            /**
+             * Get the number of categories, 0 before the table is built.
+             */
+            size_t GetSize();
+
+            /**
+             * Get the category for a column and coin.
+             * 
+             * @param Column, an unbiased integer in [0, GetSize()).
+             * @param Coin, MF_ALIAS_COIN_BITS random bits.
+             * 
+             * @return The category.
+             */
+            uint32_t Sample(uint32_t column, uint32_t coin);
+
+        private:
+            // Coins below a column's threshold keep the column, the rest take its alias
+            std::vector<uint64_t> thresholds;
+            std::vector<uint32_t> aliases;
+    };
+}
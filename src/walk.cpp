@@ -0,0 +1,112 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#include "walk.h"
+
+#include <algorithm>
+
+const MeterFeeder::WalkByteSteps& MeterFeeder::WalkByteSteps::Get() {
+    struct Table : WalkByteSteps {
+        Table() {
+            for (int b = 0; b < 256; b++) {
+                int position = 0, lowest = 8, highest = -8;
+                for (int bit = 7; bit >= 0; bit--) {
+                    position += (b >> bit) & 1 ? 1 : -1;
+                    lowest = std::min(lowest, position);
+                    highest = std::max(highest, position);
+                }
+                end[b] = (signed char)position;
+                low[b] = (signed char)lowest;
+                high[b] = (signed char)highest;
+            }
+        }
+    };
+    static const Table table;
+    return table;
+}
+
+void MeterFeeder::WalkView::Configure(size_t numPoints, uint64_t spanSteps) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    numPoints_ = numPoints;
+    stepsPerPoint_ = 0;
+    mins_.clear();
+    maxs_.clear();
+    if (numPoints > 0) {
+        uint64_t perPoint = std::max((spanSteps + numPoints - 1) / numPoints, (uint64_t)1);
+        stepsPerPoint_ = (perPoint + 7) / 8 * 8;
+        mins_.resize(numPoints);
+        maxs_.resize(numPoints);
+    }
+    position_ = min_ = max_ = 0;
+    steps_ = windowSteps_ = 0;
+}
+
+bool MeterFeeder::WalkView::IsEnabled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return numPoints_ > 0;
+}
+
+void MeterFeeder::WalkView::Add(const unsigned char* bits, uint64_t numBits) {
+    const WalkByteSteps& table = WalkByteSteps::Get();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (numPoints_ == 0) {
+        return;
+    }
+
+    // Points cover whole bytes, so while the window is byte aligned no byte straddles two points
+    uint64_t i = 0;
+    while (i < numBits) {
+        if (windowSteps_ % 8 == 0 && i % 8 == 0 && numBits - i >= 8) {
+            unsigned char b = bits[i / 8];
+            step(position_ + table.low[b], position_ + table.high[b], position_ + table.end[b], 8);
+            i += 8;
+        } else {
+            int64_t position = position_ + ((bits[i / 8] >> (7 - i % 8)) & 1 ? 1 : -1);
+            step(position, position, position, 1);
+            i++;
+        }
+    }
+}
+
+void MeterFeeder::WalkView::GetView(std::vector<int64_t>* mins, std::vector<int64_t>* maxs, WalkSummary* summary) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t filled = stepsPerPoint_ > 0 ? (size_t)((windowSteps_ + stepsPerPoint_ - 1) / stepsPerPoint_) : 0;
+    mins->assign(mins_.begin(), mins_.begin() + filled);
+    maxs->assign(maxs_.begin(), maxs_.begin() + filled);
+    summary->position = position_;
+    summary->min = min_;
+    summary->max = max_;
+    summary->steps = steps_;
+    summary->windowSteps = windowSteps_;
+    summary->stepsPerPoint = stepsPerPoint_;
+    summary->windowLength = stepsPerPoint_ * numPoints_;
+}
+
+void MeterFeeder::WalkView::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    position_ = min_ = max_ = 0;
+    steps_ = windowSteps_ = 0;
+}
+
+// Take steps within one point, starting a new window first if this one is full
+void MeterFeeder::WalkView::step(int64_t low, int64_t high, int64_t position, unsigned steps) {
+    if (windowSteps_ == stepsPerPoint_ * numPoints_) {
+        windowSteps_ = 0;
+    }
+    size_t point = (size_t)(windowSteps_ / stepsPerPoint_);
+    if (windowSteps_ % stepsPerPoint_ == 0) {
+        mins_[point] = low;
+        maxs_[point] = high;
+    } else {
+        mins_[point] = std::min(mins_[point], low);
+        maxs_[point] = std::max(maxs_[point], high);
+    }
+    min_ = std::min(min_, low);
+    max_ = std::max(max_, high);
+    position_ = position;
+    steps_ += steps;
+    windowSteps_ += steps;
+}
@@ -0,0 +1,106 @@
+/**
+ * MeterFeeder Library
+ * 
+ * by fp2.dev
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace MeterFeeder {
+    /**
+     * Where a random walk goes over each byte's 8 steps (+1 for a one, -1 for a zero, most significant
+     * bit first), relative to where it starts: the end and the lowest and highest positions after each step.
+     */
+    struct WalkByteSteps {
+        signed char end[256];
+        signed char low[256];
+        signed char high[256];
+
+        static const WalkByteSteps& Get();
+    };
+
+    /**
+     * Where a random walk is and how it got there.
+     */
+    struct WalkSummary {
+        // Current position: ones less zeros since the last reset
+        int64_t position;
+
+        // Lowest and highest positions since the last reset, including the start at 0
+        int64_t min;
+        int64_t max;
+
+        // Steps since the last reset and since the current window started
+        uint64_t steps;
+        uint64_t windowSteps;
+
+        // Steps each point of the view covers and steps the whole window covers
+        uint64_t stepsPerPoint;
+        uint64_t windowLength;
+    };
+
+    /**
+     * Random walk (+1 for each one bit, -1 for each zero) over the bits a generator hands out, kept as a
+     * fixed number of points for plotting: each covers a run of steps and holds the lowest and highest
+     * position within it, so spikes survive however much is squeezed into a pixel. Like Parking Warden's
+     * graph, the window starts over from the left when it's full while the walk carries on from where it
+     * was. Adding bits costs a table lookup per byte and the view is a copy of the points, so a GUI can
+     * redraw at its frame rate whatever the generator's bit rate.
+     */
+    class WalkView {
+        public:
+            WalkView() = default;
+            WalkView(const WalkView&) = delete;
+            WalkView& operator=(const WalkView&) = delete;
+
+            /**
+             * Set the size of the view and start the walk over. Off until configured.
+             * 
+             * @param Number of points, 0 to turn the walk off.
+             * @param Steps the window spans, rounded up so each point covers a whole number of bytes.
+             */
+            void Configure(size_t numPoints, uint64_t spanSteps);
+            bool IsEnabled() const;
+
+            /**
+             * Take steps for bits, most significant bit of each byte first.
+             * 
+             * @param The bits.
+             * @param Number of bits.
+             */
+            void Add(const unsigned char* bits, uint64_t numBits);
+
+            /**
+             * Get the points of the current window filled so far, oldest first.
+             * 
+             * @param Where to store each point's lowest position.
+             * @param Where to store each point's highest position.
+             * @param Where to store the walk's position, extremes and sizes.
+             */
+            void GetView(std::vector<int64_t>* mins, std::vector<int64_t>* maxs, WalkSummary* summary) const;
+
+            /**
+             * Start the walk over from 0 with an empty window.
+             */
+            void Reset();
+
+        private:
+            void step(int64_t low, int64_t high, int64_t position, unsigned steps);
+
+            mutable std::mutex mutex_;
+            size_t numPoints_ = 0;
+            uint64_t stepsPerPoint_ = 0;
+            std::vector<int64_t> mins_;
+            std::vector<int64_t> maxs_;
+            int64_t position_ = 0;
+            int64_t min_ = 0;
+            int64_t max_ = 0;
+            uint64_t steps_ = 0;
+            uint64_t windowSteps_ = 0;
+    };
+}